@@ -7,15 +7,35 @@
 
 #ifndef TANOSHIIEDITOR_APPLICATION_H
 #define TANOSHIIEDITOR_APPLICATION_H
+#include "KeyTrace.h"
+#include "Scheduler.h"
+#include "Screen.h"
 #include "Window.h"
+#include <chrono>
+#include <cstdio>
 #include <functional>
 #include <memory>
 #include <ncurses.h>
+#include <optional>
+#include <span>
+#include <string>
 #include <vector>
 
 class Application {
 public:
     using Signal = std::function<void()>;
+    /**
+     * @param file_path file opened on start, empty for a blank buffer
+     */
+    explicit Application(std::string file_path = "");
+    /**
+     * @brief start headless on a screen that is not a terminal, to replay recorded input: the
+     * windows are opened right away and edits are not journaled, run() must not be called
+     *
+     * @param file_path file opened on start, empty for a blank buffer
+     * @param screen screen the windows draw on
+     */
+    Application(std::string file_path, std::shared_ptr<Screen> screen);
     /**
      * @brief entry point for the application
      *
@@ -28,10 +48,31 @@ public:
      */
     void connect(Signal observer);
     /**
-     * @brief execute all the signal functions, called in the end of the main loop
+     * @brief execute all the signal functions, called at the end of a loop iteration that got
+     * input, was woken by the scheduler or is polling
      *
      */
     void notify();
+    /**
+     * @brief headless, handle a burst of keys like a loop iteration that read them, and draw the
+     * frame showing them right away
+     *
+     * @param keys the return values of getch() in ncurses, in order
+     */
+    void feedInput(std::span<const chtype> keys);
+    /**
+     * @brief headless, run what the loop runs when woken without input: completions, timers and
+     * the observers
+     *
+     * @return true if the file is loaded
+     */
+    bool pollBackground();
+    /**
+     * @brief Get the buffer the windows show
+     *
+     * @return std::shared_ptr<Buffer> buffer
+     */
+    std::shared_ptr<Buffer> getBuffer() const;
 
 private:
     /**
@@ -40,23 +81,131 @@ private:
      */
     void init();
     /**
-     * @brief Main loop of the application, will quit when app_should_terminate is true
+     * @brief open the first window with the file and connect the observer picking up the
+     * background work of the windows
+     *
+     * @param recover journal the edits and bring back those of an earlier session
+     */
+    void openWindows(bool recover);
+    /**
+     * @brief Main loop of the application, will quit when app_should_terminate is true.
+     * Each iteration sleeps until input arrives, applies everything pending as one batch and
+     * draws at most one frame, no more often than frame_interval
      * 
      */
     void loop();
+    /**
+     * @brief sleep in poll() until stdin is readable, a background job finished, the next frame
+     * or timer is due or the idle timeout runs out
+     *
+     */
+    void waitForInput();
+    /**
+     * @brief read every key already pending into input without blocking, and append them to the
+     * trace named by TANOSHII_RECORD as one burst
+     *
+     */
+    void drainInput();
+    /**
+     * @brief hand the input to the focused window, the view keys split, cycle and close windows
+     * in between
+     *
+     */
+    void dispatchInput();
+    /**
+     * @brief split the focused window, the new window shows the same buffer and takes the focus
+     *
+     */
+    void splitWindow();
+    /**
+     * @brief close the focused window unless it is the last one, the next one takes the focus
+     *
+     */
+    void closeWindow();
+    /**
+     * @brief tile the windows side by side across the screen, each rewraps for its new width
+     * starting with the lines on screen
+     *
+     */
+    void layoutWindows();
+    /**
+     * @brief fit the windows to a resized terminal. Each paints the lines around its top line at
+     * the new width right away and wraps the rest in the background.
+     *
+     */
+    void resizeScreen();
+    /**
+     * @brief move the focus and put the focused window in front
+     *
+     * @param index window index
+     */
+    void focusWindow(std::size_t index);
+    /**
+     * @brief refresh every window, the focused one last so the terminal cursor is its cursor
+     *
+     */
+    void refreshWindows();
+    /**
+     * @brief show or hide the metrics overlay in the upper right corner
+     *
+     */
+    void toggleMetrics();
+    /**
+     * @brief refresh the numbers of the metrics overlay, again every metrics_sample_interval while
+     * it is shown
+     *
+     */
+    void sampleMetrics();
+    /**
+     * @brief append the metrics to the file named by TANOSHII_METRICS_FILE as one JSON line, again
+     * every metrics_export_interval
+     *
+     */
+    void exportMetrics();
+    /**
+     * @brief write the keys recorded so far to the trace, again every trace_flush_interval
+     *
+     */
+    void flushTrace();
     /**
      * @brief Cleaning up phase of the application, run only once after everything finished
      * 
      */
     void cleanUp();
 
+    static constexpr std::chrono::milliseconds frame_interval { 16 };
+    static constexpr std::chrono::milliseconds background_poll_interval { 100 };
+    static constexpr std::size_t max_input_batch = 4096;
+    static constexpr std::chrono::milliseconds metrics_sample_interval { 500 };
+    static constexpr std::chrono::seconds metrics_export_interval { 5 };
+    static constexpr std::chrono::seconds trace_flush_interval { 1 };
+
     /* declare member variables here */
     bool app_should_terminate = false;
-    std::size_t width;
-    std::size_t height;
-    std::size_t init_x;
-    std::size_t init_y;
-    std::shared_ptr<TextEditWindow> w;
+    bool frame_pending = false;
+    std::chrono::steady_clock::time_point last_frame;
+    // negative waits forever
+    std::chrono::milliseconds idle_timeout { -1 };
+    std::vector<chtype> input;
+    // when the oldest key not shown by a frame yet was read
+    std::optional<std::chrono::steady_clock::time_point> unpainted_input;
+    std::string file_path;
+    // ncurses, or the direct ANSI writer when TANOSHII_SCREEN=ansi
+    std::shared_ptr<Screen> screen;
+    FILE* null_output = nullptr;
+    // views side by side, several may show the same buffer
+    std::vector<std::shared_ptr<TextEditWindow>> windows;
+    std::size_t focused = 0;
+    // shown in front of the windows while it exists
+    std::unique_ptr<MetricsWindow> metrics_window;
+    CancellationToken metrics_sample_timer;
+    FILE* metrics_output = nullptr;
+    CancellationToken metrics_export_timer;
+    // every burst of keys, for replaying the session headless
+    std::unique_ptr<KeyTraceWriter> key_trace;
+    CancellationToken trace_flush_timer;
+    // background jobs and timers, their callbacks run on this loop
+    std::shared_ptr<Scheduler> scheduler = Scheduler::Instance();
     std::vector<Signal> observers;
 };
 #endif // TANOSHIIEDITOR_APPLICATION_H
\ No newline at end of file
@@ -8,13 +8,118 @@
 #ifndef TANOSHIIEDITOR_BUFFER_H
 #define TANOSHIIEDITOR_BUFFER_H
 
+#include "ChunkCache.h"
+#include "EditJournal.h"
+#include "Highlighter.h"
+#include "PieceTable.h"
+#include "RecoveryJournal.h"
+#include "Scheduler.h"
+#include "TextSearch.h"
+#include "WrapCache.h"
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <ncurses.h>
 
+class BufferView;
+
 class Buffer {
 public:
+    // files bigger than this are paged by default
+    static constexpr std::size_t default_memory_budget = 512 * 1024 * 1024;
+
+    // edits wait this long before the text they added is considered for compression
+    static constexpr std::chrono::seconds compress_delay { 5 };
+    // inserted text this close to a view's top line or cursor stays uncompressed
+    static constexpr std::size_t hot_distance = 1024 * 1024;
+
     Buffer();
+    /**
+     * @brief create a buffer over existing text, the text is shared and never modified
+     *
+     * @param original original text, typically the content of a file
+     */
+    explicit Buffer(std::shared_ptr<const std::string> original);
+    /**
+     * @brief call off the compression timer and job
+     *
+     */
+    ~Buffer();
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+    /**
+     * @brief replace the content with a file. The file is memory mapped and only the first
+     * screenful is indexed up front, the rest is indexed in the background and shows up
+     * once pollLoading() picks it up.
+     *
+     * @param path file path
+     * @throw std::runtime_error if the file cannot be mapped
+     */
+    void load(const std::string& path);
+    /**
+     * @brief set how much memory a loaded file may keep resident. Files bigger than that are
+     * paged, their lines are indexed a chunk at a time as they are visited and chunks not
+     * visited lately are dropped. Call it before load().
+     *
+     * @param bytes memory budget
+     */
+    void setMemoryBudget(std::size_t bytes);
+    /**
+     * @brief Get the chunks of a paged file
+     *
+     * @return const ChunkCache* the chunks, nullptr if the file is not paged
+     */
+    const ChunkCache* getChunks() const;
+    /**
+     * @brief load the chunks of a paged file next to a line in the background, so scrolling
+     * there does not wait for the disk. Does nothing for files that are not paged.
+     *
+     * @param line line the viewport moves from
+     * @param forward true for the chunks after the line, false for the ones before it
+     */
+    void prefetch(std::size_t line, bool forward);
+    /**
+     * @brief check if the background line index is still being built, the buffer only holds
+     * the head of the file and must not be edited meanwhile
+     *
+     * @return true if loading
+     */
+    bool isLoading() const;
+    /**
+     * @brief swap in the whole file if the background line index is done
+     *
+     * @return true if loading finished during this call
+     */
+    bool pollLoading();
+    /**
+     * @brief compress the inserted text far from every view's top line and cursor in the
+     * background, see PieceTable::compressCold(). The compressed text is swapped in on the main
+     * loop unless the buffer was edited meanwhile, reading it later decompresses a frame at a
+     * time. Runs by itself compress_delay after an edit.
+     *
+     */
+    void compressCold();
+    /**
+     * @brief journal every edit so it survives a crash, the journal is replayed and started once
+     * the next load() has the whole file. It is only written once the buffer is edited and goes
+     * away when undo brings the buffer back to the file. Call it before load().
+     *
+     * @param journal_path where the journal lives, see RecoveryJournal::pathFor()
+     */
+    void enableRecovery(std::filesystem::path journal_path);
+    /**
+     * @brief Get the crash recovery journal
+     *
+     * @return const RecoveryJournal* the journal, nullptr if not journaling (yet)
+     */
+    const RecoveryJournal* getRecovery() const;
     /**
      * @brief insert a line to the buffer
      *
@@ -26,10 +131,28 @@ public:
      * @brief add a character at certain position
      *
      * @param line which line
-     * @param col which column
+     * @param col byte offset in the line
+     * @param ch unicode codepoint, stored as UTF-8
      */
     void addChAt(std::size_t line, std::size_t col, chtype ch);
-    
+    /**
+     * @brief insert a run of bytes at certain position as one edit, newlines in it split lines
+     *
+     * @param line which line
+     * @param col which column
+     * @param bytes bytes pending insert
+     * @return std::pair<std::size_t, std::size_t> line and column right after the inserted bytes
+     */
+    std::pair<std::size_t, std::size_t> insertAt(std::size_t line, std::size_t col, std::span<const char> bytes);
+    /**
+     * @brief erase bytes at certain position
+     *
+     * @param line which line
+     * @param col byte offset in the line
+     * @param count how many bytes
+     */
+    void eraseAt(std::size_t line, std::size_t col, std::size_t count);
+
     /**
      * @brief append character to the end of the line
      * 
@@ -47,6 +170,7 @@ public:
      * @brief remove a line
      *
      * @param pos line position in the buffer
+     * @throw std::runtime_error if there is no such line
      */
     void removeLine(int pos);
     /**
@@ -56,54 +180,52 @@ public:
      */
     std::size_t getBufferSize() const;
     /**
-     * @brief Get the line count after wrapped
+     * @brief Get the length of a line, without copying it out
      *
-     * @return std::size_t wrapped Line count
-     * @warning This function will NOT update the wrapped line
+     * @param line line index
+     * @return std::size_t line length
      */
-    std::size_t getWrappedLineCount() const;
+    std::size_t getLineLength(std::size_t line) const;
     /**
-     * @brief get the wrapped line at position idx
+     * @brief find where the grapheme before a position starts
      *
-     * @param idx index
-     * @return std::tuple<std::size_t, std::string> reference to wrapped line at position idx
-     * @warning This function will NOT update the wrapped line
+     * @param line line index
+     * @param col byte offset in the line, not 0
+     * @return std::size_t byte offset of the previous grapheme
      */
-    std::tuple<std::size_t, std::string>& getWrappedLineTuple(std::size_t idx);
+    std::size_t prevGrapheme(std::size_t line, std::size_t col) const;
     /**
-     * @brief get the wrapped line at position idx
+     * @brief find where the grapheme at a position ends
      *
-     * @param idx index
-     * @return std::tuple<std::size_t, std::string> reference to wrapped line at position idx
-     * @warning This function will NOT update the wrapped line
+     * @param line line index
+     * @param col byte offset in the line, before the line end
+     * @return std::size_t byte offset of the next grapheme
      */
-    std::tuple<std::size_t, std::string> getWrappedLineTuple(std::size_t idx) const;
+    std::size_t nextGrapheme(std::size_t line, std::size_t col) const;
     /**
      * @brief get the unwrapped line at position idx
      *
      * @param idx index
-     * @return std::string& unwrapped line at position idx
-     */
-    std::string& operator[](std::size_t idx);
-    /**
-     * @brief get the unwrapped line at position idx
-     *
-     * @param idx index
-     * @return std::string& unwrapped line at position idx
+     * @return std::string copy of the unwrapped line at position idx
      */
     std::string operator[](std::size_t idx) const;
     /**
-     * @brief toString
+     * @brief wrap a single line, widths are display columns and graphemes are never split
      *
-     * @return std::string the wrapped string
+     * @param line line content
+     * @param window_width max width to be wrapped
+     * @return std::vector<std::string> wrapped rows, at least one
      */
-    operator std::string() const;
+    static std::vector<std::string> wrapLine(const std::string& line, std::size_t window_width);
     /**
-     * @brief generate wrapped line buffer
+     * @brief wrap a single line into byte ranges of it, without copying it
      *
+     * @param line line content
      * @param window_width max width to be wrapped
+     * @param rows where the rows are appended, at least one
+     * @return ColumnMap column map built on the way
      */
-    void wrapLines(std::size_t window_width);
+    static ColumnMap layoutLine(std::string_view line, std::size_t window_width, std::vector<WrapCache::RowSpan>& rows);
 
     /**
      * @brief split the string by delim
@@ -114,11 +236,251 @@ public:
      */
     static std::vector<std::string> split(const std::string& str, const std::string& delim);
 
+    /**
+     * @brief revert the last undo step, a run of typing counts as one step
+     *
+     * @return std::optional<std::pair<std::size_t, std::size_t>> where the cursor goes, line and
+     * byte offset in the line, nothing if there is no step to undo
+     */
+    std::optional<std::pair<std::size_t, std::size_t>> undo();
+    /**
+     * @brief reapply the last undone step
+     *
+     * @return std::optional<std::pair<std::size_t, std::size_t>> where the cursor goes, line and
+     * byte offset in the line, nothing if there is no step to redo
+     */
+    std::optional<std::pair<std::size_t, std::size_t>> redo();
+    /**
+     * @brief end the current undo step, the next edit will not merge into it
+     *
+     */
+    void closeUndoStep();
+    /**
+     * @brief Get the undo journal
+     *
+     * @return const EditJournal& journal
+     */
+    const EditJournal& getJournal() const;
+    /**
+     * @brief search for a query, the matches are kept up to date through later edits
+     *
+     * @param query query, empty to stop searching
+     * @return std::size_t match count
+     */
+    std::size_t setSearchQuery(std::string_view query);
+    /**
+     * @brief convert a position to a byte offset in the whole text
+     *
+     * @param line line index
+     * @param col byte offset in the line
+     * @return std::size_t byte offset
+     */
+    std::size_t offsetOf(std::size_t line, std::size_t col) const;
+    /**
+     * @brief convert a byte offset in the text to a line and an offset in that line
+     *
+     * @param offset byte offset
+     * @return std::pair<std::size_t, std::size_t> line and byte offset in the line
+     */
+    std::pair<std::size_t, std::size_t> positionOf(std::size_t offset) const;
+    /**
+     * @brief Get the search index
+     *
+     * @return const TextSearch& search index
+     */
+    const TextSearch& getSearch() const;
+    /**
+     * @brief find the next or previous match of the search query, wrapping around the document
+     *
+     * @param line line index
+     * @param col byte offset in the line, a match starting right there counts as the next one
+     * @param forward search forward or backward
+     * @return std::optional<std::pair<std::size_t, std::size_t>> line and byte offset in the line
+     * of the match, nothing if there are no matches
+     */
+    std::optional<std::pair<std::size_t, std::size_t>> findMatch(std::size_t line, std::size_t col, bool forward) const;
+    /**
+     * @brief Get the parts of a line covered by matches of the search query
+     *
+     * @param line line index
+     * @param begin first byte offset in the line of interest
+     * @param end one past the last byte offset of interest
+     * @return std::vector<std::pair<std::size_t, std::size_t>> [from, to) byte offsets in the line,
+     * clipped to [begin, end), in order
+     */
+    std::vector<std::pair<std::size_t, std::size_t>> getMatchesIn(std::size_t line, std::size_t begin, std::size_t end) const;
+    /**
+     * @brief Get the text, copying it is O(1) and gives a snapshot for background jobs
+     *
+     * @return const PieceTable& text
+     */
+    const PieceTable& getText() const;
+    /**
+     * @brief Get the number of changes made to the text so far, a snapshot taken at another
+     * revision no longer matches the text
+     *
+     * @return std::uint64_t revision
+     */
+    std::uint64_t getRevision() const;
+    /**
+     * @brief apply many replacements as one edit and one undo step, the touched lines are
+     * rewrapped once on the next BufferView::wrapLines()
+     *
+     * @param replacements replacements in ascending order, not overlapping, offsets in the current text
+     * @param line line of a position to follow through the edit, typically the cursor
+     * @param col byte offset of the position in its line
+     * @return std::pair<std::size_t, std::size_t> where the position ended up, the start of the
+     * replacement if it was inside a replaced range
+     */
+    std::pair<std::size_t, std::size_t> replaceAll(const std::vector<PieceTable::Replacement>& replacements, std::size_t line, std::size_t col);
+    /**
+     * @brief highlight the text with a syntax, lexing starts with the next updateHighlights()
+     *
+     * @param syntax syntax, Highlighter::Syntax::None to stop highlighting
+     */
+    void setSyntax(Highlighter::Syntax syntax);
+    Highlighter::Syntax getSyntax() const;
+    /**
+     * @brief take in highlighting finished in the background and queue more, visible lines first
+     *
+     * @param viewport_end one past the last line on screen
+     * @return true if highlighting changed, the views got the changed lines as damage
+     */
+    bool updateHighlights(std::size_t viewport_end);
+    /**
+     * @brief check if lines are still waiting to be highlighted
+     *
+     * @return true if updateHighlights() has work left
+     */
+    bool isHighlighting() const;
+    /**
+     * @brief Get the highlighted parts of a line, valid until the next call or edit
+     *
+     * @param line line index
+     * @return const std::vector<Highlighter::Span>& spans in order, byte offsets in the line
+     */
+    const std::vector<Highlighter::Span>& getHighlights(std::size_t line) const;
+
 private:
-    
-    std::vector<std::string> lines;
-    std::vector<std::tuple<std::size_t, std::string>> wrapped_lines;
-    bool buffer_modified = false;
+    friend class BufferView;
+
+    /**
+     * @brief insert text and mark the touched lines for rewrap
+     *
+     * @param offset byte offset
+     * @param str text pending insert
+     */
+    void insertText(std::size_t offset, std::string_view str);
+    /**
+     * @brief erase text and mark the touched lines for rewrap
+     *
+     * @param offset byte offset
+     * @param length how many bytes
+     */
+    void eraseText(std::size_t offset, std::size_t length);
+    /**
+     * @brief insertText() without recording it in the journal
+     *
+     * @param offset byte offset
+     * @param str text pending insert
+     */
+    void applyInsert(std::size_t offset, std::string_view str);
+    /**
+     * @brief eraseText() without recording it in the journal
+     *
+     * @param offset byte offset
+     * @param length how many bytes
+     */
+    void applyErase(std::size_t offset, std::size_t length);
+    /**
+     * @brief replaceAll() without recording it in the journal
+     *
+     * @param replacements replacements in ascending order, not overlapping
+     */
+    void applyReplacements(const std::vector<PieceTable::Replacement>& replacements);
+    /**
+     * @brief revert or reapply a grouped undo step as one batch
+     *
+     * @param edits every edit of the step, in the order the journal returned them
+     * @param undoing true to revert them, false to reapply them
+     * @return std::size_t byte offset where the step starts
+     */
+    std::size_t applyGroup(std::vector<EditJournal::Edit> edits, bool undoing);
+    /**
+     * @brief start or stop passing edits on to a view
+     *
+     * @param view view
+     */
+    void attach(BufferView* view);
+    void detach(BufferView* view);
+    /**
+     * @brief splice the per-line caches after an edit, the new lines are dirty
+     *
+     * @param first first touched line
+     * @param old_count how many lines the edit touched before
+     * @param new_count how many lines they became
+     */
+    void replaceLines(std::size_t first, std::size_t old_count, std::size_t new_count);
+    /**
+     * @brief mark every line dirty in the per-line caches after the whole text was replaced
+     *
+     */
+    void resetLines();
+    /**
+     * @brief remember that lines starting at first changed, in every view
+     *
+     * @param first first touched line
+     * @param count touched line count, std::string::npos if lines were inserted or removed
+     */
+    void addDamage(std::size_t first, std::size_t count);
+    /**
+     * @brief replay and start the recovery journal over the loaded file
+     *
+     * @param base whole content of the loaded file
+     * @return true if edits were recovered into the text
+     */
+    bool startRecovery(std::shared_ptr<const TextBlock> base);
+    /**
+     * @brief patch the search index and the view cursors after an edit and pass the edit on to
+     * the recovery journal, compacting it when it grew enough
+     *
+     * @param offset byte offset
+     * @param inserted inserted text
+     * @param erased erased byte count, 0 for an insert
+     */
+    void editApplied(std::size_t offset, std::string_view inserted, std::size_t erased);
+    /**
+     * @brief check if the text matches the loaded file, undo went back to the loaded revision
+     *
+     * @return true if the recovery journal has nothing to keep
+     */
+    bool isUnmodified() const;
+    /**
+     * @brief run compressCold() compress_delay from now, unless it is due already
+     *
+     */
+    void scheduleCompression();
+
+    PieceTable text;
+    // views showing the buffer, each keeps its own wrapped rows in sync with the text
+    std::vector<BufferView*> views;
+    EditJournal journal;
+    TextSearch search;
+    Highlighter highlighter;
+    std::future<std::shared_ptr<const TextBlock>> pending_load;
+    std::string loading_path;
+    std::size_t memory_budget = default_memory_budget;
+    std::shared_ptr<ChunkCache> chunks;
+    // a newer prefetch calls off the one not started yet
+    CancellationToken prefetch_token;
+    std::filesystem::path recovery_path;
+    std::unique_ptr<RecoveryJournal> recovery;
+    // the journal brought back edits the loaded file does not have
+    bool recovered = false;
+    std::uint64_t revision = 0;
+    CancellationToken compress_timer;
+    bool compress_due = false;
+    CancellationToken compress_job;
 };
 
 #endif // TANOSHIIEDITOR_BUFFER_H
\ No newline at end of file
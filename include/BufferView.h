@@ -0,0 +1,239 @@
+/**
+ * @file BufferView.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief One window's wrapped layout of a shared Buffer
+ */
+
+#ifndef TANOSHIIEDITOR_BUFFERVIEW_H
+#define TANOSHIIEDITOR_BUFFERVIEW_H
+
+#include "Buffer.h"
+#include "WrapCache.h"
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief The soft wrapped rows of a Buffer at one width, the lines edited since the last look
+ * and a cursor offset, for one window. Any number of views may show the same buffer, e.g.
+ * splits of one file at different widths: the buffer splices every edit into all of them, so
+ * each view only rewraps the touched lines and its window only repaints the rows they cover.
+ * A view must not outlive its buffer.
+ *
+ * A window wraps through wrapAround(): on a new width only the lines around its top line are
+ * wrapped right away, the rest keep an estimated row count and are wrapped by background jobs in
+ * chunks of wrap_chunk_lines, on snapshots of the text. Their rows are installed on the main loop
+ * as the chunks complete, refining the row count.
+ */
+class BufferView {
+public:
+    static constexpr std::size_t wrap_chunk_lines = 16384;
+
+    /**
+     * @brief attach a view to a buffer, nothing is wrapped until the first wrapLines()
+     *
+     * @param buffer buffer to show
+     */
+    explicit BufferView(Buffer& buffer);
+    /**
+     * @brief detach from the buffer
+     *
+     */
+    ~BufferView();
+    BufferView(const BufferView&) = delete;
+    BufferView& operator=(const BufferView&) = delete;
+
+    Buffer& getBuffer() const;
+    /**
+     * @brief generate wrapped line buffer, only lines touched since the last call are rewrapped
+     * unless the width changed. Lines left to the background are wrapped right away.
+     *
+     * @param window_width max width to be wrapped
+     */
+    void wrapLines(std::size_t window_width);
+    /**
+     * @brief rewrap the lines touched since the last call, and on a new width only the lines
+     * around the top row: a screen above it to a screen below the last one shown. The rest is left
+     * to background jobs, their rows arrive with Scheduler::runPending().
+     *
+     * @param window_width max width to be wrapped
+     * @param top_row the first visual row shown. The row returned by the last call keeps its
+     * line at the top through edits, new widths and background wraps, any other row is a scroll.
+     * @param height rows shown
+     * @return std::size_t the first visual row to show
+     */
+    std::size_t wrapAround(std::size_t window_width, std::size_t top_row, std::size_t height);
+    /**
+     * @brief Get the count of lines only having an estimated row count so far
+     *
+     * @return std::size_t line count
+     */
+    std::size_t getPendingCount() const;
+    /**
+     * @brief Get the line count after wrapped
+     *
+     * @return std::size_t wrapped Line count, an estimate while lines are pending
+     * @warning This function will NOT update the wrapped line
+     */
+    std::size_t getWrappedLineCount() const;
+    /**
+     * @brief get the wrapped line at position idx
+     *
+     * @param idx index
+     * @return std::tuple<std::size_t, std::string_view> unwrapped line index and content of the wrapped line at position idx, valid as long as a getWrappedRow() result
+     * @warning This function will NOT update the wrapped line
+     */
+    std::tuple<std::size_t, std::string_view> getWrappedLineTuple(std::size_t idx) const;
+    /**
+     * @brief get the content of the wrapped line at position idx without copying
+     *
+     * @param idx index
+     * @return std::string_view wrapped line content, pointing into the buffer's text, or for a
+     * line spread over several pieces into the view, valid until the next edit or call on the view
+     * @warning This function will NOT update the wrapped line
+     */
+    std::string_view getWrappedRow(std::size_t idx) const;
+    /**
+     * @brief convert an unwrapped position to the wrapped row it is displayed on
+     *
+     * @param line unwrapped line
+     * @param col unwrapped column
+     * @return std::size_t wrapped row
+     * @warning This function will NOT update the wrapped line
+     */
+    std::size_t getWrappedRowOf(std::size_t line, std::size_t col) const;
+    /**
+     * @brief convert an unwrapped position to the display column inside its wrapped row
+     *
+     * @param line unwrapped line
+     * @param col byte offset in the line
+     * @return std::size_t display column in the wrapped row
+     * @warning This function will NOT update the wrapped line
+     */
+    std::size_t getWrappedColOf(std::size_t line, std::size_t col) const;
+    /**
+     * @brief convert a display column on a wrapped row back to an unwrapped position, landing on
+     * the grapheme covering that column
+     *
+     * @param row wrapped row
+     * @param column display column in the row
+     * @return std::pair<std::size_t, std::size_t> line and byte offset in the line
+     * @warning This function will NOT update the wrapped line
+     */
+    std::pair<std::size_t, std::size_t> getPositionOfWrapped(std::size_t row, std::size_t column) const;
+    /**
+     * @brief toString
+     *
+     * @return std::string the wrapped string
+     */
+    operator std::string() const;
+    /**
+     * @brief Get the unwrapped lines touched by edits since the last call, and forget them
+     *
+     * @return std::pair<std::size_t, std::size_t> touched lines [first, last), last is
+     * std::string::npos if lines were inserted or removed, first == last if nothing changed
+     */
+    std::pair<std::size_t, std::size_t> takeDamage();
+    /**
+     * @brief set the byte offset the view follows through edits, made through any view
+     *
+     * @param offset byte offset in the text
+     */
+    void setCursor(std::size_t offset);
+    /**
+     * @brief Get the followed byte offset, moved along by the edits since setCursor()
+     *
+     * @return std::size_t byte offset in the text
+     */
+    std::size_t getCursor() const;
+
+private:
+    friend class Buffer;
+
+    // the rows of a block of lines, wrapped by a background job
+    struct WrappedChunk {
+        std::size_t first = 0;
+        std::vector<WrapCache::RowSpan> rows;
+        std::vector<std::size_t> counts;
+        std::vector<ColumnMap> columns;
+    };
+    // an edit that moved line numbers while background jobs were running
+    struct LineShift {
+        std::size_t first, old_count, new_count;
+    };
+
+    /**
+     * @brief replace old_count lines starting at first with new_count dirty lines
+     */
+    void replaceLines(std::size_t first, std::size_t old_count, std::size_t new_count);
+    /**
+     * @brief mark every line dirty after the whole text was replaced
+     */
+    void resetLines();
+    /**
+     * @brief remember that lines starting at first changed
+     *
+     * @param first first touched line
+     * @param count touched line count, std::string::npos if lines were inserted or removed
+     */
+    void addDamage(std::size_t first, std::size_t count);
+    /**
+     * @brief Get the text of one row of a line
+     *
+     * @param line unwrapped line
+     * @param row the row
+     * @return std::string_view row content
+     */
+    std::string_view rowText(std::size_t line, WrapCache::RowSpan row) const;
+    /**
+     * @brief Get the rows of a line, a pending line is one row
+     *
+     * @param line unwrapped line
+     * @return std::span<const WrapCache::RowSpan> rows
+     */
+    std::span<const WrapCache::RowSpan> rowsOf(std::size_t line) const;
+    /**
+     * @brief Get the wrap function for the cache, counting the rows it produces
+     *
+     * @param rows the counter
+     * @return WrapCache::WrapFunction the function, must not outlive the counter
+     */
+    WrapCache::WrapFunction wrapper(std::size_t& rows);
+    /**
+     * @brief start background jobs for the pending lines, the blocks nearest to the top line first
+     *
+     */
+    void scheduleWrap();
+    /**
+     * @brief on the main loop, hand the rows of a finished job to the lines still pending. Lines
+     * edited meanwhile were rewrapped already, lines moved meanwhile are found through the shifts.
+     *
+     * @param chunk the rows
+     */
+    void installChunk(const WrappedChunk& chunk);
+    /**
+     * @brief call off every background job
+     *
+     */
+    void cancelWrap();
+
+    Buffer& buffer;
+    WrapCache wrap_cache;
+    // a line spread over several pieces is put together here
+    mutable std::string line_scratch;
+    std::size_t damage_first = 0, damage_last = 0;
+    std::size_t cursor = 0;
+    // the line wrapAround() put at the top and the row of it shown first, moved along by edits
+    std::size_t top_line = 0, top_line_row = 0;
+    std::size_t shown_top = 0;
+    std::vector<CancellationToken> wrap_jobs;
+    std::size_t wrap_jobs_left = 0;
+    std::vector<LineShift> shifts;
+};
+
+#endif // TANOSHIIEDITOR_BUFFERVIEW_H
@@ -0,0 +1,135 @@
+/**
+ * @file ChunkCache.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Newline index of a huge file, paged in fixed-size chunks under a memory budget
+ */
+
+#ifndef TANOSHIIEDITOR_CHUNKCACHE_H
+#define TANOSHIIEDITOR_CHUNKCACHE_H
+
+#include "MappedFile.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Indexes the newlines of a mapped file one fixed-size chunk at a time, for files too
+ * big to keep a newline table and every page resident. Only the newline count of each chunk is
+ * kept for good; a chunk's newline offsets are built when a lookup lands in it and stay in an
+ * LRU list. Once the loaded chunks, their pages counted in, outgrow the budget, the least
+ * recently used ones drop their offsets and hand their pages back to the kernel, which reads
+ * them from the file again if they are needed later. The file is never written, so nothing has
+ * to be saved before a chunk goes. Safe to use from any thread.
+ */
+class ChunkCache {
+public:
+    static constexpr std::size_t chunk_size = 1024 * 1024;
+
+    /**
+     * @brief page a file, nothing is counted until countLines()
+     *
+     * @param file mapped file
+     * @param budget bytes the loaded chunks may take, at least one chunk is always kept
+     */
+    ChunkCache(std::shared_ptr<const MappedFile> file, std::size_t budget);
+    ChunkCache(const ChunkCache&) = delete;
+    ChunkCache& operator=(const ChunkCache&) = delete;
+
+    /**
+     * @brief count the newlines of every chunk, front to back, releasing the pages behind.
+     * Must finish before any lookup.
+     *
+     */
+    void countLines();
+    /**
+     * @brief count newlines in [begin, end)
+     *
+     * @return std::size_t newline count
+     */
+    std::size_t countNewlines(std::size_t begin, std::size_t end);
+    /**
+     * @brief find the offset of the nth (0 based) newline at or after begin
+     *
+     * @param begin offset to start from
+     * @param nth which newline
+     * @return std::size_t offset of the newline
+     * @warning the newline must exist
+     */
+    std::size_t findNewline(std::size_t begin, std::size_t nth);
+    /**
+     * @brief load the chunks under some bytes ahead of time, bytes outside the file are ignored
+     *
+     * @param bytes bytes pointing into the mapped file
+     */
+    void prefetch(std::string_view bytes);
+    /**
+     * @brief Get the bytes the loaded chunks take, pages and offsets
+     *
+     * @return std::size_t byte count
+     */
+    std::size_t getResidentBytes() const;
+    /**
+     * @brief Get how many chunks are loaded
+     *
+     * @return std::size_t chunk count
+     */
+    std::size_t getLoadedCount() const;
+    /**
+     * @brief Get how many times a chunk was loaded, reloads after eviction included
+     *
+     * @return std::size_t load count
+     */
+    std::size_t getLoadCount() const;
+    std::size_t getBudget() const;
+
+private:
+    using Offsets = std::vector<std::uint32_t>;
+    struct Chunk {
+        // offsets of the newlines inside the chunk, null while the chunk is not loaded
+        std::shared_ptr<const Offsets> newlines;
+        std::list<std::size_t>::iterator recent;
+    };
+
+    /**
+     * @brief Get the newline offsets of a chunk, loading it if needed and marking it most
+     * recently used
+     *
+     * @param index chunk index
+     * @return std::shared_ptr<const Offsets> offsets, stays valid after the chunk is evicted
+     */
+    std::shared_ptr<const Offsets> load(std::size_t index);
+    /**
+     * @brief count the newlines before an offset
+     *
+     * @param offset byte offset
+     * @return std::size_t newline count
+     */
+    std::size_t rank(std::size_t offset);
+    /**
+     * @brief Get what a loaded chunk costs
+     *
+     * @param index chunk index
+     * @param newlines its newline offsets
+     * @return std::size_t byte count
+     */
+    std::size_t costOf(std::size_t index, const Offsets& newlines) const;
+
+    std::shared_ptr<const MappedFile> file;
+    std::string_view bytes;
+    std::size_t budget;
+    // newlines before each chunk, one more entry than there are chunks
+    std::vector<std::size_t> newlines_before;
+    mutable std::mutex mutex;
+    std::vector<Chunk> chunks;
+    // most recently used first
+    std::list<std::size_t> recent;
+    std::size_t resident = 0;
+    std::size_t loads = 0;
+};
+
+#endif // TANOSHIIEDITOR_CHUNKCACHE_H
@@ -0,0 +1,191 @@
+/**
+ * @file EditJournal.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Append-only undo/redo journal of buffer edits
+ */
+
+#ifndef TANOSHIIEDITOR_EDITJOURNAL_H
+#define TANOSHIIEDITOR_EDITJOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string_view>
+
+/**
+ * @brief Records every insert and erase as an offset and the bytes involved, never a copy of the
+ * buffer. Payloads are bump allocated from fixed size chunks, so an edit costs one copy of its
+ * bytes and undoing it touches nothing else. Consecutive keystrokes merge into the entry before
+ * them until seal() is called, and the oldest entries are dropped once the journal grows past
+ * its budget.
+ */
+class EditJournal {
+public:
+    enum class Kind : std::uint8_t {
+        Insert,
+        Erase,
+    };
+    /**
+     * @brief one recorded edit, text points into the journal and stays valid until the next record
+     */
+    struct Edit {
+        Kind kind;
+        std::size_t offset;
+        std::string_view text;
+        // undone and redone together with the edit recorded before it
+        bool linked;
+    };
+
+    static constexpr std::size_t default_budget = 16 * 1024 * 1024;
+
+    /**
+     * @brief create an empty journal
+     *
+     * @param budget bytes of payload and bookkeeping kept before the oldest entries are dropped
+     */
+    explicit EditJournal(std::size_t budget = default_budget);
+    /**
+     * @brief remember that text was inserted, everything undone so far can no longer be redone
+     *
+     * @param offset byte offset of the insert
+     * @param text inserted text
+     */
+    void recordInsert(std::size_t offset, std::string_view text);
+    /**
+     * @brief remember that text was erased, everything undone so far can no longer be redone
+     *
+     * @param offset byte offset of the erase
+     * @param text erased text
+     */
+    void recordErase(std::size_t offset, std::string_view text);
+    /**
+     * @brief stop merging, the next edit starts a new undo step
+     *
+     */
+    void seal();
+    /**
+     * @brief record the following edits as one undo step, until endGroup(). The edits of a
+     * group are recorded left to right and do not overlap, so the caller may apply a whole
+     * group as one batch.
+     *
+     */
+    void beginGroup();
+    /**
+     * @brief close the undo step opened by beginGroup()
+     *
+     */
+    void endGroup();
+    bool canUndo() const;
+    bool canRedo() const;
+    /**
+     * @brief step back, the caller reverts the returned edit
+     *
+     * @return Edit the edit to revert
+     * @warning canUndo() must be true
+     */
+    Edit undo();
+    /**
+     * @brief step forward again, the caller reapplies the returned edit
+     *
+     * @return Edit the edit to reapply
+     * @warning canRedo() must be true
+     */
+    Edit redo();
+    /**
+     * @brief check if the edit redo() would return next belongs to the step redone last
+     *
+     * @return true if it is linked to the edit before it
+     */
+    bool isRedoLinked() const;
+    /**
+     * @brief check if the text is back where the journal started, every step kept is undone and
+     * none was dropped for the budget
+     *
+     * @return true if undoing reached the start
+     */
+    bool isAtStart() const;
+    /**
+     * @brief forget everything
+     *
+     */
+    void clear();
+    /**
+     * @brief Get the number of undo steps kept, undone ones included
+     *
+     * @return std::size_t entry count
+     */
+    std::size_t size() const;
+    /**
+     * @brief Get the memory held by the journal
+     *
+     * @return std::size_t bytes
+     */
+    std::size_t memoryUsage() const;
+
+private:
+    // an entry stops growing at this size, so merging by moving bytes stays cheap
+    static constexpr std::size_t max_merged = 4096;
+    // edits up to this size count as keystrokes and may merge, one grapheme always fits
+    static constexpr std::size_t max_keystroke = 32;
+    static constexpr std::size_t chunk_size = 64 * 1024;
+
+    struct Chunk {
+        std::unique_ptr<char[]> data;
+        std::size_t capacity;
+        std::size_t used;
+    };
+    struct Entry {
+        Kind kind;
+        std::size_t offset;
+        std::size_t length;
+        char* data;
+        // serial number of the chunk holding the payload
+        std::size_t chunk;
+        bool linked;
+    };
+
+    /**
+     * @brief try to grow the last entry instead of adding one
+     *
+     * @return true if the edit was merged
+     */
+    bool merge(Kind kind, std::size_t offset, std::string_view text);
+    /**
+     * @brief append an entry with a copy of text
+     */
+    void append(Kind kind, std::size_t offset, std::string_view text);
+    /**
+     * @brief drop the entries that were undone and give their bytes back to the arena
+     *
+     */
+    void dropRedo();
+    /**
+     * @brief drop the oldest entries and their chunks until the journal fits the budget
+     *
+     */
+    void trim();
+    /**
+     * @brief check if the payload of an entry ends where the arena does, so it can grow in place
+     */
+    bool atArenaEnd(const Entry& entry, std::size_t extra) const;
+
+    std::deque<Entry> entries;
+    std::deque<Chunk> chunks;
+    // serial number of chunks.front()
+    std::size_t first_chunk = 0;
+    // entries before this index are applied, the rest were undone
+    std::size_t applied = 0;
+    // the last entry still takes keystrokes
+    bool merging = false;
+    // inside beginGroup() and endGroup(), and whether the group has an entry yet
+    bool grouping = false;
+    bool group_started = false;
+    // trim() dropped steps since clear(), the start can no longer be undone to
+    bool trimmed = false;
+    std::size_t budget;
+    std::size_t chunk_bytes = 0;
+};
+
+#endif // TANOSHIIEDITOR_EDITJOURNAL_H
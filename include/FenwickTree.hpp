@@ -0,0 +1,106 @@
+/**
+ * @file FenwickTree.hpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Fenwick tree (binary indexed tree) for prefix sums with point updates
+ */
+
+#ifndef TANOSHIIEDITOR_FENWICKTREE_H
+#define TANOSHIIEDITOR_FENWICKTREE_H
+
+#include <cstddef>
+#include <vector>
+
+template <typename T>
+class FenwickTree {
+public:
+    FenwickTree() = default;
+
+    /**
+     * @brief rebuild the tree from plain values in O(n)
+     *
+     * @param values values pending index
+     */
+    void assign(const std::vector<T>& values)
+    {
+        tree.assign(values.size() + 1, T {});
+        for (std::size_t i = 1; i < tree.size(); i++) {
+            tree[i] += values[i - 1];
+            std::size_t parent = i + (i & -i);
+            if (parent < tree.size())
+                tree[parent] += tree[i];
+        }
+    }
+
+    /**
+     * @brief add delta to the value at idx
+     *
+     * @param idx index
+     * @param delta value to be added
+     */
+    void add(std::size_t idx, T delta)
+    {
+        for (std::size_t i = idx + 1; i < tree.size(); i += i & -i)
+            tree[i] += delta;
+    }
+
+    /**
+     * @brief sum of the first count values
+     *
+     * @param count how many values
+     * @return T sum
+     */
+    T prefix(std::size_t count) const
+    {
+        T sum {};
+        for (std::size_t i = count; i > 0; i -= i & -i)
+            sum += tree[i];
+        return sum;
+    }
+
+    /**
+     * @brief sum of all values
+     *
+     * @return T sum
+     */
+    T total() const
+    {
+        return prefix(size());
+    }
+
+    /**
+     * @brief find the index whose range contains target, i.e. the largest idx with prefix(idx) <= target
+     *
+     * @param target value pending search, values must be non-negative
+     * @return std::size_t index
+     */
+    std::size_t find(T target) const
+    {
+        std::size_t pos = 0;
+        std::size_t step = 1;
+        while (step * 2 < tree.size())
+            step *= 2;
+        for (; step > 0; step /= 2) {
+            if (pos + step < tree.size() && tree[pos + step] <= target) {
+                pos += step;
+                target -= tree[pos];
+            }
+        }
+        return pos;
+    }
+
+    /**
+     * @brief Get the number of values
+     *
+     * @return std::size_t value count
+     */
+    std::size_t size() const
+    {
+        return tree.empty() ? 0 : tree.size() - 1;
+    }
+
+private:
+    std::vector<T> tree;
+};
+
+#endif // TANOSHIIEDITOR_FENWICKTREE_H
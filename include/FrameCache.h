@@ -0,0 +1,85 @@
+/**
+ * @file FrameCache.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief The frames of compressed text blocks decompressed lately
+ */
+
+#ifndef TANOSHIIEDITOR_FRAMECACHE_H
+#define TANOSHIIEDITOR_FRAMECACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Keeps the last few frames read out of compressed TextBlocks decompressed, so scrolling
+ * through or searching a compressed region decompresses each frame once. Frames are shared by
+ * every block and dropped least recently used first, a frame handed out stays valid after it is
+ * dropped. Safe to use from any thread.
+ */
+class FrameCache {
+public:
+    using Frame = std::shared_ptr<const std::string>;
+
+    // a screenful of lines rarely spans more than two frames, the rest serve searches and splits
+    static constexpr std::size_t default_capacity = 16;
+
+    /**
+     * @param capacity frames kept decompressed, at least one
+     */
+    explicit FrameCache(std::size_t capacity = default_capacity);
+    FrameCache(const FrameCache&) = delete;
+    FrameCache& operator=(const FrameCache&) = delete;
+    /**
+     * @brief the cache shared by every compressed block
+     *
+     * @return std::shared_ptr<FrameCache> cache
+     */
+    static std::shared_ptr<FrameCache> Instance();
+
+    /**
+     * @brief Get a decompressed frame, decompressing it unless it is cached, and mark it most
+     * recently used
+     *
+     * @param block id of the block the frame belongs to, never reused for another block
+     * @param index frame index in the block
+     * @param compressed the compressed frame
+     * @param size decompressed size of the frame
+     * @return Frame decompressed bytes
+     * @throw std::runtime_error if the compressed frame is damaged
+     */
+    Frame get(std::uint64_t block, std::size_t index, std::string_view compressed, std::size_t size);
+    /**
+     * @brief Get how many frames are cached
+     *
+     * @return std::size_t frame count
+     */
+    std::size_t getCachedCount() const;
+    /**
+     * @brief Get how many times a frame was decompressed, again after being dropped included
+     *
+     * @return std::size_t decompression count
+     */
+    std::size_t getDecompressCount() const;
+    std::size_t getCapacity() const;
+
+private:
+    struct Entry {
+        std::uint64_t block;
+        std::size_t index;
+        Frame frame;
+    };
+
+    std::size_t capacity;
+    mutable std::mutex mutex;
+    // most recently used first, short enough to search front to back
+    std::list<Entry> recent;
+    std::size_t decompressions = 0;
+};
+
+#endif // TANOSHIIEDITOR_FRAMECACHE_H
@@ -0,0 +1,190 @@
+/**
+ * @file Highlighter.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Incremental syntax highlighting with a per-line lexer state cache
+ */
+
+#ifndef TANOSHIIEDITOR_HIGHLIGHTER_H
+#define TANOSHIIEDITOR_HIGHLIGHTER_H
+
+#include "PieceTable.h"
+#include "Scheduler.h"
+#include "Style.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Highlights config files and logs. The lexers are line based and carry a one byte state
+ * from the end of a line into the next, e.g. inside a multi-line string or a stack trace. That
+ * state is kept for every line, so a line can be lexed alone for painting. Edits only mark the
+ * touched lines dirty and pull back a frontier before which every state is exact; background
+ * batches on the scheduler relex from the frontier and stop as soon as a line that did not
+ * change ends in the state it had before, since nothing after it can differ. The batch covering
+ * the screen runs at interactive priority, the rest in the background.
+ */
+class Highlighter {
+public:
+    enum class Syntax : std::uint8_t {
+        None,
+        // ini, toml, yaml, properties and the like
+        Config,
+        Log,
+    };
+    /**
+     * @brief one highlighted part of a line
+     */
+    struct Span {
+        // [begin, end) byte offsets in the line
+        std::size_t begin;
+        std::size_t end;
+        Style style;
+
+        bool operator==(const Span&) const = default;
+    };
+
+    Highlighter() = default;
+    /**
+     * @brief drop the running batch, it finishes on its own
+     *
+     */
+    ~Highlighter();
+    Highlighter(const Highlighter&) = delete;
+    Highlighter& operator=(const Highlighter&) = delete;
+
+    /**
+     * @brief guess the syntax of a file from its name
+     *
+     * @param path file path
+     * @return Syntax syntax, Syntax::None if unknown
+     */
+    static Syntax syntaxFor(const std::filesystem::path& path);
+    /**
+     * @brief lex one line
+     *
+     * @param syntax syntax
+     * @param line line without its newline
+     * @param state end state of the line before, 0 for the first line
+     * @param spans receives the spans of the line in order if not null
+     * @return std::uint8_t end state of the line
+     */
+    static std::uint8_t lexLine(Syntax syntax, std::string_view line, std::uint8_t state, std::vector<Span>* spans);
+
+    /**
+     * @brief switch syntax and relex everything
+     *
+     * @param syntax syntax
+     * @param line_count logical line count
+     */
+    void setSyntax(Syntax syntax, std::size_t line_count);
+    Syntax getSyntax() const;
+    /**
+     * @brief forget every state, used when the whole text is replaced
+     *
+     * @param line_count logical line count
+     */
+    void reset(std::size_t line_count);
+    /**
+     * @brief replace old_count lines starting at first with new_count dirty lines
+     *
+     * @param first first touched line
+     * @param old_count how many lines the edit touched before
+     * @param new_count how many lines they became
+     */
+    void replaceLines(std::size_t first, std::size_t old_count, std::size_t new_count);
+    /**
+     * @brief merge the finished batch and queue the next one. A frontier above viewport_end
+     * gets a batch ending there first, so the visible lines settle before the rest.
+     *
+     * @param text current text, the same one replaceLines() was called for
+     * @param viewport_end one past the last line on screen
+     * @return std::pair<std::size_t, std::size_t> lines [first, last) lexed from a different
+     * state than before, they need a repaint wherever they are shown, first == last if none
+     */
+    std::pair<std::size_t, std::size_t> update(const PieceTable& text, std::size_t viewport_end);
+    /**
+     * @brief check if every line is lexed and no batch is running
+     *
+     * @return true if done
+     */
+    bool isDone() const;
+    /**
+     * @brief Get the spans of a line, lexed from the state the line before ended in. The last
+     * line asked for is cached, painting its wrapped rows lexes it once.
+     *
+     * @param text current text
+     * @param line line index
+     * @return const std::vector<Span>& spans in order
+     */
+    const std::vector<Span>& getSpans(const PieceTable& text, std::size_t line) const;
+
+private:
+    // large enough to amortize a task, small enough to merge often on a huge file
+    static constexpr std::size_t batch_lines = 64 * 1024;
+    // lines lexed between two looks at the cancel flag
+    static constexpr std::size_t cancel_check_lines = 1024;
+
+    /**
+     * @brief one background relex, owned by the task as well so it may outlive the highlighter
+     */
+    struct Batch {
+        PieceTable text;
+        Syntax syntax;
+        std::size_t first;
+        std::uint8_t input;
+        // states and dirty flags of the lines in reach when the batch was queued
+        std::vector<std::uint8_t> old_states;
+        std::vector<std::uint8_t> old_dirty;
+        std::vector<std::uint8_t> states;
+        // stopped on a line that ended like before
+        bool converged = false;
+        CancellationToken token;
+        std::atomic<bool> done { false };
+    };
+
+    /**
+     * @brief lex the lines of a batch until it converges or runs out of lines
+     *
+     * @param batch batch
+     */
+    static void lexBatch(Batch& batch);
+    /**
+     * @brief merge a finished batch
+     *
+     * @return std::pair<std::size_t, std::size_t> lines [first, last) whose input state changed
+     */
+    std::pair<std::size_t, std::size_t> merge();
+    /**
+     * @brief find the first dirty line
+     *
+     * @param from line to start looking at
+     * @return std::size_t line index, the line count if there is none
+     */
+    std::size_t nextDirty(std::size_t from) const;
+    /**
+     * @brief the batch results can no longer be trusted from this line on
+     *
+     * @param line first changed line
+     */
+    void invalidateFrom(std::size_t line);
+
+    Syntax syntax = Syntax::None;
+    // end state of every line, exact before frontier and for lines not dirty
+    std::vector<std::uint8_t> states;
+    std::vector<std::uint8_t> dirty;
+    std::size_t frontier = 0;
+    std::shared_ptr<Batch> batch;
+    // lowest line changed since the batch was queued
+    std::size_t edit_floor = std::string::npos;
+    mutable std::size_t cached_line = std::string::npos;
+    mutable std::vector<Span> cached_spans;
+};
+
+#endif // TANOSHIIEDITOR_HIGHLIGHTER_H
@@ -0,0 +1,149 @@
+/**
+ * @file KeyTrace.h
+ * @author ayano
+ * @date 18/10/26
+ * @brief Recording of the keys of a session and their headless replay
+ */
+
+#ifndef TANOSHIIEDITOR_KEYTRACE_H
+#define TANOSHIIEDITOR_KEYTRACE_H
+
+#include "Metrics.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <ncurses.h>
+#include <span>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The keys of a session, burst by burst as the main loop read them, with the time each
+ * burst was read. On disk it is a header holding the terminal size followed by one record per
+ * burst: the microseconds since the burst before, the key count and the keys, all as
+ * variable length integers, so a typed character takes a single byte.
+ */
+struct KeyTrace {
+    struct Event {
+        // since the recording started
+        std::chrono::microseconds time;
+        std::vector<chtype> keys;
+    };
+
+    // terminal size when the recording started
+    std::size_t width = 0;
+    std::size_t height = 0;
+    std::vector<Event> events;
+
+    /**
+     * @brief read a trace, a burst torn off by a crash at the end is left out
+     *
+     * @param path trace path
+     * @return KeyTrace trace
+     * @throw std::runtime_error if the file cannot be read or is not a trace
+     */
+    static KeyTrace load(const std::filesystem::path& path);
+};
+
+/**
+ * @brief Appends the bursts of a session to a trace file. Records go through stdio's buffer, the
+ * input path never waits on the disk, and reach the file on flush() or when the writer is
+ * destroyed.
+ */
+class KeyTraceWriter {
+public:
+    /**
+     * @brief create the trace file and write its header, the clock of the trace starts here
+     *
+     * @param path trace path, truncated if it exists
+     * @param width terminal width
+     * @param height terminal height
+     * @throw std::runtime_error if the file cannot be created
+     */
+    KeyTraceWriter(const std::filesystem::path& path, std::size_t width, std::size_t height);
+    ~KeyTraceWriter();
+    KeyTraceWriter(const KeyTraceWriter&) = delete;
+    KeyTraceWriter& operator=(const KeyTraceWriter&) = delete;
+
+    /**
+     * @brief append a burst of keys read just now
+     *
+     * @param keys the return values of getch() in ncurses, in order
+     */
+    void record(std::span<const chtype> keys);
+    /**
+     * @brief hand the records buffered so far to the file, the session may end by a signal
+     *
+     */
+    void flush();
+
+private:
+    FILE* output;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::microseconds last { 0 };
+    std::string record_bytes;
+};
+
+/**
+ * @brief Feeds a trace through a headless Application on a screen in memory, no terminal
+ * involved, and times each burst from the focused window taking the keys until the frame showing
+ * them is composed. View keys split and focus windows as they did, and the background work the
+ * main loop would pick up between bursts, loading, replace-all and highlighting, is picked up the
+ * same way, so the text ends up as it did in the session.
+ */
+class TraceReplay {
+public:
+    enum class Timing : std::uint8_t {
+        // every burst right after the one before is done
+        Fast,
+        // every burst when it was read in the recording, or as soon as the one before is done
+        Original,
+    };
+
+    /**
+     * @param trace recorded session
+     * @param file_path the file the session started with, empty for a blank buffer. It should be
+     * the same content as when the session was recorded.
+     */
+    TraceReplay(KeyTrace trace, std::string file_path);
+
+    /**
+     * @brief replay the whole trace, then wait for the background work it started
+     *
+     * @param timing when the bursts are fed
+     */
+    void run(Timing timing);
+    /**
+     * @brief Get the latency of each burst
+     *
+     * @return const LatencyHistogram& latency histogram
+     */
+    const LatencyHistogram& getLatency() const;
+    /**
+     * @brief Get the 64 bit FNV-1a hash of the text the replay ended with, the same for two
+     * builds that edit alike
+     *
+     * @return std::uint64_t checksum
+     */
+    std::uint64_t getChecksum() const;
+    /**
+     * @brief write the result as one line of JSON: burst and key counts, the wall time, the
+     * latency percentiles in microseconds and the checksum
+     *
+     * @return std::string JSON object, without a trailing newline
+     */
+    std::string toJson() const;
+
+private:
+    KeyTrace trace;
+    std::string file_path;
+    Timing timing = Timing::Fast;
+    LatencyHistogram latency;
+    std::uint64_t checksum = 0;
+    std::size_t key_count = 0;
+    std::chrono::nanoseconds elapsed { 0 };
+};
+
+#endif // TANOSHIIEDITOR_KEYTRACE_H
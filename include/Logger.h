@@ -8,11 +8,43 @@
 #ifndef TANOSHIIEDITOR_LOGGER_H
 #define TANOSHIIEDITOR_LOGGER_H
 
-#include <string>
+#include "RingBuffer.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fmt/core.h>
+#include <fmt/format.h>
 #include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+
+/**
+ * @brief lowest level compiled in, 0 debug, 1 info, 2 warn, 3 error, 4 nothing
+ */
+#ifndef TANOSHII_LOG_LEVEL
+#define TANOSHII_LOG_LEVEL 0
+#endif
 
+/**
+ * @brief Asynchronous logger. Callers only copy the format string and arguments into a slot of
+ * a lock-free ring buffer, a background thread formats them and writes in batches. Levels below
+ * TANOSHII_LOG_LEVEL compile to nothing, levels below the runtime level return after one load.
+ */
 class Logger {
 public:
+    enum class Level : std::uint8_t {
+        Debug,
+        Info,
+        Warn,
+        Error,
+        Off
+    };
+    static constexpr Level compiled_level = static_cast<Level>(TANOSHII_LOG_LEVEL);
+
     virtual ~Logger();
     static std::shared_ptr<Logger> Instance();
     Logger(const Logger&) = delete;
@@ -20,13 +52,146 @@ public:
     void info(const std::string& message);
     void error(const std::string& message);
     void warn(const std::string& message);
-    std::ofstream& getLogFile();
-    std::ostream &operator<<(const std::string& message);
+    Logger& operator<<(const std::string& message);
+
+    template <typename... Args>
+    void debug(fmt::format_string<Args...> format, Args&&... args)
+    {
+        log<Level::Debug>(format, std::forward<Args>(args)...);
+    }
+    template <typename... Args>
+    void info(fmt::format_string<Args...> format, Args&&... args)
+    {
+        log<Level::Info>(format, std::forward<Args>(args)...);
+    }
+    template <typename... Args>
+    void warn(fmt::format_string<Args...> format, Args&&... args)
+    {
+        log<Level::Warn>(format, std::forward<Args>(args)...);
+    }
+    template <typename... Args>
+    void error(fmt::format_string<Args...> format, Args&&... args)
+    {
+        log<Level::Error>(format, std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief set the lowest level that gets logged
+     *
+     * @param level log level
+     */
+    void setLevel(Level level);
+    /**
+     * @brief check if a level would be logged
+     *
+     * @param level log level
+     * @return true if enabled
+     */
+    bool enabled(Level level) const;
+    /**
+     * @brief block until everything logged so far is written to the file
+     *
+     */
+    void flush();
+
 private:
     Logger();
-    void log(const std::string& message);
+
+    static constexpr std::size_t argument_capacity = 192;
+    static constexpr std::size_t queue_capacity = 4096;
+
+    /**
+     * @brief a log call waiting to be formatted, the arguments live inline in the slot
+     */
+    struct Record {
+        using Formatter = void (*)(void* arguments, fmt::memory_buffer& out);
+        Formatter formatter = nullptr;
+        Level level = Level::Info;
+        std::chrono::system_clock::time_point time;
+        alignas(std::max_align_t) unsigned char arguments[argument_capacity];
+    };
+
+    // pointers and views may dangle by the time the writer formats them, keep owned copies instead
+    template <typename T>
+    using Stored = std::conditional_t<std::is_convertible_v<const std::decay_t<T>&, std::string_view>, std::string, std::decay_t<T>>;
+
+    template <typename Tuple>
+    static void formatRecord(void* arguments, fmt::memory_buffer& out)
+    {
+        auto* stored = static_cast<Tuple*>(arguments);
+        std::apply([&out](fmt::string_view format, auto&... args) {
+            fmt::vformat_to(fmt::appender(out), format, fmt::make_format_args(args...));
+        },
+            *stored);
+        stored->~Tuple();
+    }
+
+    template <Level level, typename... Args>
+    void log(fmt::format_string<Args...> format, Args&&... args)
+    {
+        if constexpr (level < compiled_level) {
+            return;
+        } else {
+            if (!enabled(level))
+                return;
+            using Tuple = std::tuple<fmt::string_view, Stored<Args>...>;
+            if constexpr (sizeof(Tuple) > argument_capacity || alignof(Tuple) > alignof(std::max_align_t)) {
+                // too big to defer, format on the calling thread instead
+                enqueue<std::tuple<fmt::string_view, std::string>>(level, "{}", fmt::format(format, std::forward<Args>(args)...));
+            } else {
+                enqueue<Tuple>(level, static_cast<fmt::string_view>(format), std::forward<Args>(args)...);
+            }
+        }
+    }
+
+    template <typename Tuple, typename... Args>
+    void enqueue(Level level, Args&&... args)
+    {
+        auto time = std::chrono::system_clock::now();
+        bool pushed = queue.tryPush([&](Record& record) {
+            new (record.arguments) Tuple(std::forward<Args>(args)...);
+            record.formatter = formatRecord<Tuple>;
+            record.level = level;
+            record.time = time;
+        });
+        if (!pushed) {
+            // never block the caller, the writer reports the loss instead
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        enqueued.fetch_add(1, std::memory_order_seq_cst);
+        if (writer_sleeping.load(std::memory_order_seq_cst)) {
+            wakeup.fetch_add(1, std::memory_order_seq_cst);
+            wakeup.notify_one();
+        }
+    }
+
+    /**
+     * @brief body of the writer thread
+     *
+     */
+    void writerLoop();
+    /**
+     * @brief format and write everything currently queued
+     *
+     * @return true if anything was written
+     */
+    bool drain();
+
     std::ofstream log_file;
-    std::mutex lock;
+    RingBuffer<Record> queue { queue_capacity };
+    // debug traces, one per key among them, only when asked for with setLevel()
+    std::atomic<Level> runtime_level { Level::Info };
+    std::atomic<std::uint64_t> enqueued { 0 };
+    std::atomic<std::uint64_t> written { 0 };
+    std::atomic<std::uint64_t> dropped { 0 };
+    std::atomic<std::uint32_t> wakeup { 0 };
+    std::atomic<bool> writer_sleeping { false };
+    std::atomic<bool> stopping { false };
+    std::uint64_t reported_drops = 0;
+    std::time_t cached_second = 0;
+    char cached_timestamp[32] = {};
+    std::thread writer;
 };
 
-#endif // TANOSHIIEDITOR_LOGGER_H
\ No newline at end of file
+#endif // TANOSHIIEDITOR_LOGGER_H
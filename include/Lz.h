@@ -0,0 +1,42 @@
+/**
+ * @file Lz.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Small LZ77 codec for text kept compressed in memory
+ */
+
+#ifndef TANOSHIIEDITOR_LZ_H
+#define TANOSHIIEDITOR_LZ_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Byte oriented LZ77 in the spirit of LZ4: a sequence is a token byte holding a literal
+ * length and a match length, the literals, then a two byte offset back into the output. Lengths
+ * that do not fit the token continue in bytes of 255. Matches are found through a hash of the
+ * next four bytes and never reach further back than max_offset, so inputs are meant to be cut in
+ * frames of at most that size. Favours speed over ratio, text still shrinks several times.
+ */
+namespace Lz {
+constexpr std::size_t max_offset = 65535;
+/**
+ * @brief compress bytes
+ *
+ * @param input bytes pending compress
+ * @return std::string compressed bytes, a bit larger than the input if it does not compress
+ */
+std::string compress(std::string_view input);
+/**
+ * @brief decompress bytes made by compress()
+ *
+ * @param compressed compressed bytes
+ * @param output where the bytes go
+ * @param size how many bytes the input was
+ * @throw std::runtime_error if the compressed bytes are damaged or do not make size bytes
+ */
+void decompress(std::string_view compressed, char* output, std::size_t size);
+}
+
+#endif // TANOSHIIEDITOR_LZ_H
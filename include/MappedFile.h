@@ -0,0 +1,66 @@
+/**
+ * @file MappedFile.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Read-only memory mapped file
+ */
+
+#ifndef TANOSHIIEDITOR_MAPPEDFILE_H
+#define TANOSHIIEDITOR_MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Maps a whole file read-only. Pages are faulted in by the kernel on first access, so
+ * opening is O(1) regardless of the file size.
+ */
+class MappedFile {
+public:
+    /**
+     * @brief map a file
+     *
+     * @param path file path
+     * @throw std::runtime_error if the file cannot be opened or mapped
+     */
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * @brief Get the mapped bytes
+     *
+     * @return std::string_view whole file content
+     */
+    std::string_view view() const;
+    /**
+     * @brief Get the path of the file
+     *
+     * @return const std::string& path
+     */
+    const std::string& getPath() const;
+    /**
+     * @brief hand the pages of a range back to the kernel, they are read from the file again on
+     * next access
+     *
+     * @param offset start of the range, page aligned
+     * @param length bytes in the range
+     */
+    void release(std::size_t offset, std::size_t length) const;
+    /**
+     * @brief ask the kernel to start reading a range in ahead of access
+     *
+     * @param offset start of the range, page aligned
+     * @param length bytes in the range
+     */
+    void prefetch(std::size_t offset, std::size_t length) const;
+
+private:
+    std::string path;
+    const char* data = nullptr;
+    std::size_t size = 0;
+};
+
+#endif // TANOSHIIEDITOR_MAPPEDFILE_H
@@ -0,0 +1,164 @@
+/**
+ * @file Metrics.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Latency histograms and counters of the editor's hot paths
+ */
+
+#ifndef TANOSHIIEDITOR_METRICS_H
+#define TANOSHIIEDITOR_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief 0 compiles every timer and counter to nothing
+ */
+#ifndef TANOSHII_METRICS
+#define TANOSHII_METRICS 1
+#endif
+
+/**
+ * @brief Latency histogram with power of two microsecond buckets, bucket 0 holds everything
+ * below 2us and bucket i holds [2^i, 2^(i+1)) us. Recording is a few relaxed atomic adds, safe
+ * from any thread.
+ */
+class LatencyHistogram {
+public:
+    static constexpr std::size_t bucket_count = 24;
+
+    /**
+     * @brief add one sample
+     *
+     * @param elapsed measured latency
+     */
+    void record(std::chrono::nanoseconds elapsed);
+    /**
+     * @brief Get how many samples were recorded
+     *
+     * @return std::uint64_t sample count
+     */
+    std::uint64_t getCount() const;
+    /**
+     * @brief Get the latency below which a share of the samples fall, as the upper bound of the
+     * bucket holding it
+     *
+     * @param share share of the samples, in [0, 1]
+     * @return std::chrono::microseconds latency, 0 without samples
+     */
+    std::chrono::microseconds percentile(double share) const;
+    /**
+     * @brief Get the largest sample
+     *
+     * @return std::chrono::microseconds latency
+     */
+    std::chrono::microseconds getMax() const;
+    /**
+     * @brief Get the sample count of one bucket
+     *
+     * @param bucket bucket index
+     * @return std::uint64_t sample count
+     */
+    std::uint64_t getBucket(std::size_t bucket) const;
+    void reset();
+
+private:
+    std::array<std::atomic<std::uint64_t>, bucket_count> buckets {};
+    std::atomic<std::uint64_t> count { 0 };
+    std::atomic<std::uint64_t> max_us { 0 };
+};
+
+/**
+ * @brief Where the time of a keystroke goes, from getch() until the frame showing it is sent,
+ * and how much work it caused. Shown by the metrics overlay and exported as JSON lines.
+ */
+class Metrics {
+public:
+    enum class Timer : std::uint8_t {
+        // first key of a burst read until the frame showing it was sent
+        KeyToPaint,
+        // one main loop iteration, the sleep in poll() left out
+        Loop,
+        // one burst of keys applied by a window
+        Input,
+        // rewrapping the dirty lines of a view
+        Wrap,
+        // repainting the dirty rows of a window
+        Paint,
+        // sending a frame to the terminal
+        Flush,
+        Count,
+    };
+    enum class Counter : std::uint8_t {
+        Keys,
+        RowsWrapped,
+        BytesDrawn,
+        Refreshes,
+        // whole viewport repaints, scrolling and searching
+        FullRepaints,
+        Frames,
+        Count,
+    };
+
+    static std::shared_ptr<Metrics> Instance();
+
+    void record(Timer timer, std::chrono::nanoseconds elapsed)
+    {
+        if constexpr (TANOSHII_METRICS)
+            timers[static_cast<std::size_t>(timer)].record(elapsed);
+    }
+    void add(Counter counter, std::uint64_t amount = 1)
+    {
+        if constexpr (TANOSHII_METRICS)
+            counters[static_cast<std::size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+    }
+    const LatencyHistogram& getHistogram(Timer timer) const;
+    std::uint64_t getCounter(Counter counter) const;
+    static std::string_view nameOf(Timer timer);
+    static std::string_view nameOf(Counter counter);
+    /**
+     * @brief write everything recorded so far as one line of JSON: the counters, and for every
+     * timer its count, percentiles and bucket counts, latencies in microseconds
+     *
+     * @param time_ms timestamp stored with the record, milliseconds since the epoch
+     * @return std::string JSON object, without a trailing newline
+     */
+    std::string toJson(std::int64_t time_ms) const;
+    void reset();
+
+private:
+    std::array<LatencyHistogram, static_cast<std::size_t>(Timer::Count)> timers;
+    std::array<std::atomic<std::uint64_t>, static_cast<std::size_t>(Counter::Count)> counters {};
+};
+
+/**
+ * @brief records the time from construction to destruction into a timer
+ */
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Metrics::Timer timer)
+        : timer(timer)
+    {
+        if constexpr (TANOSHII_METRICS)
+            start = std::chrono::steady_clock::now();
+    }
+    ~ScopedTimer()
+    {
+        if constexpr (TANOSHII_METRICS)
+            Metrics::Instance()->record(timer, std::chrono::steady_clock::now() - start);
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Metrics::Timer timer;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // TANOSHIIEDITOR_METRICS_H
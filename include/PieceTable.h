@@ -0,0 +1,393 @@
+/**
+ * @file PieceTable.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Piece table backing store for Buffer
+ */
+
+#ifndef TANOSHIIEDITOR_PIECETABLE_H
+#define TANOSHIIEDITOR_PIECETABLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class ChunkCache;
+
+/**
+ * @brief A contiguous run of bytes that pieces point into. Blocks are either a view over
+ * bytes owned elsewhere (the original file), an append-only heap block for inserted text, or a
+ * compressed copy of one. Bytes that have been handed out to a piece are never modified again,
+ * so a block may be read on other threads while its owner keeps appending.
+ *
+ * A compressed block is cut in frames of frame_size, each LZ compressed unless it was asked to
+ * stay as it is or does not shrink. Compressed frames are read through FrameCache, and the
+ * newlines are indexed frame by frame so line lookups never decompress anything.
+ */
+class TextBlock {
+public:
+    static constexpr std::size_t frame_size = 64 * 1024;
+
+    /**
+     * @brief create an empty append-only block
+     *
+     * @param capacity bytes reserved up front, the storage never moves afterwards
+     */
+    explicit TextBlock(std::size_t capacity);
+    /**
+     * @brief create a read-only block over external bytes
+     *
+     * @param bytes the bytes
+     * @param owner keeps the bytes alive as long as any piece references this block
+     */
+    TextBlock(std::string_view bytes, std::shared_ptr<const void> owner);
+    /**
+     * @brief create a compressed copy of a block. Frames the source has compressed already are
+     * taken over as they are.
+     *
+     * @param source block to copy
+     * @param keep one flag per frame, true to leave the frame uncompressed
+     */
+    TextBlock(const TextBlock& source, const std::vector<bool>& keep);
+
+    /**
+     * @brief Get the bytes of the block
+     *
+     * @return const char* the bytes, nullptr for a compressed block, see read()
+     */
+    const char* data() const;
+    /**
+     * @brief Get the number of bytes written into the block
+     *
+     * @return std::size_t written bytes
+     */
+    std::size_t size() const;
+    /**
+     * @brief Get the number of bytes that can still be appended
+     *
+     * @return std::size_t free bytes
+     */
+    std::size_t available() const;
+    /**
+     * @brief append bytes to the block
+     *
+     * @param bytes bytes to append, must fit in available()
+     * @return std::size_t offset of the first appended byte
+     */
+    std::size_t append(std::string_view bytes);
+    /**
+     * @brief build a sorted newline offset table so newline queries become binary searches,
+     * large blocks are scanned on all cores
+     *
+     */
+    void buildLineIndex();
+    /**
+     * @brief answer newline queries through a chunk cache over the same bytes instead of one
+     * table for the whole block, for blocks too big to index at once
+     *
+     * @param chunks cache whose lines are counted already
+     */
+    void usePagedIndex(std::shared_ptr<ChunkCache> chunks);
+    /**
+     * @brief count newlines in [begin, end)
+     *
+     * @return std::size_t newline count
+     */
+    std::size_t countNewlines(std::size_t begin, std::size_t end) const;
+    /**
+     * @brief find the offset of the nth (0 based) newline at or after begin
+     *
+     * @param begin offset to start from
+     * @param nth which newline
+     * @return std::size_t offset of the newline
+     * @warning the newline must exist
+     */
+    std::size_t findNewline(std::size_t begin, std::size_t nth) const;
+    /**
+     * @brief visit the bytes of a range in order, a frame at a time for a compressed block
+     *
+     * @param start first byte
+     * @param length how many bytes, must lie in the block
+     * @param visitor called with each contiguous part, valid during the call, return false to stop
+     * @return false if the visitor stopped early
+     */
+    bool read(std::size_t start, std::size_t length, const std::function<bool(std::string_view)>& visitor) const;
+    bool isCompressed() const;
+    /**
+     * @brief check if a compressed copy could be smaller: the block is heap text of its own of
+     * at least a frame, and a frame not kept was never tried yet
+     *
+     * @param keep one flag per frame, true to leave the frame uncompressed, missing flags are false
+     * @return true if worth compressing
+     */
+    bool isCompressible(const std::vector<bool>& keep) const;
+    /**
+     * @brief Get the number of frames the block has or would be cut into
+     *
+     * @return std::size_t frame count
+     */
+    std::size_t frameCount() const;
+    /**
+     * @brief check if a frame is stored compressed
+     *
+     * @param frame frame index
+     * @return true if compressed
+     */
+    bool isFrameCompressed(std::size_t frame) const;
+    /**
+     * @brief Get the heap memory the block holds, bytes owned elsewhere are not counted
+     *
+     * @return std::size_t byte count
+     */
+    std::size_t memoryUsage() const;
+
+private:
+    enum class FrameState : std::uint8_t {
+        Raw,
+        Compressed,
+        // compressing did not shrink it, not tried again
+        Incompressible,
+    };
+    struct Frame {
+        std::string bytes;
+        FrameState state;
+    };
+
+    /**
+     * @brief count the newlines before an offset of a compressed block
+     */
+    std::size_t frameRank(std::size_t offset) const;
+
+    std::unique_ptr<char[]> storage;
+    std::shared_ptr<const void> owner;
+    const char* bytes;
+    // snapshots on other threads share an add block that keeps growing, append() publishes the
+    // bytes before the new size
+    std::atomic<std::size_t> used;
+    std::size_t capacity;
+    std::vector<std::size_t> newline_index;
+    bool indexed = false;
+    std::shared_ptr<ChunkCache> chunks;
+    // the frames of a compressed block, empty otherwise
+    std::vector<Frame> frames;
+    // newlines before each frame, one more entry than there are frames
+    std::vector<std::size_t> frame_newlines;
+    // offsets of the newlines inside their frame, frame after frame
+    std::vector<std::uint16_t> frame_newline_offsets;
+    // names the block in FrameCache
+    std::uint64_t id = 0;
+};
+
+/**
+ * @brief Persistent piece table. Pieces live in a treap ordered by document position, each node
+ * carrying the byte and newline totals of its subtree, so insert, erase and line lookup are
+ * O(log n). Nodes are immutable and shared, copying a PieceTable is O(1) and gives a snapshot
+ * that is unaffected by later edits to the original.
+ */
+class PieceTable {
+public:
+    /**
+     * @brief a range of a block, for building a table in one go
+     */
+    struct Range {
+        std::shared_ptr<const TextBlock> block;
+        std::size_t start;
+        std::size_t length;
+    };
+    /**
+     * @brief a byte range to overwrite with new text, for applying many edits in one go
+     */
+    struct Replacement {
+        std::size_t offset;
+        std::size_t length;
+        std::string text;
+    };
+
+    PieceTable();
+    /**
+     * @brief create a table over existing bytes without copying them
+     *
+     * @param original original text
+     * @param owner object keeping the original text alive
+     */
+    PieceTable(std::string_view original, std::shared_ptr<const void> owner);
+    /**
+     * @brief create a table whose initial content is a whole block
+     *
+     * @param original block holding the original text, ideally with its line index built
+     */
+    explicit PieceTable(std::shared_ptr<const TextBlock> original);
+
+    /**
+     * @brief insert bytes at position
+     *
+     * @param offset byte offset in the document
+     * @param text text pending insert
+     */
+    void insert(std::size_t offset, std::string_view text);
+    /**
+     * @brief insert a range of an existing block without copying it
+     *
+     * @param offset byte offset in the document
+     * @param block block holding the bytes, ideally with its line index built
+     * @param start first byte in the block
+     * @param length how many bytes
+     */
+    void insert(std::size_t offset, std::shared_ptr<const TextBlock> block, std::size_t start, std::size_t length);
+    /**
+     * @brief append ranges of existing blocks without copying them. The new pieces are built
+     * into a tree directly, far cheaper than one insert() per range.
+     *
+     * @param ranges ranges in document order
+     */
+    void append(const std::vector<Range>& ranges);
+    /**
+     * @brief erase bytes
+     *
+     * @param offset byte offset in the document
+     * @param length how many bytes
+     */
+    void erase(std::size_t offset, std::size_t length);
+    /**
+     * @brief apply many replacements as one edit. The untouched pieces are sliced around the
+     * replaced ranges, the new texts share one block and the tree is rebuilt once, so the cost
+     * is O(pieces + replacements) instead of a split and merge per replacement.
+     *
+     * @param replacements replacements in ascending order, not overlapping, offsets before the edit
+     * @throw std::out_of_range if a replacement runs past the end or they are out of order
+     */
+    void replaceAll(const std::vector<Replacement>& replacements);
+    /**
+     * @brief compress the inserted text no hot range comes near. Blocks of inserted text of at
+     * least a frame are copied compressed, frames under a hot range left as they are, and the
+     * pieces are pointed at the copies, the content stays the same. Takes time in proportion to
+     * the text compressed, meant for a snapshot in the background.
+     *
+     * @param hot [begin, end) byte ranges in the document to leave uncompressed, in any order
+     * @return std::size_t bytes of memory the blocks take less, 0 if nothing changed
+     */
+    std::size_t compressCold(const std::vector<std::pair<std::size_t, std::size_t>>& hot);
+
+    /**
+     * @brief Get the document size in bytes
+     *
+     * @return std::size_t byte count
+     */
+    std::size_t size() const;
+    /**
+     * @brief Get the line count, which is always newline count + 1
+     *
+     * @return std::size_t line count
+     */
+    std::size_t lineCount() const;
+    /**
+     * @brief Get the byte offset where a line starts
+     *
+     * @param line line index
+     * @return std::size_t byte offset
+     */
+    std::size_t lineStart(std::size_t line) const;
+    /**
+     * @brief Get the byte offset where a line ends, excluding the newline
+     *
+     * @param line line index
+     * @return std::size_t byte offset
+     */
+    std::size_t lineEnd(std::size_t line) const;
+    /**
+     * @brief Get the line containing the byte offset
+     *
+     * @param offset byte offset
+     * @return std::size_t line index
+     */
+    std::size_t lineOf(std::size_t offset) const;
+    /**
+     * @brief copy a line out, excluding the newline
+     *
+     * @param line line index
+     * @return std::string line content
+     */
+    std::string line(std::size_t line) const;
+    /**
+     * @brief view a line, excluding the newline, without copying it when it lies in one piece
+     * as most lines do
+     *
+     * @param line line index
+     * @param scratch holds a line spread over several pieces, the view then points into it
+     * @return std::string_view line content, valid while the blocks and scratch are
+     */
+    std::string_view lineView(std::size_t line, std::string& scratch) const;
+    /**
+     * @brief copy a byte range out
+     *
+     * @param offset byte offset
+     * @param length how many bytes, clamped to the document end
+     * @return std::string content
+     */
+    std::string substr(std::size_t offset, std::size_t length) const;
+    /**
+     * @brief visit the contiguous chunks covering a byte range in order, without copying
+     *
+     * @param offset byte offset
+     * @param length how many bytes, clamped to the document end
+     * @param visitor called with each chunk, return false to stop early
+     */
+    void forEachChunk(std::size_t offset, std::size_t length, const std::function<bool(std::string_view)>& visitor) const;
+    /**
+     * @brief Get the number of pieces
+     *
+     * @return std::size_t piece count
+     */
+    std::size_t pieceCount() const;
+
+private:
+    struct Piece {
+        std::shared_ptr<const TextBlock> block;
+        std::size_t start;
+        std::size_t length;
+        std::size_t newlines;
+    };
+    struct Node;
+    using NodePtr = std::shared_ptr<const Node>;
+    struct Node {
+        Piece piece;
+        std::uint32_t priority;
+        std::size_t bytes;
+        std::size_t newlines;
+        std::size_t pieces;
+        NodePtr left, right;
+    };
+
+    static constexpr std::size_t block_size = 64 * 1024;
+
+    NodePtr root;
+    std::shared_ptr<TextBlock> add_block;
+    std::uint32_t seed = 0x9e3779b9u;
+
+    std::uint32_t nextPriority();
+    NodePtr makeNode(Piece piece);
+    static NodePtr makeNode(const Piece& piece, std::uint32_t priority, NodePtr left, NodePtr right);
+    static Piece slice(const Piece& piece, std::size_t begin, std::size_t end);
+    /**
+     * @brief Get every piece in document order
+     */
+    std::vector<Piece> collectPieces() const;
+    std::pair<NodePtr, NodePtr> split(const NodePtr& node, std::size_t offset);
+    static NodePtr merge(const NodePtr& left, const NodePtr& right);
+    /**
+     * @brief build the treap of pieces [begin, end), the root is the piece with the highest priority
+     */
+    static NodePtr build(const std::vector<Piece>& pieces, const std::vector<std::uint32_t>& priorities, std::size_t begin, std::size_t end);
+    static NodePtr extendRightmost(const NodePtr& node, std::size_t length, std::size_t newlines);
+    static std::size_t bytesOf(const NodePtr& node);
+    static std::size_t newlinesOf(const NodePtr& node);
+    static std::size_t piecesOf(const NodePtr& node);
+};
+
+#endif // TANOSHIIEDITOR_PIECETABLE_H
@@ -0,0 +1,215 @@
+/**
+ * @file RecoveryJournal.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Write-ahead journal that brings unsaved edits back after a crash
+ */
+
+#ifndef TANOSHIIEDITOR_RECOVERYJOURNAL_H
+#define TANOSHIIEDITOR_RECOVERYJOURNAL_H
+
+#include "PieceTable.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Keeps every edit of a buffer on disk next to the file it was loaded from. Recording only
+ * appends to an in-memory batch, a background thread writes the batches and syncs them, so the
+ * input path never waits on the disk. Nothing is written before the first edit, and the file is
+ * removed again once the buffer matches its file. Once enough has been written the journal is compacted: it
+ * is rewritten as the current document, base file ranges by reference and inserted text inline,
+ * followed by whatever was recorded meanwhile. Replay maps the journal and points pieces straight
+ * into it, nothing is copied, and stops at the first torn or corrupt record.
+ */
+class RecoveryJournal {
+public:
+    /**
+     * @brief Get where the journal of a file lives, a hidden file in the same directory
+     *
+     * @param file edited file
+     * @return std::filesystem::path journal path
+     */
+    static std::filesystem::path pathFor(const std::filesystem::path& file);
+
+    /**
+     * @brief create a journal for a base file, nothing is written before start()
+     *
+     * @param journal_path journal path
+     * @param base_path the file the edits apply to, its size and modification time are recorded
+     * so a journal is never replayed onto a file that changed since
+     * @param base the whole content of the base file
+     */
+    RecoveryJournal(std::filesystem::path journal_path, const std::filesystem::path& base_path, std::shared_ptr<const TextBlock> base);
+    /**
+     * @brief write everything recorded and stop the writer thread
+     *
+     */
+    ~RecoveryJournal();
+    RecoveryJournal(const RecoveryJournal&) = delete;
+    RecoveryJournal& operator=(const RecoveryJournal&) = delete;
+
+    /**
+     * @brief apply a journal left by an earlier session. A journal made for another version of
+     * the base file is moved aside instead.
+     *
+     * @param text the base document, receives the recovered edits
+     * @return true if anything was recovered
+     */
+    bool replay(PieceTable& text);
+    /**
+     * @brief start journaling, the journal is rewritten from the current document with the first
+     * edit recorded, a journal left by an earlier session stays as it is until then
+     *
+     * @param text current document
+     */
+    void start(const PieceTable& text);
+    /**
+     * @brief remove the journal file, the document matches its file again. The next edit
+     * recorded starts a new journal from the document.
+     *
+     * @param text current document
+     */
+    void discard(const PieceTable& text);
+    /**
+     * @brief remember an insert
+     *
+     * @param offset byte offset
+     * @param text inserted text
+     */
+    void recordInsert(std::size_t offset, std::string_view text);
+    /**
+     * @brief remember an erase
+     *
+     * @param offset byte offset
+     * @param length erased byte count
+     */
+    void recordErase(std::size_t offset, std::size_t length);
+    /**
+     * @brief check if enough was recorded since the last compaction to make another worthwhile
+     *
+     * @return true if compact() should be called
+     */
+    bool wantsCompaction() const;
+    /**
+     * @brief rewrite the journal from a snapshot in the background, everything recorded before
+     * this call is covered by the snapshot
+     *
+     * @param snapshot current document, copying a PieceTable is O(1)
+     */
+    void compact(const PieceTable& snapshot);
+    /**
+     * @brief block until everything recorded so far is written and synced
+     *
+     */
+    void flush();
+    /**
+     * @brief Get the journal path
+     *
+     * @return const std::filesystem::path& journal path
+     */
+    const std::filesystem::path& getPath() const;
+
+private:
+    enum class Kind : std::uint8_t {
+        Insert = 'I',
+        Erase = 'E',
+        // insert a range of the base file
+        Copy = 'C',
+        // empty the document, a compacted journal starts with it
+        Clear = 'Z',
+    };
+    struct Record {
+        Kind kind;
+        std::uint64_t offset;
+        std::uint64_t length;
+        // Insert: position in payloads, Copy: offset in the base file
+        std::uint64_t source;
+    };
+    struct Header {
+        char magic[8];
+        std::uint64_t base_size;
+        std::int64_t base_mtime;
+    };
+
+    static constexpr std::size_t min_compaction_bytes = 4 * 1024 * 1024;
+    static constexpr std::chrono::milliseconds write_interval { 200 };
+    // a batch this large is written without waiting for the interval
+    static constexpr std::size_t eager_batch_bytes = 1024 * 1024;
+
+    /**
+     * @brief body of the writer thread
+     *
+     */
+    void writerLoop();
+    /**
+     * @brief append the encoded records to out, merging runs of typing and deleting
+     *
+     * @param records records in order
+     * @param payloads bytes the Insert records point into
+     * @param out encoded bytes
+     */
+    static void encode(const std::vector<Record>& records, std::string_view payloads, std::string& out);
+    /**
+     * @brief append one encoded record to out
+     *
+     */
+    static void encodeRecord(const Record& record, std::string_view payload, std::string& out);
+    /**
+     * @brief encode a whole document, base ranges by reference
+     *
+     * @param snapshot document
+     * @param out encoded bytes
+     */
+    void encodeSnapshot(const PieceTable& snapshot, std::string& out) const;
+    /**
+     * @brief write bytes to the open journal and sync them
+     *
+     * @return true if every byte was written and synced
+     */
+    bool writeAll(std::string_view bytes);
+    /**
+     * @brief replace the journal file with new content through a temporary file, renamed over it
+     * only once fully written and synced. On failure the old journal stays open and in place.
+     *
+     * @return true if replaced
+     */
+    bool replaceFile(std::string_view bytes);
+
+    std::filesystem::path journal_path;
+    std::shared_ptr<const TextBlock> base;
+    Header header {};
+    int fd = -1;
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::condition_variable written;
+    std::vector<Record> records;
+    std::string payloads;
+    std::optional<PieceTable> snapshot;
+    // document to start from, handed to the writer as a snapshot with the first edit
+    std::optional<PieceTable> initial;
+    // the writer removes the file before writing anything newer
+    bool discarding = false;
+    // batches handed to the writer and batches it finished, flush() waits for them to meet
+    std::uint64_t submitted = 0;
+    std::uint64_t completed = 0;
+    bool stopping = false;
+
+    // touched by the recording thread only
+    std::size_t recorded_since_compaction = 0;
+    std::atomic<std::size_t> compacted_size { 0 };
+    std::thread writer;
+};
+
+#endif // TANOSHIIEDITOR_RECOVERYJOURNAL_H
@@ -0,0 +1,148 @@
+/**
+ * @file RegexReplace.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Regular expression replace-all, scanned in the background
+ */
+
+#ifndef TANOSHIIEDITOR_REGEXREPLACE_H
+#define TANOSHIIEDITOR_REGEXREPLACE_H
+
+#include "PieceTable.h"
+#include "Scheduler.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief One replace-all job. It scans a snapshot of the text, so the buffer stays editable
+ * meanwhile, split into line-aligned chunks that run as separate jobs on the scheduler.
+ * Matches never span a line break, ^ and $ match at line boundaries. The result is the list of
+ * replacements for Buffer::replaceAll(), which applies them as one edit. A chunk that throws
+ * fails the whole job instead of leaving it unfinished.
+ */
+class RegexReplace {
+public:
+    /**
+     * @brief gives the replacement text of a match, called on the scheduler's workers
+     */
+    using Formatter = std::function<std::string(const std::cmatch&)>;
+
+    /**
+     * @brief compile the pattern and queue the scan
+     *
+     * @param text snapshot of the text
+     * @param pattern ECMAScript regular expression
+     * @param replacement replacement text, $& is the match and $1 to $99 its groups
+     * @param scheduler scheduler to scan on, every finished chunk wakes its main loop
+     * @throw std::runtime_error if the pattern is not a valid regular expression
+     */
+    RegexReplace(PieceTable text, const std::string& pattern, const std::string& replacement, std::shared_ptr<Scheduler> scheduler = Scheduler::Instance());
+    /**
+     * @brief compile the pattern and queue the scan, the replacements come from a function
+     *
+     * @param text snapshot of the text
+     * @param pattern ECMAScript regular expression
+     * @param formatter gives the replacement of each match, may throw to fail the job
+     * @param scheduler scheduler to scan on, every finished chunk wakes its main loop
+     * @throw std::runtime_error if the pattern is not a valid regular expression
+     */
+    RegexReplace(PieceTable text, const std::string& pattern, Formatter formatter, std::shared_ptr<Scheduler> scheduler = Scheduler::Instance());
+    /**
+     * @brief cancel the scan and wait for the chunks already running
+     *
+     */
+    ~RegexReplace();
+    RegexReplace(const RegexReplace&) = delete;
+    RegexReplace& operator=(const RegexReplace&) = delete;
+    /**
+     * @brief scan a text and wait for the result
+     *
+     * @param text text
+     * @param pattern ECMAScript regular expression
+     * @param replacement replacement text
+     * @return std::vector<PieceTable::Replacement> replacements in ascending order
+     * @throw std::runtime_error if the pattern is not a valid regular expression or the scan failed
+     */
+    static std::vector<PieceTable::Replacement> findAll(const PieceTable& text, const std::string& pattern, const std::string& replacement);
+
+    /**
+     * @brief stop scanning, chunks not started yet are skipped and running ones stop at the next line
+     *
+     */
+    void cancel();
+    bool isCancelled() const;
+    /**
+     * @brief check if a chunk threw, e.g. a pattern too complex for the matcher. The other chunks
+     * stop as if cancelled.
+     *
+     * @return true if failed
+     */
+    bool isFailed() const;
+    /**
+     * @brief Get what the first failing chunk threw, once done
+     *
+     * @return std::string the message, empty unless failed
+     */
+    std::string getError() const;
+    /**
+     * @brief check if every chunk finished, failed or was skipped
+     *
+     * @return true if done
+     */
+    bool isDone() const;
+    /**
+     * @brief block until isDone()
+     *
+     */
+    void wait();
+    /**
+     * @brief Get the share of the text scanned so far
+     *
+     * @return double progress from 0 to 1
+     */
+    double getProgress() const;
+    /**
+     * @brief move the replacements out once done
+     *
+     * @return std::vector<PieceTable::Replacement> replacements in ascending order, nothing if cancelled or failed
+     */
+    std::vector<PieceTable::Replacement> takeResult();
+
+private:
+    // large enough to amortize a task, small enough for a few chunks per core on a modest file
+    static constexpr std::size_t chunk_size = 1024 * 1024;
+    // lines scanned between two looks at the cancel flag
+    static constexpr std::size_t cancel_check_lines = 1024;
+
+    /**
+     * @brief find and format the matches of one chunk into its slot of parts, the chunk is
+     * counted as finished even if it throws
+     *
+     * @param index chunk index
+     */
+    void scanChunk(std::size_t index);
+    void scanLines(std::size_t index);
+
+    PieceTable text;
+    std::regex regex;
+    Formatter formatter;
+    std::vector<std::size_t> bounds;
+    std::vector<std::vector<PieceTable::Replacement>> parts;
+    std::atomic<bool> cancelled { false };
+    std::atomic<bool> failed { false };
+    // set by the first failing chunk, under mutex
+    std::string error;
+    std::atomic<std::size_t> remaining { 0 };
+    std::atomic<std::size_t> scanned { 0 };
+    mutable std::mutex mutex;
+    std::condition_variable finished;
+};
+
+#endif // TANOSHIIEDITOR_REGEXREPLACE_H
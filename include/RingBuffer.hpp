@@ -0,0 +1,109 @@
+/**
+ * @file RingBuffer.hpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Bounded lock-free multi-producer queue
+ */
+
+#ifndef TANOSHIIEDITOR_RINGBUFFER_H
+#define TANOSHIIEDITOR_RINGBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ * @brief Bounded queue after Dmitry Vyukov's design: every slot carries a sequence number, so
+ * producers only contend on one atomic counter and never take a lock. Elements are filled and
+ * consumed in place, the slots are allocated once up front.
+ *
+ * @tparam T slot type, must be default constructible
+ */
+template <typename T>
+class RingBuffer {
+public:
+    /**
+     * @param capacity slot count, rounded up to a power of two
+     */
+    explicit RingBuffer(std::size_t capacity)
+    {
+        std::size_t size = 2;
+        while (size < capacity)
+            size *= 2;
+        mask = size - 1;
+        slots.reset(new Slot[size]);
+        for (std::size_t i = 0; i < size; i++)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief claim a slot and fill it, safe to call from any number of threads
+     *
+     * @param fill called with the claimed slot
+     * @return true if pushed, false if the queue is full
+     */
+    template <typename F>
+    bool tryPush(F&& fill)
+    {
+        std::size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[pos & mask];
+            std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    fill(slot.value);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief consume the oldest slot, only one thread may pop
+     *
+     * @param consume called with the slot, which is reused afterwards
+     * @return true if a slot was consumed, false if the queue is empty
+     */
+    template <typename F>
+    bool tryPop(F&& consume)
+    {
+        std::size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        Slot& slot = slots[pos & mask];
+        if (slot.sequence.load(std::memory_order_acquire) != pos + 1)
+            return false;
+        consume(slot.value);
+        slot.sequence.store(pos + mask + 1, std::memory_order_release);
+        dequeue_pos.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * @brief check if the queue looks empty, only meaningful on the consuming thread
+     *
+     * @return true if there is nothing to pop
+     */
+    bool empty() const
+    {
+        std::size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        return slots[pos & mask].sequence.load(std::memory_order_acquire) != pos + 1;
+    }
+
+private:
+    struct Slot {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+    std::unique_ptr<Slot[]> slots;
+    std::size_t mask;
+    alignas(64) std::atomic<std::size_t> enqueue_pos { 0 };
+    alignas(64) std::atomic<std::size_t> dequeue_pos { 0 };
+};
+
+#endif // TANOSHIIEDITOR_RINGBUFFER_H
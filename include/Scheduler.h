@@ -0,0 +1,158 @@
+/**
+ * @file Scheduler.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Prioritized background jobs, timers and completions delivered to the main loop
+ */
+
+#ifndef TANOSHIIEDITOR_SCHEDULER_H
+#define TANOSHIIEDITOR_SCHEDULER_H
+
+#include "ThreadPool.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+/**
+ * @brief Shared flag to call off a job or a timer. Copies share the flag, cancelling is final.
+ */
+class CancellationToken {
+public:
+    CancellationToken();
+    void cancel() const;
+    bool isCancelled() const;
+
+private:
+    std::shared_ptr<std::atomic<bool>> flag;
+};
+
+/**
+ * @brief Runs jobs on the thread pool, most urgent priority first, and hands their completion
+ * callbacks back to the main loop through a lock-free list. Every finished job and every posted
+ * callback wakes the main loop through an eventfd, so it can sleep in poll() until there is
+ * something to do. Timers and completion callbacks run on the main loop in runPending().
+ */
+class Scheduler {
+public:
+    enum class Priority : std::uint8_t {
+        // the user waits for it, e.g. highlighting the lines on screen
+        Interactive,
+        Normal,
+        // nobody looks at the result yet
+        Background,
+    };
+    using Clock = std::chrono::steady_clock;
+    using Callback = std::function<void()>;
+    using Work = std::function<void(const CancellationToken&)>;
+
+    /**
+     * @brief create the wakeup eventfd
+     *
+     * @param pool pool the jobs run on
+     * @throw std::runtime_error if the eventfd cannot be created
+     */
+    explicit Scheduler(std::shared_ptr<ThreadPool> pool);
+    /**
+     * @brief drop the callbacks not run yet, jobs already queued still run
+     *
+     */
+    ~Scheduler();
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+    /**
+     * @brief the scheduler shared by the whole editor, on the shared thread pool
+     *
+     * @return std::shared_ptr<Scheduler> scheduler
+     */
+    static std::shared_ptr<Scheduler> Instance();
+
+    /**
+     * @brief queue a job, safe from any thread. A job cancelled before it starts is skipped,
+     * one cancelled before its callback runs loses the callback. A job whose work throws is
+     * logged and still completes, its callback finds whatever the work got done.
+     *
+     * @param priority priority
+     * @param work runs on a worker, gets the token to stop early
+     * @param done runs on the main loop once work returned or threw, if set
+     * @param token token calling the job off
+     */
+    void submit(Priority priority, Work work, Callback done = {}, CancellationToken token = {});
+    /**
+     * @brief run a callback on the main loop, safe from any thread
+     *
+     * @param callback callback
+     * @param token token calling it off
+     */
+    void post(Callback callback, CancellationToken token = {});
+    /**
+     * @brief wake the main loop without a callback, safe from any thread
+     *
+     */
+    void wake();
+    /**
+     * @brief run a callback on the main loop once a deadline passed
+     *
+     * @param deadline deadline
+     * @param callback callback
+     * @return CancellationToken token calling the timer off
+     */
+    CancellationToken runAt(Clock::time_point deadline, Callback callback);
+    /**
+     * @brief run a callback on the main loop after a delay
+     *
+     * @param delay delay
+     * @param callback callback
+     * @return CancellationToken token calling the timer off
+     */
+    CancellationToken runAfter(Clock::duration delay, Callback callback);
+    /**
+     * @brief on the main loop, consume the wakeup and run the completions and due timers
+     *
+     * @return true if the loop was woken or a timer ran
+     */
+    bool runPending();
+    /**
+     * @brief Get the deadline of the earliest timer, to bound the main loop's sleep
+     *
+     * @return std::optional<Clock::time_point> deadline, nothing without timers
+     */
+    std::optional<Clock::time_point> getNextDeadline() const;
+    /**
+     * @brief Get the descriptor that turns readable when the main loop should call runPending()
+     *
+     * @return int eventfd
+     */
+    int getWakeFd() const;
+    /**
+     * @brief Get the number of jobs queued or running
+     *
+     * @return std::size_t job count
+     */
+    std::size_t getJobCount() const;
+
+private:
+    // shared with the pool tasks, which may outlive the scheduler
+    struct State;
+    struct Timer {
+        Clock::time_point deadline;
+        // timers with the same deadline run in the order they were set
+        std::uint64_t serial;
+        Callback callback;
+        CancellationToken token;
+
+        bool operator>(const Timer& other) const;
+    };
+
+    std::shared_ptr<ThreadPool> pool;
+    std::shared_ptr<State> state;
+    // a min-heap on the deadline, only touched by the main loop
+    std::vector<Timer> timers;
+    std::uint64_t timer_serial = 0;
+};
+
+#endif // TANOSHIIEDITOR_SCHEDULER_H
@@ -0,0 +1,317 @@
+/**
+ * @file Screen.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Screen backends windows draw through: ncurses, an in-memory cell grid and a direct
+ * ANSI writer
+ */
+
+#ifndef TANOSHIIEDITOR_SCREEN_H
+#define TANOSHIIEDITOR_SCREEN_H
+
+#include "Border.hpp"
+#include "Style.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ncurses.h>
+#include <string>
+#include <string_view>
+#include <termios.h>
+#include <vector>
+
+/**
+ * @brief The drawing area of one window. Drawing only changes the surface, stage() hands the
+ * changes to the screen and Screen::update() sends every staged surface to the terminal at once.
+ * Surfaces may overlap, the one raised last is in front.
+ * Coordinates are relative to the surface, everything is clipped to it.
+ */
+class Surface {
+public:
+    virtual ~Surface() = default;
+    /**
+     * @brief write text starting at a cell
+     *
+     * @param row row
+     * @param col column
+     * @param text UTF-8 text without newlines, one cell per column, a grapheme that does not fit is
+     * left out
+     */
+    virtual void put(std::size_t row, std::size_t col, std::string_view text) = 0;
+    /**
+     * @brief fill a horizontal run of cells with one character
+     *
+     * @param row row
+     * @param col first column
+     * @param ch fill character
+     * @param count how many cells
+     */
+    virtual void fill(std::size_t row, std::size_t col, char ch, std::size_t count) = 0;
+    /**
+     * @brief set the style put() and fill() draw with from now on, surfaces start with Style::Normal
+     *
+     * @param style style
+     */
+    virtual void setStyle(Style style) = 0;
+    /**
+     * @brief draw a border along the edges
+     *
+     * @param border border characters
+     */
+    virtual void drawBorder(const Border& border) = 0;
+    /**
+     * @brief blank every cell
+     *
+     */
+    virtual void erase() = 0;
+    /**
+     * @brief set where the terminal cursor goes when this surface is the last one staged
+     *
+     * @param row row
+     * @param col column
+     */
+    virtual void setCursor(std::size_t row, std::size_t col) = 0;
+    /**
+     * @brief change the size, the content is blanked
+     *
+     * @param width new width
+     * @param height new height
+     */
+    virtual void resize(std::size_t width, std::size_t height) = 0;
+    /**
+     * @brief move the surface on the screen
+     *
+     * @param x column of the upper left corner
+     * @param y row of the upper left corner
+     */
+    virtual void moveTo(std::size_t x, std::size_t y) = 0;
+    /**
+     * @brief put the surface in front of every other one, where they overlap it is the one shown
+     * and its cursor is the terminal cursor
+     *
+     */
+    virtual void raise() = 0;
+    /**
+     * @brief never move the terminal cursor, it stays where the surfaces below put it. For
+     * surfaces that are only looked at, like overlays.
+     *
+     */
+    virtual void leaveCursor() = 0;
+    /**
+     * @brief hand the changes to the screen for the next Screen::update()
+     *
+     */
+    virtual void stage() = 0;
+};
+
+/**
+ * @brief A terminal, or something standing in for one
+ */
+class Screen {
+public:
+    virtual ~Screen() = default;
+    /**
+     * @brief create a blank surface
+     *
+     * @param x column of the upper left corner
+     * @param y row of the upper left corner
+     * @param width width
+     * @param height height
+     * @return std::unique_ptr<Surface> the surface, must not outlive the screen
+     */
+    virtual std::unique_ptr<Surface> createSurface(std::size_t x, std::size_t y, std::size_t width, std::size_t height) = 0;
+    /**
+     * @brief send everything staged since the last update to the terminal
+     *
+     */
+    virtual void update() = 0;
+    virtual std::size_t getWidth() const = 0;
+    virtual std::size_t getHeight() const = 0;
+    /**
+     * @brief pick up a new terminal size, e.g. after SIGWINCH. The surfaces have to be laid out
+     * again when it changed.
+     *
+     * @return true if the size changed since the last call
+     */
+    virtual bool fitTerminal() { return false; }
+};
+
+/**
+ * @brief Screen backed by ncurses windows, one panel each so the panel library composites them
+ * and only sends the rows that changed. ncurses must be initialized before construction.
+ */
+class NcursesScreen : public Screen {
+public:
+    NcursesScreen();
+    std::unique_ptr<Surface> createSurface(std::size_t x, std::size_t y, std::size_t width, std::size_t height) override;
+    void update() override;
+    std::size_t getWidth() const override;
+    std::size_t getHeight() const override;
+    bool fitTerminal() override;
+
+private:
+    // the size ncurses reported last, it picks up a new one in getch() and reports KEY_RESIZE
+    std::size_t known_width, known_height;
+};
+
+/**
+ * @brief One cell of a grid, holding a whole grapheme. A wide grapheme is followed by an empty
+ * continuation cell standing for its right half.
+ */
+struct Cell {
+    // graphemes longer than this are shown as U+FFFD, real text never gets close
+    static constexpr std::size_t capacity = 31;
+    char text[capacity] = { ' ' };
+    std::uint8_t size = 1;
+    Style style = Style::Normal;
+
+    Cell() = default;
+    /**
+     * @brief a cell showing one character, control characters are shown as '?'
+     *
+     * @param ch character
+     */
+    explicit Cell(char ch);
+    /**
+     * @brief a cell showing one grapheme
+     *
+     * @param grapheme UTF-8 bytes of the grapheme
+     */
+    explicit Cell(std::string_view grapheme);
+    /**
+     * @brief the right half of a wide grapheme
+     *
+     * @return Cell continuation cell
+     */
+    static Cell continuation();
+    bool isContinuation() const { return size == 0; }
+    std::string_view view() const { return std::string_view(text, size); }
+    bool operator==(const Cell& other) const = default;
+};
+
+/**
+ * @brief Screen kept as a grid of cells in memory. Staging copies the touched rows of a surface
+ * into the grid, nothing is ever output, which makes it the backend for tests and benchmarks.
+ */
+class CellScreen : public Screen {
+public:
+    CellScreen(std::size_t width, std::size_t height);
+    std::unique_ptr<Surface> createSurface(std::size_t x, std::size_t y, std::size_t width, std::size_t height) override;
+    void update() override;
+    std::size_t getWidth() const override;
+    std::size_t getHeight() const override;
+
+    /**
+     * @brief Get one row of the composed grid
+     *
+     * @param row row
+     * @return std::string the UTF-8 text of the row
+     */
+    std::string getRow(std::size_t row) const;
+    /**
+     * @brief Get the cursor position set by the last staged surface
+     *
+     * @return std::pair<std::size_t, std::size_t> row and column
+     */
+    std::pair<std::size_t, std::size_t> getCursor() const;
+    /**
+     * @brief Get how many times update() was called
+     *
+     * @return std::size_t frame count
+     */
+    std::size_t getFrameCount() const;
+
+protected:
+    friend class CellSurface;
+    /**
+     * @brief resize the grid, the content is blanked
+     *
+     * @param width new width
+     * @param height new height
+     */
+    void resizeGrid(std::size_t width, std::size_t height);
+
+    std::size_t width, height;
+    std::vector<Cell> cells;
+    std::size_t cursor_row = 0, cursor_col = 0;
+    std::size_t frame_count = 0;
+};
+
+/**
+ * @brief Screen writing escape sequences straight to a file descriptor. Every update diffs the
+ * composed grid against what the terminal already shows, and emits only the changed cells with
+ * the shortest cursor movements, as one write wrapped in a synchronized update.
+ */
+class AnsiScreen : public CellScreen {
+public:
+    /**
+     * @brief take over a terminal: alternate screen, no echo, unbuffered input, keypad mode
+     *
+     * @param fd terminal file descriptor
+     * @throw std::runtime_error if fd is not a terminal
+     */
+    explicit AnsiScreen(int fd);
+    /**
+     * @brief write frames of a fixed size to any file descriptor, the terminal modes are left alone
+     *
+     * @param fd file descriptor
+     * @param width width
+     * @param height height
+     */
+    AnsiScreen(int fd, std::size_t width, std::size_t height);
+    ~AnsiScreen() override;
+    void update() override;
+    /**
+     * @brief ask the terminal for its size, a new size starts over from a blank screen
+     *
+     * @return true if the size changed, never for a fixed size
+     */
+    bool fitTerminal() override;
+
+    /**
+     * @brief Get the bytes written by the last update()
+     *
+     * @return std::size_t byte count
+     */
+    std::size_t getLastFrameBytes() const;
+    /**
+     * @brief Get the bytes written since construction
+     *
+     * @return std::size_t byte count
+     */
+    std::size_t getTotalBytes() const;
+
+private:
+    /**
+     * @brief append the shortest sequence moving the cursor from where it is to a cell
+     *
+     * @param row row
+     * @param col column
+     */
+    void moveCursor(std::size_t row, std::size_t col);
+    /**
+     * @brief append the sequence switching the terminal to a style, if it is not drawing with it already
+     *
+     * @param style style
+     */
+    void switchStyle(Style style);
+    /**
+     * @brief write the whole output buffer, retrying partial writes
+     *
+     */
+    void flush();
+
+    int fd;
+    bool owns_terminal = false;
+    termios saved_termios {};
+    std::vector<Cell> shown;
+    std::string output;
+    // the terminal cursor, unknown after writing into the last column
+    std::size_t at_row = 0, at_col = 0;
+    bool at_known = false;
+    // the style the terminal draws with
+    Style at_style = Style::Normal;
+    std::size_t last_frame_bytes = 0, total_bytes = 0;
+};
+
+#endif // TANOSHIIEDITOR_SCREEN_H
@@ -0,0 +1,31 @@
+/**
+ * @file Style.hpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Text styles shared by the screen backends and the syntax highlighter
+ */
+
+#ifndef TANOSHIIEDITOR_STYLE_H
+#define TANOSHIIEDITOR_STYLE_H
+
+#include <cstdint>
+
+/**
+ * @brief How cells are drawn
+ */
+enum class Style : std::uint8_t {
+    Normal,
+    // a match of the search query
+    Match,
+    // syntax highlighting
+    Comment,
+    Section,
+    Key,
+    String,
+    Number,
+    Timestamp,
+    Error,
+    Warning,
+};
+
+#endif // TANOSHIIEDITOR_STYLE_H
@@ -0,0 +1,95 @@
+/**
+ * @file TextScan.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Vectorized scanning primitives over raw text
+ */
+
+#ifndef TANOSHIIEDITOR_TEXTSCAN_H
+#define TANOSHIIEDITOR_TEXTSCAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace TextScan {
+/**
+ * @brief bytes per part below which the parallel scans stay on one core, under it a single
+ * core is faster than handing parts to the thread pool
+ */
+constexpr std::size_t parallel_threshold = 16 * 1024 * 1024;
+/**
+ * @brief instruction sets the kernels come in, every call uses the best one the cpu supports
+ * unless asked for another
+ */
+enum class Isa : std::uint8_t {
+    Scalar,
+    Sse2,
+    Avx2,
+    Neon,
+};
+/**
+ * @brief check if the cpu runs a kernel variant
+ *
+ * @param isa instruction set
+ * @return true if it is compiled in and supported
+ */
+bool supports(Isa isa);
+/**
+ * @brief find every newline in text, 32 or 16 bytes at a time depending on the cpu
+ *
+ * @param text text pending scan
+ * @param base value added to every reported offset
+ * @param out newline offsets are appended here in ascending order
+ */
+void findNewlines(std::string_view text, std::size_t base, std::vector<std::size_t>& out);
+/**
+ * @brief find every newline in text, split across the shared thread pool when the text is large
+ *
+ * @param text text pending scan
+ * @return std::vector<std::size_t> newline offsets in ascending order
+ */
+std::vector<std::size_t> findNewlinesParallel(std::string_view text);
+/**
+ * @brief measure the leading run of ASCII bytes, 32 or 16 bytes at a time depending on the cpu
+ *
+ * @param text text pending scan
+ * @return std::size_t length of the run, text.size() if it is all ASCII
+ */
+std::size_t asciiPrefix(std::string_view text);
+/**
+ * @brief find every occurrence of pattern in text, overlapping ones included. Candidates are
+ * the positions where both the first and the last byte of the pattern match, found 32 or 16
+ * positions at a time, and only those are compared in full.
+ *
+ * @param text text pending scan
+ * @param pattern pattern, not empty
+ * @param base value added to every reported offset
+ * @param out match offsets are appended here in ascending order
+ */
+void findAll(std::string_view text, std::string_view pattern, std::size_t base, std::vector<std::size_t>& out);
+/**
+ * @brief find where a row of one byte per column text starting at start ends: after the last
+ * space that fits in width columns, the space going to the next row, or after width columns
+ * when no space fits. Spaces are looked for backwards from the width, 32 or 16 bytes at a time.
+ *
+ * @param text line, one byte per column
+ * @param start row start, a previous break
+ * @param width row width, at least 1
+ * @return std::size_t row end, text.size() once the rest fits
+ */
+std::size_t nextBreak(std::string_view text, std::size_t start, std::size_t width);
+/**
+ * @brief nextBreak() with a given kernel variant, to compare them
+ *
+ * @param text line, one byte per column
+ * @param start row start, a previous break
+ * @param width row width, at least 1
+ * @param isa instruction set, must be supported
+ * @return std::size_t row end, text.size() once the rest fits
+ */
+std::size_t nextBreak(std::string_view text, std::size_t start, std::size_t width, Isa isa);
+}
+
+#endif // TANOSHIIEDITOR_TEXTSCAN_H
@@ -0,0 +1,150 @@
+/**
+ * @file TextSearch.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Incremental search over a piece table with a match index kept up to date on edits
+ */
+
+#ifndef TANOSHIIEDITOR_TEXTSEARCH_H
+#define TANOSHIIEDITOR_TEXTSEARCH_H
+
+#include "PieceTable.h"
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Holds the query and the start offset of every match of it, overlapping ones included.
+ * A new query scans the document with TextScan::findAll, split into line ranges across all cores
+ * when the document is large, or only rechecks the current matches when the query was merely
+ * extended. Edits patch the index: matches around the edit are rescanned and the ones behind it
+ * shifted. Offsets are kept in buckets carrying a pending shift, so an edit costs one pass over
+ * the buckets instead of one over every match.
+ */
+class TextSearch {
+public:
+    /**
+     * @brief find every match of pattern starting in [begin, end)
+     *
+     * @param text document
+     * @param pattern pattern, not empty
+     * @param begin first offset a match may start at
+     * @param end one past the last offset a match may start at, clamped to the document end
+     * @return std::vector<std::size_t> match offsets in ascending order
+     */
+    static std::vector<std::size_t> findAll(const PieceTable& text, std::string_view pattern, std::size_t begin, std::size_t end);
+
+    /**
+     * @brief search for a new query, an empty query clears the index
+     *
+     * @param text document
+     * @param query query
+     * @return std::size_t match count
+     */
+    std::size_t setQuery(const PieceTable& text, std::string_view query);
+    const std::string& getQuery() const;
+    /**
+     * @brief forget the query and its matches
+     *
+     */
+    void clear();
+    /**
+     * @brief search the whole document again, after it was replaced
+     *
+     * @param text document
+     */
+    void refresh(const PieceTable& text);
+    /**
+     * @brief patch the index after bytes were inserted
+     *
+     * @param text document after the insert
+     * @param offset byte offset of the insert
+     * @param length inserted byte count
+     */
+    void onInsert(const PieceTable& text, std::size_t offset, std::size_t length);
+    /**
+     * @brief patch the index after bytes were erased
+     *
+     * @param text document after the erase
+     * @param offset byte offset of the erase
+     * @param length erased byte count
+     */
+    void onErase(const PieceTable& text, std::size_t offset, std::size_t length);
+
+    /**
+     * @brief Get the number of matches
+     *
+     * @return std::size_t match count
+     */
+    std::size_t count() const;
+    /**
+     * @brief Get the number of matches starting before an offset, the ordinal of a match at it
+     *
+     * @param offset byte offset
+     * @return std::size_t match count
+     */
+    std::size_t rank(std::size_t offset) const;
+    /**
+     * @brief find the first match starting at or after an offset, wrapping around to the first match
+     *
+     * @param offset byte offset
+     * @return std::optional<std::size_t> match offset, nothing if there are no matches
+     */
+    std::optional<std::size_t> next(std::size_t offset) const;
+    /**
+     * @brief find the last match starting before an offset, wrapping around to the last match
+     *
+     * @param offset byte offset
+     * @return std::optional<std::size_t> match offset, nothing if there are no matches
+     */
+    std::optional<std::size_t> previous(std::size_t offset) const;
+    /**
+     * @brief visit the matches overlapping [begin, end) in order
+     *
+     * @param begin byte offset
+     * @param end byte offset
+     * @param visitor called with the offset of each match
+     */
+    void forEachIn(std::size_t begin, std::size_t end, const std::function<void(std::size_t)>& visitor) const;
+
+private:
+    struct Bucket {
+        // the offsets are stored + shift, shifting every bucket behind an edit is O(1) each
+        std::vector<std::size_t> offsets;
+        std::ptrdiff_t shift = 0;
+    };
+
+    static constexpr std::size_t bucket_size = 512;
+    // below this many matches, extending the query rechecks them instead of searching again
+    static constexpr std::size_t max_refined = 16384;
+
+    /**
+     * @brief replace the matches starting in [begin, end) with new ones and shift those behind by
+     * delta, the new offsets and begin are after the edit, end is before it
+     */
+    void replaceRange(std::size_t begin, std::size_t end, const std::vector<std::size_t>& found, std::ptrdiff_t delta);
+    /**
+     * @brief rebuild the buckets from sorted offsets
+     */
+    void assign(const std::vector<std::size_t>& offsets);
+    /**
+     * @brief fold the pending shift of a bucket into its offsets
+     */
+    static void settle(Bucket& bucket);
+    /**
+     * @brief find the first match at or after an offset
+     *
+     * @return std::pair<std::size_t, std::size_t> bucket and index in it, buckets.size() if none
+     */
+    std::pair<std::size_t, std::size_t> locate(std::size_t offset) const;
+    static std::size_t offsetOf(const Bucket& bucket, std::size_t index);
+
+    std::string query;
+    std::vector<Bucket> buckets;
+    std::size_t match_count = 0;
+};
+
+#endif // TANOSHIIEDITOR_TEXTSEARCH_H
@@ -0,0 +1,97 @@
+/**
+ * @file ThreadPool.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Work-stealing thread pool for background jobs
+ */
+
+#ifndef TANOSHIIEDITOR_THREADPOOL_H
+#define TANOSHIIEDITOR_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A fixed set of workers, each with its own task queue. A worker runs the newest task of
+ * its own queue first, which is the one whose data is still in cache, and steals the oldest task
+ * of another queue once its own runs dry, so a job split into uneven chunks still keeps every
+ * core busy. Tasks submitted from a worker go to that worker's queue, others are dealt round robin.
+ */
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    /**
+     * @brief start the workers
+     *
+     * @param worker_count number of threads, at least one
+     */
+    explicit ThreadPool(std::size_t worker_count);
+    /**
+     * @brief run the tasks still queued, then stop the workers
+     *
+     */
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    /**
+     * @brief the pool shared by the whole editor, one worker per core
+     *
+     * @return std::shared_ptr<ThreadPool> pool
+     */
+    static std::shared_ptr<ThreadPool> Instance();
+    /**
+     * @brief queue a task, it runs on some worker later. An exception leaving the task is logged
+     * and dropped.
+     *
+     * @param task task
+     */
+    void submit(Task task);
+    /**
+     * @brief run body for every index in [0, count) and wait for all of them. The calling thread
+     * takes indices as well, so it is safe from inside a task even with every worker busy.
+     *
+     * @param count number of indices
+     * @param body called once per index, on the caller or a worker
+     * @throw whatever the first failing body threw, after every index was run
+     */
+    void parallelFor(std::size_t count, const std::function<void(std::size_t)>& body);
+    /**
+     * @brief Get the number of workers
+     *
+     * @return std::size_t worker count
+     */
+    std::size_t getWorkerCount() const;
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(std::size_t index);
+    /**
+     * @brief take the newest task of a worker's own queue, or else steal the oldest of another
+     *
+     * @return true if a task was taken
+     */
+    bool take(std::size_t index, Task& task);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    // queued only changes under idle_mutex when it goes up, so a worker about to sleep never misses a task
+    std::mutex idle_mutex;
+    std::condition_variable wakeup;
+    std::atomic<std::size_t> queued { 0 };
+    std::atomic<std::size_t> next_queue { 0 };
+    bool stopping = false;
+};
+
+#endif // TANOSHIIEDITOR_THREADPOOL_H
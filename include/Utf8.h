@@ -0,0 +1,171 @@
+/**
+ * @file Utf8.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief UTF-8 decoding, validation, grapheme segmentation and display width
+ */
+
+#ifndef TANOSHIIEDITOR_UTF8_H
+#define TANOSHIIEDITOR_UTF8_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Text is kept as UTF-8 bytes everywhere, positions are byte offsets that sit on grapheme
+ * boundaries. Invalid bytes are never rejected when reading, they decode to U+FFFD one byte at
+ * a time so every byte still belongs to exactly one grapheme. Long ASCII runs are skipped with
+ * TextScan::asciiPrefix.
+ */
+namespace Utf8 {
+constexpr char32_t replacement = 0xFFFD;
+
+/**
+ * @brief decode the codepoint starting at pos
+ *
+ * @param text text
+ * @param pos byte offset, must be inside text
+ * @param length receives the byte length of the sequence, 1 for an invalid byte
+ * @return char32_t the codepoint, replacement if the sequence is invalid
+ */
+char32_t decode(std::string_view text, std::size_t pos, std::size_t& length);
+/**
+ * @brief encode a codepoint, invalid ones become the replacement character
+ *
+ * @param codepoint codepoint
+ * @return std::string its UTF-8 bytes
+ */
+std::string encode(char32_t codepoint);
+/**
+ * @brief check if text is well formed UTF-8
+ *
+ * @param text text
+ * @return true if valid
+ */
+bool isValid(std::string_view text);
+/**
+ * @brief copy text with every invalid sequence replaced by U+FFFD
+ *
+ * @param text text
+ * @return std::string valid UTF-8
+ */
+std::string sanitize(std::string_view text);
+/**
+ * @brief find the end of the grapheme starting at pos, combining marks, variation selectors,
+ * emoji modifiers, zero width joiner sequences and flag pairs stay with their base
+ *
+ * @param text text
+ * @param pos byte offset of a grapheme start
+ * @param width receives the display width of the grapheme, 1 or 2
+ * @return std::size_t byte offset of the next grapheme
+ */
+std::size_t nextGrapheme(std::string_view text, std::size_t pos, std::size_t& width);
+/**
+ * @brief find the start of the grapheme ending at pos, looking back only a short distance
+ *
+ * @param text text
+ * @param pos byte offset of a grapheme boundary, not 0
+ * @return std::size_t byte offset of the previous grapheme
+ */
+std::size_t prevGrapheme(std::string_view text, std::size_t pos);
+/**
+ * @brief Get the terminal column count of text
+ *
+ * @param text text without newlines
+ * @return std::size_t display width
+ */
+std::size_t displayWidth(std::string_view text);
+/**
+ * @brief Get the longest prefix that fits in a column count without cutting a grapheme
+ *
+ * @param text text without newlines
+ * @param columns available columns
+ * @return std::size_t prefix length in bytes
+ */
+std::size_t fitWidth(std::string_view text, std::size_t columns);
+}
+
+/**
+ * @brief Grapheme boundaries of one line and the display column each starts at, so byte offset
+ * and column conversions are binary searches instead of rescans. Pure ASCII lines, the common
+ * case, keep no table at all since byte offsets are columns there.
+ */
+class ColumnMap {
+public:
+    ColumnMap() = default;
+    /**
+     * @brief scan a line once
+     *
+     * @param line line content without the newline
+     */
+    explicit ColumnMap(std::string_view line);
+
+    /**
+     * @brief Get the grapheme count
+     *
+     * @return std::size_t grapheme count
+     */
+    std::size_t graphemeCount() const;
+    /**
+     * @brief Get the byte offset a grapheme starts at
+     *
+     * @param grapheme grapheme index, graphemeCount() gives the line length
+     * @return std::size_t byte offset
+     */
+    std::size_t byteOf(std::size_t grapheme) const;
+    /**
+     * @brief Get the column a grapheme starts at
+     *
+     * @param grapheme grapheme index, graphemeCount() gives the line width
+     * @return std::size_t column
+     */
+    std::size_t columnOf(std::size_t grapheme) const;
+    /**
+     * @brief find the grapheme containing a byte
+     *
+     * @param byte byte offset, offsets past the end map past the last grapheme
+     * @return std::size_t grapheme index
+     */
+    std::size_t graphemeAt(std::size_t byte) const;
+    /**
+     * @brief find the last grapheme starting at or before a column
+     *
+     * @param column column
+     * @return std::size_t grapheme index
+     */
+    std::size_t graphemeAtColumn(std::size_t column) const;
+    /**
+     * @brief Get the column of the grapheme containing a byte
+     *
+     * @param byte byte offset
+     * @return std::size_t column
+     */
+    std::size_t columnAtByte(std::size_t byte) const;
+    /**
+     * @brief Get the display width of the whole line
+     *
+     * @return std::size_t width
+     */
+    std::size_t width() const;
+    /**
+     * @brief check if every grapheme is one byte wide and one column wide
+     *
+     * @return true for an ASCII line
+     */
+    bool isAsciiLine() const;
+
+private:
+    struct Table {
+        // one entry per grapheme plus a sentinel for the line end
+        std::vector<std::uint32_t> bytes;
+        std::vector<std::uint32_t> columns;
+    };
+    std::size_t length = 0;
+    std::shared_ptr<const Table> table;
+};
+
+#endif // TANOSHIIEDITOR_UTF8_H
@@ -9,11 +9,53 @@
 #define TANOSHIIEDITOR_WINDOW_H
 #include "Border.hpp"
 #include "Buffer.h"
+#include "BufferView.h"
 #include "Logger.h"
+#include "RegexReplace.h"
+#include "Scheduler.h"
+#include "Screen.h"
+#include <chrono>
+#include <cstdint>
 #include <memory>
 #include <ncurses.h>
-#include <panel.h>
+#include <span>
 #include <string>
+#include <vector>
+
+/**
+ * @brief key codes getch() reports for the bracketed paste markers, see Application::init()
+ */
+constexpr int KEY_PASTE_BEGIN = KEY_MAX + 1;
+constexpr int KEY_PASTE_END = KEY_MAX + 2;
+/**
+ * @brief undo and redo keys, Ctrl-_ and Ctrl-^ since Ctrl-Z and Ctrl-Y suspend the editor in cbreak mode
+ */
+constexpr int KEY_CTRL_UNDO = 0x1f;
+constexpr int KEY_CTRL_REDO = 0x1e;
+/**
+ * @brief search keys: Ctrl-F starts searching or jumps to the next match, Escape stops searching
+ * and keeps the matches highlighted, Ctrl-G stops and clears them
+ */
+constexpr int KEY_CTRL_FIND = 0x06;
+constexpr int KEY_CTRL_CANCEL = 0x07;
+constexpr int KEY_ESCAPE = 0x1b;
+/**
+ * @brief Ctrl-R asks for a regular expression and its replacement, then replaces every match in
+ * the background. Ctrl-G cancels a replace that is still scanning.
+ */
+constexpr int KEY_CTRL_REPLACE = 0x12;
+/**
+ * @brief view keys, taken by the application: Ctrl-T splits the focused view into a second view
+ * of the same buffer, Ctrl-N focuses the next view, Ctrl-W closes the focused view unless it is
+ * the last one
+ */
+constexpr int KEY_CTRL_SPLIT = 0x14;
+constexpr int KEY_CTRL_NEXT_VIEW = 0x0e;
+constexpr int KEY_CTRL_CLOSE_VIEW = 0x17;
+/**
+ * @brief Ctrl-D shows or hides the metrics overlay, taken by the application
+ */
+constexpr int KEY_CTRL_METRICS = 0x04;
 
 /**
  * @brief Base class of all windows, defined some utility functions, all window should explicitly or implicitly inherit this.
@@ -21,11 +63,18 @@
  */
 class BaseWindow {
 public:
-    BaseWindow(const Border& borders, const std::string& name, std::size_t width, std::size_t height, PANEL* associated_panel, std::size_t init_x, std::size_t init_y, std::size_t max_width, std::size_t max_height);
+    BaseWindow(std::shared_ptr<Screen> screen, const Border& borders, const std::string& name, std::size_t width, std::size_t height, std::size_t init_x, std::size_t init_y, std::size_t max_width, std::size_t max_height);
     virtual ~BaseWindow();
 
     void updateBorder(const Border& borders);
     void updateDimension(std::size_t width, std::size_t height);
+    /**
+     * @brief change the bounds the window must stay strictly inside, e.g. for a resized terminal
+     *
+     * @param max_width max width
+     * @param max_height max height
+     */
+    void updateMaxDimension(std::size_t max_width, std::size_t max_height);
     void moveTo(std::size_t x, std::size_t y);
 
     /**
@@ -77,10 +126,40 @@ public:
      */
     std::string getName() const;
     /**
-     * @brief refresh the window
+     * @brief repaint the dirty rows and stage the window for the next Screen::update(), nothing
+     * is sent to the terminal until then
      *
      */
     virtual void refreshWindow();
+    /**
+     * @brief check if anything was marked for repaint since the last refreshWindow()
+     *
+     * @return true if the window has dirty rows or a dirty frame
+     */
+    bool needsRefresh() const;
+    /**
+     * @brief mark window rows [begin, end) for repaint on the next refreshWindow()
+     *
+     * @param begin first row
+     * @param end one past the last row
+     */
+    void markDirty(std::size_t begin, std::size_t end);
+    /**
+     * @brief mark the whole window, border and label included, for repaint
+     *
+     */
+    void markAllDirty();
+    /**
+     * @brief mark the border and label for repaint, the content rows are left alone
+     *
+     */
+    void markFrameDirty();
+    /**
+     * @brief put the window in front of the others, its cursor becomes the terminal cursor once
+     * it is the last one refreshed
+     *
+     */
+    void raiseWindow();
 
     /**
      * @brief handles all the inputs
@@ -88,6 +167,12 @@ public:
      * @param ch the return value of getch() in ncurses
      */
     virtual void inputHandler(chtype ch) = 0;
+    /**
+     * @brief handles a burst of inputs read in one go, by default one inputHandler() call per key
+     *
+     * @param keys the return values of getch() in ncurses, in order
+     */
+    virtual void inputBatch(std::span<const chtype> keys);
 
     /**
      * @brief Get the Logger object
@@ -98,20 +183,14 @@ public:
 
 protected:
     std::shared_ptr<Logger> logger;
-    PANEL* associated_panel;
-    WINDOW* window_ptr;
+    std::shared_ptr<Screen> screen;
+    std::unique_ptr<Surface> surface;
     /**
-     * @brief Get the associated Panel object
+     * @brief Get the surface the window draws on
      *
-     * @return PANEL* associated panel ptr
+     * @return Surface* surface
      */
-    PANEL* getAssociatedPanel() const;
-    /**
-     * @brief Get the window ptr
-     *
-     * @return WINDOW* raw window ptr
-     */
-    WINDOW* getWindowPtr() const;
+    Surface* getSurface() const;
     /**
      * @brief validate window, now is only checking dimension
      *
@@ -144,8 +223,21 @@ protected:
      *
      */
     virtual void makeWindowLabel();
+    /**
+     * @brief paint one dirty row of the window content, the border is painted separately
+     *
+     * @param row window row
+     */
+    virtual void paintRow(std::size_t row);
+    /**
+     * @brief move the window cursor to where the terminal cursor should be shown
+     *
+     */
+    virtual void placeCursor();
 
 private:
+    std::vector<bool> dirty_rows;
+    bool frame_dirty = true;
     std::size_t window_width, window_height, x, y;
     std::size_t max_width, max_height;
     Border window_border;
@@ -154,10 +246,72 @@ private:
 
 class TextEditWindow : public BaseWindow {
 public:
-    TextEditWindow(const Border& borders, const std::string& name, std::size_t width, std::size_t height, PANEL* associated_panel, std::size_t init_x, std::size_t init_y, std::size_t max_width, std::size_t max_height);
+    /**
+     * @param buffer buffer to show, other windows may show it as well, a new empty one if not given
+     */
+    TextEditWindow(std::shared_ptr<Screen> screen, const Border& borders, const std::string& name, std::size_t width, std::size_t height, std::size_t init_x, std::size_t init_y, std::size_t max_width, std::size_t max_height, std::shared_ptr<Buffer> buffer = std::make_shared<Buffer>());
+    /**
+     * @brief call off the status timer, it refers to the window
+     *
+     */
+    ~TextEditWindow() override;
     void inputHandler(chtype ch) override;
+    /**
+     * @brief apply every key of the burst, then rewrap and work out the damage once
+     *
+     * @param keys the return values of getch() in ncurses, in order
+     */
+    void inputBatch(std::span<const chtype> keys) override;
+    /**
+     * @brief open a file in this window, a missing file gives an empty buffer
+     *
+     * @param path file path
+     * @param recover bring back the edits journaled by an earlier session and journal this one
+     */
+    void openFile(const std::string& path, bool recover = true);
+    /**
+     * @brief finish loading the buffer if its background indexing is done, and replay the
+     * input received meanwhile
+     *
+     * @return true if the buffer is fully loaded
+     */
+    bool finishLoading();
+    /**
+     * @brief apply a replace-all whose scan finished, as one edit, or keep its progress in the
+     * label current while it is still scanning
+     *
+     * @return true if a scan is still running
+     */
+    bool pollReplace();
+    /**
+     * @brief take in syntax highlighting finished in the background and queue the lines on
+     * screen first, the changed lines reach every view as damage
+     *
+     * @return true if lines are still waiting to be highlighted
+     */
+    bool pollHighlight();
+    /**
+     * @brief catch up with edits made through other windows on the buffer: follow the cursor
+     * through them, rewrap the touched lines and repaint the rows they cover on screen
+     *
+     */
+    void syncView();
+    /**
+     * @brief Get the buffer the window shows, to open another window on it
+     *
+     * @return std::shared_ptr<Buffer> buffer
+     */
+    std::shared_ptr<Buffer> getBuffer() const;
 
 protected:
+    void paintRow(std::size_t row) override;
+    void placeCursor() override;
+    /**
+     * @brief show the replace prompt or progress, or else the search query and the match counter
+     * while there is a query
+     *
+     */
+    void makeWindowLabel() override;
     /**
      * @brief Convert the unwrapped column to wrapped column
      *
@@ -174,27 +328,159 @@ protected:
 
 private:
     /**
-     * @brief update the display content of the text editing window
+     * @brief apply one key to the buffer and cursor, without rewrapping or marking damage
+     *
+     * @param ch the return value of getch() in ncurses
+     */
+    void applyKey(chtype ch);
+    /**
+     * @brief collect one key of a bracketed paste, the paste is inserted in one edit once it ends
+     *
+     * @param ch the return value of getch() in ncurses
+     */
+    void collectPaste(chtype ch);
+    /**
+     * @brief take one byte of typed text, a character is inserted once its UTF-8 sequence is complete
+     *
+     * @param ch the return value of getch() in ncurses
+     */
+    void insertInputByte(chtype ch);
+    /**
+     * @brief apply one key while the search query is being typed
+     *
+     * @param ch the return value of getch() in ncurses
+     * @return true if the key was taken, false if it ended the search and is left for applyKey()
+     */
+    bool searchKey(chtype ch);
+    /**
+     * @brief search for the query typed so far and move the cursor to the first match after where
+     * the search started, or back there if nothing matches
+     *
+     */
+    void updateSearch();
+    /**
+     * @brief apply one key while the replace prompt is open, keys other than text, enter,
+     * backspace and cancel are ignored
+     *
+     * @param ch the return value of getch() in ncurses
+     */
+    void replaceKey(chtype ch);
+    /**
+     * @brief start scanning for the typed pattern on a snapshot of the buffer
+     *
+     */
+    void startReplace();
+    /**
+     * @brief show the outcome of a replace in the label until the next key or status_timeout
+     *
+     * @param status status text
+     */
+    void showStatus(std::string status);
+    /**
+     * @brief mark every visual row from top_line to the bottom of the window for repaint
      *
      */
     void updateDisplay();
-
     /**
-     * @brief erase only the text portion of the window
+     * @brief mark visual rows [first, last) for repaint, rows outside the viewport are ignored
+     *
+     * @param first first visual row
+     * @param last one past the last visual row
+     */
+    void markRowsDirty(std::size_t first, std::size_t last);
+    /**
+     * @brief mark the rows of the lines the view reports as edited for repaint
+     *
+     */
+    void markDamage();
+    /**
+     * @brief let the view follow the cursor through edits made elsewhere
      *
      */
-    void eraseTextContent();
+    void saveCursor();
     /**
-     * @param cursor_col which column the cursor is on, for unwrapped line
+     * @brief scroll just enough to keep the cursor inside the viewport, and have a paged file
+     * load the chunks further along the way it scrolled
+     *
+     */
+    void followCursor();
+    /**
+     * @brief rewrap the lines edited since the last look and, at a new width, the lines on
+     * screen. The rest is wrapped in the background, the line at the top stays at the top.
+     *
+     */
+    void wrapView();
+    /**
+     * @brief Get the number of visual rows the window can show
+     *
+     * @return std::size_t text area height
+     */
+    std::size_t textHeight() const;
+
+    /**
+     * @param cursor_col byte offset of the cursor in its unwrapped line, always on a grapheme boundary
      * @param cursor_line which line the cursor is on, for unwrapped line
      * @param top_line which line is the line at the top
      */
-    std::size_t cursor_col, cursor_line, top_line;
-    Buffer buffer;
+    std::size_t cursor_col = 0, cursor_line = 0, top_line = 0;
+    std::size_t damage_row_count = 0;
+    static constexpr int max_follow_rounds = 3;
+    std::shared_ptr<Buffer> buffer;
+    // this window's wrapped rows of the buffer
+    BufferView view;
+    std::vector<chtype> pending_input;
+    bool in_paste = false;
+    bool paste_after_cr = false;
+    std::string paste_text;
+    std::string input_sequence;
+    bool searching = false;
+    std::string search_query;
+    std::size_t search_origin_line = 0, search_origin_col = 0;
+    // match count the label shows, the label is redrawn when it changes
+    std::size_t shown_match_count = 0;
+    enum class ReplacePrompt : std::uint8_t {
+        None,
+        Pattern,
+        Replacement,
+    };
+    ReplacePrompt replace_prompt = ReplacePrompt::None;
+    std::string replace_pattern;
+    std::string replace_text;
+    static constexpr std::chrono::seconds status_timeout { 3 };
+    // outcome of the last replace, shown in the label until the next key or the timer
+    std::string replace_status;
+    CancellationToken status_timer;
+    std::unique_ptr<RegexReplace> replace_job;
+    // buffer revision the job scanned, its offsets are void once the buffer moved on
+    std::uint64_t replace_revision = 0;
 
     void scrollDown();
 
     void scrollUp();
 };
 
+/**
+ * @brief Overlay showing the latency percentiles and the counters of Metrics. It takes no input,
+ * and the terminal cursor stays with the window below.
+ */
+class MetricsWindow : public BaseWindow {
+public:
+    static constexpr std::size_t overlay_width = 41;
+    static constexpr std::size_t overlay_height = 15;
+
+    MetricsWindow(std::shared_ptr<Screen> screen, const Border& borders, std::size_t init_x, std::size_t init_y, std::size_t max_width, std::size_t max_height);
+    void inputHandler(chtype ch) override;
+    /**
+     * @brief read the metrics again, only the rows whose text changed are repainted
+     *
+     */
+    void sample();
+
+protected:
+    void paintRow(std::size_t row) override;
+
+private:
+    std::vector<std::string> lines;
+};
+
 #endif // TANOSHIIEDITOR_WINDOW_H
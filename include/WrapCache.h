@@ -0,0 +1,297 @@
+/**
+ * @file WrapCache.h
+ * @author ayano
+ * @date 17/10/26
+ * @brief Per-line soft wrap cache with a logical line to visual row index
+ */
+
+#ifndef TANOSHIIEDITOR_WRAPCACHE_H
+#define TANOSHIIEDITOR_WRAPCACHE_H
+
+#include "FenwickTree.hpp"
+#include "Utf8.h"
+#include <cstddef>
+#include <functional>
+#include <span>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Keeps the wrapped rows of every logical line. Edits only mark the touched lines dirty,
+ * and update() rewraps just those.
+ *
+ * Lines are kept in chunks of a few hundred, and two Fenwick trees index the chunks: one sums
+ * their line counts and one sums their visual rows. An edit splices the lines of one chunk and
+ * patches both trees, so adding or removing lines costs the same in any file size. Visual row
+ * lookups find the chunk in O(log n) and the line inside it by a binary search over the row
+ * starts of the chunk, which are worked out again only after the chunk changed.
+ *
+ * Rows are not copied out of the text, each is a byte range of its line. The ranges of all lines
+ * share one contiguous pool: a rewrapped line overwrites its old ranges when they still fit and
+ * goes to the end of the pool otherwise, and the pool is compacted once half of it is stale. A
+ * rewrap allocates nothing once the pool has grown to size.
+ *
+ * Lines may also be pending: not wrapped at the current width yet, counted in the row index with
+ * an estimated row count. A new width or a batch of more than lazy_line_count new lines leaves
+ * them pending, so the caller can wrap the lines it shows first and the rest later, or elsewhere
+ * and install() the result.
+ */
+class WrapCache {
+public:
+    static constexpr std::size_t lazy_line_count = 16384;
+
+    /**
+     * @brief one visual row, a byte range of its logical line. The rows of a line cover it back
+     * to back.
+     */
+    struct RowSpan {
+        std::size_t offset;
+        std::size_t length;
+    };
+    /**
+     * @brief wraps one line: appends its rows to the given pool, at least one, and returns the
+     * column map built on the way, kept for cursor mapping
+     */
+    using WrapFunction = std::function<ColumnMap(std::size_t line, std::size_t width, std::vector<RowSpan>& rows)>;
+
+    /**
+     * @brief drop everything, every line is pending with an estimate of one row
+     *
+     * @param line_count logical line count
+     * @param width wrap width
+     */
+    void reset(std::size_t line_count, std::size_t width);
+    /**
+     * @brief change the width, every line turns pending. The estimates scale the row counts at the
+     * old width, so the row index stays close until the lines are wrapped again.
+     *
+     * @param width new wrap width
+     */
+    void rescale(std::size_t width);
+    /**
+     * @brief replace old_count lines starting at first with new_count dirty lines, or pending
+     * ones when there are more than lazy_line_count of them
+     *
+     * @param first first touched line
+     * @param old_count how many lines the edit touched before
+     * @param new_count how many lines they became
+     */
+    void replaceLines(std::size_t first, std::size_t old_count, std::size_t new_count);
+    /**
+     * @brief rewrap dirty lines and bring the row index up to date, pending lines stay pending
+     *
+     * @param wrap function producing the wrapped rows of a line
+     */
+    void update(const WrapFunction& wrap);
+    /**
+     * @brief update(), then wrap every pending line as well
+     *
+     * @param wrap function producing the wrapped rows of a line
+     */
+    void finish(const WrapFunction& wrap);
+    /**
+     * @brief wrap one line now if it is pending, only after update()
+     *
+     * @param line logical line
+     * @param wrap function producing the wrapped rows of a line
+     */
+    void wrapLine(std::size_t line, const WrapFunction& wrap);
+    /**
+     * @brief hand a pending line rows wrapped elsewhere at the current width, e.g. by a background
+     * job on a snapshot of the text
+     *
+     * @param line logical line, must be pending
+     * @param line_rows its rows
+     * @param columns its column map
+     */
+    void install(std::size_t line, std::span<const RowSpan> line_rows, ColumnMap columns);
+
+    /**
+     * @brief Get the wrap width
+     *
+     * @return std::size_t wrap width
+     */
+    std::size_t getWidth() const;
+    /**
+     * @brief check if there are lines pending rewrap
+     *
+     * @return true if update() has work to do
+     */
+    bool isDirty() const;
+    /**
+     * @brief check if a line is pending, without an edit waiting for update() on it
+     *
+     * @param line logical line
+     * @return true if the line has no rows at the current width yet
+     */
+    bool isPending(std::size_t line) const;
+    /**
+     * @brief Get the pending line count, dirty lines included until update()
+     *
+     * @return std::size_t line count
+     */
+    std::size_t getPendingCount() const;
+    /**
+     * @brief split the lines into blocks of chunk_lines and trim each to its pending lines
+     *
+     * @param chunk_lines block size in lines
+     * @return std::vector<std::pair<std::size_t, std::size_t>> line ranges [first, last) with
+     * pending lines at both ends, blocks without pending lines are left out
+     */
+    std::vector<std::pair<std::size_t, std::size_t>> getPendingRanges(std::size_t chunk_lines) const;
+    /**
+     * @brief Get the total visual row count
+     *
+     * @return std::size_t row count
+     */
+    std::size_t getRowCount() const;
+    /**
+     * @brief Get the first visual row of a logical line
+     *
+     * @param line logical line
+     * @return std::size_t visual row
+     */
+    std::size_t getRowOf(std::size_t line) const;
+    /**
+     * @brief find the logical line a visual row belongs to
+     *
+     * @param row visual row
+     * @return std::pair<std::size_t, std::size_t> logical line and the row index inside that line
+     */
+    std::pair<std::size_t, std::size_t> locateRow(std::size_t row) const;
+    /**
+     * @brief Get the wrapped rows of a logical line
+     *
+     * @param line logical line
+     * @return std::span<const RowSpan> rows, valid until the next update(), none while pending
+     */
+    std::span<const RowSpan> getRows(std::size_t line) const;
+    /**
+     * @brief Get the column map of a logical line, as of its last rewrap
+     *
+     * @param line logical line
+     * @return const ColumnMap& column map
+     */
+    const ColumnMap& getColumns(std::size_t line) const;
+
+private:
+    struct WrappedLine {
+        // where the rows start in the pool, none while pending
+        std::size_t first = 0;
+        std::size_t count = 0;
+        // the row count the index holds while pending
+        std::size_t estimate = 1;
+        bool dirty = false;
+        ColumnMap columns;
+
+        std::size_t shownRows() const { return count != 0 ? count : estimate; }
+    };
+
+    /**
+     * @brief a run of consecutive lines
+     */
+    struct Chunk {
+        std::vector<WrappedLine> lines;
+        // shown rows of its lines, what the row index holds for it
+        std::size_t rows = 0;
+        // first row of each line counted from the chunk's first row, worked out on demand
+        mutable std::vector<std::size_t> row_starts;
+        mutable bool starts_stale = true;
+    };
+
+    // lines a chunk is cut to, it is split at twice that and merged into a neighbour below a quarter
+    static constexpr std::size_t chunk_line_count = 256;
+
+    /**
+     * @brief find the chunk holding a line
+     *
+     * @param line logical line, below the line count
+     * @return std::pair<std::size_t, std::size_t> chunk index and the line's index inside it
+     */
+    std::pair<std::size_t, std::size_t> locate(std::size_t line) const;
+    const WrappedLine& lineAt(std::size_t line) const;
+    /**
+     * @brief Get the row starts of a chunk, working them out again if it changed
+     *
+     * @param chunk chunk index
+     * @return const std::vector<std::size_t>& first row of each line counted from the chunk's first row
+     */
+    const std::vector<std::size_t>& rowStarts(std::size_t chunk) const;
+    /**
+     * @brief change the shown rows of a chunk, in the chunk and in the row index, after one of its
+     * lines changed
+     *
+     * @param chunk chunk index
+     * @param delta row count difference, wrapping around for a decrease
+     */
+    void addRows(std::size_t chunk, std::size_t delta);
+    /**
+     * @brief call a function on each line of a range in order, crossing chunks
+     *
+     * @param first first line
+     * @param last one past the last line
+     * @param visit called with the line number and the line
+     */
+    template <typename Visit>
+    void forEachLine(std::size_t first, std::size_t last, Visit visit);
+    /**
+     * @brief remove lines, chunks left empty or small are dropped or merged
+     *
+     * @param first first line
+     * @param count line count
+     */
+    void eraseLines(std::size_t first, std::size_t count);
+    /**
+     * @brief insert pending lines estimated at one row each, a chunk grown too long is split
+     *
+     * @param first where the first new line goes
+     * @param count line count
+     */
+    void insertLines(std::size_t first, std::size_t count);
+    /**
+     * @brief cut a chunk into chunks of chunk_line_count lines
+     *
+     * @param chunk chunk index
+     */
+    void splitChunk(std::size_t chunk);
+    /**
+     * @brief rewrap one line into the pool, the caller brings the row index up to date
+     *
+     * @param line logical line
+     * @param wrapped its entry
+     * @param wrap wrap function
+     */
+    void rewrap(std::size_t line, WrappedLine& wrapped, const WrapFunction& wrap);
+    /**
+     * @brief move the rows of every line back to back in line order, dropping the stale ones
+     *
+     */
+    void compact();
+    /**
+     * @brief count the shown rows of every chunk again, then build the row index from scratch
+     *
+     */
+    void recountRows();
+    /**
+     * @brief build both chunk indexes from the line and row counts of the chunks, in O(chunks)
+     *
+     */
+    void rebuildIndex();
+
+    std::vector<Chunk> chunks;
+    std::size_t line_count = 0;
+    std::vector<RowSpan> rows;
+    // pool entries no line refers to anymore
+    std::size_t stale_rows = 0;
+    // the pool being compacted into, kept to reuse its storage
+    std::vector<RowSpan> spare_rows;
+    std::vector<std::size_t> dirty_lines;
+    // lines without rows, count == 0
+    std::size_t pending_count = 0;
+    // line counts and row counts of the chunks
+    FenwickTree<std::size_t> line_index;
+    FenwickTree<std::size_t> row_index;
+    std::size_t width = 0;
+};
+
+#endif // TANOSHIIEDITOR_WRAPCACHE_H
@@ -0,0 +1,240 @@
+/**
+ * @file AnsiScreen.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Implementation of the direct ANSI screen backend
+ */
+
+#include "Screen.h"
+#include <algorithm>
+#include <cerrno>
+#include <fmt/core.h>
+#include <stdexcept>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace {
+// an unchanged run this short costs less to rewrite than to jump over
+constexpr std::size_t max_rewritten_gap = 4;
+
+constexpr std::string_view begin_sync = "\x1b[?2026h";
+constexpr std::string_view end_sync = "\x1b[?2026l";
+
+/**
+ * @brief SGR sequence selecting a style, each one resets whatever was set before
+ */
+std::string_view sgrOf(Style style)
+{
+    switch (style) {
+    case Style::Match:
+        return "\x1b[0;7m";
+    case Style::Comment:
+        return "\x1b[0;2m";
+    case Style::Section:
+        return "\x1b[0;1;35m";
+    case Style::Key:
+        return "\x1b[0;34m";
+    case Style::String:
+        return "\x1b[0;32m";
+    case Style::Number:
+        return "\x1b[0;33m";
+    case Style::Timestamp:
+        return "\x1b[0;36m";
+    case Style::Error:
+        return "\x1b[0;1;31m";
+    case Style::Warning:
+        return "\x1b[0;1;33m";
+    case Style::Normal:
+    default:
+        return "\x1b[m";
+    }
+}
+
+/**
+ * @brief relative move by n cells, the count is left out when it is 1
+ */
+std::string relativeMove(std::size_t n, char direction)
+{
+    return n == 1 ? fmt::format("\x1b[{}", direction) : fmt::format("\x1b[{}{}", n, direction);
+}
+}
+
+AnsiScreen::AnsiScreen(int fd)
+    : CellScreen(1, 1)
+    , fd(fd)
+{
+    winsize size {};
+    if (!isatty(fd) || ioctl(fd, TIOCGWINSZ, &size) != 0)
+        throw std::runtime_error(fmt::format("AnsiScreen: fd {} is not a terminal", fd));
+    resizeGrid(size.ws_col, size.ws_row);
+    shown = cells;
+    tcgetattr(fd, &saved_termios);
+    termios raw = saved_termios;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSADRAIN, &raw);
+    owns_terminal = true;
+    // alternate screen, application cursor keys and keypad, then a blank screen matching shown
+    output = "\x1b[?1049h\x1b[?1h\x1b=\x1b[H\x1b[2J";
+    flush();
+    at_known = true;
+}
+
+AnsiScreen::AnsiScreen(int fd, std::size_t width, std::size_t height)
+    : CellScreen(width, height)
+    , fd(fd)
+{
+    shown = cells;
+}
+
+AnsiScreen::~AnsiScreen()
+{
+    if (!owns_terminal)
+        return;
+    output = "\x1b[?1l\x1b>\x1b[?1049l";
+    flush();
+    tcsetattr(fd, TCSADRAIN, &saved_termios);
+}
+
+bool AnsiScreen::fitTerminal()
+{
+    winsize size {};
+    if (!owns_terminal || ioctl(fd, TIOCGWINSZ, &size) != 0 || (size.ws_col == width && size.ws_row == height))
+        return false;
+    resizeGrid(size.ws_col, size.ws_row);
+    shown = cells;
+    // the terminal cut or reflowed what it showed, nothing of it can be diffed against
+    output = "\x1b[H\x1b[2J";
+    flush();
+    at_row = at_col = 0;
+    at_known = true;
+    return true;
+}
+
+void AnsiScreen::update()
+{
+    CellScreen::update();
+    output.clear();
+    output += begin_sync;
+    for (std::size_t row = 0; row < height; row++) {
+        const Cell* now = cells.data() + row * width;
+        const Cell* was = shown.data() + row * width;
+        std::size_t col = 0;
+        while (col < width) {
+            if (now[col] == was[col]) {
+                col++;
+                continue;
+            }
+            std::size_t end = col + 1;
+            for (std::size_t probe = end; probe < width && probe - end <= max_rewritten_gap; probe++) {
+                if (now[probe] != was[probe])
+                    end = probe + 1;
+            }
+            // a wide grapheme is written whole, from its left half
+            if (col != 0 && now[col].isContinuation())
+                col--;
+            if (end < width && now[end].isContinuation())
+                end++;
+            moveCursor(row, col);
+            // the wide grapheme before a right half already moved the cursor over it
+            for (std::size_t i = col; i < end; i++) {
+                if (now[i].isContinuation() && i != col)
+                    continue;
+                switchStyle(now[i].style);
+                if (!now[i].isContinuation())
+                    output += now[i].view();
+                else
+                    output += ' ';
+            }
+            at_col = end;
+            // the cursor now waits for a wrap at the last column, where it ends up depends on the terminal
+            if (end == width)
+                at_known = false;
+            col = end;
+        }
+    }
+    // the cursor is drawn over cells, and the next frame expects plain output
+    switchStyle(Style::Normal);
+    bool changed = output.size() != begin_sync.size();
+    if (!changed && at_known && at_row == cursor_row && at_col == cursor_col) {
+        last_frame_bytes = 0;
+        return;
+    }
+    moveCursor(cursor_row, cursor_col);
+    output += end_sync;
+    flush();
+    if (changed)
+        shown = cells;
+}
+
+void AnsiScreen::moveCursor(std::size_t row, std::size_t col)
+{
+    if (at_known && at_row == row && at_col == col)
+        return;
+    std::string best;
+    if (col == 0)
+        best = row == 0 ? "\x1b[H" : fmt::format("\x1b[{}H", row + 1);
+    else
+        best = fmt::format("\x1b[{};{}H", row + 1, col + 1);
+    auto consider = [&best](std::string candidate) {
+        if (candidate.size() < best.size())
+            best = std::move(candidate);
+    };
+    if (at_known) {
+        std::string horizontal;
+        if (col == 0 && at_col != 0)
+            horizontal = "\r";
+        else if (col < at_col)
+            horizontal = std::min(relativeMove(at_col - col, 'D'), fmt::format("\x1b[{}G", col + 1), [](auto& a, auto& b) { return a.size() < b.size(); });
+        else if (col > at_col)
+            horizontal = std::min(relativeMove(col - at_col, 'C'), fmt::format("\x1b[{}G", col + 1), [](auto& a, auto& b) { return a.size() < b.size(); });
+        if (row == at_row) {
+            consider(horizontal);
+        } else if (row > at_row && col == 0) {
+            consider("\r" + std::string(row - at_row, '\n'));
+            consider(horizontal + relativeMove(row - at_row, 'B'));
+        } else {
+            consider(horizontal + relativeMove(row > at_row ? row - at_row : at_row - row, row > at_row ? 'B' : 'A'));
+        }
+    }
+    output += best;
+    at_row = row;
+    at_col = col;
+    at_known = true;
+}
+
+void AnsiScreen::switchStyle(Style style)
+{
+    if (style == at_style)
+        return;
+    output += sgrOf(style);
+    at_style = style;
+}
+
+void AnsiScreen::flush()
+{
+    std::size_t written = 0;
+    while (written < output.size()) {
+        ssize_t n = write(fd, output.data() + written, output.size() - written);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        written += n;
+    }
+    last_frame_bytes = written;
+    total_bytes += written;
+    output.clear();
+}
+
+std::size_t AnsiScreen::getLastFrameBytes() const
+{
+    return last_frame_bytes;
+}
+
+std::size_t AnsiScreen::getTotalBytes() const
+{
+    return total_bytes;
+}
@@ -6,10 +6,34 @@
  */
 
 #include "Application.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cerrno>
+#include <clocale>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <functional>
 #include <ncurses.h>
+#include <poll.h>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <unistd.h>
 
 
+Application::Application(std::string file_path)
+    : file_path(std::move(file_path))
+{
+}
+
+Application::Application(std::string file_path, std::shared_ptr<Screen> screen)
+    : file_path(std::move(file_path))
+    , screen(std::move(screen))
+{
+    openWindows(false);
+}
+
 void Application::run()
 {
     init();
@@ -31,30 +55,331 @@ void Application::notify()
     }
 }
 
+void Application::feedInput(std::span<const chtype> keys)
+{
+    input.assign(keys.begin(), keys.end());
+    dispatchInput();
+    notify();
+    refreshWindows();
+    screen->update();
+}
+
+bool Application::pollBackground()
+{
+    scheduler->runPending();
+    notify();
+    return idle_timeout.count() < 0;
+}
+
+std::shared_ptr<Buffer> Application::getBuffer() const
+{
+    return windows.front()->getBuffer();
+}
+
 void Application::init()
 {
-    initscr();
+    // take the encoding from the environment, otherwise curses treats UTF-8 as single bytes
+    std::setlocale(LC_ALL, "");
+    if (const char* backend = std::getenv("TANOSHII_SCREEN"); backend != nullptr && std::string_view(backend) == "ansi") {
+        // ncurses only decodes the keys, frames are written by AnsiScreen
+        null_output = std::fopen("/dev/null", "w");
+        newterm(nullptr, null_output, stdin);
+        screen = std::make_shared<AnsiScreen>(STDOUT_FILENO);
+    } else {
+        initscr();
+        screen = std::make_shared<NcursesScreen>();
+    }
     cbreak();
     noecho();
     keypad(stdscr, TRUE);
-    width = COLS / 3;
-    height = LINES / 3;
-    init_x = 0;
-    init_y = 0;
-    w = std::make_shared<TextEditWindow>(DEFAULT_BORDER, "test", width, height, nullptr, init_x, init_y, COLS, LINES);
-    w->refreshWindow();
-    refresh();
+    // Escape ends a search, waiting the default second to rule out an escape sequence feels stuck
+    set_escdelay(25);
+    // keep the eighth bit of input bytes, typed UTF-8 arrives byte by byte and is put together by the window
+    meta(stdscr, TRUE);
+    // input is drained in bursts after poll() says there is some, getch() must never block
+    nodelay(stdscr, TRUE);
+    // ask the terminal to bracket pastes, so they arrive as one insert instead of keystrokes
+    define_key("\x1b[200~", KEY_PASTE_BEGIN);
+    define_key("\x1b[201~", KEY_PASTE_END);
+    std::fputs("\x1b[?2004h", stdout);
+    std::fflush(stdout);
+    openWindows(true);
+    // JSON lines for offline analysis, a file that cannot be opened only costs the export
+    if (const char* path = std::getenv("TANOSHII_METRICS_FILE"); path != nullptr && *path != '\0') {
+        metrics_output = std::fopen(path, "a");
+        if (metrics_output != nullptr)
+            metrics_export_timer = scheduler->runAfter(metrics_export_interval, [this] { exportMetrics(); });
+        else
+            Logger::Instance()->error("cannot open {}: {}", path, std::strerror(errno));
+    }
+    // the keys of the session, a trace that cannot be written only costs the recording
+    if (const char* path = std::getenv("TANOSHII_RECORD"); path != nullptr && *path != '\0') {
+        try {
+            key_trace = std::make_unique<KeyTraceWriter>(path, screen->getWidth(), screen->getHeight());
+            trace_flush_timer = scheduler->runAfter(trace_flush_interval, [this] { flushTrace(); });
+        } catch (const std::runtime_error& error) {
+            Logger::Instance()->error(std::string(error.what()));
+        }
+    }
+    refreshWindows();
+    screen->update();
+    last_frame = std::chrono::steady_clock::now();
+}
+
+void Application::openWindows(bool recover)
+{
+    // windows must stay strictly inside the screen
+    windows.push_back(std::make_shared<TextEditWindow>(screen, DEFAULT_BORDER, "test", screen->getWidth() - 1, screen->getHeight() - 1, 0, 0, screen->getWidth(), screen->getHeight()));
+    if (!file_path.empty()) {
+        // memory a file may keep resident in MiB, bigger files are paged
+        if (const char* budget = std::getenv("TANOSHII_MEMORY_BUDGET"); budget != nullptr && std::atol(budget) > 0)
+            windows.front()->getBuffer()->setMemoryBudget(std::size_t(std::atol(budget)) * 1024 * 1024);
+        windows.front()->openFile(file_path, recover);
+        idle_timeout = background_poll_interval;
+    }
+    // scans and highlighting wake the loop through the scheduler as their jobs finish, only
+    // the indexing of a file being loaded still has to be polled
+    connect([this] {
+        bool loaded = true;
+        for (auto& window : windows) {
+            loaded = window->finishLoading() && loaded;
+            window->pollReplace();
+            window->pollHighlight();
+        }
+        // edits through one window only repaint the rows they touched in the others
+        for (auto& window : windows)
+            window->syncView();
+        idle_timeout = loaded ? std::chrono::milliseconds(-1) : background_poll_interval;
+    });
 }
 
 void Application::loop()
 {
-    auto ch = getch();
-    w->inputHandler(ch);
-    refresh();
-    notify();
+    waitForInput();
+    ScopedTimer timer(Metrics::Timer::Loop);
+    drainInput();
+    // ncurses picks up a new size in getch() and reports KEY_RESIZE, the ANSI screen asks the
+    // terminal, so either way a resize is seen before the keys typed after it
+    if (screen->fitTerminal())
+        resizeScreen();
+    // completions and timers first, the input then sees what they did
+    bool woken = scheduler->runPending();
+    if (!input.empty())
+        dispatchInput();
+    // an idle loop has nothing for the observers
+    if (!input.empty() || woken || idle_timeout.count() >= 0)
+        notify();
+    frame_pending = frame_pending || !input.empty() || std::any_of(windows.begin(), windows.end(), [](const auto& window) { return window->needsRefresh(); })
+        || (metrics_window && metrics_window->needsRefresh());
+    auto now = std::chrono::steady_clock::now();
+    if (frame_pending && now - last_frame >= frame_interval) {
+        // windows only stage their changes, this is the single terminal update of the frame
+        refreshWindows();
+        {
+            ScopedTimer flush(Metrics::Timer::Flush);
+            screen->update();
+        }
+        auto metrics = Metrics::Instance();
+        metrics->add(Metrics::Counter::Frames);
+        if (unpainted_input) {
+            metrics->record(Metrics::Timer::KeyToPaint, std::chrono::steady_clock::now() - *unpainted_input);
+            unpainted_input.reset();
+        }
+        last_frame = now;
+        frame_pending = false;
+    }
+}
+
+void Application::waitForInput()
+{
+    auto now = std::chrono::steady_clock::now();
+    auto wait = idle_timeout;
+    auto wakeBy = [&](std::chrono::steady_clock::time_point deadline) {
+        auto until = std::max(std::chrono::ceil<std::chrono::milliseconds>(deadline - now), std::chrono::milliseconds(0));
+        wait = wait.count() < 0 ? until : std::min(wait, until);
+    };
+    // a frame is held back by the rate cap, wake up in time to draw it
+    if (frame_pending)
+        wakeBy(last_frame + frame_interval);
+    if (auto deadline = scheduler->getNextDeadline())
+        wakeBy(*deadline);
+    // the scheduler's eventfd turns readable when a background job finishes
+    pollfd fds[] = { { STDIN_FILENO, POLLIN, 0 }, { scheduler->getWakeFd(), POLLIN, 0 } };
+    // EINTR is fine, SIGWINCH lands here and getch() then reports KEY_RESIZE
+    poll(fds, 2, static_cast<int>(wait.count()));
+}
+
+void Application::drainInput()
+{
+    input.clear();
+    // cap the burst so a huge paste still shows progress between frames
+    while (input.size() < max_input_batch) {
+        auto ch = getch();
+        if (ch == ERR)
+            break;
+        input.push_back(ch);
+    }
+    if (key_trace && !input.empty())
+        key_trace->record(input);
+    if (!input.empty() && !unpainted_input)
+        unpainted_input = std::chrono::steady_clock::now();
+}
+
+void Application::dispatchInput()
+{
+    std::size_t begin = 0;
+    for (std::size_t i = 0; i < input.size(); i++) {
+        if (input[i] != KEY_CTRL_SPLIT && input[i] != KEY_CTRL_NEXT_VIEW && input[i] != KEY_CTRL_CLOSE_VIEW && input[i] != KEY_CTRL_METRICS && input[i] != KEY_RESIZE)
+            continue;
+        // the keys before go to the window that was focused when they were typed
+        if (i > begin)
+            windows[focused]->inputBatch(std::span<const chtype>(input).subspan(begin, i - begin));
+        begin = i + 1;
+        if (input[i] == KEY_CTRL_SPLIT)
+            splitWindow();
+        else if (input[i] == KEY_CTRL_NEXT_VIEW)
+            focusWindow((focused + 1) % windows.size());
+        else if (input[i] == KEY_CTRL_METRICS)
+            toggleMetrics();
+        else if (input[i] == KEY_CTRL_CLOSE_VIEW)
+            closeWindow();
+        // KEY_RESIZE was handled by the loop already
+    }
+    if (begin < input.size())
+        windows[focused]->inputBatch(std::span<const chtype>(input).subspan(begin));
+}
+
+void Application::splitWindow()
+{
+    // every window keeps its border and a few columns of text
+    constexpr std::size_t min_window_width = 8;
+    if ((screen->getWidth() - 1) / (windows.size() + 1) < min_window_width)
+        return;
+    const auto& current = windows[focused];
+    auto window = std::make_shared<TextEditWindow>(screen, DEFAULT_BORDER, current->getName(), current->getWidth(), current->getHeight(), current->getX(), current->getY(), screen->getWidth(), screen->getHeight(), current->getBuffer());
+    windows.insert(windows.begin() + focused + 1, std::move(window));
+    layoutWindows();
+    focusWindow(focused + 1);
+}
+
+void Application::closeWindow()
+{
+    if (windows.size() == 1)
+        return;
+    windows.erase(windows.begin() + focused);
+    layoutWindows();
+    focusWindow(focused % windows.size());
+}
+
+void Application::layoutWindows()
+{
+    std::size_t total = screen->getWidth() - 1;
+    std::size_t x = 0;
+    for (std::size_t i = 0; i < windows.size(); i++) {
+        // the last window takes what the division leaves over
+        std::size_t width = i + 1 == windows.size() ? total - x : total / windows.size();
+        windows[i]->updateDimension(width, screen->getHeight() - 1);
+        windows[i]->moveTo(x, 0);
+        windows[i]->syncView();
+        x += width;
+    }
+}
+
+void Application::resizeScreen()
+{
+    for (auto& window : windows)
+        window->updateMaxDimension(screen->getWidth(), screen->getHeight());
+    layoutWindows();
+    if (metrics_window) {
+        // back into the corner, or gone if the screen got too small for it
+        metrics_sample_timer.cancel();
+        metrics_window.reset();
+        toggleMetrics();
+    }
+    frame_pending = true;
+}
+
+void Application::focusWindow(std::size_t index)
+{
+    focused = index;
+    windows[focused]->raiseWindow();
+    frame_pending = true;
+}
+
+void Application::refreshWindows()
+{
+    for (std::size_t i = 0; i < windows.size(); i++) {
+        if (i != focused)
+            windows[i]->refreshWindow();
+    }
+    windows[focused]->refreshWindow();
+    if (metrics_window) {
+        // focusing a window puts it in front, and with cell screens every row a window staged
+        // covers the overlay again
+        metrics_window->raiseWindow();
+        metrics_window->refreshWindow();
+    }
+}
+
+void Application::toggleMetrics()
+{
+    frame_pending = true;
+    if (metrics_window) {
+        metrics_sample_timer.cancel();
+        metrics_window.reset();
+        // repaint what the overlay covered
+        for (auto& window : windows)
+            window->markAllDirty();
+        return;
+    }
+    // windows must stay strictly inside the screen
+    if (screen->getWidth() <= MetricsWindow::overlay_width + 1 || screen->getHeight() <= MetricsWindow::overlay_height)
+        return;
+    std::size_t x = screen->getWidth() - 1 - MetricsWindow::overlay_width;
+    metrics_window = std::make_unique<MetricsWindow>(screen, DEFAULT_BORDER, x, 0, screen->getWidth(), screen->getHeight());
+    metrics_sample_timer = scheduler->runAfter(metrics_sample_interval, [this] { sampleMetrics(); });
+}
+
+void Application::sampleMetrics()
+{
+    if (!metrics_window)
+        return;
+    metrics_window->sample();
+    metrics_sample_timer = scheduler->runAfter(metrics_sample_interval, [this] { sampleMetrics(); });
+}
+
+void Application::exportMetrics()
+{
+    auto time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    std::fprintf(metrics_output, "%s\n", Metrics::Instance()->toJson(time_ms).c_str());
+    std::fflush(metrics_output);
+    metrics_export_timer = scheduler->runAfter(metrics_export_interval, [this] { exportMetrics(); });
+}
+
+void Application::flushTrace()
+{
+    key_trace->flush();
+    trace_flush_timer = scheduler->runAfter(trace_flush_interval, [this] { flushTrace(); });
 }
 
 void Application::cleanUp()
 {
+    std::fputs("\x1b[?2004l", stdout);
+    std::fflush(stdout);
+    metrics_sample_timer.cancel();
+    if (metrics_output != nullptr) {
+        // the last record covers the whole session
+        metrics_export_timer.cancel();
+        exportMetrics();
+        metrics_export_timer.cancel();
+        std::fclose(metrics_output);
+    }
+    trace_flush_timer.cancel();
+    key_trace.reset();
+    metrics_window.reset();
+    windows.clear();
+    screen.reset();
     endwin();
+    if (null_output != nullptr)
+        std::fclose(null_output);
 }
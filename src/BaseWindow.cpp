@@ -7,6 +7,8 @@
 
 #include "Window.h"
 #include "Border.hpp"
+#include "Metrics.h"
+#include <algorithm>
 #include <cstddef>
 #include <fmt/core.h>
 #include <ncurses.h>
@@ -40,14 +42,9 @@ std::size_t BaseWindow::getY() const
     return y;
 }
 
-PANEL* BaseWindow::getAssociatedPanel() const
+Surface* BaseWindow::getSurface() const
 {
-    return associated_panel;
-}
-
-WINDOW* BaseWindow::getWindowPtr() const
-{
-    return window_ptr;
+    return surface.get();
 }
 
 Border BaseWindow::getBorder() const
@@ -62,8 +59,63 @@ std::string BaseWindow::getName() const
 
 void BaseWindow::refreshWindow()
 {
-    makeBorder();
-    wrefresh(window_ptr);
+    ScopedTimer timer(Metrics::Timer::Paint);
+    Metrics::Instance()->add(Metrics::Counter::Refreshes);
+    if (frame_dirty) {
+        makeBorder();
+        makeWindowLabel();
+        frame_dirty = false;
+    }
+    for (std::size_t row = 0; row < dirty_rows.size(); row++) {
+        if (dirty_rows[row]) {
+            paintRow(row);
+            dirty_rows[row] = false;
+        }
+    }
+    placeCursor();
+    surface->stage();
+}
+
+bool BaseWindow::needsRefresh() const
+{
+    return frame_dirty || std::find(dirty_rows.begin(), dirty_rows.end(), true) != dirty_rows.end();
+}
+
+void BaseWindow::inputBatch(std::span<const chtype> keys)
+{
+    for (auto ch : keys)
+        inputHandler(ch);
+}
+
+void BaseWindow::markDirty(std::size_t begin, std::size_t end)
+{
+    end = std::min(end, dirty_rows.size());
+    for (std::size_t row = begin; row < end; row++)
+        dirty_rows[row] = true;
+}
+
+void BaseWindow::markAllDirty()
+{
+    dirty_rows.assign(window_height, true);
+    frame_dirty = true;
+}
+
+void BaseWindow::markFrameDirty()
+{
+    frame_dirty = true;
+}
+
+void BaseWindow::raiseWindow()
+{
+    surface->raise();
+}
+
+void BaseWindow::paintRow(std::size_t /*row*/)
+{
+}
+
+void BaseWindow::placeCursor()
+{
 }
 
 bool BaseWindow::validifyWindow()
@@ -73,68 +125,57 @@ bool BaseWindow::validifyWindow()
 
 void BaseWindow::eraseWindow()
 {
-    wborder(window_ptr, ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ');
-    for (int i = 0; i < window_width; ++i) {
-        for (int j = 0; j < window_height; ++j) {
-            mvwaddch(window_ptr, j, i, ' ');
-        }
-    }
-    wrefresh(window_ptr);
+    surface->erase();
+    markAllDirty();
 }
 
 void BaseWindow::killWindow()
 {
-    if (window_ptr != nullptr) {
+    if (surface != nullptr) {
         eraseWindow();
-        delwin(window_ptr);
-        window_ptr = nullptr;
+        // the blank window goes out with the next Screen::update()
+        surface->stage();
+        surface.reset();
     }
 }
 
 void BaseWindow::redrawWindow()
 {
     eraseWindow();
-    makeBorder();
-    makeWindowLabel();
-    wrefresh(window_ptr);
 }
 
 void BaseWindow::makeBorder()
 {
-    wborder(window_ptr, window_border.ls, window_border.rs, window_border.ts, window_border.bs, window_border.tl, window_border.tr, window_border.bl, window_border.br);
-    wrefresh(window_ptr);
+    surface->drawBorder(window_border);
 }
 
 void BaseWindow::makeWindowLabel()
 {
-    mvwprintw(window_ptr, window_height - 1, 1, name.data());
-    wrefresh(window_ptr);
+    surface->put(window_height - 1, 1, name);
 }
 
-BaseWindow::BaseWindow(const Border& borders, const std::string& name, std::size_t width, std::size_t height, PANEL* associated_panel, std::size_t init_x, std::size_t init_y, std::size_t max_width, std::size_t max_height)
-    : window_height(height)
+BaseWindow::BaseWindow(std::shared_ptr<Screen> screen, const Border& borders, const std::string& name, std::size_t width, std::size_t height, std::size_t init_x, std::size_t init_y, std::size_t max_width, std::size_t max_height)
+    : screen(std::move(screen))
     , window_width(width)
+    , window_height(height)
     , x(init_x)
     , y(init_y)
-    , window_border(borders)
-    , associated_panel(associated_panel)
-    , max_height(max_height)
     , max_width(max_width)
+    , max_height(max_height)
+    , window_border(borders)
     , name(name)
 {
     logger = Logger::Instance();
     if (!validifyWindow()){
-        logger->error(fmt::format(
+        logger->error(
             "ERROR: Window {} doesn't match dimension requirement, expected max dimension: ({}, {}), found ({}, {})",
-            name, max_width, max_height, window_width, window_height));
+            name, max_width, max_height, window_width, window_height);
         throw std::runtime_error(fmt::format(
             "ERROR: Window {} doesn't match dimension requirement, expected max dimension: ({}, {}), found ({}, {})",
             name, max_width, max_height, window_width, window_height));
     }
-    window_ptr = newwin(height, width, x, y);
-    makeBorder();
-    makeWindowLabel();
-    wrefresh(window_ptr);
+    surface = this->screen->createSurface(x, y, width, height);
+    markAllDirty();
 }
 
 BaseWindow::~BaseWindow()
@@ -146,8 +187,7 @@ BaseWindow::~BaseWindow()
 void BaseWindow::updateBorder(const Border& borders)
 {
     window_border = borders;
-    makeBorder();
-    wrefresh(window_ptr);
+    frame_dirty = true;
 }
 
 void BaseWindow::updateDimension(std::size_t width, std::size_t height)
@@ -158,18 +198,23 @@ void BaseWindow::updateDimension(std::size_t width, std::size_t height)
         throw std::runtime_error(fmt::format(
             "ERROR: Window {} doesn't match dimension requirement, expected max dimension: ({}, {}), found ({}, {})",
             name, max_width, max_height, window_width, window_height));
-    wresize(window_ptr, window_height, window_width);
+    surface->resize(window_width, window_height);
     redrawWindow(); 
 }
 
+void BaseWindow::updateMaxDimension(std::size_t max_width, std::size_t max_height)
+{
+    this->max_width = max_width;
+    this->max_height = max_height;
+}
+
 void BaseWindow::moveTo(std::size_t x, std::size_t y)
 {
     this->x = x;
     this->y = y;
     eraseWindow();
-    mvwin(window_ptr, x, y);
-    makeBorder();
-    makeWindowLabel();
-    wrefresh(window_ptr);
+    // blanks the area the window is leaving on the next Screen::update()
+    surface->stage();
+    surface->moveTo(x, y);
 }
 
@@ -6,120 +6,613 @@
  */
 
 #include "Buffer.h"
-#include <sstream>
-#include <iostream>
+#include "BufferView.h"
+#include "MappedFile.h"
+#include "RecoveryJournal.h"
+#include "TextScan.h"
+#include "Utf8.h"
+#include <algorithm>
+#include <fmt/core.h>
+#include <stdexcept>
 #include <string>
 #include <ncurses.h>
 #include <tuple>
 #include <vector>
 
-Buffer::Buffer()
+namespace {
+/**
+ * @brief follow a byte offset through replacements
+ *
+ * @param replacements replacements in ascending order, not overlapping
+ * @param position byte offset before the replacements
+ * @return std::size_t byte offset after them, the start of the replacement if it was inside a
+ * replaced range
+ */
+std::size_t mapThrough(const std::vector<PieceTable::Replacement>& replacements, std::size_t position)
 {
-    lines.push_back("");
-    wrapped_lines.push_back(std::make_tuple(0, ""));
+    std::ptrdiff_t shift = 0;
+    for (const auto& replacement : replacements) {
+        if (replacement.offset < position && position < replacement.offset + replacement.length)
+            return replacement.offset + shift;
+        if (replacement.offset + replacement.length > position)
+            break;
+        shift += static_cast<std::ptrdiff_t>(replacement.text.size()) - static_cast<std::ptrdiff_t>(replacement.length);
+    }
+    return position + shift;
+}
 }
 
-void Buffer::insertLine(const std::string& line, std::size_t pos)
+Buffer::Buffer() = default;
+
+Buffer::Buffer(std::shared_ptr<const std::string> original)
+    : text(*original, original)
 {
-    lines.insert(lines.begin() + pos, line);
-    buffer_modified = true;
 }
 
-void Buffer::addChAt(std::size_t line, std::size_t col, chtype ch) {
-    lines[line].insert(lines[line].begin() + col, ch);
-    buffer_modified = true;
+Buffer::~Buffer()
+{
+    compress_timer.cancel();
+    compress_job.cancel();
 }
 
-void Buffer::appendCh(std::size_t line, chtype ch) {
-    lines[line].push_back(ch);
-    buffer_modified = true;
+void Buffer::load(const std::string& path)
+{
+    // enough for the first screen on any sane terminal
+    constexpr std::size_t head_size = 256 * 1024;
+    auto file = std::make_shared<const MappedFile>(path);
+    // the old journal finishes writing before a new one may replace it
+    recovery.reset();
+    recovered = false;
+    loading_path = path;
+    std::string_view bytes = file->view();
+    std::size_t head = bytes.size();
+    if (bytes.size() > head_size) {
+        std::size_t last_newline = bytes.substr(0, head_size).rfind('\n');
+        head = last_newline == std::string_view::npos ? head_size : last_newline + 1;
+    }
+    // bigger than the budget, lines are indexed a chunk at a time as they are visited
+    chunks.reset();
+    if (bytes.size() > memory_budget)
+        chunks = std::make_shared<ChunkCache>(file, memory_budget);
+    auto head_block = std::make_shared<TextBlock>(bytes.substr(0, head), file);
+    head_block->buildLineIndex();
+    text = PieceTable(head_block);
+    revision++;
+    journal.clear();
+    if (head == bytes.size())
+        startRecovery(head_block);
+    search.refresh(text);
+    resetLines();
+    addDamage(0, std::string::npos);
+    if (head == bytes.size())
+        return;
+    pending_load = std::async(std::launch::async, [file, chunks = chunks]() -> std::shared_ptr<const TextBlock> {
+        auto block = std::make_shared<TextBlock>(file->view(), file);
+        if (chunks) {
+            chunks->countLines();
+            block->usePagedIndex(chunks);
+        } else {
+            block->buildLineIndex();
+        }
+        return block;
+    });
 }
 
-void Buffer::appendLine(const std::string& line)
+void Buffer::setMemoryBudget(std::size_t bytes)
 {
-    lines.push_back(line);
-    buffer_modified = true;
+    memory_budget = bytes;
 }
 
-void Buffer::removeLine(int pos)
+const ChunkCache* Buffer::getChunks() const
 {
-    lines.erase(lines.begin() + pos);
-    buffer_modified = true;
+    return isLoading() ? nullptr : chunks.get();
 }
 
-std::size_t Buffer::getBufferSize() const
+void Buffer::prefetch(std::size_t line, bool forward)
 {
-    return lines.size();
+    if (!chunks || isLoading())
+        return;
+    // enough to scroll through while the next prefetch catches up, small enough to leave the
+    // visible chunks alone
+    std::size_t distance = std::min(2 * ChunkCache::chunk_size, memory_budget / 4);
+    std::size_t offset = text.lineStart(std::min(line, text.lineCount() - 1));
+    std::size_t begin = forward ? offset : offset - std::min(offset, distance);
+    prefetch_token.cancel();
+    prefetch_token = CancellationToken();
+    // the pieces tell where the lines are in the file, edits shift them from the document offsets
+    Scheduler::Instance()->submit(Scheduler::Priority::Normal, [snapshot = text, chunks = chunks, begin, distance](const CancellationToken& token) {
+        snapshot.forEachChunk(begin, distance, [&](std::string_view piece) {
+            chunks->prefetch(piece);
+            return !token.isCancelled();
+        });
+    }, {}, prefetch_token);
 }
 
-std::string& Buffer::operator[](std::size_t idx)
+bool Buffer::isLoading() const
 {
-    return lines[idx];
+    return pending_load.valid();
 }
 
-std::string Buffer::operator[](std::size_t idx) const
+bool Buffer::pollLoading()
 {
-    return lines.at(idx);
+    if (!pending_load.valid() || pending_load.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return false;
+    // the head ends right after a newline or is cut mid-line, either way its last line is
+    // where the rest of the file continues
+    std::size_t head_last_line = text.lineCount() - 1;
+    auto block = pending_load.get();
+    text = PieceTable(block);
+    revision++;
+    startRecovery(block);
+    search.refresh(text);
+    if (recovered) {
+        resetLines();
+        addDamage(0, std::string::npos);
+        return true;
+    }
+    replaceLines(head_last_line, 1, text.lineCount() - head_last_line);
+    addDamage(head_last_line, std::string::npos);
+    return true;
 }
 
-Buffer::operator std::string() const {
-    std::stringstream ss;
-    for (auto i : wrapped_lines) {
-        ss << std::get<1>(i) << std::endl;
+void Buffer::compressCold()
+{
+    if (isLoading())
+        return;
+    std::vector<std::pair<std::size_t, std::size_t>> hot;
+    auto around = [&hot](std::size_t offset) {
+        hot.emplace_back(offset - std::min(offset, hot_distance), offset + hot_distance);
+    };
+    for (BufferView* view : views) {
+        around(view->cursor);
+        around(text.lineStart(std::min(view->top_line, text.lineCount() - 1)));
     }
-    return ss.str();
+    compress_job.cancel();
+    compress_job = CancellationToken();
+    auto snapshot = std::make_shared<PieceTable>(text);
+    auto saved = std::make_shared<std::size_t>(0);
+    Scheduler::Instance()->submit(Scheduler::Priority::Background, [snapshot, saved, hot = std::move(hot)](const CancellationToken&) {
+        *saved = snapshot->compressCold(hot);
+    }, [this, snapshot, saved, at = revision] {
+        // the same text with other blocks under it, an edit meanwhile already asked for another pass
+        if (*saved > 0 && revision == at)
+            text = std::move(*snapshot);
+    }, compress_job);
 }
 
-std::size_t Buffer::getWrappedLineCount() const {
-    return wrapped_lines.size();
+void Buffer::scheduleCompression()
+{
+    if (compress_due)
+        return;
+    compress_due = true;
+    compress_timer = Scheduler::Instance()->runAfter(compress_delay, [this] {
+        compress_due = false;
+        compressCold();
+    });
 }
 
-void Buffer::wrapLines(std::size_t window_width) {
-    if(!buffer_modified) return;
-    wrapped_lines.clear();
-    int idx = 0;
-    for (const auto& line : lines) {
-        std::size_t start = 0;
-        std::size_t count = 0;
-        while (start < line.length()) {
-            std::size_t end = line.find(' ', start + 1);
-            if (end == std::string::npos) {
-                end = line.length();
-            }
-            std::size_t word_len = end - start;
-            if (word_len > window_width) {
-                // If the word is too long to fit on a line, split it
-                end = start + window_width;
-                word_len = window_width;
-            }
-            if (count + word_len > window_width) {
-                // If adding the word to the current line would make it too long, start a new line
-                wrapped_lines.push_back(std::make_tuple(idx, line.substr(start, word_len)));
-                count = word_len;
+void Buffer::enableRecovery(std::filesystem::path journal_path)
+{
+    recovery_path = std::move(journal_path);
+}
+
+bool Buffer::startRecovery(std::shared_ptr<const TextBlock> base)
+{
+    if (recovery_path.empty())
+        return false;
+    recovery = std::make_unique<RecoveryJournal>(recovery_path, loading_path, std::move(base));
+    recovered = recovery->replay(text);
+    recovery->start(text);
+    return recovered;
+}
+
+std::size_t Buffer::setSearchQuery(std::string_view query)
+{
+    return search.setQuery(text, query);
+}
+
+std::size_t Buffer::offsetOf(std::size_t line, std::size_t col) const
+{
+    return text.lineStart(line) + col;
+}
+
+const TextSearch& Buffer::getSearch() const
+{
+    return search;
+}
+
+std::optional<std::pair<std::size_t, std::size_t>> Buffer::findMatch(std::size_t line, std::size_t col, bool forward) const
+{
+    std::size_t offset = text.lineStart(line) + col;
+    auto match = forward ? search.next(offset) : search.previous(offset);
+    if (!match)
+        return std::nullopt;
+    return positionOf(*match);
+}
+
+std::vector<std::pair<std::size_t, std::size_t>> Buffer::getMatchesIn(std::size_t line, std::size_t begin, std::size_t end) const
+{
+    std::vector<std::pair<std::size_t, std::size_t>> spans;
+    std::size_t start = text.lineStart(line);
+    std::size_t length = search.getQuery().size();
+    search.forEachIn(start + begin, start + end, [&](std::size_t offset) {
+        std::size_t from = std::max(offset, start + begin) - start;
+        std::size_t to = std::min(offset + length, start + end) - start;
+        // overlapping matches merge into one span
+        if (!spans.empty() && from <= spans.back().second)
+            spans.back().second = std::max(spans.back().second, to);
+        else
+            spans.emplace_back(from, to);
+    });
+    return spans;
+}
+
+const PieceTable& Buffer::getText() const
+{
+    return text;
+}
+
+std::uint64_t Buffer::getRevision() const
+{
+    return revision;
+}
+
+std::pair<std::size_t, std::size_t> Buffer::replaceAll(const std::vector<PieceTable::Replacement>& replacements, std::size_t line, std::size_t col)
+{
+    if (replacements.empty())
+        return { line, col };
+    std::size_t position = mapThrough(replacements, text.lineStart(line) + col);
+    std::ptrdiff_t shift = 0;
+    journal.beginGroup();
+    for (const auto& replacement : replacements) {
+        // the journal replays the edits one after another, each sees the ones before it applied
+        std::size_t at = replacement.offset + shift;
+        journal.recordErase(at, text.substr(replacement.offset, replacement.length));
+        journal.recordInsert(at, replacement.text);
+        shift += static_cast<std::ptrdiff_t>(replacement.text.size()) - static_cast<std::ptrdiff_t>(replacement.length);
+    }
+    journal.endGroup();
+    applyReplacements(replacements);
+    return positionOf(position);
+}
+
+void Buffer::setSyntax(Highlighter::Syntax syntax)
+{
+    highlighter.setSyntax(syntax, text.lineCount());
+}
+
+Highlighter::Syntax Buffer::getSyntax() const
+{
+    return highlighter.getSyntax();
+}
+
+bool Buffer::updateHighlights(std::size_t viewport_end)
+{
+    auto [first, last] = highlighter.update(text, viewport_end);
+    if (first == last)
+        return false;
+    addDamage(first, last - first);
+    return true;
+}
+
+bool Buffer::isHighlighting() const
+{
+    return !highlighter.isDone();
+}
+
+const std::vector<Highlighter::Span>& Buffer::getHighlights(std::size_t line) const
+{
+    return highlighter.getSpans(text, line);
+}
+
+const RecoveryJournal* Buffer::getRecovery() const
+{
+    return recovery.get();
+}
+
+void Buffer::editApplied(std::size_t offset, std::string_view inserted, std::size_t erased)
+{
+    revision++;
+    scheduleCompression();
+    for (BufferView* view : views) {
+        if (view->cursor <= offset)
+            continue;
+        if (erased > 0)
+            view->cursor = view->cursor < offset + erased ? offset : view->cursor - erased;
+        else
+            view->cursor += inserted.size();
+    }
+    if (erased > 0)
+        search.onErase(text, offset, erased);
+    else
+        search.onInsert(text, offset, inserted.size());
+    if (!recovery)
+        return;
+    if (isUnmodified()) {
+        recovery->discard(text);
+        return;
+    }
+    if (erased > 0)
+        recovery->recordErase(offset, erased);
+    else
+        recovery->recordInsert(offset, inserted);
+    if (recovery->wantsCompaction())
+        recovery->compact(text);
+}
+
+bool Buffer::isUnmodified() const
+{
+    // recovered edits are not in the undo history, undoing everything still leaves them
+    return !recovered && journal.isAtStart();
+}
+
+void Buffer::insertText(std::size_t offset, std::string_view str)
+{
+    journal.recordInsert(offset, str);
+    applyInsert(offset, str);
+}
+
+void Buffer::eraseText(std::size_t offset, std::size_t length)
+{
+    length = std::min(length, text.size() - offset);
+    journal.recordErase(offset, text.substr(offset, length));
+    applyErase(offset, length);
+}
+
+void Buffer::applyInsert(std::size_t offset, std::string_view str)
+{
+    std::size_t line = text.lineOf(offset);
+    text.insert(offset, str);
+    editApplied(offset, str, 0);
+    std::size_t newlines = std::count(str.begin(), str.end(), '\n');
+    replaceLines(line, 1, 1 + newlines);
+    addDamage(line, newlines == 0 ? 1 : std::string::npos);
+}
+
+void Buffer::applyErase(std::size_t offset, std::size_t length)
+{
+    length = std::min(length, text.size() - offset);
+    std::size_t first = text.lineOf(offset);
+    std::size_t last = text.lineOf(offset + length);
+    text.erase(offset, length);
+    editApplied(offset, {}, length);
+    replaceLines(first, last - first + 1, 1);
+    addDamage(first, first == last ? 1 : std::string::npos);
+}
+
+void Buffer::applyReplacements(const std::vector<PieceTable::Replacement>& replacements)
+{
+    const auto& last_replacement = replacements.back();
+    std::size_t first = text.lineOf(replacements.front().offset);
+    std::size_t last = text.lineOf(last_replacement.offset + last_replacement.length);
+    std::size_t line_count = text.lineCount();
+    text.replaceAll(replacements);
+    revision++;
+    scheduleCompression();
+    for (BufferView* view : views)
+        view->cursor = mapThrough(replacements, view->cursor);
+    // one rescan and one journal snapshot instead of a patch and a record per replacement
+    search.refresh(text);
+    if (recovery && isUnmodified())
+        recovery->discard(text);
+    else if (recovery)
+        recovery->compact(text);
+    std::size_t new_last = last + text.lineCount() - line_count;
+    replaceLines(first, last - first + 1, new_last - first + 1);
+    addDamage(first, text.lineCount() == line_count ? new_last - first + 1 : std::string::npos);
+}
+
+std::size_t Buffer::applyGroup(std::vector<EditJournal::Edit> edits, bool undoing)
+{
+    std::vector<PieceTable::Replacement> replacements;
+    replacements.reserve(edits.size());
+    if (undoing) {
+        // reverted right to left, each edit is still at its offset in the current text
+        for (auto edit = edits.rbegin(); edit != edits.rend(); ++edit) {
+            if (edit->kind == EditJournal::Kind::Insert)
+                replacements.push_back({ edit->offset, edit->text.size(), {} });
+            else
+                replacements.push_back({ edit->offset, 0, std::string(edit->text) });
+        }
+    } else {
+        // reapplied left to right, each edit sees the ones before it applied
+        std::ptrdiff_t shift = 0;
+        for (const auto& edit : edits) {
+            std::size_t offset = edit.offset - shift;
+            if (edit.kind == EditJournal::Kind::Insert) {
+                replacements.push_back({ offset, 0, std::string(edit.text) });
+                shift += edit.text.size();
             } else {
-                // Otherwise, add the word to the current line
-                if (!wrapped_lines.empty()) {
-                    std::get<1>((wrapped_lines).back()) += line.substr(start, word_len);
-                } else {
-                    wrapped_lines.push_back(std::make_tuple(idx, line.substr(start, word_len)));
-                }
-                count += word_len;
+                replacements.push_back({ offset, edit.text.size(), {} });
+                shift -= edit.text.size();
             }
-            start = end;
         }
-        idx++;
     }
-    buffer_modified = false;
+    applyReplacements(replacements);
+    return replacements.front().offset;
+}
+
+void Buffer::attach(BufferView* view)
+{
+    views.push_back(view);
+}
+
+void Buffer::detach(BufferView* view)
+{
+    views.erase(std::find(views.begin(), views.end(), view));
+}
+
+void Buffer::replaceLines(std::size_t first, std::size_t old_count, std::size_t new_count)
+{
+    for (BufferView* view : views)
+        view->replaceLines(first, old_count, new_count);
+    highlighter.replaceLines(first, old_count, new_count);
+}
+
+void Buffer::resetLines()
+{
+    for (BufferView* view : views)
+        view->resetLines();
+    highlighter.reset(text.lineCount());
+}
+
+void Buffer::addDamage(std::size_t first, std::size_t count)
+{
+    for (BufferView* view : views)
+        view->addDamage(first, count);
+}
+
+void Buffer::insertLine(const std::string& line, std::size_t pos)
+{
+    if (pos < text.lineCount())
+        insertText(text.lineStart(pos), line + '\n');
+    else
+        insertText(text.size(), '\n' + line);
+}
+
+void Buffer::addChAt(std::size_t line, std::size_t col, chtype ch) {
+    insertText(text.lineStart(line) + col, Utf8::encode(ch));
+}
+
+std::pair<std::size_t, std::size_t> Buffer::insertAt(std::size_t line, std::size_t col, std::span<const char> bytes)
+{
+    std::string_view str(bytes.data(), bytes.size());
+    std::size_t offset = text.lineStart(line) + col;
+    journal.recordInsert(offset, str);
+    text.insert(offset, str);
+    editApplied(offset, str, 0);
+    // one scan gives both the line count for the wrap cache and the end position
+    std::vector<std::size_t> newlines;
+    TextScan::findNewlines(str, 0, newlines);
+    replaceLines(line, 1, 1 + newlines.size());
+    if (newlines.empty()) {
+        addDamage(line, 1);
+        return { line, col + str.size() };
+    }
+    addDamage(line, std::string::npos);
+    return { line + newlines.size(), str.size() - newlines.back() - 1 };
+}
+
+void Buffer::eraseAt(std::size_t line, std::size_t col, std::size_t count) {
+    eraseText(text.lineStart(line) + col, count);
+}
+
+void Buffer::appendCh(std::size_t line, chtype ch) {
+    insertText(text.lineEnd(line), Utf8::encode(ch));
+}
+
+void Buffer::appendLine(const std::string& line)
+{
+    insertText(text.size(), '\n' + line);
+}
+
+void Buffer::removeLine(int pos)
+{
+    if (pos < 0 || static_cast<std::size_t>(pos) >= text.lineCount())
+        throw std::runtime_error(fmt::format("Buffer::removeLine: line {} out of {} lines", pos, text.lineCount()));
+    auto line = static_cast<std::size_t>(pos);
+    if (text.lineCount() == 1) {
+        eraseText(0, text.size());
+    } else if (line + 1 < text.lineCount()) {
+        std::size_t start = text.lineStart(line);
+        eraseText(start, text.lineStart(line + 1) - start);
+    } else {
+        // last line, take the newline before it instead
+        std::size_t start = text.lineStart(line) - 1;
+        eraseText(start, text.size() - start);
+    }
+}
+
+std::size_t Buffer::getBufferSize() const
+{
+    return text.lineCount();
+}
+
+std::size_t Buffer::getLineLength(std::size_t line) const
+{
+    return text.lineEnd(line) - text.lineStart(line);
+}
+
+std::size_t Buffer::prevGrapheme(std::size_t line, std::size_t col) const
+{
+    // graphemes are short, a little context before the position is all that is needed
+    constexpr std::size_t context = 64;
+    std::size_t begin = col > context ? col - context : 0;
+    std::size_t start = text.lineStart(line);
+    std::string around = text.substr(start + begin, std::min(col + context, getLineLength(line)) - begin);
+    return begin + Utf8::prevGrapheme(around, col - begin);
 }
 
-std::tuple<std::size_t, std::string>& Buffer::getWrappedLineTuple(std::size_t idx)
+std::size_t Buffer::nextGrapheme(std::size_t line, std::size_t col) const
 {
-    return wrapped_lines[idx];
+    constexpr std::size_t context = 64;
+    std::size_t start = text.lineStart(line);
+    std::string around = text.substr(start + col, std::min(context, getLineLength(line) - col));
+    std::size_t width;
+    return col + Utf8::nextGrapheme(around, 0, width);
 }
 
-std::tuple<std::size_t, std::string> Buffer::getWrappedLineTuple(std::size_t idx) const
+std::string Buffer::operator[](std::size_t idx) const
 {
-    return wrapped_lines.at(idx);
+    return text.line(idx);
+}
+
+std::vector<std::string> Buffer::wrapLine(const std::string& line, std::size_t window_width)
+{
+    std::vector<WrapCache::RowSpan> spans;
+    layoutLine(line, window_width, spans);
+    std::vector<std::string> rows;
+    for (auto span : spans)
+        rows.push_back(line.substr(span.offset, span.length));
+    return rows;
+}
+
+ColumnMap Buffer::layoutLine(std::string_view line, std::size_t window_width, std::vector<WrapCache::RowSpan>& rows)
+{
+    ColumnMap columns(line);
+    std::size_t first_row = rows.size();
+    window_width = std::max<std::size_t>(window_width, 1);
+    if (columns.isAsciiLine()) {
+        // bytes are columns, rows end where the vectorized kernel finds the last space that fits,
+        // the same rows the word by word loop below gives
+        std::size_t start = 0;
+        do {
+            std::size_t end = TextScan::nextBreak(line, start, window_width);
+            rows.push_back({ start, end - start });
+            start = end;
+        } while (start < line.size());
+        return columns;
+    }
+    // positions below are grapheme indices, lengths are display columns
+    std::size_t graphemes = columns.graphemeCount();
+    std::size_t start = 0;
+    std::size_t count = 0;
+    while (start < graphemes) {
+        std::size_t space = line.find(' ', columns.byteOf(start) + 1);
+        std::size_t end = space == std::string::npos ? graphemes : columns.graphemeAt(space);
+        std::size_t word_len = columns.columnOf(end) - columns.columnOf(start);
+        if (word_len > window_width) {
+            // If the word is too long to fit on a line, split it, but never inside a grapheme
+            end = std::max(start + 1, columns.graphemeAtColumn(columns.columnOf(start) + window_width));
+            word_len = columns.columnOf(end) - columns.columnOf(start);
+        }
+        std::size_t word_begin = columns.byteOf(start);
+        std::size_t word_bytes = columns.byteOf(end) - word_begin;
+        if (rows.size() == first_row || count + word_len > window_width) {
+            // If adding the word to the current line would make it too long, start a new line
+            rows.push_back({ word_begin, word_bytes });
+            count = word_len;
+        } else {
+            // Otherwise, add the word to the current line, the row ends where the word does
+            rows.back().length += word_bytes;
+            count += word_len;
+        }
+        start = end;
+    }
+    if (rows.size() == first_row) {
+        rows.push_back({ 0, 0 });
+    }
+    return columns;
 }
 
 std::vector<std::string> Buffer::split(const std::string &str, const std::string &delim) {
@@ -134,3 +627,57 @@ std::vector<std::string> Buffer::split(const std::string &str, const std::string
     tokens.push_back(str.substr(start, end));
     return tokens;
 }
+
+std::optional<std::pair<std::size_t, std::size_t>> Buffer::undo()
+{
+    if (!journal.canUndo())
+        return std::nullopt;
+    auto edit = journal.undo();
+    if (edit.linked) {
+        std::vector<EditJournal::Edit> edits { edit };
+        while (edits.back().linked && journal.canUndo())
+            edits.push_back(journal.undo());
+        return positionOf(applyGroup(std::move(edits), true));
+    }
+    if (edit.kind == EditJournal::Kind::Insert) {
+        applyErase(edit.offset, edit.text.size());
+        return positionOf(edit.offset);
+    }
+    applyInsert(edit.offset, edit.text);
+    return positionOf(edit.offset + edit.text.size());
+}
+
+std::optional<std::pair<std::size_t, std::size_t>> Buffer::redo()
+{
+    if (!journal.canRedo())
+        return std::nullopt;
+    auto edit = journal.redo();
+    if (journal.isRedoLinked()) {
+        std::vector<EditJournal::Edit> edits { edit };
+        while (journal.isRedoLinked())
+            edits.push_back(journal.redo());
+        return positionOf(applyGroup(std::move(edits), false));
+    }
+    if (edit.kind == EditJournal::Kind::Insert) {
+        applyInsert(edit.offset, edit.text);
+        return positionOf(edit.offset + edit.text.size());
+    }
+    applyErase(edit.offset, edit.text.size());
+    return positionOf(edit.offset);
+}
+
+void Buffer::closeUndoStep()
+{
+    journal.seal();
+}
+
+const EditJournal& Buffer::getJournal() const
+{
+    return journal;
+}
+
+std::pair<std::size_t, std::size_t> Buffer::positionOf(std::size_t offset) const
+{
+    std::size_t line = text.lineOf(offset);
+    return { line, offset - text.lineStart(line) };
+}
@@ -0,0 +1,311 @@
+/**
+ * @file BufferView.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Implementation of BufferView class
+ */
+
+#include "BufferView.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <tuple>
+
+BufferView::BufferView(Buffer& buffer)
+    : buffer(buffer)
+{
+    wrap_cache.reset(buffer.getText().lineCount(), 0);
+    buffer.attach(this);
+}
+
+BufferView::~BufferView()
+{
+    cancelWrap();
+    buffer.detach(this);
+}
+
+Buffer& BufferView::getBuffer() const
+{
+    return buffer;
+}
+
+void BufferView::wrapLines(std::size_t window_width)
+{
+    const PieceTable& text = buffer.getText();
+    if (window_width != wrap_cache.getWidth()) {
+        cancelWrap();
+        wrap_cache.reset(text.lineCount(), window_width);
+    }
+    if (!wrap_cache.isDirty() && wrap_cache.getPendingCount() == 0) return;
+    cancelWrap();
+    ScopedTimer timer(Metrics::Timer::Wrap);
+    std::size_t rows = 0;
+    wrap_cache.finish(wrapper(rows));
+    Metrics::Instance()->add(Metrics::Counter::RowsWrapped, rows);
+}
+
+std::size_t BufferView::wrapAround(std::size_t window_width, std::size_t top_row, std::size_t height)
+{
+    if (window_width != wrap_cache.getWidth()) {
+        cancelWrap();
+        // until the background catches up the rows at the old width give the estimates
+        wrap_cache.rescale(window_width);
+    }
+    bool scrolled = top_row != shown_top;
+    if (wrap_cache.isDirty() || wrap_cache.getPendingCount() != 0) {
+        ScopedTimer timer(Metrics::Timer::Wrap);
+        std::size_t rows = 0;
+        auto wrap = wrapper(rows);
+        wrap_cache.update(wrap);
+        if (scrolled)
+            std::tie(top_line, top_line_row) = wrap_cache.locateRow(std::min(top_row, wrap_cache.getRowCount() - 1));
+        if (wrap_cache.getPendingCount() <= WrapCache::lazy_line_count) {
+            cancelWrap();
+            wrap_cache.finish(wrap);
+        } else if (wrap_cache.getPendingCount() != 0) {
+            // a screen above and one below as well, scrolling and moving by rows find them ready
+            wrap_cache.wrapLine(top_line, wrap);
+            for (std::size_t line = top_line, above = 0; line > 0 && above < height; line--) {
+                wrap_cache.wrapLine(line - 1, wrap);
+                above += wrap_cache.getRows(line - 1).size();
+            }
+            for (std::size_t line = top_line, below = 0; line < buffer.getText().lineCount() && below < top_line_row + 2 * height; line++) {
+                wrap_cache.wrapLine(line, wrap);
+                below += wrap_cache.getRows(line).size();
+            }
+            if (wrap_jobs_left == 0)
+                scheduleWrap();
+        }
+        Metrics::Instance()->add(Metrics::Counter::RowsWrapped, rows);
+    } else if (scrolled) {
+        std::tie(top_line, top_line_row) = wrap_cache.locateRow(std::min(top_row, wrap_cache.getRowCount() - 1));
+    }
+    shown_top = wrap_cache.getRowOf(top_line) + std::min(top_line_row, rowsOf(top_line).size() - 1);
+    return shown_top;
+}
+
+std::size_t BufferView::getPendingCount() const
+{
+    return wrap_cache.getPendingCount();
+}
+
+std::size_t BufferView::getWrappedLineCount() const
+{
+    return wrap_cache.getRowCount();
+}
+
+std::tuple<std::size_t, std::string_view> BufferView::getWrappedLineTuple(std::size_t idx) const
+{
+    auto [line, row] = wrap_cache.locateRow(idx);
+    auto rows = rowsOf(line);
+    return std::make_tuple(line, rowText(line, rows[std::min(row, rows.size() - 1)]));
+}
+
+std::string_view BufferView::getWrappedRow(std::size_t idx) const
+{
+    auto [line, row] = wrap_cache.locateRow(idx);
+    auto rows = rowsOf(line);
+    return rowText(line, rows[std::min(row, rows.size() - 1)]);
+}
+
+std::size_t BufferView::getWrappedRowOf(std::size_t line, std::size_t col) const
+{
+    if (line >= buffer.getText().lineCount())
+        return wrap_cache.getRowCount();
+    auto rows = rowsOf(line);
+    std::size_t row = 0;
+    while (row + 1 < rows.size() && col >= rows[row + 1].offset)
+        row++;
+    return wrap_cache.getRowOf(line) + row;
+}
+
+std::size_t BufferView::getWrappedColOf(std::size_t line, std::size_t col) const
+{
+    if (line >= buffer.getText().lineCount())
+        return 0;
+    auto rows = rowsOf(line);
+    std::size_t row = 0;
+    while (row + 1 < rows.size() && col >= rows[row + 1].offset)
+        row++;
+    std::size_t row_start = rows.empty() ? 0 : rows[row].offset;
+    const ColumnMap& columns = wrap_cache.getColumns(line);
+    return columns.columnAtByte(col) - columns.columnAtByte(row_start);
+}
+
+std::pair<std::size_t, std::size_t> BufferView::getPositionOfWrapped(std::size_t row, std::size_t column) const
+{
+    auto [line, row_in_line] = wrap_cache.locateRow(row);
+    auto rows = rowsOf(line);
+    // a pending line counts its estimated rows but is one row so far
+    row_in_line = std::min(row_in_line, rows.size() - 1);
+    std::size_t row_start = rows[row_in_line].offset;
+    std::size_t row_end = row_start + rows[row_in_line].length;
+    const ColumnMap& columns = wrap_cache.getColumns(line);
+    std::size_t col = columns.byteOf(columns.graphemeAtColumn(columns.columnAtByte(row_start) + column));
+    if (col >= row_end && row_in_line + 1 < rows.size()) {
+        // the row end is already the start of the next row, stay on the last grapheme of this one
+        col = columns.byteOf(columns.graphemeAt(row_end - 1));
+    }
+    return { line, std::min(col, row_end) };
+}
+
+BufferView::operator std::string() const
+{
+    std::stringstream ss;
+    for (std::size_t line = 0; line < buffer.getText().lineCount(); line++) {
+        for (auto row : rowsOf(line)) {
+            ss << rowText(line, row) << std::endl;
+        }
+    }
+    return ss.str();
+}
+
+std::pair<std::size_t, std::size_t> BufferView::takeDamage()
+{
+    auto damage = std::make_pair(damage_first, damage_last);
+    damage_first = damage_last = 0;
+    return damage;
+}
+
+void BufferView::setCursor(std::size_t offset)
+{
+    cursor = offset;
+}
+
+std::size_t BufferView::getCursor() const
+{
+    return cursor;
+}
+
+void BufferView::replaceLines(std::size_t first, std::size_t old_count, std::size_t new_count)
+{
+    wrap_cache.replaceLines(first, old_count, new_count);
+    // background jobs must not hand their rows to lines changed meanwhile
+    if (wrap_jobs_left != 0)
+        shifts.push_back({ first, old_count, new_count });
+    if (old_count == new_count)
+        return;
+    // the top line stays on screen unless it was removed, then what took its place does
+    if (top_line >= first + old_count) {
+        top_line = top_line - old_count + new_count;
+    } else if (top_line >= first && top_line >= first + new_count) {
+        top_line = new_count == 0 ? (first == 0 ? 0 : first - 1) : first + new_count - 1;
+        top_line_row = 0;
+    }
+}
+
+void BufferView::resetLines()
+{
+    cancelWrap();
+    wrap_cache.reset(buffer.getText().lineCount(), wrap_cache.getWidth());
+    top_line = std::min(top_line, buffer.getText().lineCount() - 1);
+    // nothing to follow the cursor through, keep it inside the new text
+    cursor = std::min(cursor, buffer.getText().size());
+}
+
+void BufferView::addDamage(std::size_t first, std::size_t count)
+{
+    std::size_t last = count == std::string::npos ? std::string::npos : first + count;
+    if (damage_first == damage_last) {
+        damage_first = first;
+        damage_last = last;
+        return;
+    }
+    damage_first = std::min(damage_first, first);
+    damage_last = std::max(damage_last, last);
+}
+
+std::string_view BufferView::rowText(std::size_t line, WrapCache::RowSpan row) const
+{
+    std::string_view text = buffer.getText().lineView(line, line_scratch);
+    // the rows of a line edited since the last wrapLines() may reach past its new end
+    return text.substr(std::min(row.offset, text.size()), row.length);
+}
+
+std::span<const WrapCache::RowSpan> BufferView::rowsOf(std::size_t line) const
+{
+    static constexpr WrapCache::RowSpan whole_line { 0, std::string::npos };
+    if (wrap_cache.getRows(line).empty())
+        return std::span<const WrapCache::RowSpan>(&whole_line, 1);
+    return wrap_cache.getRows(line);
+}
+
+WrapCache::WrapFunction BufferView::wrapper(std::size_t& rows)
+{
+    // two captures fit std::function's inline storage, so this allocates nothing either
+    return [this, &rows](std::size_t line, std::size_t width, std::vector<WrapCache::RowSpan>& spans) {
+        std::size_t before = spans.size();
+        ColumnMap columns = Buffer::layoutLine(buffer.getText().lineView(line, line_scratch), width, spans);
+        rows += spans.size() - before;
+        return columns;
+    };
+}
+
+void BufferView::scheduleWrap()
+{
+    auto ranges = wrap_cache.getPendingRanges(wrap_chunk_lines);
+    // the user scrolls from the top line, have what is near it first
+    auto distance = [this](const std::pair<std::size_t, std::size_t>& range) {
+        return range.first > top_line ? range.first - top_line : top_line - std::min(top_line, range.second);
+    };
+    std::stable_sort(ranges.begin(), ranges.end(), [&](const auto& a, const auto& b) { return distance(a) < distance(b); });
+    shifts.clear();
+    for (auto [first, last] : ranges) {
+        auto chunk = std::make_shared<WrappedChunk>();
+        chunk->first = first;
+        CancellationToken token;
+        wrap_jobs.push_back(token);
+        wrap_jobs_left++;
+        Scheduler::Instance()->submit(Scheduler::Priority::Background, [chunk, snapshot = buffer.getText(), last, width = wrap_cache.getWidth()](const CancellationToken& token) {
+            std::string scratch;
+            for (std::size_t line = chunk->first; line < last && !token.isCancelled(); line++) {
+                std::size_t before = chunk->rows.size();
+                chunk->columns.push_back(Buffer::layoutLine(snapshot.lineView(line, scratch), width, chunk->rows));
+                chunk->counts.push_back(chunk->rows.size() - before);
+            }
+        }, [this, chunk] { installChunk(*chunk); }, token);
+    }
+}
+
+void BufferView::installChunk(const WrappedChunk& chunk)
+{
+    wrap_jobs_left--;
+    std::size_t first_installed = std::string::npos;
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < chunk.counts.size(); offset += chunk.counts[i], i++) {
+        std::size_t line = chunk.first + i;
+        bool removed = false;
+        for (const auto& shift : shifts) {
+            if (line >= shift.first + shift.old_count) {
+                line = line - shift.old_count + shift.new_count;
+            } else if (line >= shift.first) {
+                removed = true;
+                break;
+            }
+        }
+        if (removed || !wrap_cache.isPending(line))
+            continue;
+        wrap_cache.install(line, std::span<const WrapCache::RowSpan>(chunk.rows).subspan(offset, chunk.counts[i]), chunk.columns[i]);
+        first_installed = std::min(first_installed, line);
+    }
+    Metrics::Instance()->add(Metrics::Counter::RowsWrapped, chunk.rows.size());
+    // the row count of the lines changed, every row below them moves
+    if (first_installed != std::string::npos)
+        addDamage(first_installed, std::string::npos);
+    if (wrap_jobs_left != 0)
+        return;
+    wrap_jobs.clear();
+    // lines that turned pending meanwhile, e.g. a big paste, get their own round
+    if (wrap_cache.getPendingCount() != 0)
+        scheduleWrap();
+}
+
+void BufferView::cancelWrap()
+{
+    for (const auto& token : wrap_jobs)
+        token.cancel();
+    wrap_jobs.clear();
+    wrap_jobs_left = 0;
+    shifts.clear();
+}
@@ -0,0 +1,262 @@
+/**
+ * @file CellScreen.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Implementation of the in-memory cell grid screen backend
+ */
+
+#include "Screen.h"
+#include "TextScan.h"
+#include "Utf8.h"
+#include <algorithm>
+#include <cstring>
+
+Cell::Cell(char ch)
+{
+    auto byte = static_cast<unsigned char>(ch);
+    text[0] = byte < 0x20 || byte == 0x7f ? '?' : ch;
+}
+
+Cell::Cell(std::string_view grapheme)
+{
+    if (grapheme.size() == 1) {
+        *this = Cell(grapheme[0]);
+    } else if (grapheme.size() <= capacity) {
+        std::memcpy(text, grapheme.data(), grapheme.size());
+        size = grapheme.size();
+    } else {
+        std::string replacement = Utf8::encode(Utf8::replacement);
+        std::memcpy(text, replacement.data(), replacement.size());
+        size = replacement.size();
+    }
+}
+
+Cell Cell::continuation()
+{
+    Cell cell;
+    cell.text[0] = 0;
+    cell.size = 0;
+    return cell;
+}
+
+class CellSurface : public Surface {
+public:
+    CellSurface(CellScreen& screen, std::size_t x, std::size_t y, std::size_t width, std::size_t height)
+        : screen(screen)
+        , x(x)
+        , y(y)
+    {
+        resize(width, height);
+    }
+
+    void put(std::size_t row, std::size_t col, std::string_view text) override
+    {
+        if (row >= height || col >= width)
+            return;
+        Cell* line = cells.data() + row * width;
+        cutWideBefore(line, col);
+        std::size_t pos = 0;
+        while (pos < text.size() && col < width) {
+            // an ASCII run maps byte to cell, except its last byte which may take a combining mark
+            std::size_t run = TextScan::asciiPrefix(text.substr(pos));
+            if (pos + run < text.size() && run != 0)
+                run--;
+            run = std::min(run, width - col);
+            for (std::size_t end = pos + run; pos < end; pos++)
+                line[col++] = styled(Cell(text[pos]));
+            if (pos == text.size() || col == width)
+                break;
+            std::size_t grapheme_width;
+            std::size_t next = Utf8::nextGrapheme(text, pos, grapheme_width);
+            if (col + grapheme_width > width)
+                break;
+            line[col++] = styled(Cell(text.substr(pos, next - pos)));
+            if (grapheme_width == 2)
+                line[col++] = styled(Cell::continuation());
+            pos = next;
+        }
+        cutWideAfter(line, col);
+        touched[row] = true;
+    }
+
+    void fill(std::size_t row, std::size_t col, char ch, std::size_t count) override
+    {
+        if (row >= height || col >= width)
+            return;
+        Cell* line = cells.data() + row * width;
+        count = std::min(count, width - col);
+        cutWideBefore(line, col);
+        std::fill_n(line + col, count, styled(Cell(ch)));
+        cutWideAfter(line, col + count);
+        touched[row] = true;
+    }
+
+    void setStyle(Style style) override
+    {
+        this->style = style;
+    }
+
+    void drawBorder(const Border& border) override
+    {
+        if (width < 2 || height < 2)
+            return;
+        for (std::size_t row = 1; row + 1 < height; row++) {
+            fill(row, 0, static_cast<char>(border.ls & A_CHARTEXT), 1);
+            fill(row, width - 1, static_cast<char>(border.rs & A_CHARTEXT), 1);
+        }
+        fill(0, 1, static_cast<char>(border.ts & A_CHARTEXT), width - 2);
+        fill(height - 1, 1, static_cast<char>(border.bs & A_CHARTEXT), width - 2);
+        fill(0, 0, static_cast<char>(border.tl & A_CHARTEXT), 1);
+        fill(0, width - 1, static_cast<char>(border.tr & A_CHARTEXT), 1);
+        fill(height - 1, 0, static_cast<char>(border.bl & A_CHARTEXT), 1);
+        fill(height - 1, width - 1, static_cast<char>(border.br & A_CHARTEXT), 1);
+        touched.assign(height, true);
+    }
+
+    void erase() override
+    {
+        std::fill(cells.begin(), cells.end(), Cell());
+        touched.assign(height, true);
+    }
+
+    void setCursor(std::size_t row, std::size_t col) override
+    {
+        cursor_row = std::min(row, height - 1);
+        cursor_col = std::min(col, width - 1);
+    }
+
+    void resize(std::size_t width, std::size_t height) override
+    {
+        this->width = std::max<std::size_t>(width, 1);
+        this->height = std::max<std::size_t>(height, 1);
+        cells.assign(this->width * this->height, Cell());
+        touched.assign(this->height, true);
+        cursor_row = cursor_col = 0;
+    }
+
+    void moveTo(std::size_t x, std::size_t y) override
+    {
+        this->x = x;
+        this->y = y;
+        touched.assign(height, true);
+    }
+
+    void raise() override
+    {
+        // the grid keeps what was staged last, staging every row puts the surface in front
+        touched.assign(height, true);
+    }
+
+    void leaveCursor() override
+    {
+        leave_cursor = true;
+    }
+
+    void stage() override
+    {
+        for (std::size_t row = 0; row < height && y + row < screen.height; row++) {
+            if (!touched[row] || x >= screen.width)
+                continue;
+            std::size_t count = std::min(width, screen.width - x);
+            Cell* target = screen.cells.data() + (y + row) * screen.width;
+            // a wide grapheme of another surface may straddle the edge
+            if (x != 0 && target[x].isContinuation())
+                target[x - 1] = Cell();
+            std::copy_n(cells.begin() + row * width, count, target + x);
+            if (x + count < screen.width && target[x + count].isContinuation())
+                target[x + count] = Cell();
+            // or be cut by the screen edge
+            if (count < width && cells[row * width + count].isContinuation())
+                target[x + count - 1] = Cell();
+            touched[row] = false;
+        }
+        if (leave_cursor)
+            return;
+        screen.cursor_row = std::min(y + cursor_row, screen.height - 1);
+        screen.cursor_col = std::min(x + cursor_col, screen.width - 1);
+    }
+
+private:
+    Cell styled(Cell cell) const
+    {
+        cell.style = style;
+        return cell;
+    }
+
+    /**
+     * @brief blank the left half of a wide grapheme about to lose its right half at col
+     */
+    void cutWideBefore(Cell* line, std::size_t col)
+    {
+        if (col != 0 && line[col].isContinuation())
+            line[col - 1] = Cell();
+    }
+
+    /**
+     * @brief blank a right half left behind at col after overwriting the cells before it
+     */
+    void cutWideAfter(Cell* line, std::size_t col)
+    {
+        if (col < width && line[col].isContinuation())
+            line[col] = Cell();
+    }
+
+    CellScreen& screen;
+    std::size_t x, y, width = 0, height = 0;
+    std::size_t cursor_row = 0, cursor_col = 0;
+    bool leave_cursor = false;
+    std::vector<Cell> cells;
+    std::vector<bool> touched;
+    Style style = Style::Normal;
+};
+
+CellScreen::CellScreen(std::size_t width, std::size_t height)
+{
+    resizeGrid(width, height);
+}
+
+std::unique_ptr<Surface> CellScreen::createSurface(std::size_t x, std::size_t y, std::size_t width, std::size_t height)
+{
+    return std::make_unique<CellSurface>(*this, x, y, width, height);
+}
+
+void CellScreen::update()
+{
+    frame_count++;
+}
+
+std::size_t CellScreen::getWidth() const
+{
+    return width;
+}
+
+std::size_t CellScreen::getHeight() const
+{
+    return height;
+}
+
+std::string CellScreen::getRow(std::size_t row) const
+{
+    std::string text;
+    for (std::size_t col = 0; col < width; col++)
+        text += cells[row * width + col].view();
+    return text;
+}
+
+std::pair<std::size_t, std::size_t> CellScreen::getCursor() const
+{
+    return { cursor_row, cursor_col };
+}
+
+std::size_t CellScreen::getFrameCount() const
+{
+    return frame_count;
+}
+
+void CellScreen::resizeGrid(std::size_t width, std::size_t height)
+{
+    this->width = std::max<std::size_t>(width, 1);
+    this->height = std::max<std::size_t>(height, 1);
+    cells.assign(this->width * this->height, Cell());
+    cursor_row = cursor_col = 0;
+}
@@ -0,0 +1,131 @@
+/**
+ * @file ChunkCache.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Implementation of ChunkCache
+ */
+
+#include "ChunkCache.h"
+#include "TextScan.h"
+#include <algorithm>
+
+ChunkCache::ChunkCache(std::shared_ptr<const MappedFile> file, std::size_t budget)
+    : file(std::move(file))
+    , budget(budget)
+{
+    bytes = this->file->view();
+    chunks.resize((bytes.size() + chunk_size - 1) / chunk_size);
+}
+
+void ChunkCache::countLines()
+{
+    newlines_before.assign(chunks.size() + 1, 0);
+    for (std::size_t i = 0; i < chunks.size(); i++) {
+        std::string_view chunk = bytes.substr(i * chunk_size, chunk_size);
+        newlines_before[i + 1] = newlines_before[i] + std::count(chunk.begin(), chunk.end(), '\n');
+        // a big file would otherwise end up resident as a whole
+        file->release(i * chunk_size, chunk.size());
+    }
+}
+
+std::size_t ChunkCache::countNewlines(std::size_t begin, std::size_t end)
+{
+    return rank(end) - rank(begin);
+}
+
+std::size_t ChunkCache::findNewline(std::size_t begin, std::size_t nth)
+{
+    std::size_t target = rank(begin) + nth;
+    // the chunk holding newline number target
+    std::size_t index = std::upper_bound(newlines_before.begin(), newlines_before.end(), target) - newlines_before.begin() - 1;
+    auto newlines = load(index);
+    return index * chunk_size + (*newlines)[target - newlines_before[index]];
+}
+
+void ChunkCache::prefetch(std::string_view range)
+{
+    if (range.empty() || range.data() < bytes.data() || range.data() + range.size() > bytes.data() + bytes.size())
+        return;
+    std::size_t begin = range.data() - bytes.data();
+    for (std::size_t index = begin / chunk_size; index * chunk_size < begin + range.size(); index++)
+        load(index);
+}
+
+std::size_t ChunkCache::getResidentBytes() const
+{
+    std::lock_guard lock(mutex);
+    return resident;
+}
+
+std::size_t ChunkCache::getLoadedCount() const
+{
+    std::lock_guard lock(mutex);
+    return recent.size();
+}
+
+std::size_t ChunkCache::getLoadCount() const
+{
+    std::lock_guard lock(mutex);
+    return loads;
+}
+
+std::size_t ChunkCache::getBudget() const
+{
+    return budget;
+}
+
+std::shared_ptr<const ChunkCache::Offsets> ChunkCache::load(std::size_t index)
+{
+    {
+        std::lock_guard lock(mutex);
+        Chunk& chunk = chunks[index];
+        if (chunk.newlines) {
+            recent.splice(recent.begin(), recent, chunk.recent);
+            return chunk.newlines;
+        }
+    }
+    // scanned without the lock, a lookup in another chunk need not wait for it
+    std::string_view bytes_of_chunk = bytes.substr(index * chunk_size, chunk_size);
+    file->prefetch(index * chunk_size, bytes_of_chunk.size());
+    std::vector<std::size_t> found;
+    TextScan::findNewlines(bytes_of_chunk, 0, found);
+    auto newlines = std::make_shared<const Offsets>(found.begin(), found.end());
+    std::lock_guard lock(mutex);
+    Chunk& chunk = chunks[index];
+    // another thread may have loaded it meanwhile
+    if (chunk.newlines) {
+        recent.splice(recent.begin(), recent, chunk.recent);
+        return chunk.newlines;
+    }
+    chunk.newlines = newlines;
+    loads++;
+    recent.push_front(index);
+    chunk.recent = recent.begin();
+    resident += costOf(index, *newlines);
+    while (resident > budget && recent.size() > 1) {
+        std::size_t evicted = recent.back();
+        recent.pop_back();
+        Chunk& old = chunks[evicted];
+        resident -= costOf(evicted, *old.newlines);
+        old.newlines.reset();
+        file->release(evicted * chunk_size, std::min(chunk_size, bytes.size() - evicted * chunk_size));
+    }
+    return newlines;
+}
+
+std::size_t ChunkCache::rank(std::size_t offset)
+{
+    std::size_t index = offset / chunk_size;
+    // a chunk boundary or the end of the file needs no chunk
+    if (offset >= bytes.size())
+        return newlines_before.back();
+    if (offset % chunk_size == 0)
+        return newlines_before[index];
+    auto newlines = load(index);
+    return newlines_before[index] + (std::lower_bound(newlines->begin(), newlines->end(), offset % chunk_size) - newlines->begin());
+}
+
+std::size_t ChunkCache::costOf(std::size_t index, const Offsets& newlines) const
+{
+    return std::min(chunk_size, bytes.size() - index * chunk_size) + newlines.size() * sizeof(std::uint32_t);
+}
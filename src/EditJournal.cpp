@@ -0,0 +1,202 @@
+/**
+ * @file EditJournal.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Implementation of the undo/redo journal
+ */
+
+#include "EditJournal.h"
+#include <algorithm>
+#include <cstring>
+
+EditJournal::EditJournal(std::size_t budget)
+    : budget(budget)
+{
+}
+
+void EditJournal::recordInsert(std::size_t offset, std::string_view text)
+{
+    if (text.empty())
+        return;
+    dropRedo();
+    if (!merge(Kind::Insert, offset, text))
+        append(Kind::Insert, offset, text);
+    trim();
+}
+
+void EditJournal::recordErase(std::size_t offset, std::string_view text)
+{
+    if (text.empty())
+        return;
+    dropRedo();
+    if (!merge(Kind::Erase, offset, text))
+        append(Kind::Erase, offset, text);
+    trim();
+}
+
+void EditJournal::seal()
+{
+    merging = false;
+}
+
+void EditJournal::beginGroup()
+{
+    seal();
+    grouping = true;
+    group_started = false;
+}
+
+void EditJournal::endGroup()
+{
+    grouping = false;
+    merging = false;
+}
+
+bool EditJournal::canUndo() const
+{
+    return applied != 0;
+}
+
+bool EditJournal::canRedo() const
+{
+    return applied != entries.size();
+}
+
+EditJournal::Edit EditJournal::undo()
+{
+    seal();
+    const Entry& entry = entries[--applied];
+    return { entry.kind, entry.offset, std::string_view(entry.data, entry.length), entry.linked };
+}
+
+EditJournal::Edit EditJournal::redo()
+{
+    seal();
+    const Entry& entry = entries[applied++];
+    return { entry.kind, entry.offset, std::string_view(entry.data, entry.length), entry.linked };
+}
+
+bool EditJournal::isRedoLinked() const
+{
+    return canRedo() && entries[applied].linked;
+}
+
+bool EditJournal::isAtStart() const
+{
+    return applied == 0 && !trimmed;
+}
+
+void EditJournal::clear()
+{
+    entries.clear();
+    chunks.clear();
+    first_chunk = 0;
+    applied = 0;
+    chunk_bytes = 0;
+    merging = false;
+    grouping = false;
+    trimmed = false;
+}
+
+std::size_t EditJournal::size() const
+{
+    return entries.size();
+}
+
+std::size_t EditJournal::memoryUsage() const
+{
+    return chunk_bytes + entries.size() * sizeof(Entry);
+}
+
+bool EditJournal::merge(Kind kind, std::size_t offset, std::string_view text)
+{
+    if (!merging || grouping || entries.empty() || text.size() > max_keystroke || text.find('\n') != std::string_view::npos)
+        return false;
+    Entry& last = entries.back();
+    if (last.kind != kind || last.length + text.size() > max_merged || !atArenaEnd(last, text.size()))
+        return false;
+    Chunk& chunk = chunks.back();
+    if (offset == last.offset + last.length && kind == Kind::Insert) {
+        // typing forward
+        std::memcpy(last.data + last.length, text.data(), text.size());
+    } else if (offset == last.offset && kind == Kind::Erase) {
+        // deleting forward, the erased text keeps coming from the same offset
+        std::memcpy(last.data + last.length, text.data(), text.size());
+    } else if (offset + text.size() == last.offset && kind == Kind::Erase) {
+        // backspacing, the erased text comes before what was erased already
+        std::memmove(last.data + text.size(), last.data, last.length);
+        std::memcpy(last.data, text.data(), text.size());
+        last.offset = offset;
+    } else {
+        return false;
+    }
+    last.length += text.size();
+    chunk.used += text.size();
+    return true;
+}
+
+void EditJournal::append(Kind kind, std::size_t offset, std::string_view text)
+{
+    if (chunks.empty() || chunks.back().capacity - chunks.back().used < text.size()) {
+        // an edit larger than a chunk gets a chunk of its own
+        std::size_t capacity = std::max(chunk_size, text.size());
+        chunks.push_back({ std::make_unique_for_overwrite<char[]>(capacity), capacity, 0 });
+        chunk_bytes += capacity;
+    }
+    Chunk& chunk = chunks.back();
+    char* data = chunk.data.get() + chunk.used;
+    std::memcpy(data, text.data(), text.size());
+    chunk.used += text.size();
+    entries.push_back({ kind, offset, text.size(), data, first_chunk + chunks.size() - 1, grouping && group_started });
+    applied = entries.size();
+    group_started = grouping;
+    // a line break or a paste ends the step right away
+    merging = !grouping && text.size() <= max_keystroke && text.find('\n') == std::string_view::npos;
+}
+
+void EditJournal::dropRedo()
+{
+    if (applied == entries.size())
+        return;
+    merging = false;
+    while (entries.size() > applied) {
+        const Entry& entry = entries.back();
+        // payloads are allocated in entry order, so the newest entry is always the arena end
+        while (first_chunk + chunks.size() - 1 > entry.chunk) {
+            chunk_bytes -= chunks.back().capacity;
+            chunks.pop_back();
+        }
+        chunks.back().used = entry.data - chunks.back().data.get();
+        entries.pop_back();
+    }
+}
+
+void EditJournal::trim()
+{
+    if (memoryUsage() <= budget)
+        return;
+    while (!entries.empty() && memoryUsage() > budget) {
+        // a step goes as a whole, half of a group cannot be undone on its own
+        trimmed = true;
+        do {
+            entries.pop_front();
+            applied--;
+        } while (!entries.empty() && entries.front().linked);
+        // free the chunks no entry points into anymore
+        std::size_t keep_from = entries.empty() ? first_chunk + chunks.size() : entries.front().chunk;
+        while (first_chunk < keep_from) {
+            chunk_bytes -= chunks.front().capacity;
+            chunks.pop_front();
+            first_chunk++;
+        }
+    }
+    if (entries.empty())
+        merging = false;
+}
+
+bool EditJournal::atArenaEnd(const Entry& entry, std::size_t extra) const
+{
+    const Chunk& chunk = chunks.back();
+    return entry.chunk == first_chunk + chunks.size() - 1 && entry.data + entry.length == chunk.data.get() + chunk.used
+        && chunk.used + extra <= chunk.capacity;
+}
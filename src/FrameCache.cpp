@@ -0,0 +1,67 @@
+/**
+ * @file FrameCache.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Implementation of FrameCache
+ */
+
+#include "FrameCache.h"
+#include "Lz.h"
+#include <algorithm>
+
+FrameCache::FrameCache(std::size_t capacity)
+    : capacity(std::max<std::size_t>(capacity, 1))
+{
+}
+
+std::shared_ptr<FrameCache> FrameCache::Instance()
+{
+    static std::shared_ptr<FrameCache> instance = std::make_shared<FrameCache>();
+    return instance;
+}
+
+FrameCache::Frame FrameCache::get(std::uint64_t block, std::size_t index, std::string_view compressed, std::size_t size)
+{
+    auto find = [&] {
+        return std::find_if(recent.begin(), recent.end(), [&](const Entry& entry) { return entry.block == block && entry.index == index; });
+    };
+    {
+        std::lock_guard lock(mutex);
+        if (auto entry = find(); entry != recent.end()) {
+            recent.splice(recent.begin(), recent, entry);
+            return entry->frame;
+        }
+    }
+    // decompressed without the lock, a reader of another frame need not wait for it
+    auto bytes = std::make_shared<std::string>(size, '\0');
+    Lz::decompress(compressed, bytes->data(), size);
+    Frame frame = std::move(bytes);
+    std::lock_guard lock(mutex);
+    // another thread may have decompressed it meanwhile
+    if (auto entry = find(); entry != recent.end()) {
+        recent.splice(recent.begin(), recent, entry);
+        return entry->frame;
+    }
+    decompressions++;
+    recent.push_front({ block, index, frame });
+    if (recent.size() > capacity)
+        recent.pop_back();
+    return frame;
+}
+
+std::size_t FrameCache::getCachedCount() const
+{
+    std::lock_guard lock(mutex);
+    return recent.size();
+}
+
+std::size_t FrameCache::getDecompressCount() const
+{
+    std::lock_guard lock(mutex);
+    return decompressions;
+}
+
+std::size_t FrameCache::getCapacity() const
+{
+    return capacity;
+}
@@ -0,0 +1,542 @@
+/**
+ * @file Highlighter.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Implementation of the incremental syntax highlighter and its lexers
+ */
+
+#include "Highlighter.h"
+#include "Logger.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <exception>
+
+namespace {
+using Span = Highlighter::Span;
+
+// end states of a config line
+constexpr std::uint8_t config_normal = 0;
+// inside a toml """ string
+constexpr std::uint8_t config_basic_string = 1;
+// inside a toml ''' string
+constexpr std::uint8_t config_literal_string = 2;
+// inside a yaml block scalar, the low bits are the indentation of the key owning it
+constexpr std::uint8_t config_block_scalar = 0x80;
+
+// end states of a log line, the level of the entry the line belongs to, 0 before the first one
+constexpr std::uint8_t log_error = 1;
+constexpr std::uint8_t log_warning = 2;
+constexpr std::uint8_t log_other = 3;
+
+constexpr std::array<std::string_view, 9> error_levels = { "ERROR", "ERR", "FATAL", "CRITICAL", "CRIT", "SEVERE", "PANIC", "EMERG", "ALERT" };
+constexpr std::array<std::string_view, 2> warning_levels = { "WARN", "WARNING" };
+constexpr std::array<std::string_view, 6> other_levels = { "INFO", "DEBUG", "TRACE", "NOTICE", "FINE", "VERBOSE" };
+constexpr std::array<std::string_view, 12> months = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+constexpr std::array<std::string_view, 9> constants = { "true", "false", "yes", "no", "on", "off", "null", "none", "~" };
+
+bool isSpace(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\r';
+}
+
+bool isDigit(char ch)
+{
+    return ch >= '0' && ch <= '9';
+}
+
+/**
+ * @brief check if a character ends a bare word
+ */
+bool isDelimiter(char ch)
+{
+    return isSpace(ch) || std::strchr("[]{}(),;=<>\"'", ch) != nullptr;
+}
+
+std::size_t skipSpaces(std::string_view line, std::size_t pos)
+{
+    while (pos < line.size() && isSpace(line[pos]))
+        pos++;
+    return pos;
+}
+
+void emit(std::vector<Span>* spans, std::size_t begin, std::size_t end, Style style)
+{
+    if (spans && begin < end)
+        spans->push_back({ begin, end, style });
+}
+
+template <std::size_t N>
+bool isOneOf(std::string_view word, const std::array<std::string_view, N>& words)
+{
+    return std::find(words.begin(), words.end(), word) != words.end();
+}
+
+/**
+ * @brief numbers, dates, versions and durations all start with a digit, maybe after a sign
+ */
+bool isNumber(std::string_view word)
+{
+    std::size_t digit = word.find_first_not_of("+-.");
+    if (digit == std::string_view::npos || digit > 1 || !isDigit(word[digit]))
+        return false;
+    return std::all_of(word.begin(), word.end(), [](char ch) {
+        return std::isalnum(static_cast<unsigned char>(ch)) || std::strchr("._:+-", ch) != nullptr;
+    });
+}
+
+/**
+ * @brief lex a quoted string starting at pos
+ *
+ * @return std::size_t one past its closing quote, the line end if it has none
+ */
+std::size_t stringEnd(std::string_view line, std::size_t pos)
+{
+    char quote = line[pos];
+    std::size_t end = pos + 1;
+    while (end < line.size() && line[end] != quote)
+        end += quote == '"' && line[end] == '\\' ? 2 : 1;
+    return std::min(end + 1, line.size());
+}
+
+std::size_t wordEnd(std::string_view line, std::size_t pos)
+{
+    while (pos < line.size() && !isDelimiter(line[pos]))
+        pos++;
+    return pos;
+}
+
+/**
+ * @brief lex the value part of a config line from pos
+ *
+ * @return std::uint8_t end state, a multi-line string may stay open
+ */
+std::uint8_t lexConfigValue(std::string_view line, std::size_t pos, std::vector<Span>* spans)
+{
+    while (pos < line.size()) {
+        char ch = line[pos];
+        if (isSpace(ch) || (isDelimiter(ch) && ch != '"' && ch != '\'')) {
+            pos++;
+        } else if (ch == '#') {
+            emit(spans, pos, line.size(), Style::Comment);
+            break;
+        } else if (line.substr(pos, 3) == "\"\"\"" || line.substr(pos, 3) == "'''") {
+            std::size_t close = line.find(line.substr(pos, 3), pos + 3);
+            if (close == std::string_view::npos) {
+                emit(spans, pos, line.size(), Style::String);
+                return ch == '"' ? config_basic_string : config_literal_string;
+            }
+            emit(spans, pos, close + 3, Style::String);
+            pos = close + 3;
+        } else if (ch == '"' || ch == '\'') {
+            std::size_t end = stringEnd(line, pos);
+            emit(spans, pos, end, Style::String);
+            pos = end;
+        } else {
+            std::size_t end = wordEnd(line, pos);
+            std::string_view word = line.substr(pos, end - pos);
+            if (isNumber(word) || isOneOf(word, constants))
+                emit(spans, pos, end, Style::Number);
+            pos = end;
+        }
+    }
+    return config_normal;
+}
+
+std::uint8_t lexConfig(std::string_view line, std::uint8_t state, std::vector<Span>* spans)
+{
+    if (state == config_basic_string || state == config_literal_string) {
+        std::size_t close = line.find(state == config_basic_string ? "\"\"\"" : "'''");
+        if (close == std::string_view::npos) {
+            emit(spans, 0, line.size(), Style::String);
+            return state;
+        }
+        emit(spans, 0, close + 3, Style::String);
+        return lexConfigValue(line, close + 3, spans);
+    }
+    std::size_t pos = skipSpaces(line, 0);
+    // the block scalar goes on while lines are blank or indented deeper than its key
+    if (state & config_block_scalar) {
+        std::size_t parent = state & 0x7f;
+        if (pos == line.size() || pos > parent) {
+            emit(spans, pos, line.size(), Style::String);
+            return state;
+        }
+    }
+    if (pos == line.size())
+        return config_normal;
+    if (line[pos] == '#' || line[pos] == ';') {
+        emit(spans, pos, line.size(), Style::Comment);
+        return config_normal;
+    }
+    if (line[pos] == '[') {
+        std::size_t close = line.find(']', pos);
+        if (close != std::string_view::npos) {
+            // [[array of tables]]
+            while (close + 1 < line.size() && line[close + 1] == ']')
+                close++;
+            emit(spans, pos, close + 1, Style::Section);
+            return lexConfigValue(line, close + 1, spans);
+        }
+    }
+    // a yaml list item may hold a key itself
+    if (line[pos] == '-' && (pos + 1 == line.size() || isSpace(line[pos + 1])))
+        pos = skipSpaces(line, pos + 1);
+    // the key ends at the first = or at a : followed by a space, quoted parts do not count
+    std::size_t key_end = std::string_view::npos;
+    for (std::size_t i = pos; i < line.size(); i++) {
+        char ch = line[i];
+        if (ch == '"' || ch == '\'') {
+            i = stringEnd(line, i) - 1;
+        } else if (ch == '=' || (ch == ':' && (i + 1 == line.size() || isSpace(line[i + 1])))) {
+            key_end = i;
+            break;
+        } else if (ch == '#' && i > pos && isSpace(line[i - 1])) {
+            break;
+        }
+    }
+    if (key_end == std::string_view::npos)
+        return lexConfigValue(line, pos, spans);
+    std::size_t key_last = key_end;
+    while (key_last > pos && isSpace(line[key_last - 1]))
+        key_last--;
+    emit(spans, pos, key_last, Style::Key);
+    std::size_t value = skipSpaces(line, key_end + 1);
+    if (value < line.size() && (line[value] == '|' || line[value] == '>')) {
+        std::size_t end = value + 1;
+        while (end < line.size() && (isDigit(line[end]) || line[end] == '-' || line[end] == '+'))
+            end++;
+        std::size_t rest = skipSpaces(line, end);
+        if (rest == line.size() || line[rest] == '#') {
+            emit(spans, rest, line.size(), Style::Comment);
+            return config_block_scalar | static_cast<std::uint8_t>(std::min<std::size_t>(pos, 0x7f));
+        }
+    }
+    return lexConfigValue(line, value, spans);
+}
+
+/**
+ * @brief find the timestamp a log entry starts with, ISO-like dates and times, syslog dates
+ * and bracketed kernel uptimes
+ *
+ * @return std::size_t one past its end, 0 if the line does not start with one
+ */
+std::size_t timestampEnd(std::string_view line)
+{
+    std::size_t pos = 0;
+    bool bracketed = !line.empty() && line[0] == '[';
+    if (bracketed)
+        pos = skipSpaces(line, 1);
+    std::size_t begin = pos;
+    if (line.size() >= pos + 4 && isOneOf(line.substr(pos, 3), months) && line[pos + 3] == ' ')
+        pos = skipSpaces(line, pos + 3);
+    if (pos == line.size() || !isDigit(line[pos]))
+        return 0;
+    bool separated = pos != begin;
+    while (pos < line.size()) {
+        char ch = line[pos];
+        if (isDigit(ch) || ch == '.' || ch == ',' || ch == 'T' || ch == 'Z' || ch == '+') {
+            pos++;
+        } else if (ch == '-' || ch == ':' || ch == '/') {
+            separated = true;
+            pos++;
+        } else if (ch == ' ' && pos + 1 < line.size() && isDigit(line[pos + 1])) {
+            pos++;
+        } else {
+            break;
+        }
+    }
+    if (bracketed) {
+        if (pos == line.size() || line[pos] != ']')
+            return 0;
+        return pos + 1;
+    }
+    return separated && pos - begin >= 8 ? pos : 0;
+}
+
+/**
+ * @brief lex the message of a log line from pos
+ *
+ * @return std::uint8_t level of the first level word, log_other if there is none
+ */
+std::uint8_t lexLogMessage(std::string_view line, std::size_t pos, std::vector<Span>* spans)
+{
+    std::uint8_t level = log_other;
+    bool leveled = false;
+    while (pos < line.size()) {
+        char ch = line[pos];
+        if (ch == '"') {
+            std::size_t end = stringEnd(line, pos);
+            emit(spans, pos, end, Style::String);
+            pos = end;
+        } else if (isDelimiter(ch)) {
+            pos++;
+        } else {
+            std::size_t end = wordEnd(line, pos);
+            std::string_view word = line.substr(pos, end - pos);
+            std::string_view bare = word.ends_with(':') ? word.substr(0, word.size() - 1) : word;
+            if (!leveled && isOneOf(bare, error_levels)) {
+                emit(spans, pos, pos + bare.size(), Style::Error);
+                level = log_error;
+                leveled = true;
+            } else if (!leveled && isOneOf(bare, warning_levels)) {
+                emit(spans, pos, pos + bare.size(), Style::Warning);
+                level = log_warning;
+                leveled = true;
+            } else if (!leveled && isOneOf(bare, other_levels)) {
+                emit(spans, pos, pos + bare.size(), Style::Key);
+                leveled = true;
+            } else if (isNumber(word)) {
+                emit(spans, pos, end, Style::Number);
+            }
+            pos = end;
+        }
+    }
+    return level;
+}
+
+std::uint8_t lexLog(std::string_view line, std::uint8_t state, std::vector<Span>* spans)
+{
+    std::size_t stamp_end = timestampEnd(line);
+    if (stamp_end == 0) {
+        // not an entry of its own, e.g. a stack trace, it takes the level of the entry above
+        if (state == log_error || state == log_warning) {
+            emit(spans, skipSpaces(line, 0), line.size(), state == log_error ? Style::Error : Style::Warning);
+            return state;
+        }
+        lexLogMessage(line, 0, spans);
+        return state;
+    }
+    emit(spans, 0, stamp_end, Style::Timestamp);
+    return lexLogMessage(line, stamp_end, spans);
+}
+}
+
+Highlighter::~Highlighter()
+{
+    if (batch)
+        batch->token.cancel();
+}
+
+Highlighter::Syntax Highlighter::syntaxFor(const std::filesystem::path& path)
+{
+    std::string name = path.filename().string();
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char ch) { return std::tolower(ch); });
+    std::string extension = std::filesystem::path(name).extension().string();
+    for (std::string_view config : { ".ini", ".conf", ".cfg", ".cnf", ".toml", ".yaml", ".yml", ".properties", ".env", ".desktop", ".service" }) {
+        if (extension == config || name == config)
+            return Syntax::Config;
+    }
+    if (name == ".gitconfig" || name == ".editorconfig")
+        return Syntax::Config;
+    // rotated logs keep their extension in the middle, app.log.1
+    if (extension == ".log" || name.find(".log.") != std::string::npos)
+        return Syntax::Log;
+    return Syntax::None;
+}
+
+std::uint8_t Highlighter::lexLine(Syntax syntax, std::string_view line, std::uint8_t state, std::vector<Span>* spans)
+{
+    switch (syntax) {
+    case Syntax::Config:
+        return lexConfig(line, state, spans);
+    case Syntax::Log:
+        return lexLog(line, state, spans);
+    case Syntax::None:
+    default:
+        return 0;
+    }
+}
+
+void Highlighter::setSyntax(Syntax syntax, std::size_t line_count)
+{
+    this->syntax = syntax;
+    reset(line_count);
+}
+
+Highlighter::Syntax Highlighter::getSyntax() const
+{
+    return syntax;
+}
+
+void Highlighter::reset(std::size_t line_count)
+{
+    invalidateFrom(0);
+    if (syntax == Syntax::None) {
+        states.clear();
+        dirty.clear();
+        return;
+    }
+    states.assign(line_count, 0);
+    dirty.assign(line_count, 1);
+}
+
+void Highlighter::replaceLines(std::size_t first, std::size_t old_count, std::size_t new_count)
+{
+    if (syntax == Syntax::None)
+        return;
+    invalidateFrom(first);
+    // the old states stay as a guess for painting the lines below until they are relexed
+    auto splice = [&](std::vector<std::uint8_t>& values) {
+        if (new_count > old_count)
+            values.insert(values.begin() + first + old_count, new_count - old_count, 0);
+        else
+            values.erase(values.begin() + first + new_count, values.begin() + first + old_count);
+    };
+    splice(states);
+    splice(dirty);
+    std::fill(dirty.begin() + first, dirty.begin() + first + new_count, 1);
+}
+
+std::pair<std::size_t, std::size_t> Highlighter::update(const PieceTable& text, std::size_t viewport_end)
+{
+    std::pair<std::size_t, std::size_t> changed { 0, 0 };
+    if (syntax == Syntax::None)
+        return changed;
+    // a cancelled batch may never run, its results are worthless anyway
+    if (batch && batch->token.isCancelled())
+        batch.reset();
+    if (batch && batch->done.load(std::memory_order_acquire))
+        changed = merge();
+    if (batch || frontier >= states.size())
+        return changed;
+    std::size_t limit = std::min(batch_lines, states.size() - frontier);
+    bool visible = frontier < viewport_end;
+    if (visible)
+        limit = std::min(limit, viewport_end - frontier);
+    auto next = std::make_shared<Batch>();
+    next->text = text;
+    next->syntax = syntax;
+    next->first = frontier;
+    next->input = frontier == 0 ? 0 : states[frontier - 1];
+    next->old_states.assign(states.begin() + frontier, states.begin() + frontier + limit);
+    next->old_dirty.assign(dirty.begin() + frontier, dirty.begin() + frontier + limit);
+    batch = next;
+    edit_floor = std::string::npos;
+    auto priority = visible ? Scheduler::Priority::Interactive : Scheduler::Priority::Background;
+    Scheduler::Instance()->submit(priority, [next](const CancellationToken&) {
+        try {
+            lexBatch(*next);
+        } catch (const std::exception& e) {
+            // merged like a cancelled batch, the next one picks up where it stopped
+            Logger::Instance()->error("highlight batch failed: {}", e.what());
+        }
+        next->done.store(true, std::memory_order_release);
+    }, {}, next->token);
+    return changed;
+}
+
+bool Highlighter::isDone() const
+{
+    return syntax == Syntax::None || (!batch && frontier >= states.size());
+}
+
+const std::vector<Highlighter::Span>& Highlighter::getSpans(const PieceTable& text, std::size_t line) const
+{
+    if (line == cached_line)
+        return cached_spans;
+    cached_spans.clear();
+    cached_line = line;
+    if (syntax != Syntax::None && line < states.size())
+        lexLine(syntax, text.line(line), line == 0 ? 0 : states[line - 1], &cached_spans);
+    return cached_spans;
+}
+
+void Highlighter::lexBatch(Batch& batch)
+{
+    std::size_t limit = batch.old_states.size();
+    batch.states.reserve(limit);
+    std::uint8_t state = batch.input;
+    std::string carry;
+    // returns false once the batch should stop
+    auto lexed = [&](std::string_view line) {
+        std::size_t index = batch.states.size();
+        state = lexLine(batch.syntax, line, state, nullptr);
+        batch.states.push_back(state);
+        if (!batch.old_dirty[index] && state == batch.old_states[index]) {
+            batch.converged = true;
+            return false;
+        }
+        if ((index + 1) % cancel_check_lines == 0 && batch.token.isCancelled())
+            return false;
+        return index + 1 < limit;
+    };
+    std::size_t begin = batch.text.lineStart(batch.first);
+    bool stopped = false;
+    batch.text.forEachChunk(begin, batch.text.size() - begin, [&](std::string_view chunk) {
+        std::size_t pos = 0;
+        while (true) {
+            std::size_t newline = chunk.find('\n', pos);
+            if (newline == std::string_view::npos) {
+                carry.append(chunk.substr(pos));
+                return true;
+            }
+            bool more;
+            if (carry.empty()) {
+                more = lexed(chunk.substr(pos, newline - pos));
+            } else {
+                // a line split between two pieces
+                carry.append(chunk.substr(pos, newline - pos));
+                more = lexed(carry);
+                carry.clear();
+            }
+            if (!more) {
+                stopped = true;
+                return false;
+            }
+            pos = newline + 1;
+        }
+    });
+    // the last line has no newline after it
+    if (!stopped && batch.states.size() < limit)
+        lexed(carry);
+}
+
+std::pair<std::size_t, std::size_t> Highlighter::merge()
+{
+    std::size_t first = batch->first;
+    std::size_t count = batch->states.size();
+    // lines from an edit made meanwhile on may have moved, their results are dropped
+    if (edit_floor != std::string::npos)
+        count = edit_floor > first ? std::min(count, edit_floor - first) : 0;
+    bool converged = batch->converged && count == batch->states.size();
+    std::size_t changed_first = 0, changed_last = 0;
+    for (std::size_t i = 0; i < count; i++) {
+        std::size_t line = first + i;
+        // a state is the input of the line after it
+        if (states[line] != batch->states[i] && line + 1 < states.size()) {
+            if (changed_first == changed_last)
+                changed_first = line + 1;
+            changed_last = line + 2;
+        }
+        states[line] = batch->states[i];
+        dirty[line] = 0;
+    }
+    if (count > 0)
+        cached_line = std::string::npos;
+    if (frontier == first)
+        frontier = converged ? nextDirty(first + count) : first + count;
+    batch.reset();
+    edit_floor = std::string::npos;
+    return { changed_first, changed_last };
+}
+
+std::size_t Highlighter::nextDirty(std::size_t from) const
+{
+    if (from >= dirty.size())
+        return dirty.size();
+    const void* found = std::memchr(dirty.data() + from, 1, dirty.size() - from);
+    return found ? static_cast<const std::uint8_t*>(found) - dirty.data() : dirty.size();
+}
+
+void Highlighter::invalidateFrom(std::size_t line)
+{
+    cached_line = std::string::npos;
+    frontier = std::min(frontier, line);
+    if (!batch)
+        return;
+    edit_floor = std::min(edit_floor, line);
+    if (edit_floor <= batch->first)
+        batch->token.cancel();
+}
@@ -0,0 +1,191 @@
+/**
+ * @file KeyTrace.cpp
+ * @author ayano
+ * @date 18/10/26
+ * @brief Implementation of key trace recording and replay
+ */
+
+#include "KeyTrace.h"
+#include "Application.h"
+#include "MappedFile.h"
+#include "Scheduler.h"
+#include "Screen.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fmt/core.h>
+#include <poll.h>
+#include <stdexcept>
+#include <string_view>
+
+namespace {
+constexpr char trace_magic[8] = { 'T', 'N', 'S', 'K', 'E', 'Y', '0', '1' };
+// the size used for a trace that did not record one
+constexpr std::size_t default_width = 80;
+constexpr std::size_t default_height = 24;
+// how long the replay sleeps at most before looking at the background work again
+constexpr int poll_interval_ms = 10;
+
+/**
+ * @brief append an integer seven bits at a time, the high bit set on every byte but the last
+ */
+void putVarint(std::string& out, std::uint64_t value)
+{
+    for (; value >= 0x80; value >>= 7)
+        out += static_cast<char>((value & 0x7f) | 0x80);
+    out += static_cast<char>(value);
+}
+
+bool takeVarint(std::string_view bytes, std::size_t& pos, std::uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && pos < bytes.size(); shift += 7) {
+        auto byte = static_cast<unsigned char>(bytes[pos++]);
+        value |= std::uint64_t(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+}
+
+KeyTrace KeyTrace::load(const std::filesystem::path& path)
+{
+    MappedFile file(path.string());
+    std::string_view bytes = file.view();
+    if (bytes.size() < sizeof(trace_magic) || bytes.substr(0, sizeof(trace_magic)) != std::string_view(trace_magic, sizeof(trace_magic)))
+        throw std::runtime_error(fmt::format("ERROR: {} is not a key trace", path.string()));
+    KeyTrace trace;
+    std::size_t pos = sizeof(trace_magic);
+    std::uint64_t width, height;
+    if (!takeVarint(bytes, pos, width) || !takeVarint(bytes, pos, height))
+        throw std::runtime_error(fmt::format("ERROR: {} is not a key trace", path.string()));
+    trace.width = width;
+    trace.height = height;
+    std::chrono::microseconds time { 0 };
+    while (pos < bytes.size()) {
+        std::uint64_t delta, count;
+        // a count larger than the bytes left can only be a torn record
+        if (!takeVarint(bytes, pos, delta) || !takeVarint(bytes, pos, count) || count > bytes.size() - pos)
+            break;
+        Event event { time + std::chrono::microseconds(delta), {} };
+        event.keys.reserve(count);
+        std::uint64_t key;
+        while (event.keys.size() < count && takeVarint(bytes, pos, key))
+            event.keys.push_back(static_cast<chtype>(key));
+        if (event.keys.size() < count)
+            break;
+        time = event.time;
+        trace.events.push_back(std::move(event));
+    }
+    return trace;
+}
+
+KeyTraceWriter::KeyTraceWriter(const std::filesystem::path& path, std::size_t width, std::size_t height)
+    : output(std::fopen(path.c_str(), "wb"))
+    , start(std::chrono::steady_clock::now())
+{
+    if (output == nullptr)
+        throw std::runtime_error(fmt::format("ERROR: cannot open {}: {}", path.string(), std::strerror(errno)));
+    std::string header(trace_magic, sizeof(trace_magic));
+    putVarint(header, width);
+    putVarint(header, height);
+    std::fwrite(header.data(), 1, header.size(), output);
+}
+
+KeyTraceWriter::~KeyTraceWriter()
+{
+    std::fclose(output);
+}
+
+void KeyTraceWriter::record(std::span<const chtype> keys)
+{
+    auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    record_bytes.clear();
+    putVarint(record_bytes, (time - last).count());
+    putVarint(record_bytes, keys.size());
+    for (auto ch : keys)
+        putVarint(record_bytes, ch);
+    std::fwrite(record_bytes.data(), 1, record_bytes.size(), output);
+    last = time;
+}
+
+void KeyTraceWriter::flush()
+{
+    std::fflush(output);
+}
+
+TraceReplay::TraceReplay(KeyTrace trace, std::string file_path)
+    : trace(std::move(trace))
+    , file_path(std::move(file_path))
+{
+}
+
+void TraceReplay::run(Timing timing)
+{
+    this->timing = timing;
+    latency.reset();
+    key_count = 0;
+    std::size_t width = trace.width > 1 ? trace.width : default_width;
+    std::size_t height = trace.height > 1 ? trace.height : default_height;
+    auto screen = std::make_shared<CellScreen>(width, height);
+    auto started = std::chrono::steady_clock::now();
+    Application app(file_path, screen);
+    auto scheduler = Scheduler::Instance();
+    auto sleepUntil = [&](std::chrono::steady_clock::time_point deadline) {
+        auto wait = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        pollfd fd = { scheduler->getWakeFd(), POLLIN, 0 };
+        poll(&fd, 1, static_cast<int>(std::clamp<std::chrono::milliseconds::rep>(wait.count(), 0, poll_interval_ms)));
+    };
+    // as fast as possible times the editing, not the keys queued while the file loads
+    if (timing == Timing::Fast) {
+        while (!app.pollBackground())
+            sleepUntil(std::chrono::steady_clock::now() + std::chrono::milliseconds(poll_interval_ms));
+    }
+    for (const auto& event : trace.events) {
+        if (timing == Timing::Original) {
+            auto due = started + event.time;
+            while (std::chrono::steady_clock::now() < due) {
+                sleepUntil(due);
+                app.pollBackground();
+            }
+        }
+        app.pollBackground();
+        key_count += event.keys.size();
+        auto begin = std::chrono::steady_clock::now();
+        app.feedInput(event.keys);
+        latency.record(std::chrono::steady_clock::now() - begin);
+    }
+    // the text is final once the load and the replace-all scans the keys started are applied
+    while (!app.pollBackground() || scheduler->getJobCount() != 0)
+        sleepUntil(std::chrono::steady_clock::now() + std::chrono::milliseconds(poll_interval_ms));
+    app.pollBackground();
+    elapsed = std::chrono::steady_clock::now() - started;
+    const PieceTable& text = app.getBuffer()->getText();
+    checksum = 14695981039346656037ull;
+    text.forEachChunk(0, text.size(), [this](std::string_view chunk) {
+        for (char ch : chunk) {
+            checksum ^= static_cast<unsigned char>(ch);
+            checksum *= 1099511628211ull;
+        }
+        return true;
+    });
+}
+
+const LatencyHistogram& TraceReplay::getLatency() const
+{
+    return latency;
+}
+
+std::uint64_t TraceReplay::getChecksum() const
+{
+    return checksum;
+}
+
+std::string TraceReplay::toJson() const
+{
+    return fmt::format("{{\"timing\":\"{}\",\"events\":{},\"keys\":{},\"elapsed_ms\":{},\"latency_us\":{{\"p50\":{},\"p90\":{},\"p99\":{},\"p999\":{},\"max\":{}}},\"checksum\":\"{:016x}\"}}",
+        timing == Timing::Fast ? "fast" : "original", latency.getCount(), key_count,
+        std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), latency.percentile(0.5).count(), latency.percentile(0.9).count(),
+        latency.percentile(0.99).count(), latency.percentile(0.999).count(), latency.getMax().count(), checksum);
+}
@@ -10,15 +10,34 @@
 #include "fmt/core.h"
 #include <ctime>
 #include <filesystem>
-#include <iomanip>
 #include <memory>
-#include <mutex>
+
+namespace {
+constexpr std::size_t batch_bytes = 64 * 1024;
+
+const char* levelTag(Logger::Level level)
+{
+    switch (level) {
+    case Logger::Level::Debug:
+        return "[DEBUG] ";
+    case Logger::Level::Info:
+        return "[INFO] ";
+    case Logger::Level::Warn:
+        return "[WARN] ";
+    case Logger::Level::Error:
+        return "[ERROR] ";
+    default:
+        return "";
+    }
+}
+}
 
 Logger::Logger()
 {
     std::string name = fmt::format("logs/{}.log", std::to_string(std::chrono::system_clock::to_time_t(std::chrono::system_clock::now())));
     std::filesystem::create_directory("logs");
     log_file.open(name, std::ios::out | std::ios::app);
+    writer = std::thread(&Logger::writerLoop, this);
 }
 
 std::shared_ptr<Logger> Logger::Instance()
@@ -29,43 +48,109 @@ std::shared_ptr<Logger> Logger::Instance()
 
 Logger::~Logger()
 {
+    stopping.store(true, std::memory_order_seq_cst);
+    wakeup.fetch_add(1, std::memory_order_seq_cst);
+    wakeup.notify_one();
+    writer.join();
     log_file.close();
 }
 
-void Logger::log(const std::string& message)
+void Logger::writerLoop()
 {
-    std::lock_guard<std::mutex> guard(lock);
-    auto t = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-    auto tm = std::localtime(&t);
-    std::stringstream ss;
-    ss << std::put_time(tm, "%F %T");
-    log_file << fmt::format("[{}] {}\n", ss.str(), message);
+    while (true) {
+        if (drain())
+            continue;
+        if (stopping.load(std::memory_order_seq_cst)) {
+            drain();
+            return;
+        }
+        // announce the sleep before the last look at the counter, so a producer either sees
+        // the flag and wakes us or its record is seen here
+        writer_sleeping.store(true, std::memory_order_seq_cst);
+        auto observed = wakeup.load(std::memory_order_seq_cst);
+        if (enqueued.load(std::memory_order_seq_cst) == written.load(std::memory_order_relaxed) && !stopping.load(std::memory_order_seq_cst))
+            wakeup.wait(observed, std::memory_order_seq_cst);
+        writer_sleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+bool Logger::drain()
+{
+    fmt::memory_buffer batch;
+    std::uint64_t count = 0;
+    auto consume = [this, &batch](Record& record) {
+        auto second = std::chrono::system_clock::to_time_t(record.time);
+        if (second != cached_second) {
+            std::tm tm;
+            localtime_r(&second, &tm);
+            std::strftime(cached_timestamp, sizeof(cached_timestamp), "%F %T", &tm);
+            cached_second = second;
+        }
+        batch.push_back('[');
+        batch.append(std::string_view(cached_timestamp));
+        batch.append(std::string_view("] "));
+        batch.append(std::string_view(levelTag(record.level)));
+        record.formatter(record.arguments, batch);
+        batch.push_back('\n');
+    };
+    while (queue.tryPop(consume)) {
+        count++;
+        if (batch.size() >= batch_bytes) {
+            log_file.write(batch.data(), batch.size());
+            batch.clear();
+        }
+    }
+    if (auto drops = dropped.load(std::memory_order_relaxed); drops != reported_drops) {
+        fmt::format_to(fmt::appender(batch), "[{}] [WARN] logger queue full, dropped {} messages\n", cached_timestamp, drops - reported_drops);
+        reported_drops = drops;
+    }
+    if (batch.size() != 0) {
+        log_file.write(batch.data(), batch.size());
+    }
+    if (count == 0)
+        return false;
     log_file.flush();
+    written.fetch_add(count, std::memory_order_release);
+    return true;
 }
 
-void Logger::info(const std::string& message)
+void Logger::setLevel(Level level)
 {
-    log(fmt::format("[INFO] {}", message));
+    runtime_level.store(level, std::memory_order_relaxed);
 }
 
-void Logger::error(const std::string& message)
+bool Logger::enabled(Level level) const
 {
-    log(fmt::format("[ERROR] {}", message));
+    return level >= compiled_level && level >= runtime_level.load(std::memory_order_relaxed);
 }
 
-void Logger::warn(const std::string& message)
+void Logger::flush()
 {
-    log(fmt::format("[WARN] {}", message));
+    auto target = enqueued.load(std::memory_order_seq_cst);
+    while (written.load(std::memory_order_acquire) < target) {
+        wakeup.fetch_add(1, std::memory_order_seq_cst);
+        wakeup.notify_one();
+        std::this_thread::yield();
+    }
 }
 
-std::ofstream& Logger::getLogFile()
+void Logger::info(const std::string& message)
 {
-    return log_file;
+    log<Level::Info>("{}", message);
 }
 
-std::ostream& Logger::operator<<(const std::string& message)
+void Logger::error(const std::string& message)
 {
-    log(message);
-    return log_file;
+    log<Level::Error>("{}", message);
 }
 
+void Logger::warn(const std::string& message)
+{
+    log<Level::Warn>("{}", message);
+}
+
+Logger& Logger::operator<<(const std::string& message)
+{
+    log<Level::Info>("{}", message);
+    return *this;
+}
@@ -0,0 +1,154 @@
+/**
+ * @file Lz.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Implementation of the LZ codec
+ */
+
+#include "Lz.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fmt/core.h>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+constexpr std::size_t min_match = 4;
+constexpr int hash_bits = 14;
+// every 2^skip_shift misses in a row the search steps one byte further, so input that does not
+// compress is skipped through instead of hashed at every byte
+constexpr int skip_shift = 6;
+
+std::uint32_t read32(const char* data)
+{
+    std::uint32_t word;
+    std::memcpy(&word, data, sizeof(word));
+    return word;
+}
+
+std::uint32_t hashOf(std::uint32_t word)
+{
+    return (word * 2654435761u) >> (32 - hash_bits);
+}
+
+/**
+ * @brief append the part of a length that did not fit its 4 bits of the token
+ */
+void putLength(std::string& out, std::size_t length)
+{
+    for (; length >= 255; length -= 255)
+        out += static_cast<char>(255);
+    out += static_cast<char>(length);
+}
+
+/**
+ * @brief append a sequence, a match length of 0 ends the input with the literals
+ */
+void putSequence(std::string& out, std::string_view literals, std::size_t offset, std::size_t match)
+{
+    std::size_t match_code = match == 0 ? 0 : match - min_match;
+    out += static_cast<char>((std::min<std::size_t>(literals.size(), 15) << 4) | std::min<std::size_t>(match_code, 15));
+    if (literals.size() >= 15)
+        putLength(out, literals.size() - 15);
+    out.append(literals);
+    if (match == 0)
+        return;
+    out += static_cast<char>(offset & 0xff);
+    out += static_cast<char>(offset >> 8);
+    if (match_code >= 15)
+        putLength(out, match_code - 15);
+}
+}
+
+std::string Lz::compress(std::string_view input)
+{
+    std::string out;
+    out.reserve(input.size() / 2 + 16);
+    const char* data = input.data();
+    std::size_t size = input.size();
+    // where each hash was seen last, plus one so 0 means never
+    std::vector<std::uint32_t> table(std::size_t(1) << hash_bits, 0);
+    std::size_t anchor = 0, position = 0, misses = 0;
+    while (position + min_match <= size) {
+        std::uint32_t word = read32(data + position);
+        std::uint32_t& slot = table[hashOf(word)];
+        std::size_t candidate = slot;
+        slot = static_cast<std::uint32_t>(position + 1);
+        if (candidate == 0 || position + 1 - candidate > max_offset || read32(data + candidate - 1) != word) {
+            position += 1 + (misses++ >> skip_shift);
+            continue;
+        }
+        std::size_t from = candidate - 1;
+        std::size_t length = min_match;
+        while (position + length < size && data[from + length] == data[position + length])
+            length++;
+        // the match may start before the byte that found it
+        while (position > anchor && from > 0 && data[from - 1] == data[position - 1]) {
+            position--;
+            from--;
+            length++;
+        }
+        putSequence(out, input.substr(anchor, position - anchor), position - from, length);
+        position += length;
+        anchor = position;
+        misses = 0;
+        // the end of a match is a likely start of the next one
+        if (position + 2 <= size)
+            table[hashOf(read32(data + position - 2))] = static_cast<std::uint32_t>(position - 1);
+    }
+    if (anchor < size)
+        putSequence(out, input.substr(anchor), 0, 0);
+    return out;
+}
+
+void Lz::decompress(std::string_view compressed, char* output, std::size_t size)
+{
+    std::size_t in = 0, out = 0;
+    auto damaged = [&] {
+        return std::runtime_error(fmt::format("Lz::decompress: damaged input at byte {} of {}", in, compressed.size()));
+    };
+    auto readLength = [&](std::size_t length) {
+        if (length < 15)
+            return length;
+        while (true) {
+            if (in >= compressed.size())
+                throw damaged();
+            auto extra = static_cast<unsigned char>(compressed[in++]);
+            length += extra;
+            if (extra != 255)
+                return length;
+        }
+    };
+    while (out < size) {
+        if (in >= compressed.size())
+            throw damaged();
+        auto token = static_cast<unsigned char>(compressed[in++]);
+        std::size_t literals = readLength(token >> 4);
+        if (literals > compressed.size() - in || literals > size - out)
+            throw damaged();
+        std::memcpy(output + out, compressed.data() + in, literals);
+        in += literals;
+        out += literals;
+        if (out == size)
+            break;
+        if (compressed.size() - in < 2)
+            throw damaged();
+        std::size_t offset = static_cast<unsigned char>(compressed[in]) | static_cast<std::size_t>(static_cast<unsigned char>(compressed[in + 1])) << 8;
+        in += 2;
+        std::size_t length = readLength(token & 15) + min_match;
+        if (offset == 0 || offset > out || length > size - out)
+            throw damaged();
+        const char* from = output + out - offset;
+        if (offset >= length) {
+            std::memcpy(output + out, from, length);
+        } else {
+            // the match overlaps the bytes it writes, a run repeating its last offset bytes
+            for (std::size_t i = 0; i < length; i++)
+                output[out + i] = from[i];
+        }
+        out += length;
+    }
+    if (in != compressed.size())
+        throw damaged();
+}
@@ -0,0 +1,71 @@
+/**
+ * @file MappedFile.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Implementation of MappedFile
+ */
+
+#include "MappedFile.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path)
+    : path(path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error(fmt::format("ERROR: cannot open {}: {}", path, std::strerror(errno)));
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw std::runtime_error(fmt::format("ERROR: cannot stat {}: {}", path, std::strerror(errno)));
+    }
+    size = info.st_size;
+    if (size != 0) {
+        void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error(fmt::format("ERROR: cannot map {}: {}", path, std::strerror(errno)));
+        }
+        // the newline index reads the file front to back once
+        ::madvise(mapping, size, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(mapping);
+    }
+    // the mapping stays valid after the descriptor is closed
+    ::close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (data != nullptr)
+        ::munmap(const_cast<char*>(data), size);
+}
+
+std::string_view MappedFile::view() const
+{
+    return std::string_view(data, size);
+}
+
+const std::string& MappedFile::getPath() const
+{
+    return path;
+}
+
+void MappedFile::release(std::size_t offset, std::size_t length) const
+{
+    // the mapping is private and never written, dropping its pages loses nothing
+    if (length != 0)
+        ::madvise(const_cast<char*>(data) + offset, length, MADV_DONTNEED);
+}
+
+void MappedFile::prefetch(std::size_t offset, std::size_t length) const
+{
+    if (length != 0)
+        ::madvise(const_cast<char*>(data) + offset, length, MADV_WILLNEED);
+}
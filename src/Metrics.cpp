@@ -0,0 +1,123 @@
+/**
+ * @file Metrics.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Implementation of Metrics
+ */
+
+#include "Metrics.h"
+#include <algorithm>
+#include <bit>
+#include <fmt/core.h>
+
+void LatencyHistogram::record(std::chrono::nanoseconds elapsed)
+{
+    auto us = static_cast<std::uint64_t>(std::max<std::int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count(), 0));
+    std::size_t bucket = std::min<std::size_t>(us < 2 ? 0 : std::bit_width(us) - 1, bucket_count - 1);
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    // retries only while another thread raises the max at the same time
+    std::uint64_t seen = max_us.load(std::memory_order_relaxed);
+    while (us > seen && !max_us.compare_exchange_weak(seen, us, std::memory_order_relaxed))
+        ;
+}
+
+std::uint64_t LatencyHistogram::getCount() const
+{
+    return count.load(std::memory_order_relaxed);
+}
+
+std::chrono::microseconds LatencyHistogram::percentile(double share) const
+{
+    std::uint64_t total = getCount();
+    if (total == 0)
+        return std::chrono::microseconds(0);
+    // the rank of the sample asked for, 1 based
+    auto rank = std::max<std::uint64_t>(static_cast<std::uint64_t>(share * total + 0.5), 1);
+    std::uint64_t seen = 0;
+    for (std::size_t bucket = 0; bucket < bucket_count; bucket++) {
+        seen += getBucket(bucket);
+        if (seen >= rank)
+            return std::min(std::chrono::microseconds(std::uint64_t(2) << bucket), getMax());
+    }
+    return getMax();
+}
+
+std::chrono::microseconds LatencyHistogram::getMax() const
+{
+    return std::chrono::microseconds(max_us.load(std::memory_order_relaxed));
+}
+
+std::uint64_t LatencyHistogram::getBucket(std::size_t bucket) const
+{
+    return buckets[bucket].load(std::memory_order_relaxed);
+}
+
+void LatencyHistogram::reset()
+{
+    for (auto& bucket : buckets)
+        bucket.store(0, std::memory_order_relaxed);
+    count.store(0, std::memory_order_relaxed);
+    max_us.store(0, std::memory_order_relaxed);
+}
+
+std::shared_ptr<Metrics> Metrics::Instance()
+{
+    static std::shared_ptr<Metrics> instance = std::make_shared<Metrics>();
+    return instance;
+}
+
+const LatencyHistogram& Metrics::getHistogram(Timer timer) const
+{
+    return timers[static_cast<std::size_t>(timer)];
+}
+
+std::uint64_t Metrics::getCounter(Counter counter) const
+{
+    return counters[static_cast<std::size_t>(counter)].load(std::memory_order_relaxed);
+}
+
+std::string_view Metrics::nameOf(Timer timer)
+{
+    static constexpr std::string_view names[] = { "key_to_paint", "loop", "input", "wrap", "paint", "flush" };
+    return names[static_cast<std::size_t>(timer)];
+}
+
+std::string_view Metrics::nameOf(Counter counter)
+{
+    static constexpr std::string_view names[] = { "keys", "rows_wrapped", "bytes_drawn", "refreshes", "full_repaints", "frames" };
+    return names[static_cast<std::size_t>(counter)];
+}
+
+std::string Metrics::toJson(std::int64_t time_ms) const
+{
+    std::string json = fmt::format("{{\"time_ms\":{},\"counters\":{{", time_ms);
+    for (std::size_t i = 0; i < counters.size(); i++) {
+        auto counter = static_cast<Counter>(i);
+        json += fmt::format("{}\"{}\":{}", i == 0 ? "" : ",", nameOf(counter), getCounter(counter));
+    }
+    json += "},\"latency_us\":{";
+    for (std::size_t i = 0; i < timers.size(); i++) {
+        const LatencyHistogram& histogram = timers[i];
+        json += fmt::format("{}\"{}\":{{\"count\":{},\"p50\":{},\"p90\":{},\"p99\":{},\"max\":{},\"buckets\":[",
+            i == 0 ? "" : ",", nameOf(static_cast<Timer>(i)), histogram.getCount(), histogram.percentile(0.5).count(),
+            histogram.percentile(0.9).count(), histogram.percentile(0.99).count(), histogram.getMax().count());
+        // trailing empty buckets are left out, a bucket's bounds follow from its index
+        std::size_t used = LatencyHistogram::bucket_count;
+        while (used > 0 && histogram.getBucket(used - 1) == 0)
+            used--;
+        for (std::size_t bucket = 0; bucket < used; bucket++)
+            json += fmt::format("{}{}", bucket == 0 ? "" : ",", histogram.getBucket(bucket));
+        json += "]}";
+    }
+    json += "}}";
+    return json;
+}
+
+void Metrics::reset()
+{
+    for (auto& timer : timers)
+        timer.reset();
+    for (auto& counter : counters)
+        counter.store(0, std::memory_order_relaxed);
+}
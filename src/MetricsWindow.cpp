@@ -0,0 +1,56 @@
+/**
+ * @file MetricsWindow.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Implementation of MetricsWindow
+ */
+
+#include "Metrics.h"
+#include "Window.h"
+#include <fmt/core.h>
+
+MetricsWindow::MetricsWindow(std::shared_ptr<Screen> screen, const Border& borders, std::size_t init_x, std::size_t init_y, std::size_t max_width, std::size_t max_height)
+    : BaseWindow(std::move(screen), borders, "metrics", overlay_width, overlay_height, init_x, init_y, max_width, max_height)
+{
+    surface->leaveCursor();
+    sample();
+}
+
+void MetricsWindow::inputHandler(chtype /*ch*/)
+{
+}
+
+void MetricsWindow::sample()
+{
+    auto metrics = Metrics::Instance();
+    std::vector<std::string> sampled;
+    sampled.push_back(fmt::format("{:<12}{:>7}{:>6}{:>6}{:>8}", "latency us", "count", "p50", "p99", "max"));
+    for (std::size_t i = 0; i < static_cast<std::size_t>(Metrics::Timer::Count); i++) {
+        auto timer = static_cast<Metrics::Timer>(i);
+        const LatencyHistogram& histogram = metrics->getHistogram(timer);
+        sampled.push_back(fmt::format("{:<12}{:>7}{:>6}{:>6}{:>8}", Metrics::nameOf(timer), histogram.getCount(),
+            histogram.percentile(0.5).count(), histogram.percentile(0.99).count(), histogram.getMax().count()));
+    }
+    for (std::size_t i = 0; i < static_cast<std::size_t>(Metrics::Counter::Count); i++) {
+        auto counter = static_cast<Metrics::Counter>(i);
+        sampled.push_back(fmt::format("{:<12}{:>27}", Metrics::nameOf(counter), metrics->getCounter(counter)));
+    }
+    for (std::size_t line = 0; line < sampled.size(); line++) {
+        if (line >= lines.size() || lines[line] != sampled[line])
+            markDirty(line + 1, line + 2);
+    }
+    lines = std::move(sampled);
+}
+
+void MetricsWindow::paintRow(std::size_t row)
+{
+    // row 0 and the last row belong to the border
+    if (row == 0 || row + 1 >= getHeight())
+        return;
+    std::size_t text_width = getWidth() - 2;
+    std::string_view text = row - 1 < lines.size() ? std::string_view(lines[row - 1]) : std::string_view();
+    text = text.substr(0, text_width);
+    surface->put(row, 1, text);
+    if (text.size() < text_width)
+        surface->fill(row, 1 + text.size(), ' ', text_width - text.size());
+}
@@ -0,0 +1,196 @@
+/**
+ * @file NcursesScreen.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Implementation of the ncurses screen backend
+ */
+
+#include "Screen.h"
+#include "Utf8.h"
+#include <algorithm>
+#include <ncurses.h>
+#include <panel.h>
+
+namespace {
+/**
+ * @brief foreground color and attributes of a style, -1 keeps the terminal's own color
+ */
+struct StyleLook {
+    short color;
+    attr_t attributes;
+};
+
+StyleLook lookOf(Style style)
+{
+    switch (style) {
+    case Style::Match:
+        return { -1, A_REVERSE };
+    case Style::Comment:
+        return { -1, A_DIM };
+    case Style::Section:
+        return { COLOR_MAGENTA, A_BOLD };
+    case Style::Key:
+        return { COLOR_BLUE, A_NORMAL };
+    case Style::String:
+        return { COLOR_GREEN, A_NORMAL };
+    case Style::Number:
+        return { COLOR_YELLOW, A_NORMAL };
+    case Style::Timestamp:
+        return { COLOR_CYAN, A_NORMAL };
+    case Style::Error:
+        return { COLOR_RED, A_BOLD };
+    case Style::Warning:
+        return { COLOR_YELLOW, A_BOLD };
+    case Style::Normal:
+    default:
+        return { -1, A_NORMAL };
+    }
+}
+
+/**
+ * @brief attributes drawing a style, the color pair of a style is numbered after it
+ */
+attr_t attributesOf(Style style)
+{
+    StyleLook look = lookOf(style);
+    if (look.color < 0 || !has_colors())
+        return look.attributes;
+    return look.attributes | COLOR_PAIR(static_cast<short>(style));
+}
+
+/**
+ * @brief a window on a panel of its own, new surfaces go on top of the stack
+ */
+class NcursesSurface : public Surface {
+public:
+    NcursesSurface(std::size_t x, std::size_t y, std::size_t width, std::size_t height)
+        : window_ptr(newwin(height, width, y, x))
+        , panel(new_panel(window_ptr))
+        , width(width)
+    {
+    }
+
+    ~NcursesSurface() override
+    {
+        // the panels below show through again on the next update_panels()
+        del_panel(panel);
+        delwin(window_ptr);
+    }
+
+    void put(std::size_t row, std::size_t col, std::string_view text) override
+    {
+        if (col >= width)
+            return;
+        // clip by display width, the wide ncurses library decodes the UTF-8 itself
+        mvwaddnstr(window_ptr, row, col, text.data(), Utf8::fitWidth(text, width - col));
+    }
+
+    void fill(std::size_t row, std::size_t col, char ch, std::size_t count) override
+    {
+        if (col >= width || count == 0)
+            return;
+        mvwhline(window_ptr, row, col, static_cast<unsigned char>(ch) | attributes, std::min(count, width - col));
+    }
+
+    void setStyle(Style style) override
+    {
+        attributes = attributesOf(style);
+        wattrset(window_ptr, attributes);
+    }
+
+    void drawBorder(const Border& border) override
+    {
+        wborder(window_ptr, border.ls, border.rs, border.ts, border.bs, border.tl, border.tr, border.bl, border.br);
+    }
+
+    void erase() override
+    {
+        werase(window_ptr);
+    }
+
+    void setCursor(std::size_t row, std::size_t col) override
+    {
+        wmove(window_ptr, row, col);
+    }
+
+    void resize(std::size_t width, std::size_t height) override
+    {
+        this->width = width;
+        wresize(window_ptr, height, width);
+    }
+
+    void moveTo(std::size_t x, std::size_t y) override
+    {
+        move_panel(panel, y, x);
+    }
+
+    void raise() override
+    {
+        top_panel(panel);
+    }
+
+    void leaveCursor() override
+    {
+        leaveok(window_ptr, TRUE);
+    }
+
+    void stage() override
+    {
+        // update_panels() stages every panel in stacking order, covered parts included
+    }
+
+private:
+    WINDOW* window_ptr;
+    PANEL* panel;
+    std::size_t width;
+    attr_t attributes = A_NORMAL;
+};
+}
+
+NcursesScreen::NcursesScreen()
+    : known_width(COLS)
+    , known_height(LINES)
+{
+    // stdscr is never drawn on, refresh it once so getch() never has a reason to repaint it
+    refresh();
+    if (!has_colors())
+        return;
+    start_color();
+    use_default_colors();
+    for (auto style = static_cast<short>(Style::Normal); style <= static_cast<short>(Style::Warning); style++) {
+        StyleLook look = lookOf(static_cast<Style>(style));
+        if (look.color >= 0)
+            init_pair(style, look.color, -1);
+    }
+}
+
+std::unique_ptr<Surface> NcursesScreen::createSurface(std::size_t x, std::size_t y, std::size_t width, std::size_t height)
+{
+    return std::make_unique<NcursesSurface>(x, y, width, height);
+}
+
+void NcursesScreen::update()
+{
+    // the top panel's cursor is the one shown
+    update_panels();
+    doupdate();
+}
+
+std::size_t NcursesScreen::getWidth() const
+{
+    return COLS;
+}
+
+std::size_t NcursesScreen::getHeight() const
+{
+    return LINES;
+}
+
+bool NcursesScreen::fitTerminal()
+{
+    if (getWidth() == known_width && getHeight() == known_height)
+        return false;
+    known_width = getWidth();
+    known_height = getHeight();
+    return true;
+}
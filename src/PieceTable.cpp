@@ -0,0 +1,691 @@
+/**
+ * @file PieceTable.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Implementation of PieceTable and TextBlock
+ */
+
+#include "PieceTable.h"
+#include "ChunkCache.h"
+#include "FrameCache.h"
+#include "Lz.h"
+#include "TextScan.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fmt/core.h>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+// 0 is left for blocks that are not compressed
+std::atomic<std::uint64_t> next_block_id { 1 };
+}
+
+TextBlock::TextBlock(std::size_t capacity)
+    : storage(new char[capacity])
+    , bytes(storage.get())
+    , used(0)
+    , capacity(capacity)
+{
+}
+
+TextBlock::TextBlock(std::string_view bytes, std::shared_ptr<const void> owner)
+    : owner(std::move(owner))
+    , bytes(bytes.data())
+    , used(bytes.size())
+    , capacity(bytes.size())
+{
+}
+
+TextBlock::TextBlock(const TextBlock& source, const std::vector<bool>& keep)
+    : bytes(nullptr)
+    , used(source.size())
+    , capacity(source.size())
+    , id(next_block_id.fetch_add(1, std::memory_order_relaxed))
+{
+    std::size_t count = source.frameCount();
+    frames.resize(count);
+    if (source.isCompressed()) {
+        frame_newlines = source.frame_newlines;
+        frame_newline_offsets = source.frame_newline_offsets;
+    } else {
+        frame_newlines.assign(count + 1, 0);
+    }
+    std::vector<std::size_t> found;
+    for (std::size_t i = 0; i < count; i++) {
+        const Frame* old = source.isCompressed() ? &source.frames[i] : nullptr;
+        if (old && old->state != FrameState::Raw) {
+            frames[i] = *old;
+            continue;
+        }
+        std::string_view raw = old ? std::string_view(old->bytes) : std::string_view(source.bytes + i * frame_size, std::min(frame_size, size() - i * frame_size));
+        if (!old) {
+            found.clear();
+            TextScan::findNewlines(raw, 0, found);
+            frame_newlines[i + 1] = frame_newlines[i] + found.size();
+            frame_newline_offsets.insert(frame_newline_offsets.end(), found.begin(), found.end());
+        }
+        if (i < keep.size() && keep[i]) {
+            frames[i] = { std::string(raw), FrameState::Raw };
+            continue;
+        }
+        std::string compressed = Lz::compress(raw);
+        // saving less than an eighth is not worth decompressing for
+        if (compressed.size() + raw.size() / 8 < raw.size()) {
+            compressed.shrink_to_fit();
+            frames[i] = { std::move(compressed), FrameState::Compressed };
+        } else {
+            frames[i] = { std::string(raw), FrameState::Incompressible };
+        }
+    }
+    frame_newline_offsets.shrink_to_fit();
+}
+
+const char* TextBlock::data() const
+{
+    return bytes;
+}
+
+std::size_t TextBlock::size() const
+{
+    return used.load(std::memory_order_acquire);
+}
+
+std::size_t TextBlock::available() const
+{
+    return capacity - used.load(std::memory_order_relaxed);
+}
+
+std::size_t TextBlock::append(std::string_view text)
+{
+    // only the owner appends, the size it reads back is its own
+    std::size_t offset = used.load(std::memory_order_relaxed);
+    std::memcpy(storage.get() + offset, text.data(), text.size());
+    used.store(offset + text.size(), std::memory_order_release);
+    return offset;
+}
+
+void TextBlock::buildLineIndex()
+{
+    newline_index = TextScan::findNewlinesParallel(std::string_view(bytes, size()));
+    indexed = true;
+}
+
+void TextBlock::usePagedIndex(std::shared_ptr<ChunkCache> chunks)
+{
+    this->chunks = std::move(chunks);
+}
+
+std::size_t TextBlock::countNewlines(std::size_t begin, std::size_t end) const
+{
+    if (isCompressed())
+        return frameRank(end) - frameRank(begin);
+    if (chunks)
+        return chunks->countNewlines(begin, end);
+    if (indexed) {
+        auto first = std::lower_bound(newline_index.begin(), newline_index.end(), begin);
+        auto last = std::lower_bound(first, newline_index.end(), end);
+        return last - first;
+    }
+    return std::count(bytes + begin, bytes + end, '\n');
+}
+
+std::size_t TextBlock::findNewline(std::size_t begin, std::size_t nth) const
+{
+    if (isCompressed()) {
+        std::size_t target = frameRank(begin) + nth;
+        std::size_t frame = std::upper_bound(frame_newlines.begin(), frame_newlines.end(), target) - frame_newlines.begin() - 1;
+        return frame * frame_size + frame_newline_offsets[target];
+    }
+    if (chunks)
+        return chunks->findNewline(begin, nth);
+    if (indexed) {
+        auto first = std::lower_bound(newline_index.begin(), newline_index.end(), begin);
+        return *(first + nth);
+    }
+    const char* p = bytes + begin;
+    const char* end = bytes + size();
+    while (true) {
+        p = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (nth == 0)
+            return p - bytes;
+        --nth;
+        ++p;
+    }
+}
+
+bool TextBlock::read(std::size_t start, std::size_t length, const std::function<bool(std::string_view)>& visitor) const
+{
+    if (!isCompressed())
+        return visitor(std::string_view(bytes + start, length));
+    while (length > 0) {
+        std::size_t index = start / frame_size;
+        std::size_t from = start % frame_size;
+        std::size_t count = std::min(length, frame_size - from);
+        const Frame& frame = frames[index];
+        bool more;
+        if (frame.state == FrameState::Compressed) {
+            // holds on to the frame while the visitor looks at it, even if the cache drops it
+            auto decompressed = FrameCache::Instance()->get(id, index, frame.bytes, std::min(frame_size, size() - index * frame_size));
+            more = visitor(std::string_view(*decompressed).substr(from, count));
+        } else {
+            more = visitor(std::string_view(frame.bytes).substr(from, count));
+        }
+        if (!more)
+            return false;
+        start += count;
+        length -= count;
+    }
+    return true;
+}
+
+bool TextBlock::isCompressed() const
+{
+    return id != 0;
+}
+
+bool TextBlock::isCompressible(const std::vector<bool>& keep) const
+{
+    if (size() < frame_size || (!storage && !isCompressed()))
+        return false;
+    for (std::size_t i = 0; i < frameCount(); i++) {
+        if (i < keep.size() && keep[i])
+            continue;
+        if (!isCompressed() || frames[i].state == FrameState::Raw)
+            return true;
+    }
+    return false;
+}
+
+std::size_t TextBlock::frameCount() const
+{
+    return (size() + frame_size - 1) / frame_size;
+}
+
+bool TextBlock::isFrameCompressed(std::size_t frame) const
+{
+    return isCompressed() && frames[frame].state == FrameState::Compressed;
+}
+
+std::size_t TextBlock::memoryUsage() const
+{
+    std::size_t total = storage ? capacity : 0;
+    total += newline_index.capacity() * sizeof(std::size_t);
+    total += frames.capacity() * sizeof(Frame);
+    for (const Frame& frame : frames)
+        total += frame.bytes.capacity();
+    total += frame_newlines.capacity() * sizeof(std::size_t) + frame_newline_offsets.capacity() * sizeof(std::uint16_t);
+    return total;
+}
+
+std::size_t TextBlock::frameRank(std::size_t offset) const
+{
+    std::size_t frame = offset / frame_size;
+    if (frame >= frames.size())
+        return frame_newlines.back();
+    auto first = frame_newline_offsets.begin() + frame_newlines[frame];
+    auto last = frame_newline_offsets.begin() + frame_newlines[frame + 1];
+    return frame_newlines[frame] + (std::lower_bound(first, last, offset % frame_size) - first);
+}
+
+PieceTable::PieceTable() = default;
+
+PieceTable::PieceTable(std::string_view original, std::shared_ptr<const void> owner)
+{
+    auto block = std::make_shared<TextBlock>(original, std::move(owner));
+    block->buildLineIndex();
+    *this = PieceTable(std::move(block));
+}
+
+PieceTable::PieceTable(std::shared_ptr<const TextBlock> original)
+{
+    if (original->size() == 0)
+        return;
+    std::size_t length = original->size();
+    root = makeNode(Piece { original, 0, length, original->countNewlines(0, length) });
+}
+
+std::uint32_t PieceTable::nextPriority()
+{
+    // xorshift32, treap priorities only need to be well spread, not unpredictable
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+PieceTable::NodePtr PieceTable::makeNode(Piece piece)
+{
+    return makeNode(piece, nextPriority(), nullptr, nullptr);
+}
+
+PieceTable::NodePtr PieceTable::makeNode(const Piece& piece, std::uint32_t priority, NodePtr left, NodePtr right)
+{
+    auto node = std::make_shared<Node>();
+    node->piece = piece;
+    node->priority = priority;
+    node->bytes = bytesOf(left) + piece.length + bytesOf(right);
+    node->newlines = newlinesOf(left) + piece.newlines + newlinesOf(right);
+    node->pieces = piecesOf(left) + 1 + piecesOf(right);
+    node->left = std::move(left);
+    node->right = std::move(right);
+    return node;
+}
+
+std::size_t PieceTable::bytesOf(const NodePtr& node)
+{
+    return node ? node->bytes : 0;
+}
+
+std::size_t PieceTable::newlinesOf(const NodePtr& node)
+{
+    return node ? node->newlines : 0;
+}
+
+std::size_t PieceTable::piecesOf(const NodePtr& node)
+{
+    return node ? node->pieces : 0;
+}
+
+PieceTable::Piece PieceTable::slice(const Piece& piece, std::size_t begin, std::size_t end)
+{
+    std::size_t start = piece.start + begin;
+    return Piece { piece.block, start, end - begin, piece.block->countNewlines(start, piece.start + end) };
+}
+
+std::vector<PieceTable::Piece> PieceTable::collectPieces() const
+{
+    std::vector<Piece> pieces;
+    pieces.reserve(pieceCount());
+    auto collect = [&](auto& self, const Node* node) -> void {
+        if (!node)
+            return;
+        self(self, node->left.get());
+        pieces.push_back(node->piece);
+        self(self, node->right.get());
+    };
+    collect(collect, root.get());
+    return pieces;
+}
+
+std::pair<PieceTable::NodePtr, PieceTable::NodePtr> PieceTable::split(const NodePtr& node, std::size_t offset)
+{
+    if (!node)
+        return { nullptr, nullptr };
+    std::size_t left_bytes = bytesOf(node->left);
+    const Piece& piece = node->piece;
+    if (offset <= left_bytes) {
+        auto [a, b] = split(node->left, offset);
+        return { a, makeNode(piece, node->priority, b, node->right) };
+    }
+    if (offset >= left_bytes + piece.length) {
+        auto [a, b] = split(node->right, offset - left_bytes - piece.length);
+        return { makeNode(piece, node->priority, node->left, a), b };
+    }
+    std::size_t cut = offset - left_bytes;
+    Piece head = slice(piece, 0, cut);
+    Piece tail { piece.block, piece.start + cut, piece.length - cut, piece.newlines - head.newlines };
+    // both halves keeping the node's priority would tie in merge(), and cuts merged back together,
+    // like an insert followed by its undo, would degrade the treap into a list. Fresh priorities
+    // keep it balanced, merging each half with its side costs O(log n) like the split itself.
+    return { merge(node->left, makeNode(head)), merge(makeNode(tail), node->right) };
+}
+
+PieceTable::NodePtr PieceTable::merge(const NodePtr& left, const NodePtr& right)
+{
+    if (!left)
+        return right;
+    if (!right)
+        return left;
+    if (left->priority > right->priority)
+        return makeNode(left->piece, left->priority, left->left, merge(left->right, right));
+    return makeNode(right->piece, right->priority, merge(left, right->left), right->right);
+}
+
+PieceTable::NodePtr PieceTable::build(const std::vector<Piece>& pieces, const std::vector<std::uint32_t>& priorities, std::size_t begin, std::size_t end)
+{
+    if (begin == end)
+        return nullptr;
+    std::size_t top = std::max_element(priorities.begin() + begin, priorities.begin() + end) - priorities.begin();
+    return makeNode(pieces[top], priorities[top], build(pieces, priorities, begin, top), build(pieces, priorities, top + 1, end));
+}
+
+PieceTable::NodePtr PieceTable::extendRightmost(const NodePtr& node, std::size_t length, std::size_t newlines)
+{
+    if (node->right)
+        return makeNode(node->piece, node->priority, node->left, extendRightmost(node->right, length, newlines));
+    Piece piece = node->piece;
+    piece.length += length;
+    piece.newlines += newlines;
+    return makeNode(piece, node->priority, node->left, nullptr);
+}
+
+void PieceTable::insert(std::size_t offset, std::string_view text)
+{
+    if (offset > size())
+        throw std::out_of_range(fmt::format("PieceTable::insert: offset {} out of range {}", offset, size()));
+    if (text.empty())
+        return;
+    auto [left, right] = split(root, offset);
+    std::size_t newlines = std::count(text.begin(), text.end(), '\n');
+
+    // typing usually continues right after the previous insert, extend that piece instead of adding one
+    if (left && add_block && add_block->available() >= text.size()) {
+        const Node* last = left.get();
+        while (last->right)
+            last = last->right.get();
+        if (last->piece.block == add_block && last->piece.start + last->piece.length == add_block->size()) {
+            add_block->append(text);
+            root = merge(extendRightmost(left, text.size(), newlines), right);
+            return;
+        }
+    }
+
+    Piece piece;
+    if (text.size() > block_size) {
+        // large inserts get a block of their own with a newline index, so they never get rescanned
+        auto block = std::make_shared<TextBlock>(text.size());
+        block->append(text);
+        block->buildLineIndex();
+        piece = Piece { block, 0, text.size(), newlines };
+    } else {
+        if (!add_block || add_block->available() < text.size())
+            add_block = std::make_shared<TextBlock>(block_size);
+        piece = Piece { add_block, add_block->append(text), text.size(), newlines };
+    }
+    root = merge(merge(left, makeNode(piece)), right);
+}
+
+void PieceTable::insert(std::size_t offset, std::shared_ptr<const TextBlock> block, std::size_t start, std::size_t length)
+{
+    if (offset > size())
+        throw std::out_of_range(fmt::format("PieceTable::insert: offset {} out of range {}", offset, size()));
+    if (start + length > block->size())
+        throw std::out_of_range(fmt::format("PieceTable::insert: range {}+{} out of block size {}", start, length, block->size()));
+    if (length == 0)
+        return;
+    std::size_t newlines = block->countNewlines(start, start + length);
+    auto [left, right] = split(root, offset);
+    root = merge(merge(left, makeNode(Piece { std::move(block), start, length, newlines })), right);
+}
+
+void PieceTable::append(const std::vector<Range>& ranges)
+{
+    std::vector<Piece> pieces;
+    std::vector<std::uint32_t> priorities;
+    pieces.reserve(ranges.size());
+    priorities.reserve(ranges.size());
+    for (const Range& range : ranges) {
+        if (range.start + range.length > range.block->size())
+            throw std::out_of_range(fmt::format("PieceTable::append: range {}+{} out of block size {}", range.start, range.length, range.block->size()));
+        if (range.length == 0)
+            continue;
+        pieces.push_back({ range.block, range.start, range.length, range.block->countNewlines(range.start, range.start + range.length) });
+        priorities.push_back(nextPriority());
+    }
+    // with random priorities the scan for the top in build() costs O(n log n) in total, one
+    // insert() per piece would allocate a whole path of nodes each time
+    root = merge(root, build(pieces, priorities, 0, pieces.size()));
+}
+
+void PieceTable::erase(std::size_t offset, std::size_t length)
+{
+    if (offset > size())
+        throw std::out_of_range(fmt::format("PieceTable::erase: offset {} out of range {}", offset, size()));
+    length = std::min(length, size() - offset);
+    if (length == 0)
+        return;
+    auto [left, rest] = split(root, offset);
+    auto [removed, right] = split(rest, length);
+    root = merge(left, right);
+}
+
+void PieceTable::replaceAll(const std::vector<Replacement>& replacements)
+{
+    if (replacements.empty())
+        return;
+    std::size_t new_bytes = 0;
+    std::size_t position = 0;
+    for (const Replacement& replacement : replacements) {
+        if (replacement.offset < position || replacement.offset + replacement.length > size())
+            throw std::out_of_range(fmt::format("PieceTable::replaceAll: replacement {}+{} out of order or out of range {}", replacement.offset, replacement.length, size()));
+        position = replacement.offset + replacement.length;
+        new_bytes += replacement.text.size();
+    }
+    std::vector<Piece> old_pieces = collectPieces();
+
+    std::shared_ptr<TextBlock> block;
+    if (new_bytes > 0)
+        block = std::make_shared<TextBlock>(new_bytes);
+    std::vector<Piece> pieces;
+    pieces.reserve(old_pieces.size() + 2 * replacements.size());
+    std::size_t piece_index = 0, piece_begin = 0;
+    // keep the old bytes [from, to), from never goes backwards
+    auto keep = [&](std::size_t from, std::size_t to) {
+        while (from < to) {
+            while (piece_begin + old_pieces[piece_index].length <= from)
+                piece_begin += old_pieces[piece_index++].length;
+            const Piece& piece = old_pieces[piece_index];
+            std::size_t begin = from - piece_begin;
+            std::size_t end = std::min(to - piece_begin, piece.length);
+            pieces.push_back(begin == 0 && end == piece.length ? piece : slice(piece, begin, end));
+            from = piece_begin + end;
+        }
+    };
+    position = 0;
+    for (const Replacement& replacement : replacements) {
+        keep(position, replacement.offset);
+        position = replacement.offset + replacement.length;
+        if (replacement.text.empty())
+            continue;
+        std::size_t start = block->append(replacement.text);
+        std::size_t newlines = std::count(replacement.text.begin(), replacement.text.end(), '\n');
+        if (!pieces.empty() && pieces.back().block == block && pieces.back().start + pieces.back().length == start) {
+            // back to back replacements are back to back in the block too
+            pieces.back().length += replacement.text.size();
+            pieces.back().newlines += newlines;
+        } else {
+            pieces.push_back(Piece { block, start, replacement.text.size(), newlines });
+        }
+    }
+    keep(position, size());
+    if (new_bytes > block_size)
+        block->buildLineIndex();
+    std::vector<std::uint32_t> priorities(pieces.size());
+    for (auto& priority : priorities)
+        priority = nextPriority();
+    root = build(pieces, priorities, 0, pieces.size());
+}
+
+std::size_t PieceTable::compressCold(const std::vector<std::pair<std::size_t, std::size_t>>& hot)
+{
+    std::vector<Piece> pieces = collectPieces();
+    // the frames under a hot range, for every block worth compressing
+    std::unordered_map<const TextBlock*, std::vector<bool>> keep;
+    std::size_t position = 0;
+    for (const Piece& piece : pieces) {
+        const TextBlock* block = piece.block.get();
+        // the add block still takes typing
+        if (block != add_block.get() && block->isCompressible({})) {
+            auto& frames = keep.try_emplace(block, block->frameCount(), false).first->second;
+            for (auto [begin, end] : hot) {
+                std::size_t from = std::max(begin, position);
+                std::size_t to = std::min(end, position + piece.length);
+                if (from >= to)
+                    continue;
+                std::size_t first = (piece.start + from - position) / TextBlock::frame_size;
+                std::size_t last = (piece.start + to - position - 1) / TextBlock::frame_size;
+                std::fill(frames.begin() + first, frames.begin() + last + 1, true);
+            }
+        }
+        position += piece.length;
+    }
+    std::unordered_map<const TextBlock*, std::shared_ptr<const TextBlock>> copies;
+    std::size_t saved = 0;
+    for (const auto& [block, frames] : keep) {
+        if (!block->isCompressible(frames))
+            continue;
+        auto copy = std::make_shared<const TextBlock>(*block, frames);
+        saved += block->memoryUsage() - std::min(block->memoryUsage(), copy->memoryUsage());
+        copies.emplace(block, std::move(copy));
+    }
+    if (saved == 0)
+        return 0;
+    for (Piece& piece : pieces) {
+        if (auto copy = copies.find(piece.block.get()); copy != copies.end())
+            piece.block = copy->second;
+    }
+    std::vector<std::uint32_t> priorities(pieces.size());
+    for (auto& priority : priorities)
+        priority = nextPriority();
+    root = build(pieces, priorities, 0, pieces.size());
+    return saved;
+}
+
+std::size_t PieceTable::size() const
+{
+    return bytesOf(root);
+}
+
+std::size_t PieceTable::lineCount() const
+{
+    return newlinesOf(root) + 1;
+}
+
+std::size_t PieceTable::pieceCount() const
+{
+    return piecesOf(root);
+}
+
+std::size_t PieceTable::lineStart(std::size_t line) const
+{
+    if (line >= lineCount())
+        throw std::out_of_range(fmt::format("PieceTable::lineStart: line {} out of range {}", line, lineCount()));
+    if (line == 0)
+        return 0;
+    // looking for the byte after the line-th newline
+    std::size_t remaining = line;
+    std::size_t base = 0;
+    const Node* node = root.get();
+    while (node) {
+        std::size_t left_newlines = newlinesOf(node->left);
+        if (remaining <= left_newlines) {
+            node = node->left.get();
+            continue;
+        }
+        remaining -= left_newlines;
+        base += bytesOf(node->left);
+        const Piece& piece = node->piece;
+        if (remaining <= piece.newlines)
+            return base + piece.block->findNewline(piece.start, remaining - 1) - piece.start + 1;
+        remaining -= piece.newlines;
+        base += piece.length;
+        node = node->right.get();
+    }
+    return base;
+}
+
+std::size_t PieceTable::lineEnd(std::size_t line) const
+{
+    if (line + 1 < lineCount())
+        return lineStart(line + 1) - 1;
+    return size();
+}
+
+std::size_t PieceTable::lineOf(std::size_t offset) const
+{
+    std::size_t line = 0;
+    const Node* node = root.get();
+    while (node) {
+        std::size_t left_bytes = bytesOf(node->left);
+        if (offset < left_bytes) {
+            node = node->left.get();
+            continue;
+        }
+        offset -= left_bytes;
+        line += newlinesOf(node->left);
+        const Piece& piece = node->piece;
+        if (offset < piece.length)
+            return line + piece.block->countNewlines(piece.start, piece.start + offset);
+        offset -= piece.length;
+        line += piece.newlines;
+        node = node->right.get();
+    }
+    return line;
+}
+
+std::string PieceTable::line(std::size_t line) const
+{
+    std::size_t start = lineStart(line);
+    return substr(start, lineEnd(line) - start);
+}
+
+std::string_view PieceTable::lineView(std::size_t line, std::string& scratch) const
+{
+    std::size_t start = lineStart(line);
+    std::size_t length = lineEnd(line) - start;
+    if (length == 0)
+        return {};
+    // the piece holding the line start, it usually holds the whole line
+    std::size_t offset = start;
+    const Node* node = root.get();
+    while (node) {
+        std::size_t left_bytes = bytesOf(node->left);
+        if (offset < left_bytes) {
+            node = node->left.get();
+            continue;
+        }
+        offset -= left_bytes;
+        const Piece& piece = node->piece;
+        if (offset < piece.length) {
+            // a compressed block is read into scratch, its frames may be gone after the call
+            if (offset + length <= piece.length && piece.block->data())
+                return std::string_view(piece.block->data() + piece.start + offset, length);
+            break;
+        }
+        offset -= piece.length;
+        node = node->right.get();
+    }
+    scratch.clear();
+    forEachChunk(start, length, [&scratch](std::string_view chunk) {
+        scratch.append(chunk);
+        return true;
+    });
+    return scratch;
+}
+
+std::string PieceTable::substr(std::size_t offset, std::size_t length) const
+{
+    std::string result;
+    result.reserve(std::min(length, size() - std::min(offset, size())));
+    forEachChunk(offset, length, [&result](std::string_view chunk) {
+        result.append(chunk);
+        return true;
+    });
+    return result;
+}
+
+void PieceTable::forEachChunk(std::size_t offset, std::size_t length, const std::function<bool(std::string_view)>& visitor) const
+{
+    if (offset >= size() || length == 0)
+        return;
+    std::size_t end = offset + std::min(length, size() - offset);
+    // in-order walk, skipping subtrees entirely outside [offset, end)
+    auto walk = [&](auto& self, const Node* node, std::size_t base) -> bool {
+        if (!node || base >= end || base + node->bytes <= offset)
+            return true;
+        if (!self(self, node->left.get(), base))
+            return false;
+        std::size_t piece_begin = base + bytesOf(node->left);
+        std::size_t piece_end = piece_begin + node->piece.length;
+        if (piece_begin < end && piece_end > offset) {
+            std::size_t from = std::max(piece_begin, offset) - piece_begin;
+            std::size_t to = std::min(piece_end, end) - piece_begin;
+            if (!node->piece.block->read(node->piece.start + from, to - from, visitor))
+                return false;
+        }
+        return self(self, node->right.get(), piece_end);
+    };
+    walk(walk, root.get(), 0);
+}
@@ -0,0 +1,470 @@
+/**
+ * @file RecoveryJournal.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Implementation of the crash recovery journal
+ */
+
+#include "RecoveryJournal.h"
+#include "Logger.h"
+#include "MappedFile.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <stdexcept>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+constexpr char journal_magic[8] = { 'T', 'N', 'S', 'W', 'A', 'L', '0', '1' };
+
+/**
+ * @brief FNV-1a, enough to tell a torn record from a complete one
+ */
+std::uint32_t checksum(std::string_view bytes)
+{
+    std::uint32_t hash = 2166136261u;
+    for (char ch : bytes) {
+        hash ^= static_cast<unsigned char>(ch);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+template <typename T>
+void put(std::string& out, T value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+bool take(std::string_view bytes, std::size_t& pos, T& value)
+{
+    if (bytes.size() - pos < sizeof(value))
+        return false;
+    std::memcpy(&value, bytes.data() + pos, sizeof(value));
+    pos += sizeof(value);
+    return true;
+}
+}
+
+std::filesystem::path RecoveryJournal::pathFor(const std::filesystem::path& file)
+{
+    return file.parent_path() / ("." + file.filename().string() + ".journal");
+}
+
+RecoveryJournal::RecoveryJournal(std::filesystem::path journal_path, const std::filesystem::path& base_path, std::shared_ptr<const TextBlock> base)
+    : journal_path(std::move(journal_path))
+    , base(std::move(base))
+{
+    std::memcpy(header.magic, journal_magic, sizeof(journal_magic));
+    header.base_size = this->base->size();
+    std::error_code error;
+    auto mtime = std::filesystem::last_write_time(base_path, error);
+    header.base_mtime = error ? 0 : mtime.time_since_epoch().count();
+}
+
+RecoveryJournal::~RecoveryJournal()
+{
+    if (writer.joinable()) {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_one();
+        writer.join();
+    }
+    if (fd >= 0)
+        close(fd);
+}
+
+bool RecoveryJournal::replay(PieceTable& text)
+{
+    std::error_code error;
+    if (!std::filesystem::exists(journal_path, error))
+        return false;
+    std::shared_ptr<const MappedFile> file;
+    try {
+        file = std::make_shared<const MappedFile>(journal_path.string());
+    } catch (const std::runtime_error& e) {
+        Logger::Instance()->warn("cannot read journal {}: {}", journal_path.string(), e.what());
+        return false;
+    }
+    std::string_view bytes = file->view();
+    Header stored {};
+    std::size_t pos = 0;
+    if (!take(bytes, pos, stored) || std::memcmp(stored.magic, journal_magic, sizeof(journal_magic)) != 0
+        || stored.base_size != header.base_size || stored.base_mtime != header.base_mtime) {
+        // the file changed since, replaying would scramble it, keep the journal for the user instead
+        auto stale = journal_path;
+        stale += ".stale";
+        std::filesystem::rename(journal_path, stale, error);
+        Logger::Instance()->warn("journal {} does not match its file, moved to {}", journal_path.string(), stale.string());
+        return false;
+    }
+    // inserted text is referenced where it lies in the mapped journal, the index makes newline counts cheap
+    auto block = std::make_shared<TextBlock>(bytes, file);
+    block->buildLineIndex();
+    PieceTable recovered = text;
+    // a compacted journal is mostly ranges appended one after the other, those are collected and
+    // appended in one go
+    std::vector<PieceTable::Range> appended;
+    std::size_t appended_size = 0;
+    auto flushAppended = [&] {
+        recovered.append(appended);
+        appended.clear();
+        appended_size = 0;
+    };
+    std::size_t count = 0;
+    while (pos < bytes.size()) {
+        std::size_t begin = pos;
+        std::uint8_t kind = 0;
+        std::uint64_t offset = 0, length = 0, source = 0;
+        take(bytes, pos, kind);
+        bool complete = true;
+        if (kind != static_cast<std::uint8_t>(Kind::Clear))
+            complete = take(bytes, pos, offset) && take(bytes, pos, length);
+        if (kind == static_cast<std::uint8_t>(Kind::Copy))
+            complete = complete && take(bytes, pos, source);
+        std::size_t payload = pos;
+        if (complete && kind == static_cast<std::uint8_t>(Kind::Insert)) {
+            complete = length <= bytes.size() - pos;
+            pos += complete ? length : 0;
+        }
+        std::uint32_t stored_sum = 0;
+        complete = complete && take(bytes, pos, stored_sum) && stored_sum == checksum(bytes.substr(begin, pos - sizeof(stored_sum) - begin));
+        bool applicable = complete;
+        std::size_t current_size = recovered.size() + appended_size;
+        if (complete) {
+            switch (static_cast<Kind>(kind)) {
+            case Kind::Insert:
+                applicable = offset <= current_size;
+                if (applicable && offset == current_size) {
+                    appended.push_back({ block, payload, length });
+                    appended_size += length;
+                } else if (applicable) {
+                    flushAppended();
+                    recovered.insert(offset, block, payload, length);
+                }
+                break;
+            case Kind::Erase:
+                applicable = offset <= current_size && length <= current_size - offset;
+                if (applicable) {
+                    flushAppended();
+                    recovered.erase(offset, length);
+                }
+                break;
+            case Kind::Copy:
+                applicable = offset <= current_size && source <= base->size() && length <= base->size() - source;
+                if (applicable && offset == current_size) {
+                    appended.push_back({ base, source, length });
+                    appended_size += length;
+                } else if (applicable) {
+                    flushAppended();
+                    recovered.insert(offset, base, source, length);
+                }
+                break;
+            case Kind::Clear:
+                appended.clear();
+                appended_size = 0;
+                recovered = PieceTable();
+                break;
+            default:
+                applicable = false;
+            }
+        }
+        if (!applicable) {
+            // a crash mid-write leaves a torn record at the end, everything before it is good
+            Logger::Instance()->warn("journal {}: stopped at an incomplete record at byte {}", journal_path.string(), begin);
+            break;
+        }
+        count++;
+    }
+    flushAppended();
+    if (count == 0)
+        return false;
+    text = std::move(recovered);
+    Logger::Instance()->info("recovered {} edits from {}", count, journal_path.string());
+    return true;
+}
+
+void RecoveryJournal::start(const PieceTable& text)
+{
+    {
+        std::lock_guard lock(mutex);
+        initial = text;
+    }
+    recorded_since_compaction = 0;
+    writer = std::thread(&RecoveryJournal::writerLoop, this);
+}
+
+void RecoveryJournal::discard(const PieceTable& text)
+{
+    {
+        std::lock_guard lock(mutex);
+        records.clear();
+        payloads.clear();
+        snapshot.reset();
+        initial = text;
+        discarding = true;
+    }
+    recorded_since_compaction = 0;
+    compacted_size.store(0, std::memory_order_relaxed);
+    wakeup.notify_one();
+}
+
+void RecoveryJournal::recordInsert(std::size_t offset, std::string_view text)
+{
+    bool first;
+    bool large;
+    {
+        std::lock_guard lock(mutex);
+        if (initial)
+            snapshot = std::exchange(initial, std::nullopt);
+        first = records.empty();
+        records.push_back({ Kind::Insert, offset, text.size(), payloads.size() });
+        payloads.append(text);
+        large = payloads.size() >= eager_batch_bytes;
+    }
+    recorded_since_compaction += sizeof(Record) + text.size();
+    // the writer only needs to hear about the start of a batch, or a batch worth writing early
+    if (first || large)
+        wakeup.notify_one();
+}
+
+void RecoveryJournal::recordErase(std::size_t offset, std::size_t length)
+{
+    bool first;
+    {
+        std::lock_guard lock(mutex);
+        if (initial)
+            snapshot = std::exchange(initial, std::nullopt);
+        first = records.empty();
+        records.push_back({ Kind::Erase, offset, length, 0 });
+    }
+    recorded_since_compaction += sizeof(Record);
+    if (first)
+        wakeup.notify_one();
+}
+
+bool RecoveryJournal::wantsCompaction() const
+{
+    return recorded_since_compaction > std::max(min_compaction_bytes, 2 * compacted_size.load(std::memory_order_relaxed));
+}
+
+void RecoveryJournal::compact(const PieceTable& snapshot)
+{
+    {
+        std::lock_guard lock(mutex);
+        this->snapshot = snapshot;
+        initial.reset();
+        // the snapshot already contains these
+        records.clear();
+        payloads.clear();
+    }
+    recorded_since_compaction = 0;
+    wakeup.notify_one();
+}
+
+void RecoveryJournal::flush()
+{
+    std::unique_lock lock(mutex);
+    std::uint64_t target = ++submitted;
+    wakeup.notify_one();
+    written.wait(lock, [this, target] { return completed >= target; });
+}
+
+const std::filesystem::path& RecoveryJournal::getPath() const
+{
+    return journal_path;
+}
+
+void RecoveryJournal::writerLoop()
+{
+    std::unique_lock lock(mutex);
+    while (true) {
+        auto urgent = [this] { return stopping || discarding || snapshot || payloads.size() >= eager_batch_bytes || submitted != completed; };
+        wakeup.wait(lock, [&] { return urgent() || !records.empty(); });
+        // let keystrokes pile up into one write, unless someone is waiting
+        wakeup.wait_for(lock, write_interval, urgent);
+        std::vector<Record> batch = std::move(records);
+        std::string batch_payloads = std::move(payloads);
+        std::optional<PieceTable> batch_snapshot = std::move(snapshot);
+        records.clear();
+        payloads.clear();
+        snapshot.reset();
+        std::uint64_t target = submitted;
+        bool stop = stopping;
+        bool discard = std::exchange(discarding, false);
+        lock.unlock();
+
+        // the batch holds only what was recorded after the discard, it goes to a new file
+        if (discard) {
+            if (fd >= 0)
+                close(fd);
+            fd = -1;
+            std::error_code error;
+            std::filesystem::remove(journal_path, error);
+        }
+        std::string out;
+        bool replaced = true;
+        if (batch_snapshot) {
+            put(out, header);
+            encodeSnapshot(*batch_snapshot, out);
+            std::size_t compacted = out.size();
+            encode(batch, batch_payloads, out);
+            replaced = replaceFile(out);
+            if (replaced)
+                compacted_size.store(compacted, std::memory_order_relaxed);
+        } else if (!batch.empty()) {
+            encode(batch, batch_payloads, out);
+            writeAll(out);
+        }
+
+        lock.lock();
+        completed = target;
+        written.notify_all();
+        if (!replaced && !stop) {
+            // the old journal lacks what the snapshot holds, nothing may be appended to it. The
+            // snapshot goes first again with whatever was recorded meanwhile, unless a newer one
+            // replaced it, and is retried after a pause.
+            if (!snapshot && !discarding) {
+                for (Record& record : records) {
+                    if (record.kind == Kind::Insert)
+                        record.source += batch_payloads.size();
+                }
+                batch.insert(batch.end(), records.begin(), records.end());
+                records = std::move(batch);
+                payloads.insert(0, batch_payloads);
+                snapshot = std::move(batch_snapshot);
+            }
+            wakeup.wait_for(lock, write_interval, [this] { return stopping; });
+        }
+        if (stop && records.empty() && !snapshot && !discarding)
+            return;
+    }
+}
+
+void RecoveryJournal::encode(const std::vector<Record>& records, std::string_view payloads, std::string& out)
+{
+    std::optional<Record> current;
+    std::string merged;
+    for (const Record& record : records) {
+        if (current && current->kind == Kind::Insert && record.kind == Kind::Insert && record.offset == current->offset + current->length) {
+            // typing
+            merged += payloads.substr(record.source, record.length);
+            current->length += record.length;
+            continue;
+        }
+        if (current && current->kind == Kind::Erase && record.kind == Kind::Erase) {
+            if (record.offset == current->offset) {
+                // deleting forward
+                current->length += record.length;
+                continue;
+            }
+            if (record.offset + record.length == current->offset) {
+                // backspacing
+                current->offset = record.offset;
+                current->length += record.length;
+                continue;
+            }
+        }
+        if (current)
+            encodeRecord(*current, merged, out);
+        current = record;
+        merged.assign(record.kind == Kind::Insert ? payloads.substr(record.source, record.length) : std::string_view());
+    }
+    if (current)
+        encodeRecord(*current, merged, out);
+}
+
+void RecoveryJournal::encodeRecord(const Record& record, std::string_view payload, std::string& out)
+{
+    std::size_t begin = out.size();
+    put(out, static_cast<std::uint8_t>(record.kind));
+    if (record.kind != Kind::Clear) {
+        put(out, record.offset);
+        put(out, record.length);
+    }
+    if (record.kind == Kind::Copy)
+        put(out, record.source);
+    if (record.kind == Kind::Insert)
+        out.append(payload);
+    put(out, checksum(std::string_view(out).substr(begin)));
+}
+
+void RecoveryJournal::encodeSnapshot(const PieceTable& snapshot, std::string& out) const
+{
+    encodeRecord({ Kind::Clear, 0, 0, 0 }, {}, out);
+    auto base_begin = reinterpret_cast<std::uintptr_t>(base->data());
+    auto base_end = base_begin + base->size();
+    std::uint64_t position = 0;
+    snapshot.forEachChunk(0, snapshot.size(), [&](std::string_view chunk) {
+        auto chunk_begin = reinterpret_cast<std::uintptr_t>(chunk.data());
+        if (chunk_begin >= base_begin && chunk_begin + chunk.size() <= base_end)
+            encodeRecord({ Kind::Copy, position, chunk.size(), chunk_begin - base_begin }, {}, out);
+        else
+            encodeRecord({ Kind::Insert, position, chunk.size(), 0 }, chunk, out);
+        position += chunk.size();
+        return true;
+    });
+}
+
+bool RecoveryJournal::writeAll(std::string_view bytes)
+{
+    if (fd < 0)
+        return false;
+    std::size_t done = 0;
+    while (done < bytes.size()) {
+        ssize_t n = write(fd, bytes.data() + done, bytes.size() - done);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            Logger::Instance()->error("cannot write journal {}: {}", journal_path.string(), std::strerror(errno));
+            return false;
+        }
+        done += n;
+    }
+    if (fdatasync(fd) != 0) {
+        Logger::Instance()->error("cannot sync journal {}: {}", journal_path.string(), std::strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool RecoveryJournal::replaceFile(std::string_view bytes)
+{
+    auto temporary = journal_path;
+    temporary += ".tmp";
+    int new_fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (new_fd < 0) {
+        Logger::Instance()->error("cannot create journal {}: {}", temporary.string(), std::strerror(errno));
+        return false;
+    }
+    std::swap(fd, new_fd);
+    // the rename is atomic, a crash leaves either the old journal or the complete new one, so a
+    // short write must never be renamed over it
+    bool replaced = writeAll(bytes);
+    if (replaced && std::rename(temporary.c_str(), journal_path.c_str()) != 0) {
+        Logger::Instance()->error("cannot replace journal {}: {}", journal_path.string(), std::strerror(errno));
+        replaced = false;
+    }
+    if (!replaced) {
+        // keep appending to the old journal, replay never reads the temporary one
+        std::swap(fd, new_fd);
+        close(new_fd);
+        unlink(temporary.c_str());
+        return false;
+    }
+    if (new_fd >= 0)
+        close(new_fd);
+    // the rename itself only survives a crash once the directory is synced
+    auto directory = journal_path.parent_path();
+    int directory_fd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory_fd < 0 || fsync(directory_fd) != 0)
+        Logger::Instance()->warn("cannot sync directory of journal {}: {}", journal_path.string(), std::strerror(errno));
+    if (directory_fd >= 0)
+        close(directory_fd);
+    return true;
+}
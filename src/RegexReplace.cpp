@@ -0,0 +1,155 @@
+/**
+ * @file RegexReplace.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Implementation of the parallel regular expression replace-all
+ */
+
+#include "RegexReplace.h"
+#include <fmt/core.h>
+#include <stdexcept>
+
+RegexReplace::RegexReplace(PieceTable text, const std::string& pattern, const std::string& replacement, std::shared_ptr<Scheduler> scheduler)
+    : RegexReplace(std::move(text), pattern, [replacement](const std::cmatch& match) { return match.format(replacement); }, std::move(scheduler))
+{
+}
+
+RegexReplace::RegexReplace(PieceTable text, const std::string& pattern, Formatter formatter, std::shared_ptr<Scheduler> scheduler)
+    : text(std::move(text))
+    , formatter(std::move(formatter))
+{
+    try {
+        regex = std::regex(pattern, std::regex::ECMAScript | std::regex::optimize);
+    } catch (const std::regex_error& e) {
+        throw std::runtime_error(fmt::format("RegexReplace: invalid pattern {}: {}", pattern, e.what()));
+    }
+    // chunks start on line starts, so no line is split between two of them
+    std::size_t size = this->text.size();
+    bounds.push_back(0);
+    for (std::size_t target = chunk_size; target < size; target += chunk_size) {
+        std::size_t bound = this->text.lineStart(this->text.lineOf(target));
+        if (bound > bounds.back())
+            bounds.push_back(bound);
+    }
+    bounds.push_back(size);
+    parts.resize(bounds.size() - 1);
+    remaining.store(parts.size());
+    // skipped chunks are counted too, so the chunks check the cancel flag themselves
+    for (std::size_t i = 0; i < parts.size(); i++)
+        scheduler->submit(Scheduler::Priority::Normal, [this, i](const CancellationToken&) { scanChunk(i); });
+}
+
+RegexReplace::~RegexReplace()
+{
+    cancel();
+    wait();
+}
+
+std::vector<PieceTable::Replacement> RegexReplace::findAll(const PieceTable& text, const std::string& pattern, const std::string& replacement)
+{
+    RegexReplace job(text, pattern, replacement);
+    job.wait();
+    if (job.isFailed())
+        throw std::runtime_error(fmt::format("RegexReplace: scan for {} failed: {}", pattern, job.getError()));
+    return job.takeResult();
+}
+
+void RegexReplace::cancel()
+{
+    cancelled.store(true, std::memory_order_relaxed);
+}
+
+bool RegexReplace::isCancelled() const
+{
+    return cancelled.load(std::memory_order_relaxed);
+}
+
+bool RegexReplace::isFailed() const
+{
+    return failed.load(std::memory_order_relaxed);
+}
+
+std::string RegexReplace::getError() const
+{
+    std::lock_guard lock(mutex);
+    return error;
+}
+
+bool RegexReplace::isDone() const
+{
+    return remaining.load(std::memory_order_acquire) == 0;
+}
+
+void RegexReplace::wait()
+{
+    std::unique_lock lock(mutex);
+    finished.wait(lock, [this] { return isDone(); });
+}
+
+double RegexReplace::getProgress() const
+{
+    if (text.size() == 0)
+        return isDone() ? 1.0 : 0.0;
+    return static_cast<double>(scanned.load(std::memory_order_relaxed)) / text.size();
+}
+
+std::vector<PieceTable::Replacement> RegexReplace::takeResult()
+{
+    std::vector<PieceTable::Replacement> result;
+    if (!isDone() || isCancelled() || isFailed())
+        return result;
+    std::size_t total = 0;
+    for (const auto& part : parts)
+        total += part.size();
+    result.reserve(total);
+    for (auto& part : parts) {
+        result.insert(result.end(), std::make_move_iterator(part.begin()), std::make_move_iterator(part.end()));
+        part.clear();
+    }
+    return result;
+}
+
+void RegexReplace::scanChunk(std::size_t index)
+{
+    if (!isCancelled() && !isFailed()) {
+        try {
+            scanLines(index);
+        } catch (const std::exception& e) {
+            // wait() and the destructor count on every chunk, a throwing one still finishes
+            std::lock_guard lock(mutex);
+            if (!failed.exchange(true, std::memory_order_relaxed))
+                error = e.what();
+        }
+    }
+    scanned.fetch_add(bounds[index + 1] - bounds[index], std::memory_order_relaxed);
+    // notified under the lock, the job may be destroyed as soon as wait() sees it done
+    std::lock_guard lock(mutex);
+    if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        finished.notify_all();
+}
+
+void RegexReplace::scanLines(std::size_t index)
+{
+    std::size_t begin = bounds[index];
+    std::size_t end = bounds[index + 1];
+    std::string bytes = text.substr(begin, end - begin);
+    auto& out = parts[index];
+    bool last_chunk = index + 1 == parts.size();
+    std::size_t line_begin = 0;
+    for (std::size_t lines = 1;; lines++) {
+        std::size_t line_end = bytes.find('\n', line_begin);
+        if (line_end == std::string::npos)
+            line_end = bytes.size();
+        const char* first = bytes.data() + line_begin;
+        for (std::cregex_iterator match(first, bytes.data() + line_end, regex), done; match != done; ++match)
+            out.push_back({ begin + line_begin + match->position(), static_cast<std::size_t>(match->length()), formatter(*match) });
+        if (line_end == bytes.size())
+            break;
+        line_begin = line_end + 1;
+        // the line after the last newline of a chunk is the first line of the next one
+        if (line_begin == bytes.size() && !last_chunk)
+            break;
+        if (lines % cancel_check_lines == 0 && (isCancelled() || isFailed()))
+            break;
+    }
+}
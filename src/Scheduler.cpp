@@ -0,0 +1,219 @@
+/**
+ * @file Scheduler.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Implementation of the background job scheduler
+ */
+
+#include "Scheduler.h"
+#include "Logger.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fmt/core.h>
+#include <mutex>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace {
+constexpr std::size_t priority_count = 3;
+}
+
+struct Scheduler::State {
+    struct Job {
+        Work work;
+        Callback done;
+        CancellationToken token;
+    };
+    // one node of the completion list, pushed by workers and taken all at once by the main loop
+    struct Completion {
+        Callback callback;
+        CancellationToken token;
+        Completion* next;
+    };
+
+    int wake_fd;
+    std::mutex mutex;
+    std::array<std::deque<Job>, priority_count> queues;
+    std::atomic<std::size_t> jobs { 0 };
+    std::atomic<Completion*> completed { nullptr };
+
+    explicit State(int wake_fd)
+        : wake_fd(wake_fd)
+    {
+    }
+
+    ~State()
+    {
+        for (Completion* node = completed.load(); node != nullptr;) {
+            Completion* next = node->next;
+            delete node;
+            node = next;
+        }
+        close(wake_fd);
+    }
+
+    void wake()
+    {
+        eventfd_write(wake_fd, 1);
+    }
+
+    void complete(Callback callback, CancellationToken token)
+    {
+        auto* node = new Completion { std::move(callback), std::move(token), completed.load(std::memory_order_relaxed) };
+        while (!completed.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+        wake();
+    }
+
+    /**
+     * @brief run the most urgent queued job, every pool task submitted runs exactly one
+     */
+    void runOne()
+    {
+        Job job;
+        {
+            std::lock_guard lock(mutex);
+            auto queue = std::find_if(queues.begin(), queues.end(), [](const auto& jobs) { return !jobs.empty(); });
+            job = std::move(queue->front());
+            queue->pop_front();
+        }
+        if (!job.token.isCancelled()) {
+            try {
+                job.work(job.token);
+            } catch (const std::exception& e) {
+                Logger::Instance()->error("job failed: {}", e.what());
+            }
+            // callers counting their jobs must hear of a failed one too
+            if (job.done)
+                complete(std::move(job.done), job.token);
+            else
+                wake();
+        }
+        jobs.fetch_sub(1, std::memory_order_release);
+    }
+};
+
+CancellationToken::CancellationToken()
+    : flag(std::make_shared<std::atomic<bool>>(false))
+{
+}
+
+void CancellationToken::cancel() const
+{
+    flag->store(true, std::memory_order_relaxed);
+}
+
+bool CancellationToken::isCancelled() const
+{
+    return flag->load(std::memory_order_relaxed);
+}
+
+bool Scheduler::Timer::operator>(const Timer& other) const
+{
+    return deadline != other.deadline ? deadline > other.deadline : serial > other.serial;
+}
+
+Scheduler::Scheduler(std::shared_ptr<ThreadPool> pool)
+    : pool(std::move(pool))
+{
+    int wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0)
+        throw std::runtime_error(fmt::format("Scheduler: cannot create eventfd: {}", std::strerror(errno)));
+    state = std::make_shared<State>(wake_fd);
+}
+
+Scheduler::~Scheduler() = default;
+
+std::shared_ptr<Scheduler> Scheduler::Instance()
+{
+    static std::shared_ptr<Scheduler> instance = std::make_shared<Scheduler>(ThreadPool::Instance());
+    return instance;
+}
+
+void Scheduler::submit(Priority priority, Work work, Callback done, CancellationToken token)
+{
+    {
+        std::lock_guard lock(state->mutex);
+        state->queues[static_cast<std::size_t>(priority)].push_back({ std::move(work), std::move(done), std::move(token) });
+    }
+    state->jobs.fetch_add(1, std::memory_order_relaxed);
+    // the pool picks any of its tasks, each one takes whatever job is most urgent by then
+    pool->submit([state = state] { state->runOne(); });
+}
+
+void Scheduler::post(Callback callback, CancellationToken token)
+{
+    state->complete(std::move(callback), std::move(token));
+}
+
+void Scheduler::wake()
+{
+    state->wake();
+}
+
+CancellationToken Scheduler::runAt(Clock::time_point deadline, Callback callback)
+{
+    CancellationToken token;
+    timers.push_back({ deadline, timer_serial++, std::move(callback), token });
+    std::push_heap(timers.begin(), timers.end(), std::greater<>());
+    return token;
+}
+
+CancellationToken Scheduler::runAfter(Clock::duration delay, Callback callback)
+{
+    return runAt(Clock::now() + delay, std::move(callback));
+}
+
+bool Scheduler::runPending()
+{
+    eventfd_t count = 0;
+    bool woken = eventfd_read(state->wake_fd, &count) == 0 && count > 0;
+    // the list comes out newest first
+    State::Completion* reversed = nullptr;
+    for (State::Completion* node = state->completed.exchange(nullptr, std::memory_order_acquire); node != nullptr;) {
+        State::Completion* next = node->next;
+        node->next = reversed;
+        reversed = node;
+        node = next;
+    }
+    while (reversed != nullptr) {
+        std::unique_ptr<State::Completion> node(reversed);
+        reversed = node->next;
+        if (!node->token.isCancelled())
+            node->callback();
+    }
+    auto now = Clock::now();
+    bool fired = false;
+    while (!timers.empty() && timers.front().deadline <= now) {
+        std::pop_heap(timers.begin(), timers.end(), std::greater<>());
+        Timer timer = std::move(timers.back());
+        timers.pop_back();
+        if (!timer.token.isCancelled()) {
+            timer.callback();
+            fired = true;
+        }
+    }
+    return woken || fired;
+}
+
+std::optional<Scheduler::Clock::time_point> Scheduler::getNextDeadline() const
+{
+    if (timers.empty())
+        return std::nullopt;
+    return timers.front().deadline;
+}
+
+int Scheduler::getWakeFd() const
+{
+    return state->wake_fd;
+}
+
+std::size_t Scheduler::getJobCount() const
+{
+    return state->jobs.load(std::memory_order_acquire);
+}
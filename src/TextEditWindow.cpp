@@ -6,147 +6,648 @@
  */
 
 #include "Logger.h"
+#include "Metrics.h"
+#include "Utf8.h"
 #include "Window.h"
+#include <filesystem>
 #include <fmt/core.h>
 #include <ncurses.h>
+#include <algorithm>
 #include <string>
+#include <string_view>
+#include <tuple>
 
-TextEditWindow::TextEditWindow(const Border& borders, const std::string& name, std::size_t width, std::size_t height, PANEL* associated_panel, std::size_t init_x, std::size_t init_y, std::size_t max_width, std::size_t max_height)
-    : BaseWindow(borders, name, width, height, associated_panel, init_x, init_y, max_width, max_height)
+TextEditWindow::TextEditWindow(std::shared_ptr<Screen> screen, const Border& borders, const std::string& name, std::size_t width, std::size_t height, std::size_t init_x, std::size_t init_y, std::size_t max_width, std::size_t max_height, std::shared_ptr<Buffer> buffer)
+    : BaseWindow(std::move(screen), borders, name, width, height, init_x, init_y, max_width, max_height)
+    , buffer(std::move(buffer))
+    , view(*this->buffer)
 {
-    wrefresh(getWindowPtr());
+}
+
+TextEditWindow::~TextEditWindow()
+{
+    status_timer.cancel();
+}
+
+void TextEditWindow::openFile(const std::string& path, bool recover)
+{
+    if (!std::filesystem::exists(path)) {
+        logger->info("{} does not exist, starting with an empty buffer", path);
+        return;
+    }
+    if (recover)
+        buffer->enableRecovery(RecoveryJournal::pathFor(path));
+    buffer->setSyntax(Highlighter::syntaxFor(path));
+    buffer->load(path);
+    wrapView();
+    updateDisplay();
+}
+
+bool TextEditWindow::finishLoading()
+{
+    // any window on the buffer may be the one picking up the whole file, every view gets the
+    // new lines as damage
+    if (buffer->isLoading() && !buffer->pollLoading())
+        return false;
+    if (pending_input.empty())
+        return true;
+    auto input = std::move(pending_input);
+    pending_input.clear();
+    inputBatch(input);
+    return true;
 }
 
 void TextEditWindow::inputHandler(chtype ch)
 {
-    auto logger = Logger::Instance();
+    inputBatch(std::span<const chtype>(&ch, 1));
+}
+
+void TextEditWindow::inputBatch(std::span<const chtype> keys)
+{
+    if (buffer->isLoading()) {
+        // the buffer only holds the head of the file until indexing is done
+        pending_input.insert(pending_input.end(), keys.begin(), keys.end());
+        return;
+    }
+    ScopedTimer timer(Metrics::Timer::Input);
+    Metrics::Instance()->add(Metrics::Counter::Keys, keys.size());
+    std::size_t top_before = top_line;
+    bool was_searching = searching;
+    if (!replace_status.empty()) {
+        replace_status.clear();
+        markFrameDirty();
+    }
+    for (auto ch : keys)
+        applyKey(ch);
+    // the buffer collects the damage of the whole burst, rewrap and repaint it in one go
+    wrapView();
+    followCursor();
+    if (searching || was_searching) {
+        // the highlight moves around the whole viewport
+        markAllDirty();
+        updateDisplay();
+    } else if (top_line != top_before) {
+        updateDisplay();
+    } else {
+        markDamage();
+    }
+    // the counter follows the cursor and the edits
+    if (replace_prompt != ReplacePrompt::None || !buffer->getSearch().getQuery().empty() || buffer->getSearch().count() != shown_match_count)
+        markFrameDirty();
+    saveCursor();
+}
+
+bool TextEditWindow::pollReplace()
+{
+    if (!replace_job)
+        return false;
+    // the label shows the progress
+    markFrameDirty();
+    if (!replace_job->isDone())
+        return true;
+    auto job = std::move(replace_job);
+    if (job->isCancelled()) {
+        showStatus("replace cancelled");
+        return false;
+    }
+    if (job->isFailed()) {
+        logger->warn("replace \"{}\" failed: {}", replace_pattern, job->getError());
+        showStatus("replace failed");
+        return false;
+    }
+    if (buffer->getRevision() != replace_revision) {
+        showStatus("text changed, replace dropped");
+        return false;
+    }
+    auto replacements = job->takeResult();
+    std::tie(cursor_line, cursor_col) = buffer->replaceAll(replacements, cursor_line, cursor_col);
+    showStatus(fmt::format("{} replaced", replacements.size()));
+    logger->info("replaced {} matches of \"{}\"", replacements.size(), replace_pattern);
+    // the whole batch is rewrapped and repainted once
+    std::size_t top_before = top_line;
+    wrapView();
+    followCursor();
+    if (top_line != top_before)
+        updateDisplay();
+    else
+        markDamage();
+    saveCursor();
+    return false;
+}
+
+bool TextEditWindow::pollHighlight()
+{
+    // the wrap cache only covers the head of the file while loading
+    if (buffer->isLoading())
+        return buffer->isHighlighting();
+    // the rows must be current to find the last line on screen
+    wrapView();
+    std::size_t last_row = std::min(top_line + textHeight(), view.getWrappedLineCount()) - 1;
+    std::size_t viewport_end = view.getPositionOfWrapped(last_row, 0).first + 1;
+    // lines lexing differently now are damage, markDamage() repaints the visible ones
+    if (buffer->updateHighlights(viewport_end))
+        markDamage();
+    return buffer->isHighlighting();
+}
+
+void TextEditWindow::syncView()
+{
+    std::tie(cursor_line, cursor_col) = buffer->positionOf(view.getCursor());
+    std::size_t top_before = top_line;
+    // the top line stays where it is when the rows above it changed, e.g. wrapped in the background
+    wrapView();
+    // the text may have shrunk under the viewport
+    top_line = std::min(top_line, view.getWrappedLineCount() - 1);
+    followCursor();
+    if (top_line != top_before)
+        updateDisplay();
+    else
+        markDamage();
+    if (buffer->getSearch().count() != shown_match_count)
+        markFrameDirty();
+}
+
+std::shared_ptr<Buffer> TextEditWindow::getBuffer() const
+{
+    return buffer;
+}
+
+void TextEditWindow::saveCursor()
+{
+    // the column may sit past the end of a shorter line
+    view.setCursor(buffer->offsetOf(cursor_line, std::min(cursor_col, buffer->getLineLength(cursor_line))));
+}
+
+void TextEditWindow::applyKey(chtype ch)
+{
+    if (in_paste) {
+        collectPaste(ch);
+        return;
+    }
+    if (replace_prompt != ReplacePrompt::None) {
+        replaceKey(ch);
+        return;
+    }
+    if (searching && searchKey(ch))
+        return;
     switch (ch) {
+    case KEY_PASTE_BEGIN:
+        buffer->closeUndoStep();
+        in_paste = true;
+        paste_after_cr = false;
+        paste_text.clear();
+        break;
+    case KEY_CTRL_FIND:
+        buffer->closeUndoStep();
+        searching = true;
+        search_origin_line = cursor_line;
+        search_origin_col = cursor_col;
+        // start from the last query, typing replaces it
+        if (!search_query.empty())
+            updateSearch();
+        break;
+    case KEY_CTRL_REPLACE:
+        buffer->closeUndoStep();
+        replace_prompt = ReplacePrompt::Pattern;
+        replace_pattern.clear();
+        replace_text.clear();
+        break;
+    case KEY_CTRL_CANCEL:
+        if (replace_job)
+            replace_job->cancel();
+        else
+            buffer->setSearchQuery("");
+        break;
+    case KEY_CTRL_UNDO:
+    case KEY_UNDO:
+        if (auto position = buffer->undo())
+            std::tie(cursor_line, cursor_col) = *position;
+        break;
+    case KEY_CTRL_REDO:
+    case KEY_REDO:
+        if (auto position = buffer->redo())
+            std::tie(cursor_line, cursor_col) = *position;
+        break;
     case KEY_LEFT:
+        buffer->closeUndoStep();
         if (cursor_col != 0) {
-            cursor_col--;
+            cursor_col = buffer->prevGrapheme(cursor_line, cursor_col);
         } else if (cursor_line != 0) {
             cursor_line--;
-            cursor_col = buffer[cursor_line].empty() ? 0 : buffer[cursor_line].size();
+            cursor_col = buffer->getLineLength(cursor_line);
         }
         break;
     case KEY_RIGHT:
-        if (cursor_col + 1 < buffer[cursor_line].size()) {
-            cursor_col++;
+        buffer->closeUndoStep();
+        if (cursor_col < buffer->getLineLength(cursor_line)) {
+            cursor_col = buffer->nextGrapheme(cursor_line, cursor_col);
         }
-        else {
+        else if (cursor_line + 1 < buffer->getBufferSize()) {
             cursor_line++;
             cursor_col = 0;
         }
         break;
     case KEY_UP:
-        if (cursor_col - getWidth() < cursor_line) {
-            cursor_col -= getWidth();
-        }
-        else {
-            if (cursor_line == 0) {
-                cursor_col = 0;
-            }
+    case KEY_DOWN: {
+        buffer->closeUndoStep();
+        // move by wrapped row and keep the display column, the rows must be current for that
+        wrapView();
+        std::size_t row = view.getWrappedRowOf(cursor_line, cursor_col);
+        if (ch == KEY_UP ? row == 0 : row + 1 >= view.getWrappedLineCount())
+            break;
+        std::size_t column = view.getWrappedColOf(cursor_line, cursor_col);
+        std::tie(cursor_line, cursor_col) = view.getPositionOfWrapped(ch == KEY_UP ? row - 1 : row + 1, column);
+        break;
+    }
+    // with nl() in effect the terminal's Enter arrives as a newline, the keypad's as KEY_ENTER
+    case '\n':
+    case '\r':
+    case KEY_ENTER:
+        buffer->closeUndoStep();
+        std::tie(cursor_line, cursor_col) = buffer->insertAt(cursor_line, cursor_col, std::string_view("\n"));
+        break;
+#ifdef __APPLE__
+    // backspace, since ncurses's definition won't work on mac
+    case 127:
+#else
+    case KEY_BACKSPACE:
+#endif
+        if (cursor_col != 0) {
+            std::size_t start = buffer->prevGrapheme(cursor_line, cursor_col);
+            buffer->eraseAt(cursor_line, start, cursor_col - start);
+            cursor_col = start;
+        } else if (cursor_line != 0) {
+            // join with the line above by erasing its newline
             cursor_line--;
-            cursor_col = buffer[cursor_line].size() - 1;
+            cursor_col = buffer->getLineLength(cursor_line);
+            buffer->eraseAt(cursor_line, cursor_col, 1);
         }
         break;
+    default:
+        insertInputByte(ch);
+        break;
+    }
+    logger->debug("cursor_line: {}, cursor_col: {}, character inputed: {}", cursor_line, cursor_col, ch);
+}
+
+void TextEditWindow::insertInputByte(chtype ch)
+{
+    // keys come in one byte at a time, collect a whole UTF-8 sequence before inserting it
+    if (ch > 0xff)
+        return;
+    auto byte = static_cast<unsigned char>(ch);
+    // control bytes without a key of their own would split or garble lines on screen, a tab is text
+    if (byte < 0x20 && byte != '\t')
+        return;
+    bool continuation = (byte & 0xC0) == 0x80;
+    if (!input_sequence.empty() && !continuation) {
+        // the sequence was cut short, keep what arrived as one replacement character
+        buffer->addChAt(cursor_line, cursor_col, Utf8::replacement);
+        cursor_col += Utf8::encode(Utf8::replacement).size();
+        input_sequence.clear();
+    }
+    input_sequence.push_back(static_cast<char>(byte));
+    auto lead = static_cast<unsigned char>(input_sequence[0]);
+    std::size_t expected = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+    if (input_sequence.size() < expected)
+        return;
+    std::size_t length;
+    char32_t codepoint = Utf8::decode(input_sequence, 0, length);
+    input_sequence.clear();
+    // long lines are wrapped for display, the cursor stays on the same buffer line
+    buffer->addChAt(cursor_line, cursor_col, codepoint);
+    cursor_col += Utf8::encode(codepoint).size();
+}
+
+bool TextEditWindow::searchKey(chtype ch)
+{
+    switch (ch) {
+    case KEY_CTRL_FIND:
+    case KEY_ENTER:
+    case '\n':
+    case '\r':
     case KEY_DOWN:
-        if (cursor_line + getWidth() < buffer.getBufferSize()) {
-            cursor_col += getWidth();
+    case KEY_UP: {
+        bool forward = ch != KEY_UP;
+        // strictly after the cursor, which sits on the current match
+        if (auto match = buffer->findMatch(cursor_line, forward ? cursor_col + 1 : cursor_col, forward))
+            std::tie(cursor_line, cursor_col) = *match;
+        return true;
+    }
+    case KEY_ESCAPE:
+        searching = false;
+        return true;
+    case KEY_CTRL_CANCEL:
+        searching = false;
+        buffer->setSearchQuery("");
+        return true;
+#ifdef __APPLE__
+    case 127:
+#else
+    case KEY_BACKSPACE:
+#endif
+        if (!search_query.empty()) {
+            search_query.erase(Utf8::prevGrapheme(search_query, search_query.size()));
+            updateSearch();
         }
-        else {
-            cursor_line++;
-            cursor_col = buffer[cursor_line].size() - 1;
+        return true;
+    case KEY_PASTE_BEGIN:
+        // a paste ends the search like any other key, it edits the buffer
+        break;
+    default:
+        if (ch >= 0x20 && ch <= 0xff && ch != 0x7f) {
+            search_query.push_back(static_cast<char>(ch));
+            // wait for the rest of a multibyte character
+            if (Utf8::isValid(search_query))
+                updateSearch();
+            return true;
         }
         break;
-#ifdef __APPLE__
-    // enter, since ncurses's definition won't work on mac
-    case 10:
-#else
+    }
+    searching = false;
+    return false;
+}
+
+void TextEditWindow::updateSearch()
+{
+    std::size_t count = buffer->setSearchQuery(search_query);
+    logger->debug("search for \"{}\": {} matches", search_query, count);
+    cursor_line = search_origin_line;
+    cursor_col = search_origin_col;
+    if (auto match = buffer->findMatch(search_origin_line, search_origin_col, true))
+        std::tie(cursor_line, cursor_col) = *match;
+}
+
+void TextEditWindow::replaceKey(chtype ch)
+{
+    std::string& field = replace_prompt == ReplacePrompt::Pattern ? replace_pattern : replace_text;
+    switch (ch) {
     case KEY_ENTER:
-#endif
-        buffer.appendLine("");
-        buffer.wrapLines(getWidth() - 2);
-        cursor_line++;
-        cursor_col = 0;
+    case '\n':
+    case '\r':
+        if (replace_prompt == ReplacePrompt::Pattern) {
+            if (!replace_pattern.empty())
+                replace_prompt = ReplacePrompt::Replacement;
+        } else {
+            replace_prompt = ReplacePrompt::None;
+            startReplace();
+        }
+        break;
+    case KEY_ESCAPE:
+    case KEY_CTRL_CANCEL:
+        replace_prompt = ReplacePrompt::None;
         break;
 #ifdef __APPLE__
-    // backspace, since ncurses's definition won't work on mac
     case 127:
 #else
     case KEY_BACKSPACE:
 #endif
-        if (buffer[cursor_line].size() == 0) {
-            if (cursor_col == 0) {
-                buffer.wrapLines(getWidth() - 2);
-                break;
-            }
-            cursor_col--;
-            buffer.removeLine(cursor_line);
-        } else {
-            buffer[cursor_line].erase(cursor_col - 1, 1);
-        }
-        buffer.wrapLines(getWidth() - 2);
+        if (!field.empty())
+            field.erase(Utf8::prevGrapheme(field, field.size()));
         break;
     default:
-        if (cursor_col == getWidth() - 1) {
-            cursor_line++;
-            cursor_col = 1;
-        }
-        buffer.addChAt(cursor_line, cursor_col, ch);
-        buffer.wrapLines(getWidth() - 2);
-        cursor_col++;
+        if (ch >= 0x20 && ch <= 0xff && ch != 0x7f)
+            field.push_back(static_cast<char>(ch));
         break;
     }
-    logger->info(fmt::format("cursor_line: {}, cursor_col: {}, wrapped_line: {}, wrapped_col: {}, character inputed: {}", cursor_line, cursor_col, wrappedLine(), wrappedCol(), ch));
-    updateDisplay();
 }
 
-void TextEditWindow::updateDisplay()
+void TextEditWindow::showStatus(std::string status)
 {
+    replace_status = std::move(status);
+    markFrameDirty();
+    // nobody may press a key for a while, the status goes away on its own
+    status_timer.cancel();
+    status_timer = Scheduler::Instance()->runAfter(status_timeout, [this] {
+        replace_status.clear();
+        markFrameDirty();
+    });
+}
 
-    eraseTextContent();
-    makeBorder();
-    mvaddstr(getY() + 1, getX() + 1, std::string(buffer).c_str());
+void TextEditWindow::startReplace()
+{
+    // a replace still scanning is superseded
+    replace_job.reset();
+    try {
+        replace_job = std::make_unique<RegexReplace>(buffer->getText(), replace_pattern, replace_text);
+    } catch (const std::runtime_error& e) {
+        logger->warn("{}", e.what());
+        showStatus(fmt::format("bad pattern {}", replace_pattern));
+        return;
+    }
+    replace_revision = buffer->getRevision();
+    logger->debug("replace \"{}\" with \"{}\"", replace_pattern, replace_text);
 }
 
-void TextEditWindow::scrollUp()
+void TextEditWindow::makeWindowLabel()
 {
-    buffer.wrapLines(getWidth() - 2);
-    if (top_line != 0)
-        top_line--;
+    const TextSearch& search = buffer->getSearch();
+    shown_match_count = search.count();
+    std::string label;
+    if (replace_prompt == ReplacePrompt::Pattern) {
+        label = fmt::format("replace: {}", replace_pattern);
+    } else if (replace_prompt == ReplacePrompt::Replacement) {
+        label = fmt::format("replace {} with: {}", replace_pattern, replace_text);
+    } else if (replace_job) {
+        label = fmt::format("replacing {}: {}%", replace_pattern, static_cast<int>(replace_job->getProgress() * 100));
+    } else if (!replace_status.empty()) {
+        label = fmt::format("{} [{}]", getName(), replace_status);
+    } else if (!searching && search.getQuery().empty()) {
+        BaseWindow::makeWindowLabel();
+        return;
+    } else {
+        std::string counter;
+        std::size_t offset = buffer->offsetOf(cursor_line, cursor_col);
+        if (auto match = search.next(offset); match && *match == offset)
+            counter = fmt::format("{}/{}", search.rank(offset) + 1, search.count());
+        else
+            counter = fmt::format("{} matches", search.count());
+        label = searching ? fmt::format("search: {} [{}]", search_query, counter) : fmt::format("{} [{}: {}]", getName(), search.getQuery(), counter);
+    }
+    std::size_t space = getWidth() > 2 ? getWidth() - 2 : 0;
+    surface->put(getHeight() - 1, 1, std::string_view(label).substr(0, Utf8::fitWidth(label, space)));
 }
 
-void TextEditWindow::scrollDown()
+void TextEditWindow::collectPaste(chtype ch)
 {
-    buffer.wrapLines(getWidth() - 2);
-    if (top_line != buffer.getWrappedLineCount())
-        top_line++;
+    if (ch == KEY_PASTE_END) {
+        in_paste = false;
+        // the cursor may sit past the end after moving between lines of different length
+        cursor_col = std::min(cursor_col, buffer->getLineLength(cursor_line));
+        if (!Utf8::isValid(paste_text))
+            paste_text = Utf8::sanitize(paste_text);
+        std::tie(cursor_line, cursor_col) = buffer->insertAt(cursor_line, cursor_col, paste_text);
+        buffer->closeUndoStep();
+        logger->debug("pasted {} bytes, cursor_line: {}, cursor_col: {}", paste_text.size(), cursor_line, cursor_col);
+        paste_text.clear();
+        return;
+    }
+    if (ch > 0xff)
+        return;
+    // terminals send line breaks as CR, keep a CRLF pair as one line break
+    if (ch == '\n' && paste_after_cr) {
+        paste_after_cr = false;
+        return;
+    }
+    paste_after_cr = ch == '\r';
+    paste_text.push_back(paste_after_cr ? '\n' : static_cast<char>(ch));
 }
 
-void TextEditWindow::eraseTextContent()
+void TextEditWindow::markDamage()
+{
+    auto [first, last] = view.takeDamage();
+    if (first == last)
+        return;
+    // rewrapping can change the row count of the touched lines, which shifts every row below
+    std::size_t first_row = view.getWrappedRowOf(first, 0);
+    if (last == std::string::npos || view.getWrappedLineCount() != damage_row_count) {
+        markRowsDirty(first_row, top_line + textHeight());
+    } else {
+        markRowsDirty(first_row, view.getWrappedRowOf(last, 0));
+    }
+    damage_row_count = view.getWrappedLineCount();
+}
+
+void TextEditWindow::updateDisplay()
 {
-    for (int i = 1; i < getWidth() - 1; ++i) {
-        for (int j = 1; j < getHeight(); ++j) {
-            mvwaddch(window_ptr, j, i, ' ');
+    Metrics::Instance()->add(Metrics::Counter::FullRepaints);
+    view.takeDamage();
+    damage_row_count = view.getWrappedLineCount();
+    markDirty(1, textHeight() + 1);
+}
+
+void TextEditWindow::markRowsDirty(std::size_t first, std::size_t last)
+{
+    first = std::max(first, top_line);
+    last = std::min(last, top_line + textHeight());
+    if (first < last)
+        markDirty(first - top_line + 1, last - top_line + 1);
+}
+
+void TextEditWindow::paintRow(std::size_t row)
+{
+    // row 0 and the last row belong to the border
+    if (row == 0 || row > textHeight())
+        return;
+    std::size_t text_width = getWidth() - 2;
+    std::size_t visual_row = top_line + row - 1;
+    std::size_t drawn = 0;
+    std::size_t bytes = 0;
+    if (visual_row < view.getWrappedLineCount()) {
+        std::string_view content = view.getWrappedRow(visual_row);
+        // rows are wrapped to the text width already, measuring them keeps the fill after a wide character right
+        content = content.substr(0, Utf8::fitWidth(content, text_width));
+        bytes = content.size();
+        // a tab takes one column like any other byte, the terminal would jump to its next tab stop
+        std::string untabbed;
+        if (content.find('\t') != std::string_view::npos) {
+            untabbed = content;
+            std::replace(untabbed.begin(), untabbed.end(), '\t', ' ');
+            content = untabbed;
+        }
+        bool highlighted = buffer->getSearch().count() != 0 || buffer->getSyntax() != Highlighter::Syntax::None;
+        if (!highlighted) {
+            surface->put(row, 1, content);
+            drawn = Utf8::displayWidth(content);
+        } else {
+            // syntax first, matches on top of it, then draw each run of one style
+            auto [line, start] = view.getPositionOfWrapped(visual_row, 0);
+            std::size_t end = start + content.size();
+            std::vector<Style> styles(content.size(), Style::Normal);
+            for (const auto& span : buffer->getHighlights(line)) {
+                if (span.end > start && span.begin < end)
+                    std::fill(styles.begin() + std::max(span.begin, start) - start, styles.begin() + std::min(span.end, end) - start, span.style);
+            }
+            if (buffer->getSearch().count() != 0) {
+                for (auto [from, to] : buffer->getMatchesIn(line, start, end))
+                    std::fill(styles.begin() + from - start, styles.begin() + to - start, Style::Match);
+            }
+            for (std::size_t pos = 0; pos < content.size();) {
+                std::size_t run_end = pos + 1;
+                while (run_end < content.size() && styles[run_end] == styles[pos])
+                    run_end++;
+                std::string_view run = content.substr(pos, run_end - pos);
+                surface->setStyle(styles[pos]);
+                surface->put(row, 1 + drawn, run);
+                drawn += Utf8::displayWidth(run);
+                pos = run_end;
+            }
+            surface->setStyle(Style::Normal);
         }
     }
+    if (drawn < text_width) {
+        surface->fill(row, 1 + drawn, ' ', text_width - drawn);
+        bytes += text_width - drawn;
+    }
+    Metrics::Instance()->add(Metrics::Counter::BytesDrawn, bytes);
 }
 
-std::size_t TextEditWindow::wrappedLine() const
+void TextEditWindow::placeCursor()
+{
+    if (wrappedLine() > top_line && wrappedLine() <= top_line + textHeight())
+        surface->setCursor(wrappedLine() - top_line, std::min(wrappedCol(), getWidth() - 2));
+}
+
+void TextEditWindow::followCursor()
 {
-    std::size_t ans = 0;
-    for (int i = 0; i <= cursor_line; i++) {
-        if (i == cursor_line) {
-            ans += cursor_col / (getWidth() - 2) + 1;
-            return ans;
+    std::size_t top_before = top_line;
+    std::size_t row = wrappedLine() - 1;
+    // the lines scrolled onto may only have estimated rows so far, wrapping them can move the
+    // cursor row again
+    for (int round = 0; round < max_follow_rounds && (row < top_line || row >= top_line + textHeight()); round++) {
+        if (row < top_line) {
+            if (top_line - row > textHeight())
+                top_line = row;
+            while (row < top_line && top_line != 0)
+                scrollUp();
+        } else {
+            if (row - top_line > 2 * textHeight())
+                top_line = row - textHeight();
+            for (std::size_t last = -1; row >= top_line + textHeight() && top_line != last;) {
+                last = top_line;
+                scrollDown();
+            }
         }
-        ans += buffer[i].size() / (getWidth() - 2) + 1;
+        wrapView();
+        row = wrappedLine() - 1;
     }
-    return ans;
+    if (top_line == top_before)
+        return;
+    // a paged file keeps going the way the viewport went, have the chunks there ready
+    if (row < top_line + textHeight() / 2)
+        buffer->prefetch(std::get<0>(view.getWrappedLineTuple(top_line)), false);
+    else
+        buffer->prefetch(std::get<0>(view.getWrappedLineTuple(std::min(top_line + textHeight(), view.getWrappedLineCount()) - 1)), true);
+}
+
+void TextEditWindow::wrapView()
+{
+    top_line = view.wrapAround(getWidth() - 2, top_line, textHeight());
+}
+
+std::size_t TextEditWindow::textHeight() const
+{
+    return getHeight() - 2;
+}
+
+void TextEditWindow::scrollUp()
+{
+    if (top_line != 0)
+        top_line--;
+}
+
+void TextEditWindow::scrollDown()
+{
+    if (top_line + 1 < view.getWrappedLineCount())
+        top_line++;
+}
+
+std::size_t TextEditWindow::wrappedLine() const
+{
+    return view.getWrappedRowOf(cursor_line, cursor_col) + 1;
 }
 
 std::size_t TextEditWindow::wrappedCol() const
 {
-    return cursor_col % (getWidth() - 2) + 1;
+    return view.getWrappedColOf(cursor_line, cursor_col) + 1;
 }
@@ -0,0 +1,444 @@
+/**
+ * @file TextScan.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Implementation of the vectorized text scanning primitives
+ */
+
+#include "TextScan.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define TANOSHII_SCAN_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define TANOSHII_SCAN_NEON
+#endif
+
+namespace {
+using ScanFunction = void (*)(const char*, std::size_t, std::size_t, std::vector<std::size_t>&);
+
+void scanScalar(const char* data, std::size_t length, std::size_t base, std::vector<std::size_t>& out)
+{
+    const char* p = data;
+    const char* end = data + length;
+    while ((p = static_cast<const char*>(std::memchr(p, '\n', end - p))) != nullptr) {
+        out.push_back(base + (p - data));
+        ++p;
+    }
+}
+
+#ifdef TANOSHII_SCAN_X86
+void scanSse2(const char* data, std::size_t length, std::size_t base, std::vector<std::size_t>& out)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    std::size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        std::uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+        while (mask) {
+            out.push_back(base + i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    scanScalar(data + i, length - i, base + i, out);
+}
+
+__attribute__((target("avx2"))) void scanAvx2(const char* data, std::size_t length, std::size_t base, std::vector<std::size_t>& out)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+    std::size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        std::uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline));
+        while (mask) {
+            out.push_back(base + i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    // leaving the upper halves dirty would stall every legacy SSE instruction after this, the
+    // compiler only clears them by itself when optimizing
+    _mm256_zeroupper();
+    scanSse2(data + i, length - i, base + i, out);
+}
+#endif
+
+#ifdef TANOSHII_SCAN_NEON
+void scanNeon(const char* data, std::size_t length, std::size_t base, std::vector<std::size_t>& out)
+{
+    const uint8x16_t newline = vdupq_n_u8('\n');
+    std::size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(reinterpret_cast<const std::uint8_t*>(data + i)), newline);
+        // narrow every byte of the compare result to a nibble, giving a 64 bit mask
+        std::uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        while (mask) {
+            int bit = __builtin_ctzll(mask);
+            out.push_back(base + i + bit / 4);
+            mask &= ~(std::uint64_t { 0xf } << (bit & ~3));
+        }
+    }
+    scanScalar(data + i, length - i, base + i, out);
+}
+#endif
+
+using AsciiFunction = std::size_t (*)(const char*, std::size_t);
+
+std::size_t asciiScalar(const char* data, std::size_t length)
+{
+    std::size_t i = 0;
+    // eight bytes at a time, any set high bit ends the run
+    for (std::uint64_t word; i + 8 <= length; i += 8) {
+        std::memcpy(&word, data + i, 8);
+        if (word & 0x8080808080808080ull)
+            break;
+    }
+    while (i < length && static_cast<unsigned char>(data[i]) < 0x80)
+        i++;
+    return i;
+}
+
+#ifdef TANOSHII_SCAN_X86
+std::size_t asciiSse2(const char* data, std::size_t length)
+{
+    std::size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        std::uint32_t mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + asciiScalar(data + i, length - i);
+}
+
+__attribute__((target("avx2"))) std::size_t asciiAvx2(const char* data, std::size_t length)
+{
+    std::size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        std::uint32_t mask = _mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)));
+        if (mask) {
+            _mm256_zeroupper();
+            return i + __builtin_ctz(mask);
+        }
+    }
+    _mm256_zeroupper();
+    return i + asciiSse2(data + i, length - i);
+}
+#endif
+
+#ifdef TANOSHII_SCAN_NEON
+std::size_t asciiNeon(const char* data, std::size_t length)
+{
+    std::size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        if (vmaxvq_u8(vld1q_u8(reinterpret_cast<const std::uint8_t*>(data + i))) >= 0x80)
+            break;
+    }
+    return i + asciiScalar(data + i, length - i);
+}
+#endif
+
+AsciiFunction selectAscii()
+{
+#if defined(TANOSHII_SCAN_X86)
+    if (__builtin_cpu_supports("avx2"))
+        return asciiAvx2;
+    return asciiSse2;
+#elif defined(TANOSHII_SCAN_NEON)
+    return asciiNeon;
+#else
+    return asciiScalar;
+#endif
+}
+
+const AsciiFunction ascii_scanner = selectAscii();
+
+ScanFunction selectScanner()
+{
+#if defined(TANOSHII_SCAN_X86)
+    if (__builtin_cpu_supports("avx2"))
+        return scanAvx2;
+    return scanSse2;
+#elif defined(TANOSHII_SCAN_NEON)
+    return scanNeon;
+#else
+    return scanScalar;
+#endif
+}
+
+const ScanFunction scanner = selectScanner();
+
+using FindFunction = void (*)(std::string_view, std::string_view, std::size_t, std::vector<std::size_t>&);
+
+/**
+ * @brief Boyer-Moore-Horspool, skipping by the byte under the last pattern position
+ */
+void findScalar(std::string_view text, std::string_view pattern, std::size_t base, std::vector<std::size_t>& out)
+{
+    std::size_t m = pattern.size();
+    if (text.size() < m)
+        return;
+    if (m == 1) {
+        for (const char* p = text.data(); (p = static_cast<const char*>(std::memchr(p, pattern[0], text.data() + text.size() - p))) != nullptr; ++p)
+            out.push_back(base + (p - text.data()));
+        return;
+    }
+    std::size_t skip[256];
+    std::fill(std::begin(skip), std::end(skip), m);
+    for (std::size_t i = 0; i + 1 < m; i++)
+        skip[static_cast<unsigned char>(pattern[i])] = m - 1 - i;
+    char last = pattern[m - 1];
+    for (std::size_t i = 0; i + m <= text.size();) {
+        char probe = text[i + m - 1];
+        if (probe == last && std::memcmp(text.data() + i, pattern.data(), m - 1) == 0)
+            out.push_back(base + i);
+        i += skip[static_cast<unsigned char>(probe)];
+    }
+}
+
+#ifdef TANOSHII_SCAN_X86
+void findSse2(std::string_view text, std::string_view pattern, std::size_t base, std::vector<std::size_t>& out)
+{
+    std::size_t m = pattern.size();
+    const __m128i first = _mm_set1_epi8(pattern[0]);
+    const __m128i last = _mm_set1_epi8(pattern[m - 1]);
+    std::size_t i = 0;
+    for (; i + m - 1 + 16 <= text.size(); i += 16) {
+        __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + i));
+        __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + i + m - 1));
+        std::uint32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last)));
+        while (mask) {
+            std::size_t at = i + __builtin_ctz(mask);
+            if (m <= 2 || std::memcmp(text.data() + at + 1, pattern.data() + 1, m - 2) == 0)
+                out.push_back(base + at);
+            mask &= mask - 1;
+        }
+    }
+    // the tail is shorter than a vector plus the pattern
+    findScalar(text.substr(i), pattern, base + i, out);
+}
+
+__attribute__((target("avx2"))) void findAvx2(std::string_view text, std::string_view pattern, std::size_t base, std::vector<std::size_t>& out)
+{
+    std::size_t m = pattern.size();
+    const __m256i first = _mm256_set1_epi8(pattern[0]);
+    const __m256i last = _mm256_set1_epi8(pattern[m - 1]);
+    std::size_t i = 0;
+    for (; i + m - 1 + 32 <= text.size(); i += 32) {
+        __m256i head = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + i));
+        __m256i tail = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + i + m - 1));
+        std::uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(head, first), _mm256_cmpeq_epi8(tail, last)));
+        while (mask) {
+            std::size_t at = i + __builtin_ctz(mask);
+            if (m <= 2 || std::memcmp(text.data() + at + 1, pattern.data() + 1, m - 2) == 0)
+                out.push_back(base + at);
+            mask &= mask - 1;
+        }
+    }
+    _mm256_zeroupper();
+    findSse2(text.substr(i), pattern, base + i, out);
+}
+#endif
+
+#ifdef TANOSHII_SCAN_NEON
+void findNeon(std::string_view text, std::string_view pattern, std::size_t base, std::vector<std::size_t>& out)
+{
+    std::size_t m = pattern.size();
+    const uint8x16_t first = vdupq_n_u8(pattern[0]);
+    const uint8x16_t last = vdupq_n_u8(pattern[m - 1]);
+    std::size_t i = 0;
+    for (; i + m - 1 + 16 <= text.size(); i += 16) {
+        uint8x16_t head = vld1q_u8(reinterpret_cast<const std::uint8_t*>(text.data() + i));
+        uint8x16_t tail = vld1q_u8(reinterpret_cast<const std::uint8_t*>(text.data() + i + m - 1));
+        uint8x16_t eq = vandq_u8(vceqq_u8(head, first), vceqq_u8(tail, last));
+        std::uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        while (mask) {
+            int bit = __builtin_ctzll(mask);
+            std::size_t at = i + bit / 4;
+            if (m <= 2 || std::memcmp(text.data() + at + 1, pattern.data() + 1, m - 2) == 0)
+                out.push_back(base + at);
+            mask &= ~(std::uint64_t { 0xf } << (bit & ~3));
+        }
+    }
+    findScalar(text.substr(i), pattern, base + i, out);
+}
+#endif
+
+FindFunction selectFinder()
+{
+#if defined(TANOSHII_SCAN_X86)
+    if (__builtin_cpu_supports("avx2"))
+        return findAvx2;
+    return findSse2;
+#elif defined(TANOSHII_SCAN_NEON)
+    return findNeon;
+#else
+    return findScalar;
+#endif
+}
+
+const FindFunction finder = selectFinder();
+
+using SpaceFunction = std::size_t (*)(const char*, std::size_t, std::size_t);
+
+// the last space in (start, end], start if there is none
+std::size_t lastSpaceScalar(const char* data, std::size_t start, std::size_t end)
+{
+    while (end > start && data[end] != ' ')
+        end--;
+    return end;
+}
+
+#ifdef TANOSHII_SCAN_X86
+std::size_t lastSpaceSse2(const char* data, std::size_t start, std::size_t end)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    // blocks ending at end, each fully inside (start, end]
+    for (; end - start >= 16; end -= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + end - 15));
+        std::uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, space));
+        if (mask)
+            return end - 15 + (31 - __builtin_clz(mask));
+    }
+    return lastSpaceScalar(data, start, end);
+}
+
+__attribute__((target("avx2"))) std::size_t lastSpaceAvx2(const char* data, std::size_t start, std::size_t end)
+{
+    const __m256i space = _mm256_set1_epi8(' ');
+    for (; end - start >= 32; end -= 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + end - 31));
+        std::uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, space));
+        if (mask) {
+            _mm256_zeroupper();
+            return end - 31 + (31 - __builtin_clz(mask));
+        }
+    }
+    _mm256_zeroupper();
+    return lastSpaceSse2(data, start, end);
+}
+#endif
+
+#ifdef TANOSHII_SCAN_NEON
+std::size_t lastSpaceNeon(const char* data, std::size_t start, std::size_t end)
+{
+    const uint8x16_t space = vdupq_n_u8(' ');
+    for (; end - start >= 16; end -= 16) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(reinterpret_cast<const std::uint8_t*>(data + end - 15)), space);
+        std::uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        if (mask)
+            return end - 15 + (63 - __builtin_clzll(mask)) / 4;
+    }
+    return lastSpaceScalar(data, start, end);
+}
+#endif
+
+SpaceFunction spaceFinderFor(TextScan::Isa isa)
+{
+    switch (isa) {
+#ifdef TANOSHII_SCAN_X86
+    case TextScan::Isa::Sse2:
+        return lastSpaceSse2;
+    case TextScan::Isa::Avx2:
+        return lastSpaceAvx2;
+#endif
+#ifdef TANOSHII_SCAN_NEON
+    case TextScan::Isa::Neon:
+        return lastSpaceNeon;
+#endif
+    default:
+        return lastSpaceScalar;
+    }
+}
+
+TextScan::Isa selectIsa()
+{
+#if defined(TANOSHII_SCAN_X86)
+    if (__builtin_cpu_supports("avx2"))
+        return TextScan::Isa::Avx2;
+    return TextScan::Isa::Sse2;
+#elif defined(TANOSHII_SCAN_NEON)
+    return TextScan::Isa::Neon;
+#else
+    return TextScan::Isa::Scalar;
+#endif
+}
+
+const TextScan::Isa best_isa = selectIsa();
+const SpaceFunction space_finder = spaceFinderFor(best_isa);
+
+std::size_t breakWith(SpaceFunction last_space, std::string_view text, std::size_t start, std::size_t width)
+{
+    if (text.size() - start <= width)
+        return text.size();
+    std::size_t space = last_space(text.data(), start, start + width);
+    return space != start ? space : start + width;
+}
+}
+
+bool TextScan::supports(Isa isa)
+{
+    switch (isa) {
+    case Isa::Scalar:
+        return true;
+    case Isa::Sse2:
+        return best_isa == Isa::Sse2 || best_isa == Isa::Avx2;
+    default:
+        return isa == best_isa;
+    }
+}
+
+void TextScan::findNewlines(std::string_view text, std::size_t base, std::vector<std::size_t>& out)
+{
+    scanner(text.data(), text.size(), base, out);
+}
+
+std::size_t TextScan::asciiPrefix(std::string_view text)
+{
+    return ascii_scanner(text.data(), text.size());
+}
+
+void TextScan::findAll(std::string_view text, std::string_view pattern, std::size_t base, std::vector<std::size_t>& out)
+{
+    if (pattern.empty() || text.size() < pattern.size())
+        return;
+    finder(text, pattern, base, out);
+}
+
+std::size_t TextScan::nextBreak(std::string_view text, std::size_t start, std::size_t width)
+{
+    return breakWith(space_finder, text, start, width);
+}
+
+std::size_t TextScan::nextBreak(std::string_view text, std::size_t start, std::size_t width, Isa isa)
+{
+    return breakWith(spaceFinderFor(isa), text, start, width);
+}
+
+std::vector<std::size_t> TextScan::findNewlinesParallel(std::string_view text)
+{
+    std::vector<std::size_t> result;
+    auto pool = ThreadPool::Instance();
+    std::size_t parts_count = std::min(pool->getWorkerCount() + 1, text.size() / parallel_threshold);
+    if (parts_count <= 1) {
+        findNewlines(text, 0, result);
+        return result;
+    }
+    std::vector<std::vector<std::size_t>> parts(parts_count);
+    std::size_t part_size = text.size() / parts_count;
+    pool->parallelFor(parts_count, [&](std::size_t i) {
+        std::size_t begin = i * part_size;
+        std::size_t end = i + 1 == parts_count ? text.size() : begin + part_size;
+        findNewlines(text.substr(begin, end - begin), begin, parts[i]);
+    });
+    std::size_t total = 0;
+    for (const auto& part : parts)
+        total += part.size();
+    result.reserve(total);
+    for (auto& part : parts)
+        result.insert(result.end(), part.begin(), part.end());
+    return result;
+}
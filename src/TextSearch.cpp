@@ -0,0 +1,308 @@
+/**
+ * @file TextSearch.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Implementation of the incremental search index
+ */
+
+#include "TextSearch.h"
+#include "TextScan.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace {
+/**
+ * @brief find the matches starting in [begin, end), pieces are scanned where they lie and only
+ * the few bytes around each seam between two pieces are copied
+ */
+void scanRange(const PieceTable& text, std::string_view pattern, std::size_t begin, std::size_t end, std::vector<std::size_t>& out)
+{
+    std::size_t m = pattern.size();
+    std::size_t scan_end = std::min(text.size(), end + m - 1);
+    if (begin >= scan_end)
+        return;
+    // the last m - 1 bytes before the current piece, where a match across the seam would start
+    std::string carry;
+    std::string seam;
+    std::vector<std::size_t> seam_matches;
+    std::size_t position = begin;
+    std::size_t next_start = begin;
+    text.forEachChunk(begin, scan_end - begin, [&](std::string_view chunk) {
+        if (!carry.empty()) {
+            seam = carry;
+            seam.append(chunk.substr(0, m - 1));
+            seam_matches.clear();
+            TextScan::findAll(seam, pattern, position - carry.size(), seam_matches);
+            for (std::size_t match : seam_matches) {
+                if (match >= next_start && match < position && match < end)
+                    out.push_back(match);
+            }
+        }
+        std::size_t before = out.size();
+        TextScan::findAll(chunk, pattern, position, out);
+        while (out.size() > before && out.back() >= end)
+            out.pop_back();
+        if (!out.empty())
+            next_start = std::max(next_start, out.back() + 1);
+        if (chunk.size() >= m - 1) {
+            carry.assign(chunk.substr(chunk.size() - (m - 1)));
+        } else {
+            carry.append(chunk);
+            if (carry.size() > m - 1)
+                carry.erase(0, carry.size() - (m - 1));
+        }
+        position += chunk.size();
+        return true;
+    });
+}
+}
+
+std::vector<std::size_t> TextSearch::findAll(const PieceTable& text, std::string_view pattern, std::size_t begin, std::size_t end)
+{
+    std::vector<std::size_t> result;
+    end = std::min(end, text.size());
+    if (pattern.empty() || begin >= end)
+        return result;
+    if (end - begin < 2 * TextScan::parallel_threshold) {
+        // the common case while typing, a few bytes around an edit
+        scanRange(text, pattern, begin, end, result);
+        return result;
+    }
+    auto pool = ThreadPool::Instance();
+    std::size_t parts_count = std::min(pool->getWorkerCount() + 1, (end - begin) / TextScan::parallel_threshold);
+    if (parts_count <= 1) {
+        scanRange(text, pattern, begin, end, result);
+        return result;
+    }
+    // every part gets whole lines, a match can still run past its range and is found there
+    std::vector<std::size_t> bounds { begin };
+    for (std::size_t i = 1; i < parts_count; i++) {
+        std::size_t bound = text.lineStart(text.lineOf(begin + i * ((end - begin) / parts_count)));
+        if (bound > bounds.back())
+            bounds.push_back(bound);
+    }
+    bounds.push_back(end);
+    std::vector<std::vector<std::size_t>> parts(bounds.size() - 1);
+    pool->parallelFor(parts.size(), [&](std::size_t i) {
+        scanRange(text, pattern, bounds[i], bounds[i + 1], parts[i]);
+    });
+    std::size_t total = 0;
+    for (const auto& part : parts)
+        total += part.size();
+    result.reserve(total);
+    for (auto& part : parts)
+        result.insert(result.end(), part.begin(), part.end());
+    return result;
+}
+
+std::size_t TextSearch::setQuery(const PieceTable& text, std::string_view query)
+{
+    if (query.empty()) {
+        clear();
+        return 0;
+    }
+    bool extended = !this->query.empty() && query.size() > this->query.size() && query.starts_with(this->query);
+    if (extended && match_count <= max_refined) {
+        // every match of the longer query is a match of the shorter one
+        std::vector<std::size_t> kept;
+        forEachIn(0, text.size(), [&](std::size_t offset) {
+            if (text.substr(offset, query.size()) == query)
+                kept.push_back(offset);
+        });
+        this->query = query;
+        assign(kept);
+        return match_count;
+    }
+    this->query = query;
+    assign(findAll(text, this->query, 0, text.size()));
+    return match_count;
+}
+
+const std::string& TextSearch::getQuery() const
+{
+    return query;
+}
+
+void TextSearch::clear()
+{
+    query.clear();
+    buckets.clear();
+    match_count = 0;
+}
+
+void TextSearch::refresh(const PieceTable& text)
+{
+    if (!query.empty())
+        assign(findAll(text, query, 0, text.size()));
+}
+
+void TextSearch::onInsert(const PieceTable& text, std::size_t offset, std::size_t length)
+{
+    if (query.empty() || length == 0)
+        return;
+    // matches running across the insert point are broken, new ones may start up to m - 1 bytes before it
+    std::size_t first = offset - std::min(offset, query.size() - 1);
+    replaceRange(first, offset, findAll(text, query, first, offset + length), static_cast<std::ptrdiff_t>(length));
+}
+
+void TextSearch::onErase(const PieceTable& text, std::size_t offset, std::size_t length)
+{
+    if (query.empty() || length == 0)
+        return;
+    std::size_t first = offset - std::min(offset, query.size() - 1);
+    replaceRange(first, offset + length, findAll(text, query, first, offset), -static_cast<std::ptrdiff_t>(length));
+}
+
+std::size_t TextSearch::count() const
+{
+    return match_count;
+}
+
+std::size_t TextSearch::rank(std::size_t offset) const
+{
+    auto [bucket, index] = locate(offset);
+    std::size_t before = index;
+    for (std::size_t b = 0; b < bucket; b++)
+        before += buckets[b].offsets.size();
+    return before;
+}
+
+std::optional<std::size_t> TextSearch::next(std::size_t offset) const
+{
+    if (match_count == 0)
+        return std::nullopt;
+    auto [bucket, index] = locate(offset);
+    if (bucket == buckets.size())
+        return offsetOf(buckets.front(), 0);
+    return offsetOf(buckets[bucket], index);
+}
+
+std::optional<std::size_t> TextSearch::previous(std::size_t offset) const
+{
+    if (match_count == 0)
+        return std::nullopt;
+    auto [bucket, index] = locate(offset);
+    if (index != 0)
+        return offsetOf(buckets[bucket], index - 1);
+    if (bucket == 0 || bucket == buckets.size())
+        bucket = buckets.size();
+    return offsetOf(buckets[bucket - 1], buckets[bucket - 1].offsets.size() - 1);
+}
+
+void TextSearch::forEachIn(std::size_t begin, std::size_t end, const std::function<void(std::size_t)>& visitor) const
+{
+    if (query.empty())
+        return;
+    auto [bucket, index] = locate(begin - std::min(begin, query.size() - 1));
+    for (; bucket < buckets.size(); bucket++, index = 0) {
+        for (; index < buckets[bucket].offsets.size(); index++) {
+            std::size_t offset = offsetOf(buckets[bucket], index);
+            if (offset >= end)
+                return;
+            visitor(offset);
+        }
+    }
+}
+
+void TextSearch::replaceRange(std::size_t begin, std::size_t end, const std::vector<std::size_t>& found, std::ptrdiff_t delta)
+{
+    auto [first_bucket, first_index] = locate(begin);
+    auto [last_bucket, last_index] = locate(end);
+    if (last_bucket < buckets.size()) {
+        Bucket& bucket = buckets[last_bucket];
+        settle(bucket);
+        for (std::size_t i = last_index; i < bucket.offsets.size(); i++)
+            bucket.offsets[i] += delta;
+        for (std::size_t b = last_bucket + 1; b < buckets.size(); b++)
+            buckets[b].shift += delta;
+    }
+    if (first_bucket == buckets.size()) {
+        // nothing at or after begin, the new matches go to the end
+        if (found.empty())
+            return;
+        if (buckets.empty())
+            buckets.emplace_back();
+        first_bucket = last_bucket = buckets.size() - 1;
+        settle(buckets.back());
+        first_index = last_index = buckets.back().offsets.size();
+    }
+    Bucket& target = buckets[first_bucket];
+    settle(target);
+    std::size_t removed;
+    if (first_bucket == last_bucket) {
+        removed = last_index - first_index;
+        target.offsets.erase(target.offsets.begin() + first_index, target.offsets.begin() + last_index);
+    } else {
+        removed = target.offsets.size() - first_index;
+        target.offsets.resize(first_index);
+        for (std::size_t b = first_bucket + 1; b < last_bucket; b++)
+            removed += buckets[b].offsets.size();
+        if (last_bucket < buckets.size()) {
+            removed += last_index;
+            buckets[last_bucket].offsets.erase(buckets[last_bucket].offsets.begin(), buckets[last_bucket].offsets.begin() + last_index);
+        }
+        buckets.erase(buckets.begin() + first_bucket + 1, buckets.begin() + last_bucket);
+    }
+    target.offsets.insert(target.offsets.begin() + first_index, found.begin(), found.end());
+    match_count = match_count - removed + found.size();
+
+    // keep the touched buckets non-empty and bounded
+    if (first_bucket + 1 < buckets.size() && buckets[first_bucket + 1].offsets.empty())
+        buckets.erase(buckets.begin() + first_bucket + 1);
+    if (buckets[first_bucket].offsets.empty()) {
+        buckets.erase(buckets.begin() + first_bucket);
+    } else if (buckets[first_bucket].offsets.size() > 2 * bucket_size) {
+        std::vector<std::size_t> offsets = std::move(buckets[first_bucket].offsets);
+        std::vector<Bucket> pieces((offsets.size() + bucket_size - 1) / bucket_size);
+        for (std::size_t i = 0; i < pieces.size(); i++)
+            pieces[i].offsets.assign(offsets.begin() + i * bucket_size, offsets.begin() + std::min(offsets.size(), (i + 1) * bucket_size));
+        buckets.erase(buckets.begin() + first_bucket);
+        buckets.insert(buckets.begin() + first_bucket, std::make_move_iterator(pieces.begin()), std::make_move_iterator(pieces.end()));
+    }
+}
+
+void TextSearch::assign(const std::vector<std::size_t>& offsets)
+{
+    buckets.clear();
+    for (std::size_t i = 0; i < offsets.size(); i += bucket_size) {
+        Bucket bucket;
+        bucket.offsets.assign(offsets.begin() + i, offsets.begin() + std::min(offsets.size(), i + bucket_size));
+        buckets.push_back(std::move(bucket));
+    }
+    match_count = offsets.size();
+}
+
+void TextSearch::settle(Bucket& bucket)
+{
+    if (bucket.shift == 0)
+        return;
+    for (auto& offset : bucket.offsets)
+        offset += bucket.shift;
+    bucket.shift = 0;
+}
+
+std::pair<std::size_t, std::size_t> TextSearch::locate(std::size_t offset) const
+{
+    auto bucket = std::partition_point(buckets.begin(), buckets.end(), [offset](const Bucket& bucket) {
+        return offsetOf(bucket, bucket.offsets.size() - 1) < offset;
+    });
+    if (bucket == buckets.end())
+        return { buckets.size(), 0 };
+    std::size_t index = 0, count = bucket->offsets.size();
+    // lower bound on the shifted offsets
+    while (count > 0) {
+        std::size_t half = count / 2;
+        if (offsetOf(*bucket, index + half) < offset) {
+            index += half + 1;
+            count -= half + 1;
+        } else {
+            count = half;
+        }
+    }
+    return { static_cast<std::size_t>(bucket - buckets.begin()), index };
+}
+
+std::size_t TextSearch::offsetOf(const Bucket& bucket, std::size_t index)
+{
+    return bucket.offsets[index] + bucket.shift;
+}
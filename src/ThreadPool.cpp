@@ -0,0 +1,153 @@
+/**
+ * @file ThreadPool.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Implementation of the work-stealing thread pool
+ */
+
+#include "ThreadPool.h"
+#include "Logger.h"
+#include <algorithm>
+#include <exception>
+
+namespace {
+// the pool and queue the current thread works for, so tasks spawned by a task stay on its worker
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local std::size_t current_queue = 0;
+}
+
+ThreadPool::ThreadPool(std::size_t worker_count)
+{
+    worker_count = std::max<std::size_t>(worker_count, 1);
+    for (std::size_t i = 0; i < worker_count; i++)
+        queues.push_back(std::make_unique<Queue>());
+    for (std::size_t i = 0; i < worker_count; i++)
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock(idle_mutex);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+std::shared_ptr<ThreadPool> ThreadPool::Instance()
+{
+    static std::shared_ptr<ThreadPool> instance = std::make_shared<ThreadPool>(std::thread::hardware_concurrency());
+    return instance;
+}
+
+void ThreadPool::submit(Task task)
+{
+    std::size_t index = current_pool == this ? current_queue : next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+    {
+        std::lock_guard lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard lock(idle_mutex);
+        queued.fetch_add(1, std::memory_order_relaxed);
+    }
+    wakeup.notify_one();
+}
+
+void ThreadPool::parallelFor(std::size_t count, const std::function<void(std::size_t)>& body)
+{
+    struct Loop {
+        const std::function<void(std::size_t)>* body;
+        std::size_t count;
+        std::atomic<std::size_t> next { 0 };
+        std::size_t finished = 0;
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable done;
+
+        void run()
+        {
+            // body is only touched for an index taken, before the caller can see them all finished
+            for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count;) {
+                std::exception_ptr thrown;
+                try {
+                    (*body)(i);
+                } catch (...) {
+                    thrown = std::current_exception();
+                }
+                std::lock_guard lock(mutex);
+                if (thrown && !error)
+                    error = thrown;
+                if (++finished == count)
+                    done.notify_all();
+            }
+        }
+    };
+    if (count == 0)
+        return;
+    auto loop = std::make_shared<Loop>();
+    loop->body = &body;
+    loop->count = count;
+    // helpers that start after the caller took the last index return at once
+    for (std::size_t i = 1; i < std::min(count, workers.size() + 1); i++)
+        submit([loop] { loop->run(); });
+    loop->run();
+    std::unique_lock lock(loop->mutex);
+    loop->done.wait(lock, [&] { return loop->finished == count; });
+    if (loop->error)
+        std::rethrow_exception(loop->error);
+}
+
+std::size_t ThreadPool::getWorkerCount() const
+{
+    return workers.size();
+}
+
+void ThreadPool::workerLoop(std::size_t index)
+{
+    current_pool = this;
+    current_queue = index;
+    Task task;
+    while (true) {
+        if (take(index, task)) {
+            try {
+                task();
+            } catch (const std::exception& e) {
+                Logger::Instance()->error("background task failed: {}", e.what());
+            }
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock lock(idle_mutex);
+        wakeup.wait(lock, [this] { return stopping || queued.load(std::memory_order_relaxed) != 0; });
+        if (stopping && queued.load(std::memory_order_relaxed) == 0)
+            return;
+    }
+}
+
+bool ThreadPool::take(std::size_t index, Task& task)
+{
+    {
+        Queue& own = *queues[index];
+        std::lock_guard lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    for (std::size_t i = 1; i < queues.size(); i++) {
+        Queue& victim = *queues[(index + i) % queues.size()];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
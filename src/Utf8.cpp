@@ -0,0 +1,348 @@
+/**
+ * @file Utf8.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Implementation of the UTF-8 helpers and ColumnMap
+ */
+
+#include "Utf8.h"
+#include "TextScan.h"
+#include <algorithm>
+#include <iterator>
+
+namespace {
+struct Range {
+    char32_t first, last;
+};
+
+// combining marks, joiners, variation selectors and emoji modifiers, they extend the grapheme before them
+constexpr Range zero_width[] = {
+    { 0x0300, 0x036F }, { 0x0483, 0x0489 }, { 0x0591, 0x05BD }, { 0x05BF, 0x05BF }, { 0x05C1, 0x05C2 },
+    { 0x05C4, 0x05C5 }, { 0x05C7, 0x05C7 }, { 0x0610, 0x061A }, { 0x064B, 0x065F }, { 0x0670, 0x0670 },
+    { 0x06D6, 0x06DC }, { 0x06DF, 0x06E4 }, { 0x0900, 0x0902 }, { 0x093A, 0x093A }, { 0x093C, 0x093C },
+    { 0x0941, 0x0948 }, { 0x094D, 0x094D }, { 0x0E31, 0x0E31 }, { 0x0E34, 0x0E3A }, { 0x0E47, 0x0E4E },
+    { 0x1160, 0x11FF }, { 0x1AB0, 0x1AFF }, { 0x1DC0, 0x1DFF }, { 0x200B, 0x200F }, { 0x2028, 0x202E },
+    { 0x2060, 0x2064 }, { 0x20D0, 0x20FF }, { 0x302A, 0x302F }, { 0x3099, 0x309A }, { 0xFE00, 0xFE0F },
+    { 0xFE20, 0xFE2F }, { 0xFEFF, 0xFEFF }, { 0x1F3FB, 0x1F3FF }, { 0xE0001, 0xE01EF },
+};
+
+// East Asian wide and fullwidth characters and emoji presentation
+constexpr Range wide[] = {
+    { 0x1100, 0x115F }, { 0x231A, 0x231B }, { 0x2329, 0x232A }, { 0x23E9, 0x23EC }, { 0x23F0, 0x23F0 },
+    { 0x23F3, 0x23F3 }, { 0x25FD, 0x25FE }, { 0x2614, 0x2615 }, { 0x2648, 0x2653 }, { 0x267F, 0x267F },
+    { 0x2693, 0x2693 }, { 0x26A1, 0x26A1 }, { 0x26AA, 0x26AB }, { 0x26BD, 0x26BE }, { 0x26C4, 0x26C5 },
+    { 0x26CE, 0x26CE }, { 0x26D4, 0x26D4 }, { 0x26EA, 0x26EA }, { 0x26F2, 0x26F3 }, { 0x26F5, 0x26F5 },
+    { 0x26FA, 0x26FA }, { 0x26FD, 0x26FD }, { 0x2705, 0x2705 }, { 0x270A, 0x270B }, { 0x2728, 0x2728 },
+    { 0x274C, 0x274C }, { 0x274E, 0x274E }, { 0x2753, 0x2755 }, { 0x2757, 0x2757 }, { 0x2795, 0x2797 },
+    { 0x27B0, 0x27B0 }, { 0x27BF, 0x27BF }, { 0x2B1B, 0x2B1C }, { 0x2B50, 0x2B50 }, { 0x2B55, 0x2B55 },
+    { 0x2E80, 0x303E }, { 0x3041, 0x33FF }, { 0x3400, 0x4DBF }, { 0x4E00, 0x9FFF }, { 0xA000, 0xA4CF },
+    { 0xA960, 0xA97F }, { 0xAC00, 0xD7A3 }, { 0xF900, 0xFAFF }, { 0xFE10, 0xFE19 }, { 0xFE30, 0xFE6F },
+    { 0xFF00, 0xFF60 }, { 0xFFE0, 0xFFE6 }, { 0x16FE0, 0x16FE4 }, { 0x17000, 0x18AFF }, { 0x1B000, 0x1B2FF },
+    { 0x1F004, 0x1F004 }, { 0x1F0CF, 0x1F0CF }, { 0x1F18E, 0x1F18E }, { 0x1F191, 0x1F19A }, { 0x1F200, 0x1F251 },
+    { 0x1F300, 0x1F64F }, { 0x1F680, 0x1F6FF }, { 0x1F7E0, 0x1F7EB }, { 0x1F90C, 0x1F9FF }, { 0x1FA70, 0x1FAFF },
+    { 0x20000, 0x2FFFD }, { 0x30000, 0x3FFFD },
+};
+
+constexpr char32_t zero_width_joiner = 0x200D;
+constexpr char32_t emoji_presentation = 0xFE0F;
+
+template <std::size_t N>
+bool inRanges(const Range (&ranges)[N], char32_t codepoint)
+{
+    auto it = std::upper_bound(std::begin(ranges), std::end(ranges), codepoint, [](char32_t cp, const Range& range) {
+        return cp < range.first;
+    });
+    return it != std::begin(ranges) && codepoint <= std::prev(it)->last;
+}
+
+bool isZeroWidth(char32_t codepoint)
+{
+    return codepoint >= 0x300 && inRanges(zero_width, codepoint);
+}
+
+bool isRegionalIndicator(char32_t codepoint)
+{
+    return codepoint >= 0x1F1E6 && codepoint <= 0x1F1FF;
+}
+
+std::size_t codepointWidth(char32_t codepoint)
+{
+    if (codepoint < 0x1100)
+        return 1;
+    if (isRegionalIndicator(codepoint))
+        return 2;
+    return inRanges(wide, codepoint) ? 2 : 1;
+}
+
+bool isAscii(char ch)
+{
+    return static_cast<unsigned char>(ch) < 0x80;
+}
+
+/**
+ * @brief length of the ASCII run at pos whose bytes are whole graphemes, the last byte of a run
+ * is left out when a combining mark may follow it
+ */
+std::size_t plainAsciiRun(std::string_view text, std::size_t pos)
+{
+    std::size_t run = TextScan::asciiPrefix(text.substr(pos));
+    return pos + run == text.size() || run == 0 ? run : run - 1;
+}
+}
+
+char32_t Utf8::decode(std::string_view text, std::size_t pos, std::size_t& length)
+{
+    auto byte = [&text](std::size_t i) { return static_cast<unsigned char>(text[i]); };
+    unsigned char lead = byte(pos);
+    length = 1;
+    if (lead < 0x80)
+        return lead;
+    std::size_t count;
+    char32_t codepoint, minimum;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        count = 2;
+        codepoint = lead & 0x1F;
+        minimum = 0x80;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        count = 3;
+        codepoint = lead & 0x0F;
+        minimum = 0x800;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        count = 4;
+        codepoint = lead & 0x07;
+        minimum = 0x10000;
+    } else {
+        return replacement;
+    }
+    if (pos + count > text.size())
+        return replacement;
+    for (std::size_t i = 1; i < count; i++) {
+        if ((byte(pos + i) & 0xC0) != 0x80)
+            return replacement;
+        codepoint = (codepoint << 6) | (byte(pos + i) & 0x3F);
+    }
+    if (codepoint < minimum || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF))
+        return replacement;
+    length = count;
+    return codepoint;
+}
+
+std::string Utf8::encode(char32_t codepoint)
+{
+    if (codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF))
+        codepoint = replacement;
+    std::string bytes;
+    if (codepoint < 0x80) {
+        bytes += static_cast<char>(codepoint);
+    } else if (codepoint < 0x800) {
+        bytes += static_cast<char>(0xC0 | (codepoint >> 6));
+        bytes += static_cast<char>(0x80 | (codepoint & 0x3F));
+    } else if (codepoint < 0x10000) {
+        bytes += static_cast<char>(0xE0 | (codepoint >> 12));
+        bytes += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        bytes += static_cast<char>(0x80 | (codepoint & 0x3F));
+    } else {
+        bytes += static_cast<char>(0xF0 | (codepoint >> 18));
+        bytes += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+        bytes += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        bytes += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+    return bytes;
+}
+
+bool Utf8::isValid(std::string_view text)
+{
+    std::size_t pos = 0;
+    while (pos < text.size()) {
+        pos += TextScan::asciiPrefix(text.substr(pos));
+        if (pos == text.size())
+            break;
+        std::size_t length;
+        if (decode(text, pos, length) == replacement && length == 1)
+            return false;
+        pos += length;
+    }
+    return true;
+}
+
+std::string Utf8::sanitize(std::string_view text)
+{
+    std::string result;
+    result.reserve(text.size());
+    std::size_t pos = 0;
+    while (pos < text.size()) {
+        std::size_t run = TextScan::asciiPrefix(text.substr(pos));
+        result.append(text.substr(pos, run));
+        pos += run;
+        if (pos == text.size())
+            break;
+        std::size_t length;
+        if (decode(text, pos, length) == replacement && length == 1)
+            result += encode(replacement);
+        else
+            result.append(text.substr(pos, length));
+        pos += length;
+    }
+    return result;
+}
+
+std::size_t Utf8::nextGrapheme(std::string_view text, std::size_t pos, std::size_t& width)
+{
+    std::size_t length;
+    char32_t base = decode(text, pos, length);
+    std::size_t end = pos + length;
+    width = codepointWidth(base);
+    if (isRegionalIndicator(base) && end < text.size()) {
+        // flags are pairs of regional indicators
+        if (isRegionalIndicator(decode(text, end, length)))
+            end += length;
+    }
+    while (end < text.size() && !isAscii(text[end])) {
+        char32_t next = decode(text, end, length);
+        if (next == zero_width_joiner) {
+            end += length;
+            if (end < text.size()) {
+                decode(text, end, length);
+                end += length;
+            }
+        } else if (isZeroWidth(next)) {
+            if (next == emoji_presentation)
+                width = 2;
+            end += length;
+        } else {
+            break;
+        }
+    }
+    return end;
+}
+
+std::size_t Utf8::prevGrapheme(std::string_view text, std::size_t pos)
+{
+    constexpr std::size_t look_back = 64;
+    if (isAscii(text[pos - 1]) && (pos == text.size() || isAscii(text[pos])))
+        return pos - 1;
+    std::size_t anchor = pos > look_back ? pos - look_back : 0;
+    while (anchor < pos && (static_cast<unsigned char>(text[anchor]) & 0xC0) == 0x80)
+        anchor++;
+    std::size_t last = anchor;
+    for (std::size_t p = anchor, width; p < pos;) {
+        last = p;
+        p = nextGrapheme(text, p, width);
+    }
+    return last;
+}
+
+std::size_t Utf8::displayWidth(std::string_view text)
+{
+    std::size_t width = 0;
+    std::size_t pos = 0;
+    while (pos < text.size()) {
+        std::size_t run = plainAsciiRun(text, pos);
+        width += run;
+        pos += run;
+        if (pos == text.size())
+            break;
+        std::size_t grapheme_width;
+        pos = nextGrapheme(text, pos, grapheme_width);
+        width += grapheme_width;
+    }
+    return width;
+}
+
+std::size_t Utf8::fitWidth(std::string_view text, std::size_t columns)
+{
+    std::size_t width = 0;
+    std::size_t pos = 0;
+    while (pos < text.size()) {
+        std::size_t run = std::min(plainAsciiRun(text, pos), columns - width);
+        width += run;
+        pos += run;
+        if (pos == text.size() || width == columns)
+            break;
+        std::size_t grapheme_width;
+        std::size_t end = nextGrapheme(text, pos, grapheme_width);
+        if (width + grapheme_width > columns)
+            break;
+        width += grapheme_width;
+        pos = end;
+    }
+    return pos;
+}
+
+ColumnMap::ColumnMap(std::string_view line)
+    : length(line.size())
+{
+    std::size_t ascii = TextScan::asciiPrefix(line);
+    if (ascii == line.size())
+        return;
+    auto built = std::make_shared<Table>();
+    std::size_t pos = 0;
+    std::size_t column = 0;
+    while (pos < line.size()) {
+        built->bytes.push_back(pos);
+        built->columns.push_back(column);
+        if (isAscii(line[pos]) && (pos + 1 == line.size() || isAscii(line[pos + 1]))) {
+            pos++;
+            column++;
+            continue;
+        }
+        std::size_t width;
+        pos = Utf8::nextGrapheme(line, pos, width);
+        column += width;
+    }
+    built->bytes.push_back(pos);
+    built->columns.push_back(column);
+    table = std::move(built);
+}
+
+std::size_t ColumnMap::graphemeCount() const
+{
+    return table ? table->bytes.size() - 1 : length;
+}
+
+std::size_t ColumnMap::byteOf(std::size_t grapheme) const
+{
+    if (!table)
+        return grapheme;
+    std::size_t count = graphemeCount();
+    return grapheme <= count ? table->bytes[grapheme] : length + (grapheme - count);
+}
+
+std::size_t ColumnMap::columnOf(std::size_t grapheme) const
+{
+    if (!table)
+        return grapheme;
+    std::size_t count = graphemeCount();
+    return grapheme <= count ? table->columns[grapheme] : table->columns.back() + (grapheme - count);
+}
+
+std::size_t ColumnMap::graphemeAt(std::size_t byte) const
+{
+    if (!table)
+        return byte;
+    if (byte >= length)
+        return graphemeCount() + (byte - length);
+    return std::upper_bound(table->bytes.begin(), table->bytes.end(), byte) - table->bytes.begin() - 1;
+}
+
+std::size_t ColumnMap::graphemeAtColumn(std::size_t column) const
+{
+    if (!table)
+        return std::min(column, length);
+    return std::upper_bound(table->columns.begin(), table->columns.end(), column) - table->columns.begin() - 1;
+}
+
+std::size_t ColumnMap::columnAtByte(std::size_t byte) const
+{
+    return columnOf(graphemeAt(byte));
+}
+
+std::size_t ColumnMap::width() const
+{
+    return table ? table->columns.back() : length;
+}
+
+bool ColumnMap::isAsciiLine() const
+{
+    return !table;
+}
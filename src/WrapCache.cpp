@@ -0,0 +1,418 @@
+/**
+ * @file WrapCache.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Implementation of WrapCache
+ */
+
+#include "WrapCache.h"
+#include <algorithm>
+#include <iterator>
+
+void WrapCache::reset(std::size_t line_count, std::size_t width)
+{
+    this->width = width;
+    chunks.clear();
+    for (std::size_t first = 0; first < line_count; first += chunk_line_count) {
+        Chunk& chunk = chunks.emplace_back();
+        chunk.lines.resize(std::min(chunk_line_count, line_count - first));
+        chunk.rows = chunk.lines.size();
+    }
+    this->line_count = line_count;
+    rows.clear();
+    stale_rows = 0;
+    dirty_lines.clear();
+    pending_count = line_count;
+    rebuildIndex();
+}
+
+void WrapCache::rescale(std::size_t width)
+{
+    for (auto& chunk : chunks) {
+        for (auto& wrapped : chunk.lines) {
+            // a line of n rows is longer than n - 1 full rows of the old width
+            std::size_t shown = wrapped.shownRows();
+            wrapped.estimate = this->width == 0 ? 1 : 1 + (shown - 1) * this->width / std::max<std::size_t>(width, 1);
+            wrapped.first = wrapped.count = 0;
+        }
+    }
+    this->width = width;
+    rows.clear();
+    stale_rows = 0;
+    pending_count = line_count;
+    recountRows();
+}
+
+void WrapCache::replaceLines(std::size_t first, std::size_t old_count, std::size_t new_count)
+{
+    if (old_count != new_count) {
+        eraseLines(first, old_count);
+        insertLines(first, new_count);
+    }
+    // too many to rewrap in one go, e.g. a loaded file or a big paste: the lines keep their row
+    // count as the estimate and are wrapped when they are needed
+    bool lazy = new_count > lazy_line_count;
+    forEachLine(first, first + new_count, [&](std::size_t, WrappedLine& wrapped) {
+        wrapped.dirty = !lazy;
+        if (!lazy || wrapped.count == 0)
+            return;
+        stale_rows += wrapped.count;
+        wrapped.estimate = wrapped.count;
+        wrapped.first = wrapped.count = 0;
+        pending_count++;
+    });
+    // lines keeping their number keep their stale rows until update(), so the row index stays consistent
+    std::vector<std::size_t> shifted;
+    shifted.reserve(dirty_lines.size() + (lazy ? 0 : new_count));
+    for (auto line : dirty_lines) {
+        if (line < first)
+            shifted.push_back(line);
+    }
+    for (std::size_t i = first; i < first + new_count && !lazy; i++)
+        shifted.push_back(i);
+    for (auto line : dirty_lines) {
+        if (line >= first + old_count)
+            shifted.push_back(line - old_count + new_count);
+    }
+    dirty_lines = std::move(shifted);
+}
+
+void WrapCache::update(const WrapFunction& wrap)
+{
+    for (auto line : dirty_lines) {
+        auto [chunk, offset] = locate(line);
+        WrappedLine& wrapped = chunks[chunk].lines[offset];
+        std::size_t before = wrapped.shownRows();
+        rewrap(line, wrapped, wrap);
+        addRows(chunk, wrapped.count - before);
+    }
+    dirty_lines.clear();
+    if (stale_rows > rows.size() / 2)
+        compact();
+}
+
+void WrapCache::finish(const WrapFunction& wrap)
+{
+    update(wrap);
+    if (pending_count == 0)
+        return;
+    if (pending_count == line_count) {
+        // no line refers to the pool, every line goes to it in order
+        rows.clear();
+        stale_rows = 0;
+    }
+    std::size_t line = 0;
+    for (auto& chunk : chunks) {
+        for (auto& wrapped : chunk.lines) {
+            if (wrapped.count == 0)
+                rewrap(line, wrapped, wrap);
+            line++;
+        }
+    }
+    recountRows();
+}
+
+void WrapCache::wrapLine(std::size_t line, const WrapFunction& wrap)
+{
+    auto [chunk, offset] = locate(line);
+    WrappedLine& wrapped = chunks[chunk].lines[offset];
+    if (wrapped.count != 0)
+        return;
+    std::size_t before = wrapped.estimate;
+    rewrap(line, wrapped, wrap);
+    addRows(chunk, wrapped.count - before);
+}
+
+void WrapCache::install(std::size_t line, std::span<const RowSpan> line_rows, ColumnMap columns)
+{
+    auto [chunk, offset] = locate(line);
+    WrappedLine& wrapped = chunks[chunk].lines[offset];
+    std::size_t before = wrapped.estimate;
+    wrapped.first = rows.size();
+    rows.insert(rows.end(), line_rows.begin(), line_rows.end());
+    wrapped.count = line_rows.size();
+    wrapped.columns = std::move(columns);
+    pending_count--;
+    addRows(chunk, wrapped.count - before);
+}
+
+std::size_t WrapCache::getWidth() const
+{
+    return width;
+}
+
+bool WrapCache::isDirty() const
+{
+    return !dirty_lines.empty();
+}
+
+bool WrapCache::isPending(std::size_t line) const
+{
+    const WrappedLine& wrapped = lineAt(line);
+    return wrapped.count == 0 && !wrapped.dirty;
+}
+
+std::size_t WrapCache::getPendingCount() const
+{
+    return pending_count;
+}
+
+std::vector<std::pair<std::size_t, std::size_t>> WrapCache::getPendingRanges(std::size_t chunk_lines) const
+{
+    std::vector<std::pair<std::size_t, std::size_t>> ranges;
+    // the first pending line of the current block and one past its last, equal while there is none
+    std::size_t first = 0, last = 0;
+    std::size_t line = 0;
+    for (const auto& chunk : chunks) {
+        for (const auto& wrapped : chunk.lines) {
+            if (line % chunk_lines == 0) {
+                if (first != last)
+                    ranges.emplace_back(first, last);
+                first = last = line;
+            }
+            if (wrapped.count == 0 && !wrapped.dirty) {
+                if (first == last)
+                    first = line;
+                last = line + 1;
+            }
+            line++;
+        }
+    }
+    if (first != last)
+        ranges.emplace_back(first, last);
+    return ranges;
+}
+
+std::size_t WrapCache::getRowCount() const
+{
+    return row_index.total();
+}
+
+std::size_t WrapCache::getRowOf(std::size_t line) const
+{
+    if (line >= line_count)
+        return row_index.total();
+    auto [chunk, offset] = locate(line);
+    return row_index.prefix(chunk) + rowStarts(chunk)[offset];
+}
+
+std::pair<std::size_t, std::size_t> WrapCache::locateRow(std::size_t row) const
+{
+    std::size_t chunk = row_index.find(row);
+    if (chunk >= chunks.size())
+        return { line_count, row - row_index.total() };
+    row -= row_index.prefix(chunk);
+    const auto& starts = rowStarts(chunk);
+    std::size_t offset = std::upper_bound(starts.begin(), starts.end(), row) - starts.begin() - 1;
+    return { line_index.prefix(chunk) + offset, row - starts[offset] };
+}
+
+std::span<const WrapCache::RowSpan> WrapCache::getRows(std::size_t line) const
+{
+    const WrappedLine& wrapped = lineAt(line);
+    return std::span<const RowSpan>(rows).subspan(wrapped.first, wrapped.count);
+}
+
+const ColumnMap& WrapCache::getColumns(std::size_t line) const
+{
+    return lineAt(line).columns;
+}
+
+std::pair<std::size_t, std::size_t> WrapCache::locate(std::size_t line) const
+{
+    // chunks are never empty, so the chunk a line falls in is the last one starting at or before it
+    std::size_t chunk = std::min(line_index.find(line), chunks.size() - 1);
+    return { chunk, line - line_index.prefix(chunk) };
+}
+
+const WrapCache::WrappedLine& WrapCache::lineAt(std::size_t line) const
+{
+    auto [chunk, offset] = locate(line);
+    return chunks[chunk].lines[offset];
+}
+
+const std::vector<std::size_t>& WrapCache::rowStarts(std::size_t chunk) const
+{
+    const Chunk& target = chunks[chunk];
+    if (target.starts_stale) {
+        target.row_starts.resize(target.lines.size());
+        std::size_t row = 0;
+        for (std::size_t i = 0; i < target.lines.size(); i++) {
+            target.row_starts[i] = row;
+            row += target.lines[i].shownRows();
+        }
+        target.starts_stale = false;
+    }
+    return target.row_starts;
+}
+
+void WrapCache::addRows(std::size_t chunk, std::size_t delta)
+{
+    chunks[chunk].rows += delta;
+    chunks[chunk].starts_stale = true;
+    row_index.add(chunk, delta);
+}
+
+template <typename Visit>
+void WrapCache::forEachLine(std::size_t first, std::size_t last, Visit visit)
+{
+    if (first >= last)
+        return;
+    auto [chunk, offset] = locate(first);
+    for (std::size_t line = first; line < last; chunk++, offset = 0) {
+        for (; offset < chunks[chunk].lines.size() && line < last; offset++, line++)
+            visit(line, chunks[chunk].lines[offset]);
+    }
+}
+
+void WrapCache::eraseLines(std::size_t first, std::size_t count)
+{
+    if (count == 0)
+        return;
+    std::size_t touched = locate(first).first;
+    bool emptied = false;
+    for (std::size_t left = count; left > 0;) {
+        auto [chunk, offset] = locate(first);
+        Chunk& target = chunks[chunk];
+        auto begin = target.lines.begin() + offset;
+        auto end = begin + std::min(left, target.lines.size() - offset);
+        std::size_t removed_rows = 0;
+        for (auto it = begin; it != end; ++it) {
+            stale_rows += it->count;
+            pending_count -= it->count == 0;
+            removed_rows += it->shownRows();
+        }
+        std::size_t removed = end - begin;
+        target.lines.erase(begin, end);
+        addRows(chunk, 0 - removed_rows);
+        line_index.add(chunk, 0 - removed);
+        emptied |= target.lines.empty();
+        left -= removed;
+    }
+    line_count -= count;
+    bool merged = false;
+    if (emptied) {
+        chunks.erase(std::remove_if(chunks.begin() + touched, chunks.end(), [](const Chunk& chunk) { return chunk.lines.empty(); }), chunks.end());
+    }
+    // a chunk left short is folded into a neighbour, so the chunk count follows the line count
+    if (touched < chunks.size() && chunks[touched].lines.size() < chunk_line_count / 4) {
+        std::size_t into = touched;
+        if (touched + 1 < chunks.size() && chunks[touched].lines.size() + chunks[touched + 1].lines.size() <= chunk_line_count * 2)
+            into = touched + 1;
+        else if (touched > 0 && chunks[touched - 1].lines.size() + chunks[touched].lines.size() <= chunk_line_count * 2)
+            into = touched - 1;
+        if (into != touched) {
+            std::size_t low = std::min(into, touched);
+            Chunk& kept = chunks[low];
+            Chunk& gone = chunks[low + 1];
+            kept.lines.insert(kept.lines.end(), std::make_move_iterator(gone.lines.begin()), std::make_move_iterator(gone.lines.end()));
+            kept.rows += gone.rows;
+            kept.starts_stale = true;
+            chunks.erase(chunks.begin() + low + 1);
+            merged = true;
+        }
+    }
+    if (emptied || merged)
+        rebuildIndex();
+}
+
+void WrapCache::insertLines(std::size_t first, std::size_t count)
+{
+    if (count == 0)
+        return;
+    bool restructured = chunks.empty();
+    if (restructured)
+        chunks.emplace_back();
+    // past the last line the new lines go to the end of the last chunk
+    auto [chunk, offset] = first < line_count ? locate(first) : std::pair { chunks.size() - 1, chunks.back().lines.size() };
+    Chunk& target = chunks[chunk];
+    target.lines.insert(target.lines.begin() + offset, count, WrappedLine {});
+    target.rows += count;
+    target.starts_stale = true;
+    line_count += count;
+    pending_count += count;
+    if (target.lines.size() > chunk_line_count * 2) {
+        splitChunk(chunk);
+        restructured = true;
+    }
+    if (restructured) {
+        rebuildIndex();
+        return;
+    }
+    row_index.add(chunk, count);
+    line_index.add(chunk, count);
+}
+
+void WrapCache::splitChunk(std::size_t chunk)
+{
+    std::vector<Chunk> pieces;
+    std::vector<WrappedLine>& lines = chunks[chunk].lines;
+    for (std::size_t first = chunk_line_count; first < lines.size(); first += chunk_line_count) {
+        Chunk& piece = pieces.emplace_back();
+        auto begin = lines.begin() + first;
+        auto end = lines.begin() + std::min(first + chunk_line_count, lines.size());
+        piece.lines.assign(std::make_move_iterator(begin), std::make_move_iterator(end));
+        for (const auto& wrapped : piece.lines)
+            piece.rows += wrapped.shownRows();
+        chunks[chunk].rows -= piece.rows;
+    }
+    lines.resize(chunk_line_count);
+    chunks[chunk].starts_stale = true;
+    chunks.insert(chunks.begin() + chunk + 1, std::make_move_iterator(pieces.begin()), std::make_move_iterator(pieces.end()));
+}
+
+void WrapCache::rewrap(std::size_t line, WrappedLine& wrapped, const WrapFunction& wrap)
+{
+    std::size_t end = rows.size();
+    wrapped.columns = wrap(line, width, rows);
+    wrapped.dirty = false;
+    pending_count -= wrapped.count == 0;
+    std::size_t count = rows.size() - end;
+    if (count <= wrapped.count) {
+        // the old place is big enough, the tail of it goes stale
+        std::copy(rows.begin() + end, rows.end(), rows.begin() + wrapped.first);
+        rows.resize(end);
+        stale_rows += wrapped.count - count;
+    } else {
+        stale_rows += wrapped.count;
+        wrapped.first = end;
+    }
+    wrapped.count = count;
+}
+
+void WrapCache::compact()
+{
+    spare_rows.clear();
+    spare_rows.reserve(rows.size() - stale_rows);
+    for (auto& chunk : chunks) {
+        for (auto& wrapped : chunk.lines) {
+            std::size_t first = spare_rows.size();
+            spare_rows.insert(spare_rows.end(), rows.begin() + wrapped.first, rows.begin() + wrapped.first + wrapped.count);
+            wrapped.first = first;
+        }
+    }
+    rows.swap(spare_rows);
+    stale_rows = 0;
+}
+
+void WrapCache::recountRows()
+{
+    for (auto& chunk : chunks) {
+        chunk.rows = 0;
+        for (const auto& wrapped : chunk.lines)
+            chunk.rows += wrapped.shownRows();
+        chunk.starts_stale = true;
+    }
+    rebuildIndex();
+}
+
+void WrapCache::rebuildIndex()
+{
+    std::vector<std::size_t> line_counts(chunks.size()), row_counts(chunks.size());
+    for (std::size_t i = 0; i < chunks.size(); i++) {
+        line_counts[i] = chunks[i].lines.size();
+        row_counts[i] = chunks[i].rows;
+    }
+    line_index.assign(line_counts);
+    row_index.assign(row_counts);
+}
@@ -0,0 +1,480 @@
+/**
+ * @file bench.cpp
+ * @author ayano
+ * @date 17/10/26
+ * @brief Benchmarks of the buffer, wrap and render hot paths, results are printed as JSON lines
+ */
+
+#include "Buffer.h"
+#include "BufferView.h"
+#include "Logger.h"
+#include "RecoveryJournal.h"
+#include "RegexReplace.h"
+#include "Screen.h"
+#include "Window.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fstream>
+#include <memory>
+#include <ncurses.h>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+std::string name_filter;
+
+/**
+ * @brief time every call of op separately and print one JSON line with the latency distribution
+ *
+ * @param name benchmark name, slash separated
+ * @param iterations how many calls
+ * @param bytes bytes processed per call, 0 if meaningless
+ * @param op the operation, called with the iteration index
+ * @param output if set, the bytes it sends per call are reported too
+ */
+template <typename F>
+void measure(const std::string& name, std::size_t iterations, std::size_t bytes, F&& op, const AnsiScreen* output = nullptr)
+{
+    if (!name_filter.empty() && name.find(name_filter) == std::string::npos)
+        return;
+    std::vector<double> samples(iterations);
+    std::size_t sent_before = output != nullptr ? output->getTotalBytes() : 0;
+    auto start = Clock::now();
+    for (std::size_t i = 0; i < iterations; i++) {
+        auto before = Clock::now();
+        op(i);
+        samples[i] = std::chrono::duration<double, std::nano>(Clock::now() - before).count();
+    }
+    double total = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&samples](double p) {
+        return samples[std::min(samples.size() - 1, static_cast<std::size_t>(p * samples.size()))];
+    };
+    double mean = total / iterations;
+    fmt::print("{{\"name\":\"{}\",\"iterations\":{},\"mean_ns\":{:.0f},\"p50_ns\":{:.0f},\"p99_ns\":{:.0f},\"max_ns\":{:.0f}",
+        name, iterations, mean, percentile(0.5), percentile(0.99), samples.back());
+    if (bytes != 0)
+        fmt::print(",\"mb_per_s\":{:.1f}", bytes / mean * 1e3);
+    if (output != nullptr)
+        fmt::print(",\"sent_bytes_per_op\":{:.1f}", static_cast<double>(output->getTotalBytes() - sent_before) / iterations);
+    fmt::print("}}\n");
+    std::fflush(stdout);
+}
+
+/**
+ * @brief generate deterministic prose, mostly short lines with the odd very long one
+ *
+ * @param size approximate size in bytes
+ * @param wide use CJK words and emoji instead of ASCII ones
+ * @return std::string text
+ */
+std::string makeText(std::size_t size, bool wide = false)
+{
+    static constexpr std::string_view ascii_words[] = { "lorem", "ipsum", "dolor", "sit", "amet", "consectetur",
+        "adipiscing", "elit", "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore", "et" };
+    static constexpr std::string_view wide_words[] = { "\u6587\u5b57", "\u7de8\u96c6", "\u753b\u9762",
+        "\u3042\u3044\u3046", "\ud55c\uae00", "\u6d4b\u8bd5\u6587\u672c", "cafe\u0301", "\U0001F600",
+        "\U0001F44D\U0001F3FD", "\u4e2d", "\u8a00\u8a9e", "\u884c", "\u5217", "\u30c6\u30ad\u30b9\u30c8",
+        "\u7a97", "\u5e45" };
+    const auto& words = wide ? wide_words : ascii_words;
+    std::mt19937 rng(42);
+    std::string text;
+    text.reserve(size + 512);
+    while (text.size() < size) {
+        std::size_t line_length = rng() % 32 == 0 ? 400 : rng() % 100;
+        std::size_t line_start = text.size();
+        while (text.size() - line_start < line_length) {
+            text += words[rng() % std::size(words)];
+            text += ' ';
+        }
+        text += '\n';
+    }
+    return text;
+}
+
+std::string sizeName(std::size_t size)
+{
+    return size >= 1024 * 1024 ? fmt::format("{}M", size / (1024 * 1024)) : fmt::format("{}K", size / 1024);
+}
+
+void benchBuffer(std::size_t size)
+{
+    auto text = std::make_shared<const std::string>(makeText(size));
+    std::mt19937 rng(7);
+    {
+        Buffer buffer(text);
+        std::size_t lines = buffer.getBufferSize();
+        measure("buffer/insert_char/" + sizeName(size), 100000, 0, [&](std::size_t) {
+            std::size_t line = rng() % lines;
+            buffer.addChAt(line, rng() % (buffer.getLineLength(line) + 1), 'x');
+        });
+        measure("buffer/erase_char/" + sizeName(size), 100000, 0, [&](std::size_t) {
+            std::size_t line = rng() % lines;
+            if (std::size_t length = buffer.getLineLength(line); length != 0)
+                buffer.eraseAt(line, rng() % length, 1);
+        });
+    }
+    {
+        Buffer buffer(text);
+        std::string paste = makeText(64 * 1024);
+        measure("buffer/insert_paste_64K/" + sizeName(size), 1000, paste.size(), [&](std::size_t) {
+            std::size_t line = rng() % buffer.getBufferSize();
+            buffer.insertAt(line, 0, paste);
+        });
+    }
+    {
+        Buffer buffer(text);
+        std::size_t lines = buffer.getBufferSize();
+        measure("buffer/edit_undo/" + sizeName(size), 100000, 0, [&](std::size_t i) {
+            if (i % 2 == 0) {
+                std::size_t line = rng() % lines;
+                buffer.addChAt(line, rng() % (buffer.getLineLength(line) + 1), 'x');
+                buffer.closeUndoStep();
+            } else {
+                buffer.undo();
+            }
+        });
+    }
+    {
+        Buffer buffer(text);
+        measure("buffer/insert_erase_line/" + sizeName(size), 100000, 0, [&](std::size_t i) {
+            std::size_t line = rng() % buffer.getBufferSize();
+            if (i % 2 == 0)
+                buffer.insertLine("inserted line", line);
+            else
+                buffer.removeLine(line);
+        });
+    }
+}
+
+void benchWrap(std::size_t size)
+{
+    auto text = std::make_shared<const std::string>(makeText(size));
+    for (std::size_t width : { 40, 80, 160 }) {
+        Buffer buffer(text);
+        BufferView view(buffer);
+        std::size_t iterations = std::max<std::size_t>(2, 32 * 1024 * 1024 / size);
+        // alternate with a neighbouring width so every call is a full rewrap
+        measure(fmt::format("wrap/full/{}/{}", sizeName(size), width), iterations, size, [&](std::size_t i) {
+            view.wrapLines(i % 2 == 0 ? width : width + 1);
+        });
+    }
+    {
+        // multibyte text goes through the grapheme scan instead of the ASCII fast path
+        auto wide_text = std::make_shared<const std::string>(makeText(size, true));
+        Buffer buffer(wide_text);
+        BufferView view(buffer);
+        std::size_t iterations = std::max<std::size_t>(2, 32 * 1024 * 1024 / size);
+        measure(fmt::format("wrap/full_wide/{}/80", sizeName(size)), iterations, size, [&](std::size_t i) {
+            view.wrapLines(i % 2 == 0 ? 80 : 81);
+        });
+    }
+    {
+        // what a resize waits for before the first paint, the rest is wrapped in the background
+        Buffer buffer(text);
+        BufferView view(buffer);
+        view.wrapLines(80);
+        std::size_t top = view.getWrappedLineCount() / 2;
+        std::size_t iterations = std::max<std::size_t>(2, 32 * 1024 * 1024 / size);
+        measure(fmt::format("wrap/resize_first_paint/{}/80", sizeName(size)), iterations, 0, [&](std::size_t i) {
+            top = view.wrapAround(i % 2 == 0 ? 79 : 80, top, 50);
+        });
+    }
+    Buffer buffer(text);
+    BufferView view(buffer);
+    view.wrapLines(80);
+    std::mt19937 rng(11);
+    measure("wrap/after_keystroke/" + sizeName(size), 100000, 0, [&](std::size_t) {
+        std::size_t line = rng() % buffer.getBufferSize();
+        buffer.addChAt(line, 0, 'x');
+        view.wrapLines(80);
+    });
+}
+
+void benchSplit(std::size_t size)
+{
+    std::string text = makeText(size);
+    std::size_t iterations = std::max<std::size_t>(2, 64 * 1024 * 1024 / size);
+    measure("split/newline/" + sizeName(size), iterations, size, [&](std::size_t) {
+        auto lines = Buffer::split(text, "\n");
+        if (lines.empty())
+            std::abort();
+    });
+}
+
+/**
+ * @brief whole keystroke cycles, input handling, repaint and screen update
+ *
+ * @param backend backend name used in the benchmark names
+ * @param screen screen the window draws on
+ * @param path file shown in the window
+ * @param size file size
+ * @param output set for the ANSI backend, to report the bytes sent per keystroke
+ */
+void benchKeystrokes(const std::string& backend, std::shared_ptr<Screen> screen, const std::filesystem::path& path, std::size_t size, const AnsiScreen* output)
+{
+    TextEditWindow window(screen, DEFAULT_BORDER, "bench", screen->getWidth() - 1, screen->getHeight() - 1, 0, 0, screen->getWidth(), screen->getHeight());
+    window.openFile(path.string());
+    while (!window.finishLoading())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    // what the application's observer does once a load finished
+    window.syncView();
+    window.refreshWindow();
+    screen->update();
+    auto cycle = [&window, &screen](chtype ch) {
+        window.inputHandler(ch);
+        window.refreshWindow();
+        screen->update();
+    };
+    auto name = [&backend, size](std::string_view what) {
+        return fmt::format("render/{}/{}/{}", backend, what, sizeName(size));
+    };
+    measure(name("type_char"), 20000, 0, [&](std::size_t i) {
+        cycle(i % 64 == 63 ? ' ' : 'a' + i % 26);
+    }, output);
+    measure(name("backspace"), 20000, 0, [&](std::size_t) {
+        cycle(KEY_BACKSPACE);
+    }, output);
+    measure(name("enter"), 5000, 0, [&](std::size_t) {
+        cycle(KEY_ENTER);
+    }, output);
+    measure(name("cursor_down"), 20000, 0, [&](std::size_t) {
+        cycle(KEY_DOWN);
+    }, output);
+    measure(name("full_repaint"), 5000, 0, [&](std::size_t) {
+        window.markAllDirty();
+        window.refreshWindow();
+        screen->update();
+    }, output);
+}
+
+/**
+ * @brief whole document searches, typing a query letter by letter, and editing with matches indexed
+ *
+ * @param size file size
+ */
+void benchSearch(std::size_t size)
+{
+    auto text = std::make_shared<const std::string>(makeText(size));
+    Buffer buffer(text);
+    measure("search/find_all/" + sizeName(size), 20, size, [&](std::size_t i) {
+        // alternate so the index is never merely refined
+        buffer.setSearchQuery(i % 2 == 0 ? "consectetur" : "tempor");
+    });
+    std::string_view query = "adipiscing elit";
+    measure("search/type_query/" + sizeName(size), 20 * query.size(), 0, [&](std::size_t i) {
+        buffer.setSearchQuery(query.substr(0, i % query.size() + 1));
+    });
+    buffer.setSearchQuery("et");
+    std::mt19937 rng(7);
+    std::size_t lines = buffer.getBufferSize();
+    measure("search/insert_char_indexed/" + sizeName(size), 100000, 0, [&](std::size_t) {
+        std::size_t line = rng() % lines;
+        buffer.addChAt(line, rng() % (buffer.getLineLength(line) + 1), 'e');
+    });
+}
+
+/**
+ * @brief regex replace-all: the parallel scan, the batched apply, and the same replacements
+ * applied one edit and one rewrap at a time
+ *
+ * @param size file size
+ */
+void benchReplace(std::size_t size)
+{
+    auto text = std::make_shared<const std::string>(makeText(size));
+    Buffer buffer(text);
+    BufferView view(buffer);
+    view.wrapLines(78);
+    std::vector<PieceTable::Replacement> replacements;
+    measure("replace/scan/" + sizeName(size), 5, size, [&](std::size_t) {
+        replacements = RegexReplace::findAll(buffer.getText(), "tempor|dolor(e?)", "[$&]");
+    });
+    measure("replace/apply_batch/" + sizeName(size), 5, 0, [&](std::size_t) {
+        buffer.replaceAll(replacements, 0, 0);
+        view.wrapLines(78);
+        buffer.undo();
+        view.wrapLines(78);
+    });
+    measure("replace/apply_single/" + sizeName(size), 1, 0, [&](std::size_t) {
+        // back to front, so the offsets stay valid
+        for (auto it = replacements.rbegin(); it != replacements.rend(); ++it) {
+            std::size_t line = buffer.getText().lineOf(it->offset);
+            std::size_t col = it->offset - buffer.getText().lineStart(line);
+            buffer.eraseAt(line, col, it->length);
+            buffer.insertAt(line, col, it->text);
+            view.wrapLines(78);
+        }
+    });
+}
+
+/**
+ * @brief cold text compression: compressing pasted text away from the viewport, and reading
+ * lines out of it afterwards, a frame decompression whenever scrolling enters a new frame
+ *
+ * @param size text size
+ */
+void benchCompress(std::size_t size)
+{
+    std::string text = makeText(size);
+    PieceTable pasted;
+    pasted.insert(0, text);
+    PieceTable compressed;
+    std::size_t saved = 0;
+    measure("compress/cold/" + sizeName(size), 3, size, [&](std::size_t) {
+        compressed = pasted;
+        saved = compressed.compressCold({ { 0, Buffer::hot_distance } });
+    });
+    if (name_filter.empty() || std::string_view("compress/saved").find(name_filter) != std::string_view::npos)
+        fmt::print("{{\"name\":\"compress/saved/{}\",\"text_bytes\":{},\"saved_bytes\":{}}}\n", sizeName(size), size, saved);
+    std::string scratch;
+    std::size_t lines = compressed.lineCount();
+    // a page down at a time from the end of the hot range, each page a new frame now and then
+    std::size_t first = compressed.lineOf(std::min(Buffer::hot_distance, compressed.size() - 1));
+    measure("compress/scroll_cold/" + sizeName(size), 2000, 0, [&](std::size_t i) {
+        for (std::size_t line = first + i * 50; line < std::min(lines, first + i * 50 + 50); line++)
+            compressed.lineView(line, scratch);
+    });
+}
+
+/**
+ * @brief syntax highlighting of a log: lexing it all, and settling again after a keystroke,
+ * which only relexes until the line states converge
+ *
+ * @param size file size
+ */
+void benchHighlight(std::size_t size)
+{
+    std::mt19937 rng(16);
+    auto text = std::make_shared<std::string>();
+    while (text->size() < size) {
+        *text += fmt::format("2026-10-17 12:{:02}:{:02},{:03} INFO request {} took {}ms\n", rng() % 60, rng() % 60, rng() % 1000, rng() % 100000, rng() % 500);
+        if (rng() % 50 == 0)
+            *text += "2026-10-17 12:00:00,000 ERROR \"failed\"\n    at Handler.run(Handler.java:42)\n    at Main.main(Main.java:7)\n";
+    }
+    Buffer buffer(text);
+    auto settle = [&buffer] {
+        while (true) {
+            buffer.updateHighlights(buffer.getBufferSize());
+            if (!buffer.isHighlighting())
+                return;
+            std::this_thread::yield();
+        }
+    };
+    measure("highlight/full/" + sizeName(size), 3, size, [&](std::size_t) {
+        buffer.setSyntax(Highlighter::Syntax::Log);
+        settle();
+    });
+    measure("highlight/keystroke/" + sizeName(size), 1000, 0, [&](std::size_t) {
+        buffer.addChAt(rng() % buffer.getBufferSize(), 0, 'x');
+        settle();
+    });
+}
+
+/**
+ * @brief journaled editing against the same edits unjournaled, and replaying the journal
+ *
+ * @param size file size
+ */
+void benchRecovery(std::size_t size)
+{
+    auto path = std::filesystem::temp_directory_path() / fmt::format("tanoshii_bench_recovery_{}.txt", size);
+    auto journal_path = RecoveryJournal::pathFor(path);
+    {
+        std::ofstream file(path, std::ios::binary);
+        std::string text = makeText(size);
+        file.write(text.data(), text.size());
+    }
+    std::filesystem::remove(journal_path);
+    auto load = [&path, &journal_path](Buffer& buffer) {
+        buffer.enableRecovery(journal_path);
+        buffer.load(path.string());
+        while (!buffer.pollLoading() && buffer.isLoading())
+            std::this_thread::yield();
+    };
+    std::mt19937 rng(7);
+    {
+        Buffer buffer;
+        load(buffer);
+        std::size_t lines = buffer.getBufferSize();
+        measure("recovery/insert_char/" + sizeName(size), 100000, 0, [&](std::size_t) {
+            std::size_t line = rng() % lines;
+            buffer.addChAt(line, rng() % (buffer.getLineLength(line) + 1), 'x');
+        });
+        std::string paste = makeText(64 * 1024);
+        measure("recovery/insert_paste_64K/" + sizeName(size), 1000, paste.size(), [&](std::size_t) {
+            buffer.insertAt(rng() % buffer.getBufferSize(), 0, paste);
+        });
+    }
+    measure("recovery/replay/" + sizeName(size), 5, 0, [&](std::size_t) {
+        Buffer buffer;
+        load(buffer);
+    });
+    std::filesystem::remove(journal_path);
+    std::filesystem::remove(path);
+}
+
+/**
+ * @brief keystroke cycles against every screen backend, nothing reaches a real terminal
+ *
+ * @param size file size
+ */
+void benchRender(std::size_t size)
+{
+    auto path = std::filesystem::temp_directory_path() / fmt::format("tanoshii_bench_{}.txt", size);
+    {
+        std::ofstream file(path, std::ios::binary);
+        std::string text = makeText(size);
+        file.write(text.data(), text.size());
+    }
+    benchKeystrokes("cells", std::make_shared<CellScreen>(80, 24), path, size, nullptr);
+    int null_fd = open("/dev/null", O_WRONLY);
+    auto ansi = std::make_shared<AnsiScreen>(null_fd, 80, 24);
+    benchKeystrokes("ansi", ansi, path, size, ansi.get());
+    ansi.reset();
+    close(null_fd);
+    FILE* out = std::fopen("/dev/null", "w");
+    FILE* in = std::fopen("/dev/null", "r");
+    SCREEN* terminal = newterm("xterm", out, in);
+    if (terminal == nullptr) {
+        fmt::print(stderr, "no terminfo entry for xterm, skipping the ncurses backend\n");
+    } else {
+        benchKeystrokes("ncurses", std::make_shared<NcursesScreen>(), path, size, nullptr);
+        endwin();
+        delscreen(terminal);
+    }
+    std::fclose(in);
+    std::fclose(out);
+    std::filesystem::remove(path);
+}
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+        name_filter = argv[1];
+    // the per-keystroke debug trace would flood the log queue and measure the logger instead
+    Logger::Instance()->setLevel(Logger::Level::Info);
+    for (std::size_t size : { 1024 * 1024, 16 * 1024 * 1024 }) {
+        benchBuffer(size);
+        benchWrap(size);
+        benchSplit(size);
+        benchRender(size);
+        benchRecovery(size);
+        benchSearch(size);
+        benchReplace(size);
+        benchCompress(size);
+        benchHighlight(size);
+    }
+    return 0;
+}
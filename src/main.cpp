@@ -1,8 +1,26 @@
 #include <ncurses.h>
 #include "Application.h"
+#include "KeyTrace.h"
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string_view>
 
-int main() {
-    Application app;
+int main(int argc, char** argv) {
+    // headless: feed a recorded session through this build and print its latency and checksum
+    if (const char* trace_path = std::getenv("TANOSHII_REPLAY"); trace_path != nullptr && *trace_path != '\0') {
+        const char* timing = std::getenv("TANOSHII_REPLAY_TIMING");
+        try {
+            TraceReplay replay(KeyTrace::load(trace_path), argc > 1 ? argv[1] : "");
+            replay.run(timing != nullptr && std::string_view(timing) == "original" ? TraceReplay::Timing::Original : TraceReplay::Timing::Fast);
+            std::printf("%s\n", replay.toJson().c_str());
+        } catch (const std::runtime_error& error) {
+            std::fprintf(stderr, "%s\n", error.what());
+            return 1;
+        }
+        return 0;
+    }
+    Application app(argc > 1 ? argv[1] : "");
     app.run();
     return 0;
-}
\ No newline at end of file
+}
@@ -1,5 +1,13 @@
 #include <gtest/gtest.h>
 #include "Buffer.h"
+#include "BufferView.h"
+#include "TextScan.h"
+#include "testUtil.h"
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <thread>
 
 TEST(bufferTest, calculateWrappedLineTest) {
     auto splitted = Buffer::split("Labore sit deserunt non nisi", " ");
@@ -9,3 +17,268 @@ TEST(bufferTest, calculateWrappedLineTest) {
     EXPECT_EQ(splitted[3], "non");
     EXPECT_EQ(splitted[4], "nisi");
 }
+
+TEST(bufferTest, lineEditTest) {
+    Buffer buffer;
+    buffer.appendLine("second");
+    buffer.insertLine("zeroth", 0);
+    buffer.addChAt(1, 0, 'x');
+    buffer.appendCh(2, '!');
+    ASSERT_EQ(buffer.getBufferSize(), 3);
+    EXPECT_EQ(buffer[0], "zeroth");
+    EXPECT_EQ(buffer[1], "x");
+    EXPECT_EQ(buffer[2], "second!");
+    buffer.eraseAt(2, 0, 3);
+    EXPECT_EQ(buffer[2], "ond!");
+    EXPECT_EQ(buffer.getLineLength(2), 4);
+    buffer.removeLine(2);
+    buffer.removeLine(0);
+    ASSERT_EQ(buffer.getBufferSize(), 1);
+    EXPECT_EQ(buffer[0], "x");
+    EXPECT_THROW(buffer.removeLine(-1), std::runtime_error);
+    EXPECT_THROW(buffer.removeLine(1), std::runtime_error);
+    EXPECT_EQ(buffer[0], "x");
+}
+
+TEST(bufferTest, bulkInsertTest) {
+    Buffer buffer;
+    BufferView view(buffer);
+    buffer.appendLine("head tail");
+    view.wrapLines(10);
+    std::string paste = "one\ntwo\nthree ";
+    auto [line, col] = buffer.insertAt(1, 5, paste);
+    EXPECT_EQ(line, 3);
+    EXPECT_EQ(col, 6);
+    ASSERT_EQ(buffer.getBufferSize(), 4);
+    EXPECT_EQ(buffer[1], "head one");
+    EXPECT_EQ(buffer[2], "two");
+    EXPECT_EQ(buffer[3], "three tail");
+    std::tie(line, col) = buffer.insertAt(2, 1, std::string("xy"));
+    EXPECT_EQ(line, 2);
+    EXPECT_EQ(col, 3);
+    EXPECT_EQ(buffer[2], "txywo");
+    view.wrapLines(8);
+    ASSERT_EQ(view.getWrappedLineCount(), 5);
+    EXPECT_EQ(view.getWrappedRow(4), " tail");
+}
+
+TEST(bufferTest, utf8WrapTest) {
+    // wide characters take two columns and are never split between rows
+    auto rows = Buffer::wrapLine("\u4e2d\u6587\u5b57\u7b26\u6d4b\u8bd5", 5);
+    ASSERT_EQ(rows.size(), 3);
+    EXPECT_EQ(rows[0], "\u4e2d\u6587");
+    EXPECT_EQ(rows[2], "\u6d4b\u8bd5");
+    // a combining mark stays with its letter at the cut
+    rows = Buffer::wrapLine("abce\u0301fg", 4);
+    ASSERT_EQ(rows.size(), 2);
+    EXPECT_EQ(rows[0], "abce\u0301");
+
+    Buffer buffer;
+    BufferView view(buffer);
+    buffer.insertAt(0, 0, std::string("\u4e2d\u6587\u5b57\u7b26\u6d4b\u8bd5\nab"));
+    view.wrapLines(5);
+    EXPECT_EQ(view.getWrappedLineCount(), 4);
+    // cursor positions are bytes, the wrapped column is in display columns
+    EXPECT_EQ(view.getWrappedRowOf(0, 9), 1);
+    EXPECT_EQ(view.getWrappedColOf(0, 9), 2);
+    EXPECT_EQ(buffer.nextGrapheme(0, 3), 6);
+    EXPECT_EQ(buffer.prevGrapheme(0, 6), 3);
+    // the right half of a wide character lands on the character
+    auto [line, col] = view.getPositionOfWrapped(2, 3);
+    EXPECT_EQ(line, 0);
+    EXPECT_EQ(col, 15);
+    std::tie(line, col) = view.getPositionOfWrapped(3, 7);
+    EXPECT_EQ(line, 1);
+    EXPECT_EQ(col, 2);
+}
+
+TEST(bufferTest, originalTextSharedTest) {
+    auto original = std::make_shared<const std::string>("alpha\nbeta\ngamma");
+    Buffer buffer(original);
+    ASSERT_EQ(buffer.getBufferSize(), 3);
+    for (int i = 0; i < 100; i++) {
+        buffer.addChAt(1, 2, 'a' + i % 26);
+    }
+    buffer.removeLine(0);
+    EXPECT_EQ(buffer.getLineLength(0), 104);
+    EXPECT_EQ(buffer[1], "gamma");
+    EXPECT_EQ(*original, "alpha\nbeta\ngamma");
+}
+
+TEST(bufferTest, incrementalWrapTest) {
+    Buffer buffer;
+    BufferView view(buffer);
+    buffer.insertLine("Labore sit deserunt non nisi", 0);
+    view.wrapLines(10);
+    ASSERT_EQ(view.getWrappedLineCount(), 4);
+    EXPECT_EQ(std::get<1>(view.getWrappedLineTuple(0)), "Labore sit");
+    EXPECT_EQ(std::get<1>(view.getWrappedLineTuple(2)), " non nisi");
+    EXPECT_EQ(std::get<0>(view.getWrappedLineTuple(3)), 1);
+    buffer.addChAt(1, 0, 'x');
+    buffer.insertLine("", 1);
+    view.wrapLines(10);
+    ASSERT_EQ(view.getWrappedLineCount(), 5);
+    EXPECT_EQ(view.getWrappedRowOf(2, 0), 4);
+    EXPECT_EQ(view.getWrappedRowOf(0, 12), 1);
+    EXPECT_EQ(view.getWrappedColOf(0, 12), 2);
+    EXPECT_EQ(std::get<1>(view.getWrappedLineTuple(4)), "x");
+    buffer.appendCh(2, 'y');
+    view.wrapLines(10);
+    EXPECT_EQ(view.getWrappedLineCount(), 5);
+    EXPECT_EQ(std::get<1>(view.getWrappedLineTuple(4)), "xy");
+    EXPECT_EQ(view.getWrappedRow(4), "xy");
+}
+
+TEST(bufferTest, zeroCopyWrapTest) {
+    auto original = std::make_shared<const std::string>("Labore sit deserunt non nisi\nshort\n");
+    Buffer buffer(original);
+    BufferView view(buffer);
+    view.wrapLines(10);
+    // rows point into the text, nothing was copied
+    std::string_view row = view.getWrappedRow(1);
+    EXPECT_EQ(row, " deserunt");
+    EXPECT_EQ(row.data(), original->data() + 10);
+    // a line spread over several pieces still reads as one
+    buffer.insertAt(0, 7, std::string("amet "));
+    buffer.insertAt(0, 0, std::string("> "));
+    view.wrapLines(10);
+    EXPECT_EQ(view.getWrappedRow(0), "> Labore");
+    EXPECT_EQ(view.getWrappedRow(1), " amet sit");
+    EXPECT_EQ(std::get<1>(view.getWrappedLineTuple(4)), "short");
+    // growing and shrinking lines over and over keeps every row right as the row pool is reused
+    for (int i = 0; i < 200; i++) {
+        if (i % 3 == 2)
+            buffer.eraseAt(1, 0, 6);
+        else
+            buffer.insertAt(1, 0, std::string("word "));
+        view.wrapLines(10);
+    }
+    std::string expected;
+    for (std::size_t line = 0; line < buffer.getBufferSize(); line++) {
+        for (const auto& wrapped : Buffer::wrapLine(buffer[line], 10))
+            expected += wrapped + "\n";
+    }
+    EXPECT_EQ(std::string(view), expected);
+}
+
+TEST(bufferTest, spliceWrapTest) {
+    // enough lines to span many chunks of the wrap cache, split and merged again as lines come and go
+    std::string text;
+    for (int i = 0; i < 3000; i++)
+        text += "line " + std::to_string(i) + (i % 7 == 0 ? " with a tail long enough to wrap" : "") + "\n";
+    Buffer buffer(std::make_shared<const std::string>(text));
+    BufferView view(buffer);
+    view.wrapLines(12);
+    std::mt19937 rng(5);
+    for (int i = 0; i < 400; i++) {
+        std::size_t line = rng() % buffer.getBufferSize();
+        switch (rng() % 4) {
+        case 0:
+            buffer.insertAt(line, 0, std::string("split\nhere "));
+            break;
+        case 1:
+            buffer.insertAt(line, 0, std::string(rng() % 600, '\n'));
+            break;
+        default:
+            for (std::size_t count = rng() % 300; count > 0 && buffer.getBufferSize() > 1; count--)
+                buffer.removeLine(static_cast<int>(std::min(line, buffer.getBufferSize() - 1)));
+            break;
+        }
+        view.wrapLines(12);
+    }
+    std::string expected;
+    std::size_t row = 0;
+    for (std::size_t line = 0; line < buffer.getBufferSize(); line++) {
+        ASSERT_EQ(view.getWrappedRowOf(line, 0), row) << line;
+        auto [found, col] = view.getPositionOfWrapped(row, 0);
+        ASSERT_EQ(found, line) << row;
+        for (const auto& wrapped : Buffer::wrapLine(buffer[line], 12)) {
+            expected += wrapped + "\n";
+            row++;
+        }
+    }
+    EXPECT_EQ(view.getWrappedLineCount(), row);
+    EXPECT_EQ(std::string(view), expected);
+}
+
+TEST(bufferTest, lazyLoadTest) {
+    auto path = tempPath("lazy_load_test.txt");
+    {
+        std::ofstream out(path);
+        for (int i = 0; i < 100000; i++) {
+            out << "line " << i << '\n';
+        }
+    }
+    Buffer buffer;
+    BufferView view(buffer);
+    buffer.load(path.string());
+    EXPECT_TRUE(buffer.isLoading());
+    EXPECT_EQ(buffer[0], "line 0");
+    while (!buffer.pollLoading()) {
+        std::this_thread::yield();
+    }
+    EXPECT_FALSE(buffer.isLoading());
+    ASSERT_EQ(buffer.getBufferSize(), 100001);
+    EXPECT_EQ(buffer[99999], "line 99999");
+    view.wrapLines(80);
+    EXPECT_EQ(view.getWrappedLineCount(), 100001);
+    std::filesystem::remove(path);
+}
+
+TEST(bufferTest, wrapKernelTest) {
+    // the word by word loop the kernel replaces, on one byte per column text
+    auto reference = [](std::string_view line, std::size_t width) {
+        std::vector<std::size_t> ends;
+        std::size_t start = 0, count = 0;
+        while (start < line.size()) {
+            std::size_t end = std::min(line.find(' ', start + 1), line.size());
+            if (end - start > width)
+                end = start + width;
+            if (ends.empty() || count + (end - start) > width) {
+                ends.push_back(end);
+                count = end - start;
+            } else {
+                ends.back() = end;
+                count += end - start;
+            }
+            start = end;
+        }
+        if (ends.empty())
+            ends.push_back(0);
+        return ends;
+    };
+    std::mt19937 rng(23);
+    std::vector<std::string> lines = { "", " ", "word", "   leading and trailing   ", std::string(200, 'x'), std::string(100, ' ') };
+    for (int i = 0; i < 300; i++) {
+        std::string line;
+        std::size_t length = rng() % 400;
+        while (line.size() < length) {
+            // mostly short words, runs of spaces and the odd word longer than any row
+            std::size_t word = rng() % 10 == 0 ? rng() % 150 : rng() % 9;
+            line += std::string(word, static_cast<char>('a' + rng() % 26)) + std::string(1 + (rng() % 4 == 0 ? rng() % 5 : 0), ' ');
+        }
+        lines.push_back(line);
+    }
+    for (auto isa : { TextScan::Isa::Scalar, TextScan::Isa::Sse2, TextScan::Isa::Avx2, TextScan::Isa::Neon }) {
+        if (!TextScan::supports(isa))
+            continue;
+        for (const auto& line : lines) {
+            for (std::size_t width : { 1, 2, 7, 15, 16, 17, 31, 32, 33, 40, 80, 100, 160 }) {
+                std::vector<std::size_t> ends;
+                std::size_t start = 0;
+                do {
+                    start = TextScan::nextBreak(line, start, width, isa);
+                    ends.push_back(start);
+                } while (start < line.size());
+                ASSERT_EQ(ends, reference(line, width)) << "isa " << static_cast<int>(isa) << " width " << width << " line \"" << line << "\"";
+            }
+        }
+    }
+    // the rows of the wrap, which picks the best kernel
+    std::vector<WrapCache::RowSpan> rows;
+    Buffer::layoutLine("Labore sit  deserunt non", 10, rows);
+    ASSERT_EQ(rows.size(), 3);
+    EXPECT_EQ(rows[1].offset, 10);
+    EXPECT_EQ(rows[1].length, 10);
+    EXPECT_EQ(rows[2].offset, 20);
+}
@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include "Buffer.h"
+#include "ChunkCache.h"
+#include "MappedFile.h"
+#include "testUtil.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+
+namespace {
+
+// numbered lines of varying length, a bit over five chunks
+std::filesystem::path writeLines(const std::string& name, std::size_t& lines)
+{
+    auto path = tempPath(name);
+    std::ofstream out(path);
+    std::size_t written = 0;
+    for (lines = 0; written < 5 * ChunkCache::chunk_size + 12345; lines++) {
+        std::string line = "line " + std::to_string(lines) + std::string(lines % 97, '.') + '\n';
+        out << line;
+        written += line.size();
+    }
+    return path;
+}
+
+}
+
+TEST(chunkCacheTest, lookupTest) {
+    std::size_t lines = 0;
+    auto path = writeLines("chunk_lookup_test.txt", lines);
+    auto file = std::make_shared<const MappedFile>(path.string());
+    TextBlock whole(file->view(), file);
+    whole.buildLineIndex();
+    ChunkCache chunks(file, 2 * ChunkCache::chunk_size);
+    chunks.countLines();
+    // counting leaves nothing loaded
+    EXPECT_EQ(chunks.getLoadedCount(), 0);
+    EXPECT_EQ(chunks.countNewlines(0, file->view().size()), lines);
+    EXPECT_EQ(chunks.getLoadedCount(), 0);
+    // lookups in every chunk, on and next to chunk boundaries, match the whole-file index
+    for (std::size_t offset : { std::size_t(0), std::size_t(17), ChunkCache::chunk_size - 1, ChunkCache::chunk_size,
+             3 * ChunkCache::chunk_size + 5, 5 * ChunkCache::chunk_size + 1, file->view().size() - 1 }) {
+        EXPECT_EQ(chunks.countNewlines(0, offset), whole.countNewlines(0, offset)) << offset;
+        EXPECT_EQ(chunks.countNewlines(offset, file->view().size()), whole.countNewlines(offset, file->view().size())) << offset;
+        EXPECT_EQ(chunks.findNewline(offset, 0), whole.findNewline(offset, 0)) << offset;
+    }
+    for (std::size_t nth = 0; nth < lines; nth += 997)
+        EXPECT_EQ(chunks.findNewline(0, nth), whole.findNewline(0, nth)) << nth;
+    // only what fits the budget stayed
+    EXPECT_LE(chunks.getResidentBytes(), chunks.getBudget());
+    EXPECT_EQ(chunks.getLoadedCount(), 1);
+    std::filesystem::remove(path);
+}
+
+TEST(chunkCacheTest, evictionTest) {
+    std::size_t lines = 0;
+    auto path = writeLines("chunk_eviction_test.txt", lines);
+    auto file = std::make_shared<const MappedFile>(path.string());
+    ChunkCache chunks(file, 3 * ChunkCache::chunk_size);
+    chunks.countLines();
+    std::string_view bytes = file->view();
+    chunks.prefetch(bytes.substr(0, 2 * ChunkCache::chunk_size));
+    EXPECT_EQ(chunks.getLoadedCount(), 2);
+    // touching chunk 0 makes chunk 1 the least recently used, so it goes first
+    chunks.countNewlines(0, 10);
+    chunks.prefetch(bytes.substr(2 * ChunkCache::chunk_size, 2 * ChunkCache::chunk_size));
+    EXPECT_EQ(chunks.getLoadedCount(), 2);
+    EXPECT_LE(chunks.getResidentBytes(), chunks.getBudget());
+    // evicted chunks load again on demand
+    TextBlock whole(bytes, file);
+    EXPECT_EQ(chunks.countNewlines(ChunkCache::chunk_size + 3, bytes.size() - 3), whole.countNewlines(ChunkCache::chunk_size + 3, bytes.size() - 3));
+    // bytes outside the file are no chunk of it
+    std::string elsewhere(100, '\n');
+    chunks.prefetch(elsewhere);
+    std::filesystem::remove(path);
+}
+
+TEST(chunkCacheTest, pagedBufferTest) {
+    std::size_t lines = 0;
+    auto path = writeLines("paged_buffer_test.txt", lines);
+    Buffer buffer;
+    buffer.setMemoryBudget(4 * ChunkCache::chunk_size);
+    buffer.load(path.string());
+    while (!buffer.pollLoading()) {
+        std::this_thread::yield();
+    }
+    const ChunkCache* chunks = buffer.getChunks();
+    ASSERT_NE(chunks, nullptr);
+    ASSERT_EQ(buffer.getBufferSize(), lines + 1);
+    EXPECT_EQ(buffer[lines - 1], "line " + std::to_string(lines - 1) + std::string((lines - 1) % 97, '.'));
+    EXPECT_EQ(buffer[1000], "line 1000" + std::string(1000 % 97, '.'));
+    // edits go to the buffer's own blocks, the file chunks stay as they are
+    buffer.insertAt(1000, 0, std::string("> "));
+    buffer.removeLine(lines - 1);
+    EXPECT_EQ(buffer[1000], "> line 1000" + std::string(1000 % 97, '.'));
+    EXPECT_EQ(buffer.getBufferSize(), lines);
+    // prefetching ahead loads the chunk of the line and the next one in the background, within
+    // the budget
+    std::size_t loads = chunks->getLoadCount();
+    buffer.prefetch(lines / 2, true);
+    for (int i = 0; i < 1000 && chunks->getLoadCount() < loads + 2; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    EXPECT_EQ(chunks->getLoadCount(), loads + 2);
+    EXPECT_LE(chunks->getResidentBytes(), chunks->getBudget());
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,172 @@
+#include <gtest/gtest.h>
+#include "Buffer.h"
+#include "BufferView.h"
+#include "FrameCache.h"
+#include "Lz.h"
+#include "PieceTable.h"
+#include <chrono>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace {
+
+// log lines, repetitive like the real thing but not trivially so
+std::string logText(std::size_t size, std::uint32_t seed = 7)
+{
+    std::mt19937 rng(seed);
+    const char* levels[] = { "INFO", "WARN", "DEBUG", "ERROR" };
+    const char* messages[] = { "request served", "cache miss for key", "retrying connection to", "user logged in from" };
+    std::string text;
+    for (std::size_t line = 0; text.size() < size; line++)
+        text += "2026-10-17T12:" + std::to_string(10 + line % 50) + ":" + std::to_string(rng() % 60) + " " + levels[rng() % 4] + " "
+            + messages[rng() % 4] + " 10.0." + std::to_string(rng() % 256) + "." + std::to_string(rng() % 256) + " id=" + std::to_string(rng()) + "\n";
+    text.resize(size);
+    return text;
+}
+
+std::string roundTrip(std::string_view input)
+{
+    std::string compressed = Lz::compress(input);
+    std::string output(input.size(), '\0');
+    Lz::decompress(compressed, output.data(), output.size());
+    return output;
+}
+
+}
+
+TEST(compressTest, codecTest) {
+    std::mt19937 rng(3);
+    std::string random(50000, '\0');
+    for (auto& byte : random)
+        byte = static_cast<char>(rng());
+    std::string log = logText(Lz::max_offset);
+    for (const std::string& input : { std::string(), std::string("abc"), std::string(100000, 'a'), std::string("abcabcabcabcabcab"), random, log })
+        EXPECT_EQ(roundTrip(input), input) << input.size();
+    // lengths right at the edges of the token and the extension bytes
+    for (std::size_t length : { 14, 15, 16, 18, 19, 20, 269, 270, 271, 525 }) {
+        std::string input = std::string(length, 'x') + "|" + std::string(length, 'x') + std::string(length, 'y');
+        EXPECT_EQ(roundTrip(input), input) << length;
+    }
+    EXPECT_LT(Lz::compress(log).size() * 2, log.size());
+    // damage is reported, never written past the output
+    std::string compressed = Lz::compress(log);
+    std::string output(log.size(), '\0');
+    EXPECT_THROW(Lz::decompress(std::string_view(compressed).substr(0, compressed.size() / 2), output.data(), output.size()), std::runtime_error);
+    EXPECT_THROW(Lz::decompress(compressed, output.data(), output.size() - 1), std::runtime_error);
+    EXPECT_THROW(Lz::decompress(std::string("\xf0\xff\xff", 3), output.data(), output.size()), std::runtime_error);
+}
+
+TEST(compressTest, blockTest) {
+    std::string text = logText(5 * TextBlock::frame_size + 1234);
+    TextBlock block(text.size());
+    block.append(text);
+    ASSERT_TRUE(block.isCompressible({}));
+    TextBlock compressed(block, { false, true });
+    EXPECT_TRUE(compressed.isCompressed());
+    EXPECT_EQ(compressed.data(), nullptr);
+    EXPECT_EQ(compressed.frameCount(), 6);
+    EXPECT_TRUE(compressed.isFrameCompressed(0));
+    EXPECT_FALSE(compressed.isFrameCompressed(1));
+    EXPECT_TRUE(compressed.isFrameCompressed(5));
+    EXPECT_LT(compressed.memoryUsage() * 3, block.memoryUsage() * 2);
+    // the kept frame can still be compressed, the rest is done
+    EXPECT_TRUE(compressed.isCompressible({}));
+    EXPECT_FALSE(compressed.isCompressible({ false, true }));
+    TextBlock again(compressed, {});
+    EXPECT_TRUE(again.isFrameCompressed(1));
+    EXPECT_FALSE(again.isCompressible({}));
+    // newline lookups and reads agree with the plain block, across frame boundaries too
+    for (std::size_t offset : { std::size_t(0), std::size_t(1), TextBlock::frame_size - 1, TextBlock::frame_size, 3 * TextBlock::frame_size + 7, text.size() - 1, text.size() }) {
+        EXPECT_EQ(again.countNewlines(0, offset), block.countNewlines(0, offset)) << offset;
+        EXPECT_EQ(again.countNewlines(offset, text.size()), block.countNewlines(offset, text.size())) << offset;
+        if (offset < text.size() && block.countNewlines(offset, text.size()) > 0) {
+            EXPECT_EQ(again.findNewline(offset, 0), block.findNewline(offset, 0)) << offset;
+        }
+    }
+    for (std::size_t nth = 0; nth < block.countNewlines(0, text.size()); nth += 101)
+        EXPECT_EQ(again.findNewline(0, nth), block.findNewline(0, nth)) << nth;
+    std::string read;
+    compressed.read(TextBlock::frame_size - 10, 2 * TextBlock::frame_size + 20, [&read](std::string_view part) {
+        read.append(part);
+        return true;
+    });
+    EXPECT_EQ(read, text.substr(TextBlock::frame_size - 10, 2 * TextBlock::frame_size + 20));
+    // a block over bytes owned elsewhere is left alone
+    TextBlock view(text, nullptr);
+    EXPECT_FALSE(view.isCompressible({}));
+}
+
+TEST(compressTest, pieceTableTest) {
+    std::string original = "head\n";
+    std::string inserted = logText(8 * TextBlock::frame_size);
+    PieceTable table(original, nullptr);
+    table.insert(original.size(), inserted);
+    std::string expected = original + inserted;
+    PieceTable before = table;
+    // the frames around the hot offset stay, the others are compressed
+    std::size_t hot = original.size() + 4 * TextBlock::frame_size + 100;
+    EXPECT_GT(table.compressCold({ { hot, hot + 10 } }), 4 * TextBlock::frame_size);
+    EXPECT_EQ(table.compressCold({ { hot, hot + 10 } }), 0);
+    ASSERT_EQ(table.size(), expected.size());
+    ASSERT_EQ(table.lineCount(), before.lineCount());
+    auto cache = FrameCache::Instance();
+    std::string scratch;
+    std::size_t hot_line = table.lineOf(hot);
+    std::size_t decompressed = cache->getDecompressCount();
+    EXPECT_EQ(table.lineView(hot_line, scratch), before.line(hot_line));
+    EXPECT_EQ(cache->getDecompressCount(), decompressed);
+    std::size_t cold_line = table.lineOf(original.size() + 100);
+    EXPECT_EQ(table.lineView(cold_line, scratch), before.line(cold_line));
+    EXPECT_EQ(cache->getDecompressCount(), decompressed + 1);
+    // reading it again is served by the cache
+    EXPECT_EQ(table.lineView(cold_line + 1, scratch), before.line(cold_line + 1));
+    EXPECT_EQ(cache->getDecompressCount(), decompressed + 1);
+    EXPECT_EQ(table.substr(0, table.size()), expected);
+    // the snapshot taken before still reads its own blocks
+    EXPECT_EQ(before.substr(0, before.size()), expected);
+    // edits land in compressed pieces like in any other
+    table.insert(original.size() + 2 * TextBlock::frame_size, "inserted\n");
+    expected.insert(original.size() + 2 * TextBlock::frame_size, "inserted\n");
+    table.erase(original.size() + 6 * TextBlock::frame_size, 5000);
+    expected.erase(original.size() + 6 * TextBlock::frame_size, 5000);
+    EXPECT_EQ(table.substr(0, table.size()), expected);
+    for (std::size_t line = 0; line < table.lineCount(); line += 97)
+        EXPECT_EQ(table.lineStart(line), line == 0 ? 0 : expected.find('\n', table.lineStart(line - 1)) + 1) << line;
+}
+
+TEST(compressTest, bufferTest) {
+    std::string text = logText(3 * Buffer::hot_distance);
+    Buffer buffer;
+    BufferView view(buffer);
+    buffer.insertAt(0, 0, text);
+    view.wrapLines(80);
+    buffer.compressCold();
+    // swapped in on the main loop once the job is done, the view and its cursor sit at the top
+    // and the end of the text is far enough to be compressed
+    auto cache = FrameCache::Instance();
+    auto scheduler = Scheduler::Instance();
+    std::size_t last = buffer.getText().lineCount() - 1;
+    std::string scratch;
+    bool compressed = false;
+    for (int i = 0; i < 5000 && !compressed; i++) {
+        scheduler->runPending();
+        std::size_t decompressed = cache->getDecompressCount();
+        buffer.getText().lineView(last - 1, scratch);
+        compressed = cache->getDecompressCount() != decompressed;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_TRUE(compressed);
+    EXPECT_EQ(buffer.getText().substr(0, buffer.getText().size()), text);
+    std::size_t decompressed = cache->getDecompressCount();
+    EXPECT_EQ(buffer[0], text.substr(0, text.find('\n')));
+    EXPECT_EQ(cache->getDecompressCount(), decompressed);
+    // an edit while the job runs keeps the text it made
+    buffer.compressCold();
+    buffer.insertAt(0, 0, std::string("x"));
+    for (int i = 0; i < 1000 && scheduler->getJobCount() != 0; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    scheduler->runPending();
+    EXPECT_EQ(buffer.getText().substr(0, buffer.getText().size()), "x" + text);
+}
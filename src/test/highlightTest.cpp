@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+#include "Buffer.h"
+#include "Highlighter.h"
+#include <array>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+using Span = Highlighter::Span;
+using Syntax = Highlighter::Syntax;
+
+std::vector<Span> lex(Syntax syntax, std::string_view line, std::uint8_t& state)
+{
+    std::vector<Span> spans;
+    state = Highlighter::lexLine(syntax, line, state, &spans);
+    return spans;
+}
+
+void settle(Buffer& buffer)
+{
+    while (true) {
+        buffer.updateHighlights(buffer.getBufferSize());
+        if (!buffer.isHighlighting())
+            return;
+        std::this_thread::yield();
+    }
+}
+
+/**
+ * @brief compare the highlights of every line with a plain top to bottom lex
+ */
+void expectSettled(Buffer& buffer, Syntax syntax)
+{
+    std::uint8_t state = 0;
+    for (std::size_t i = 0; i < buffer.getBufferSize(); i++) {
+        auto expected = lex(syntax, buffer[i], state);
+        ASSERT_EQ(buffer.getHighlights(i), expected) << "line " << i;
+    }
+}
+}
+
+TEST(highlightTest, syntaxTest) {
+    EXPECT_EQ(Highlighter::syntaxFor("/etc/app/Settings.TOML"), Syntax::Config);
+    EXPECT_EQ(Highlighter::syntaxFor("compose.yml"), Syntax::Config);
+    EXPECT_EQ(Highlighter::syntaxFor(".env"), Syntax::Config);
+    EXPECT_EQ(Highlighter::syntaxFor("/var/log/app.log.1"), Syntax::Log);
+    EXPECT_EQ(Highlighter::syntaxFor("main.cpp"), Syntax::None);
+}
+
+TEST(highlightTest, configTest) {
+    std::uint8_t state = 0;
+    EXPECT_EQ(lex(Syntax::Config, "[server]  # main", state), (std::vector<Span> { { 0, 8, Style::Section }, { 10, 16, Style::Comment } }));
+    EXPECT_EQ(lex(Syntax::Config, "port = 8080", state), (std::vector<Span> { { 0, 4, Style::Key }, { 7, 11, Style::Number } }));
+    EXPECT_EQ(lex(Syntax::Config, "name: \"a # b\" # c", state), (std::vector<Span> { { 0, 4, Style::Key }, { 6, 13, Style::String }, { 14, 17, Style::Comment } }));
+    EXPECT_EQ(lex(Syntax::Config, "url = http://host:80", state), (std::vector<Span> { { 0, 3, Style::Key } }));
+    // a toml multi-line string spans lines
+    lex(Syntax::Config, "text = \"\"\"first", state);
+    EXPECT_EQ(lex(Syntax::Config, "key = not a key", state), (std::vector<Span> { { 0, 15, Style::String } }));
+    EXPECT_EQ(lex(Syntax::Config, "end\"\"\" # done", state), (std::vector<Span> { { 0, 6, Style::String }, { 7, 13, Style::Comment } }));
+    EXPECT_EQ(state, 0);
+    // a yaml block scalar lasts while lines are indented deeper than its key
+    lex(Syntax::Config, "  script: |", state);
+    EXPECT_EQ(lex(Syntax::Config, "    run: true", state), (std::vector<Span> { { 4, 13, Style::String } }));
+    EXPECT_EQ(lex(Syntax::Config, "", state), std::vector<Span> {});
+    EXPECT_EQ(lex(Syntax::Config, "  - enabled: off", state), (std::vector<Span> { { 4, 11, Style::Key }, { 13, 16, Style::Number } }));
+    EXPECT_EQ(state, 0);
+}
+
+TEST(highlightTest, logTest) {
+    std::uint8_t state = 0;
+    EXPECT_EQ(lex(Syntax::Log, "2026-10-17 12:00:01,250 INFO started in 12ms", state),
+        (std::vector<Span> { { 0, 23, Style::Timestamp }, { 24, 28, Style::Key }, { 40, 44, Style::Number } }));
+    EXPECT_EQ(lex(Syntax::Log, "[2026-10-17T12:00:02Z] ERROR: \"boom\"", state),
+        (std::vector<Span> { { 0, 22, Style::Timestamp }, { 23, 28, Style::Error }, { 30, 36, Style::String } }));
+    // the stack trace belongs to the error above it
+    EXPECT_EQ(lex(Syntax::Log, "    at Main.run(Main.java:12)", state), (std::vector<Span> { { 4, 29, Style::Error } }));
+    EXPECT_EQ(lex(Syntax::Log, "Oct 17 12:00:03 host sshd WARN: slow", state),
+        (std::vector<Span> { { 0, 15, Style::Timestamp }, { 26, 30, Style::Warning } }));
+    EXPECT_EQ(lex(Syntax::Log, "[    0.004000] no level", state), (std::vector<Span> { { 0, 14, Style::Timestamp } }));
+    EXPECT_EQ(lex(Syntax::Log, "    continued", state), std::vector<Span> {});
+}
+
+TEST(highlightTest, incrementalTest) {
+    std::mt19937 rng(16);
+    const std::vector<std::string> lines = { "[section]", "key = 1", "text = \"\"\"", "\"\"\"", "# comment", "name: |", "  body", "list = [1, 'a']" };
+    std::string content;
+    for (int i = 0; i < 5000; i++)
+        content += lines[rng() % lines.size()] + '\n';
+    Buffer buffer(std::make_shared<const std::string>(content));
+    buffer.setSyntax(Syntax::Config);
+    settle(buffer);
+    expectSettled(buffer, Syntax::Config);
+    // every edit relexes until the states converge again, opening strings flips everything below
+    for (int round = 0; round < 40; round++) {
+        std::size_t line = rng() % buffer.getBufferSize();
+        if (rng() % 3 == 0 && buffer.getLineLength(line) > 0) {
+            buffer.eraseAt(line, 0, 1);
+        } else {
+            std::string_view insert = std::array<std::string_view, 4> { "\"\"\"", "x\ny = 2\n", "'''", "  " }[rng() % 4];
+            buffer.insertAt(line, 0, insert);
+        }
+        // edits landing while a batch runs drop its stale part
+        if (round % 2 == 0)
+            buffer.updateHighlights(buffer.getBufferSize());
+        if (round % 4 == 0) {
+            settle(buffer);
+            expectSettled(buffer, Syntax::Config);
+        }
+    }
+    settle(buffer);
+    expectSettled(buffer, Syntax::Config);
+}
+
+TEST(highlightTest, typingTest) {
+    Buffer buffer(std::make_shared<const std::string>("[typed]\n"));
+    buffer.setSyntax(Syntax::Config);
+    settle(buffer);
+    // every keystroke grows the add block the running batch is reading lines from
+    const std::string_view typed = "key = \"value\" # note\n";
+    for (int i = 0; i < 300; i++) {
+        for (char c : typed) {
+            std::size_t line = buffer.getBufferSize() - 1;
+            buffer.insertAt(line, buffer.getLineLength(line), std::string_view(&c, 1));
+            buffer.updateHighlights(buffer.getBufferSize());
+        }
+    }
+    settle(buffer);
+    expectSettled(buffer, Syntax::Config);
+}
@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+#include "Buffer.h"
+#include "EditJournal.h"
+#include <string>
+
+TEST(journalTest, coalesceTest) {
+    EditJournal journal;
+    for (std::size_t i = 0; i < 5; i++)
+        journal.recordInsert(10 + i, std::string(1, 'a' + i));
+    // backspacing over the last three characters
+    for (std::size_t i = 0; i < 3; i++)
+        journal.recordErase(14 - i, std::string(1, 'e' - i));
+    journal.seal();
+    journal.recordInsert(11, "x");
+    EXPECT_EQ(journal.size(), 3);
+
+    auto edit = journal.undo();
+    EXPECT_EQ(edit.kind, EditJournal::Kind::Insert);
+    EXPECT_EQ(edit.text, "x");
+    edit = journal.undo();
+    EXPECT_EQ(edit.kind, EditJournal::Kind::Erase);
+    EXPECT_EQ(edit.offset, 12);
+    EXPECT_EQ(edit.text, "cde");
+    edit = journal.undo();
+    EXPECT_EQ(edit.offset, 10);
+    EXPECT_EQ(edit.text, "abcde");
+    EXPECT_FALSE(journal.canUndo());
+    // a new edit after undoing drops the redo steps
+    journal.redo();
+    journal.recordInsert(0, "y");
+    EXPECT_FALSE(journal.canRedo());
+    EXPECT_EQ(journal.size(), 2);
+}
+
+TEST(journalTest, boundedTest) {
+    constexpr std::size_t budget = 256 * 1024;
+    EditJournal journal(budget);
+    std::string line(100, 'z');
+    for (std::size_t i = 0; i < 200000; i++) {
+        if (i % 2 == 0)
+            journal.recordInsert(i, line);
+        else
+            journal.recordErase(i, line);
+    }
+    EXPECT_LE(journal.memoryUsage(), budget);
+    EXPECT_GT(journal.size(), 1000);
+    std::size_t undone = 0;
+    for (; journal.canUndo(); undone++)
+        ASSERT_EQ(journal.undo().text, line);
+    EXPECT_EQ(undone, journal.size());
+}
+
+TEST(journalTest, bufferUndoTest) {
+    Buffer buffer;
+    buffer.insertLine("first", 0);
+    buffer.closeUndoStep();
+    for (char ch : std::string("abc"))
+        buffer.addChAt(0, buffer.getLineLength(0), ch);
+    buffer.eraseAt(0, 1, 1);
+    EXPECT_EQ(buffer[0], "frstabc");
+
+    auto position = buffer.undo();
+    ASSERT_TRUE(position.has_value());
+    EXPECT_EQ(buffer[0], "firstabc");
+    EXPECT_EQ(position->second, 2);
+    position = buffer.undo();
+    EXPECT_EQ(buffer[0], "first");
+    EXPECT_EQ(position->second, 5);
+    position = buffer.redo();
+    EXPECT_EQ(buffer[0], "firstabc");
+    EXPECT_EQ(position->second, 8);
+    buffer.redo();
+    EXPECT_EQ(buffer[0], "frstabc");
+    EXPECT_FALSE(buffer.redo().has_value());
+}
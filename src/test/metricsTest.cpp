@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+#include "Metrics.h"
+#include "Window.h"
+#include <chrono>
+#include <memory>
+#include <string>
+
+using namespace std::chrono_literals;
+
+TEST(metricsTest, histogramTest) {
+    LatencyHistogram histogram;
+    EXPECT_EQ(histogram.percentile(0.5), 0us);
+    // 90 fast samples, 9 slow ones and an outlier
+    for (int i = 0; i < 90; i++)
+        histogram.record(3us);
+    for (int i = 0; i < 9; i++)
+        histogram.record(700us);
+    histogram.record(20ms);
+    EXPECT_EQ(histogram.getCount(), 100);
+    EXPECT_EQ(histogram.getBucket(1), 90);
+    EXPECT_EQ(histogram.getBucket(9), 9);
+    // a percentile is the upper bound of its bucket, never above the largest sample
+    EXPECT_EQ(histogram.percentile(0.5), 4us);
+    EXPECT_EQ(histogram.percentile(0.99), 1024us);
+    EXPECT_EQ(histogram.percentile(1.0), 20ms);
+    EXPECT_EQ(histogram.getMax(), 20ms);
+    histogram.reset();
+    EXPECT_EQ(histogram.getCount(), 0);
+}
+
+TEST(metricsTest, jsonTest) {
+    Metrics metrics;
+    metrics.add(Metrics::Counter::Keys, 3);
+    metrics.record(Metrics::Timer::Wrap, 5us);
+    std::string json = metrics.toJson(1234);
+    EXPECT_EQ(json.find('\n'), std::string::npos);
+    EXPECT_NE(json.find("{\"time_ms\":1234,\"counters\":{\"keys\":3,\"rows_wrapped\":0,"), std::string::npos);
+    EXPECT_NE(json.find("\"wrap\":{\"count\":1,\"p50\":5,\"p90\":5,\"p99\":5,\"max\":5,\"buckets\":[0,0,1]}"), std::string::npos);
+    EXPECT_NE(json.find("\"loop\":{\"count\":0,\"p50\":0,\"p90\":0,\"p99\":0,\"max\":0,\"buckets\":[]}"), std::string::npos);
+}
+
+TEST(metricsTest, instrumentationTest) {
+    auto screen = std::make_shared<CellScreen>(60, 16);
+    TextEditWindow window(screen, DEFAULT_BORDER, "text", 59, 15, 0, 0, 60, 16);
+    auto metrics = Metrics::Instance();
+    auto keys = metrics->getCounter(Metrics::Counter::Keys);
+    auto inputs = metrics->getHistogram(Metrics::Timer::Input).getCount();
+    auto rows = metrics->getCounter(Metrics::Counter::RowsWrapped);
+    auto refreshes = metrics->getCounter(Metrics::Counter::Refreshes);
+    auto bytes = metrics->getCounter(Metrics::Counter::BytesDrawn);
+    std::string typed = "hello";
+    window.inputBatch(std::vector<chtype>(typed.begin(), typed.end()));
+    window.refreshWindow();
+    EXPECT_EQ(metrics->getCounter(Metrics::Counter::Keys), keys + 5);
+    EXPECT_EQ(metrics->getHistogram(Metrics::Timer::Input).getCount(), inputs + 1);
+    EXPECT_GT(metrics->getCounter(Metrics::Counter::RowsWrapped), rows);
+    EXPECT_EQ(metrics->getCounter(Metrics::Counter::Refreshes), refreshes + 1);
+    // one whole text row was repainted
+    EXPECT_GE(metrics->getCounter(Metrics::Counter::BytesDrawn), bytes + 57);
+}
+
+TEST(metricsTest, overlayTest) {
+    auto screen = std::make_shared<CellScreen>(60, 16);
+    TextEditWindow window(screen, DEFAULT_BORDER, "text", 59, 15, 0, 0, 60, 16);
+    window.inputHandler('x');
+    window.refreshWindow();
+    MetricsWindow overlay(screen, DEFAULT_BORDER, 59 - MetricsWindow::overlay_width, 0, 60, 16);
+    overlay.refreshWindow();
+    screen->update();
+    EXPECT_EQ(screen->getRow(1).substr(0, 3), "|x ");
+    EXPECT_NE(screen->getRow(1).find("latency us"), std::string::npos);
+    EXPECT_NE(screen->getRow(2).find("key_to_paint"), std::string::npos);
+    // the terminal cursor stays with the text
+    EXPECT_EQ(screen->getCursor(), (std::pair<std::size_t, std::size_t> { 1, 2 }));
+    // new numbers show up with the next sample
+    EXPECT_FALSE(overlay.needsRefresh());
+    Metrics::Instance()->add(Metrics::Counter::Frames);
+    overlay.sample();
+    EXPECT_TRUE(overlay.needsRefresh());
+    overlay.refreshWindow();
+    screen->update();
+    EXPECT_NE(screen->getRow(13).find(std::to_string(Metrics::Instance()->getCounter(Metrics::Counter::Frames))), std::string::npos);
+}
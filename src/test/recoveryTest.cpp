@@ -0,0 +1,176 @@
+#include <gtest/gtest.h>
+#include "Buffer.h"
+#include "RecoveryJournal.h"
+#include "testUtil.h"
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace {
+std::string loadRecovered(const std::filesystem::path& path)
+{
+    Buffer buffer;
+    buffer.enableRecovery(RecoveryJournal::pathFor(path));
+    buffer.load(path.string());
+    return contentOf(buffer);
+}
+
+std::filesystem::path writeBase(const std::string& name, const std::string& content)
+{
+    auto path = tempPath(name);
+    std::ofstream(path) << content;
+    std::filesystem::remove(RecoveryJournal::pathFor(path));
+    return path;
+}
+
+void removeAll(const std::filesystem::path& path)
+{
+    auto journal = RecoveryJournal::pathFor(path);
+    std::filesystem::remove(path);
+    std::filesystem::remove(journal);
+    std::filesystem::remove(journal.string() + ".stale");
+}
+}
+
+TEST(recoveryTest, replayTest) {
+    auto path = writeBase("recovery_replay.txt", "first\nsecond\nthird");
+    std::string expected;
+    {
+        Buffer buffer;
+        buffer.enableRecovery(RecoveryJournal::pathFor(path));
+        buffer.load(path.string());
+        for (char ch : std::string("new "))
+            buffer.addChAt(1, buffer.getLineLength(1) - 6, ch);
+        buffer.eraseAt(0, 0, 2);
+        buffer.insertAt(2, 0, std::string("pasted\nlines "));
+        buffer.undo();
+        buffer.appendLine("last");
+        expected = contentOf(buffer);
+    }
+    // the journal outlives the buffer, as it would a crash
+    EXPECT_EQ(loadRecovered(path), expected);
+    // and keeps recording on top of the recovered text
+    {
+        Buffer buffer;
+        buffer.enableRecovery(RecoveryJournal::pathFor(path));
+        buffer.load(path.string());
+        buffer.appendLine("more");
+        expected = contentOf(buffer);
+    }
+    EXPECT_EQ(loadRecovered(path), expected);
+    Buffer plain;
+    plain.load(path.string());
+    EXPECT_EQ(contentOf(plain), "first\nsecond\nthird");
+    removeAll(path);
+}
+
+TEST(recoveryTest, tornTailTest) {
+    auto path = writeBase("recovery_torn.txt", "abc\ndef\n");
+    std::string expected;
+    {
+        Buffer buffer;
+        buffer.enableRecovery(RecoveryJournal::pathFor(path));
+        buffer.load(path.string());
+        buffer.insertAt(1, 3, std::string(" ghi"));
+        expected = contentOf(buffer);
+    }
+    // a record cut short by a crash
+    std::ofstream(RecoveryJournal::pathFor(path), std::ios::app) << "I\x05\x00\x00";
+    EXPECT_EQ(loadRecovered(path), expected);
+    removeAll(path);
+}
+
+TEST(recoveryTest, compactionTest) {
+    std::string original;
+    for (int i = 0; i < 1000; i++)
+        original += "line " + std::to_string(i) + '\n';
+    auto path = writeBase("recovery_compaction.txt", original);
+    std::string expected;
+    {
+        Buffer buffer;
+        buffer.enableRecovery(RecoveryJournal::pathFor(path));
+        buffer.load(path.string());
+        std::string chunk(64 * 1024 - 1, 'x');
+        chunk += '\n';
+        // far more churn than the journal may keep
+        for (int i = 0; i < 200; i++) {
+            buffer.insertAt(500, 0, chunk);
+            buffer.eraseAt(500, 0, chunk.size());
+        }
+        buffer.insertAt(999, 0, std::string("kept "));
+        expected = contentOf(buffer);
+    }
+    EXPECT_LT(std::filesystem::file_size(RecoveryJournal::pathFor(path)), 1024 * 1024);
+    EXPECT_EQ(loadRecovered(path), expected);
+    removeAll(path);
+}
+
+TEST(recoveryTest, failedRenameTest) {
+    auto path = writeBase("recovery_rename.txt", "base\n");
+    auto journal = RecoveryJournal::pathFor(path);
+    // a directory with something in it cannot be renamed over
+    std::filesystem::create_directories(journal / "occupied");
+    auto bytes = std::make_shared<const std::string>("base\n");
+    auto base = std::make_shared<const TextBlock>(*bytes, bytes);
+    {
+        RecoveryJournal recovery(journal, path, base);
+        PieceTable text(base);
+        recovery.start(text);
+        text.insert(0, "a");
+        recovery.recordInsert(0, "a");
+        recovery.flush();
+        text.insert(1, "b");
+        recovery.recordInsert(1, "b");
+        recovery.flush();
+    }
+    // nothing is left writing into a temporary file replay never reads
+    EXPECT_FALSE(std::filesystem::exists(journal.string() + ".tmp"));
+    EXPECT_TRUE(std::filesystem::is_directory(journal / "occupied"));
+    std::filesystem::remove_all(journal);
+    removeAll(path);
+}
+
+TEST(recoveryTest, staleBaseTest) {
+    auto path = writeBase("recovery_stale.txt", "old content");
+    {
+        Buffer buffer;
+        buffer.enableRecovery(RecoveryJournal::pathFor(path));
+        buffer.load(path.string());
+        buffer.appendLine("edit");
+    }
+    std::ofstream(path) << "changed elsewhere";
+    EXPECT_EQ(loadRecovered(path), "changed elsewhere");
+    EXPECT_TRUE(std::filesystem::exists(RecoveryJournal::pathFor(path).string() + ".stale"));
+    removeAll(path);
+}
+
+TEST(recoveryTest, cleanBufferTest) {
+    auto path = writeBase("recovery_clean.txt", "untouched\n");
+    auto journal = RecoveryJournal::pathFor(path);
+    {
+        Buffer buffer;
+        buffer.enableRecovery(journal);
+        buffer.load(path.string());
+    }
+    // only looked at
+    EXPECT_FALSE(std::filesystem::exists(journal));
+    {
+        Buffer buffer;
+        buffer.enableRecovery(journal);
+        buffer.load(path.string());
+        buffer.insertAt(0, 0, std::string("x"));
+        buffer.undo();
+    }
+    // undone back to the file
+    EXPECT_FALSE(std::filesystem::exists(journal));
+    {
+        Buffer buffer;
+        buffer.enableRecovery(journal);
+        buffer.load(path.string());
+        buffer.insertAt(0, 0, std::string("x"));
+        buffer.undo();
+        buffer.redo();
+    }
+    EXPECT_EQ(loadRecovered(path), "xuntouched\n");
+    removeAll(path);
+}
@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+#include "Buffer.h"
+#include "PieceTable.h"
+#include "RegexReplace.h"
+#include "ThreadPool.h"
+#include "testUtil.h"
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(replaceTest, poolTest) {
+    ThreadPool pool(4);
+    std::atomic<int> done { 0 };
+    // tasks spawning tasks land on their own worker and get stolen by the idle ones
+    for (int i = 0; i < 8; i++) {
+        pool.submit([&] {
+            for (int j = 0; j < 100; j++)
+                pool.submit([&] { done++; });
+        });
+    }
+    while (done.load() != 800)
+        std::this_thread::yield();
+    EXPECT_EQ(pool.getWorkerCount(), 4);
+}
+
+TEST(replaceTest, parallelForTest) {
+    ThreadPool pool(1);
+    std::vector<int> hits(64, 0);
+    // from inside a task the only worker is busy, the caller runs the indices itself
+    std::atomic<bool> finished { false };
+    pool.submit([&] {
+        pool.parallelFor(hits.size(), [&](std::size_t i) { hits[i]++; });
+        finished = true;
+    });
+    while (!finished.load())
+        std::this_thread::yield();
+    EXPECT_EQ(std::count(hits.begin(), hits.end(), 1), 64);
+    // every index still runs before the first failure is rethrown
+    std::atomic<int> ran { 0 };
+    EXPECT_THROW(pool.parallelFor(8, [&](std::size_t i) {
+        ran++;
+        if (i == 3)
+            throw std::runtime_error("boom");
+    }), std::runtime_error);
+    EXPECT_EQ(ran.load(), 8);
+}
+
+TEST(replaceTest, pieceReplaceTest) {
+    std::mt19937 rng(21);
+    for (int round = 0; round < 50; round++) {
+        PieceTable table;
+        std::string mirror;
+        for (int i = 0; i < 200; i++) {
+            std::string piece(1 + rng() % 5, "ab\n"[rng() % 3]);
+            std::size_t at = rng() % (mirror.size() + 1);
+            table.insert(at, piece);
+            mirror.insert(at, piece);
+        }
+        std::vector<PieceTable::Replacement> replacements;
+        for (std::size_t offset = rng() % 10; offset < mirror.size(); offset += rng() % 10) {
+            std::size_t length = std::min<std::size_t>(rng() % 4, mirror.size() - offset);
+            replacements.push_back({ offset, length, std::string(rng() % 3, "xy\n"[rng() % 3]) });
+            offset += length;
+        }
+        for (auto it = replacements.rbegin(); it != replacements.rend(); ++it)
+            mirror.replace(it->offset, it->length, it->text);
+        table.replaceAll(replacements);
+        ASSERT_EQ(table.substr(0, table.size()), mirror) << "round " << round;
+        ASSERT_EQ(table.lineCount(), std::count(mirror.begin(), mirror.end(), '\n') + 1);
+        std::size_t last_line = table.lineCount() - 1;
+        EXPECT_EQ(table.lineStart(last_line), mirror.rfind('\n') == std::string::npos ? 0 : mirror.rfind('\n') + 1);
+    }
+    PieceTable table(std::string_view("abc"), nullptr);
+    EXPECT_THROW(table.replaceAll({ { 2, 1, "x" }, { 1, 1, "y" } }), std::out_of_range);
+    EXPECT_THROW(table.replaceAll({ { 2, 2, "x" } }), std::out_of_range);
+}
+
+TEST(replaceTest, regexTest) {
+    PieceTable table(std::string_view("key = 1\nother = 22\nkey = 333"), nullptr);
+    auto replacements = RegexReplace::findAll(table, "(\\w+) = (\\d+)", "$2 = $1");
+    ASSERT_EQ(replacements.size(), 3);
+    table.replaceAll(replacements);
+    EXPECT_EQ(table.substr(0, table.size()), "1 = key\n22 = other\n333 = key");
+    // several chunks, every line is matched once and no match crosses a line break
+    auto original = std::make_shared<const std::string>([] {
+        std::string text;
+        for (int i = 0; i < 300000; i++)
+            text += "line " + std::to_string(i) + "\n";
+        return text;
+    }());
+    PieceTable big(*original, original);
+    EXPECT_EQ(RegexReplace::findAll(big, "^", "> ").size(), big.lineCount());
+    EXPECT_EQ(RegexReplace::findAll(big, "\\d$", "").size(), 300000);
+    EXPECT_EQ(RegexReplace::findAll(big, "9\\n", "").size(), 0);
+    EXPECT_THROW(RegexReplace::findAll(big, "(", ""), std::runtime_error);
+}
+
+TEST(replaceTest, cancelTest) {
+    auto original = std::make_shared<const std::string>(std::string(8 * 1024 * 1024, 'a'));
+    RegexReplace job(PieceTable(*original, original), "a", "b");
+    job.cancel();
+    job.wait();
+    EXPECT_TRUE(job.isDone());
+    EXPECT_TRUE(job.takeResult().empty());
+}
+
+TEST(replaceTest, failTest) {
+    auto original = std::make_shared<const std::string>([] {
+        std::string text;
+        for (int i = 0; i < 300000; i++)
+            text += "line " + std::to_string(i) + "\n";
+        return text;
+    }());
+    // one chunk throws, the job still finishes and reports it
+    RegexReplace job(PieceTable(*original, original), "^line 150000$", [](const std::cmatch&) -> std::string { throw std::length_error("too long"); });
+    job.wait();
+    EXPECT_TRUE(job.isDone());
+    EXPECT_TRUE(job.isFailed());
+    EXPECT_EQ(job.getError(), "too long");
+    EXPECT_TRUE(job.takeResult().empty());
+}
+
+TEST(replaceTest, bufferReplaceTest) {
+    Buffer buffer(std::make_shared<const std::string>("one fish\ntwo fish\nred fish\nblue fish"));
+    buffer.setSearchQuery("fish");
+    std::size_t revision = buffer.getRevision();
+    auto replacements = RegexReplace::findAll(buffer.getText(), "f(is)h", "b$1cuit\nb");
+    // the cursor is behind two replacements
+    auto position = buffer.replaceAll(replacements, 2, 4);
+    EXPECT_EQ(contentOf(buffer), "one biscuit\nb\ntwo biscuit\nb\nred biscuit\nb\nblue biscuit\nb");
+    EXPECT_EQ(position, std::make_pair(std::size_t(4), std::size_t(4)));
+    EXPECT_NE(buffer.getRevision(), revision);
+    EXPECT_EQ(buffer.getSearch().count(), 0);
+    // one undo step for the whole batch
+    buffer.undo();
+    EXPECT_EQ(contentOf(buffer), "one fish\ntwo fish\nred fish\nblue fish");
+    EXPECT_EQ(buffer.getSearch().count(), 4);
+    buffer.redo();
+    EXPECT_EQ(contentOf(buffer), "one biscuit\nb\ntwo biscuit\nb\nred biscuit\nb\nblue biscuit\nb");
+    buffer.undo();
+    buffer.appendLine("green fish");
+    EXPECT_FALSE(buffer.getJournal().canRedo());
+    EXPECT_EQ(buffer.getSearch().count(), 5);
+}
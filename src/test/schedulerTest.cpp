@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include "Scheduler.h"
+#include <atomic>
+#include <chrono>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace {
+bool isWoken(const Scheduler& scheduler)
+{
+    pollfd fd { scheduler.getWakeFd(), POLLIN, 0 };
+    return poll(&fd, 1, 1000) == 1;
+}
+
+void waitIdle(const Scheduler& scheduler)
+{
+    while (scheduler.getJobCount() != 0)
+        std::this_thread::yield();
+}
+}
+
+TEST(schedulerTest, priorityTest) {
+    Scheduler scheduler(std::make_shared<ThreadPool>(1));
+    // hold the only worker, so everything below queues up behind it
+    std::atomic<bool> release { false };
+    scheduler.submit(Scheduler::Priority::Normal, [&](const CancellationToken&) {
+        while (!release.load())
+            std::this_thread::yield();
+    });
+    std::string order;
+    scheduler.submit(Scheduler::Priority::Background, [&](const CancellationToken&) { order += 'b'; });
+    scheduler.submit(Scheduler::Priority::Normal, [&](const CancellationToken&) { order += 'n'; });
+    scheduler.submit(Scheduler::Priority::Interactive, [&](const CancellationToken&) { order += 'i'; });
+    release.store(true);
+    waitIdle(scheduler);
+    EXPECT_EQ(order, "inb");
+}
+
+TEST(schedulerTest, completionTest) {
+    Scheduler scheduler(std::make_shared<ThreadPool>(2));
+    EXPECT_FALSE(scheduler.runPending());
+    int result = 0;
+    std::string done;
+    scheduler.submit(Scheduler::Priority::Normal, [&](const CancellationToken&) { result = 42; }, [&] { done += std::to_string(result); });
+    EXPECT_TRUE(isWoken(scheduler));
+    waitIdle(scheduler);
+    // callbacks only run on the main loop
+    EXPECT_EQ(done, "");
+    scheduler.post([&] { done += '!'; });
+    EXPECT_TRUE(scheduler.runPending());
+    EXPECT_EQ(done, "42!");
+    EXPECT_FALSE(scheduler.runPending());
+}
+
+TEST(schedulerTest, cancelTest) {
+    Scheduler scheduler(std::make_shared<ThreadPool>(1));
+    std::atomic<bool> release { false };
+    scheduler.submit(Scheduler::Priority::Normal, [&](const CancellationToken&) {
+        while (!release.load())
+            std::this_thread::yield();
+    });
+    // skipped before it starts
+    CancellationToken skipped;
+    bool ran = false;
+    scheduler.submit(Scheduler::Priority::Normal, [&](const CancellationToken&) { ran = true; }, {}, skipped);
+    skipped.cancel();
+    // finished, but its callback is called off
+    CancellationToken late;
+    bool done = false;
+    scheduler.submit(Scheduler::Priority::Normal, [](const CancellationToken&) {}, [&] { done = true; }, late);
+    release.store(true);
+    waitIdle(scheduler);
+    late.cancel();
+    scheduler.runPending();
+    EXPECT_FALSE(ran);
+    EXPECT_FALSE(done);
+}
+
+TEST(schedulerTest, failTest) {
+    Scheduler scheduler(std::make_shared<ThreadPool>(1));
+    // a job that throws still completes, whoever counts its jobs is not left waiting
+    bool done = false;
+    scheduler.submit(Scheduler::Priority::Normal, [](const CancellationToken&) { throw std::runtime_error("boom"); }, [&] { done = true; });
+    EXPECT_TRUE(isWoken(scheduler));
+    waitIdle(scheduler);
+    scheduler.runPending();
+    EXPECT_TRUE(done);
+}
+
+TEST(schedulerTest, timerTest) {
+    Scheduler scheduler(std::make_shared<ThreadPool>(1));
+    EXPECT_FALSE(scheduler.getNextDeadline());
+    std::string fired;
+    auto now = Scheduler::Clock::now();
+    scheduler.runAt(now + std::chrono::hours(1), [&] { fired += 'c'; });
+    scheduler.runAt(now, [&] { fired += 'a'; });
+    scheduler.runAt(now, [&] { fired += 'b'; });
+    scheduler.runAfter(std::chrono::seconds(0), [&] { fired += 'x'; }).cancel();
+    EXPECT_EQ(scheduler.getNextDeadline(), now);
+    EXPECT_TRUE(scheduler.runPending());
+    EXPECT_EQ(fired, "ab");
+    EXPECT_EQ(scheduler.getNextDeadline(), now + std::chrono::hours(1));
+}
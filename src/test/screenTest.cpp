@@ -0,0 +1,172 @@
+#include <gtest/gtest.h>
+#include "Screen.h"
+#include "Window.h"
+#include <cctype>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+/**
+ * @brief just enough of a terminal to replay what AnsiScreen emits
+ */
+struct FakeTerminal {
+    std::size_t width, height;
+    std::vector<std::string> rows;
+    std::size_t row = 0, col = 0;
+    bool pending_wrap = false;
+
+    FakeTerminal(std::size_t width, std::size_t height)
+        : width(width)
+        , height(height)
+        , rows(height, std::string(width, ' '))
+    {
+    }
+
+    void feed(const std::string& bytes)
+    {
+        for (std::size_t i = 0; i < bytes.size(); i++) {
+            char ch = bytes[i];
+            if (ch == '\x1b') {
+                ASSERT_EQ(bytes[++i], '[');
+                std::string params;
+                while (!std::isalpha(static_cast<unsigned char>(bytes[++i])))
+                    params += bytes[i];
+                csi(params, bytes[i]);
+            } else if (ch == '\r') {
+                col = 0;
+                pending_wrap = false;
+            } else if (ch == '\n') {
+                // the tty turns a newline into CR LF
+                row = std::min(row + 1, height - 1);
+                col = 0;
+                pending_wrap = false;
+            } else {
+                if (pending_wrap) {
+                    row = std::min(row + 1, height - 1);
+                    col = 0;
+                    pending_wrap = false;
+                }
+                rows[row][col] = ch;
+                if (col + 1 == width)
+                    pending_wrap = true;
+                else
+                    col++;
+            }
+        }
+    }
+
+    void csi(const std::string& params, char command)
+    {
+        pending_wrap = false;
+        if (!params.empty() && params[0] == '?')
+            return;
+        std::size_t first = params.empty() ? 1 : std::stoul(params);
+        std::size_t semicolon = params.find(';');
+        switch (command) {
+        case 'H':
+            row = first - 1;
+            col = semicolon == std::string::npos ? 0 : std::stoul(params.substr(semicolon + 1)) - 1;
+            break;
+        case 'A':
+            row -= first;
+            break;
+        case 'B':
+            row += first;
+            break;
+        case 'C':
+            col += first;
+            break;
+        case 'D':
+            col -= first;
+            break;
+        case 'G':
+            col = first - 1;
+            break;
+        default:
+            FAIL() << "unexpected sequence " << params << command;
+        }
+    }
+};
+
+std::string readAll(int fd)
+{
+    std::string bytes;
+    lseek(fd, 0, SEEK_SET);
+    char chunk[4096];
+    for (ssize_t n; (n = read(fd, chunk, sizeof(chunk))) > 0;)
+        bytes.append(chunk, n);
+    ftruncate(fd, 0);
+    lseek(fd, 0, SEEK_SET);
+    return bytes;
+}
+}
+
+TEST(screenTest, cellScreenWindowTest) {
+    auto screen = std::make_shared<CellScreen>(40, 12);
+    TextEditWindow window(screen, DEFAULT_BORDER, "name", 20, 6, 2, 1, 40, 12);
+    for (char ch : std::string("hello"))
+        window.inputHandler(ch);
+    window.refreshWindow();
+    screen->update();
+    EXPECT_EQ(screen->getRow(0), std::string(40, ' '));
+    EXPECT_EQ(screen->getRow(1).substr(0, 23), "  +------------------+ ");
+    EXPECT_EQ(screen->getRow(2).substr(0, 23), "  |hello             | ");
+    EXPECT_EQ(screen->getRow(6).substr(0, 23), "  +name--------------+ ");
+    auto [row, col] = screen->getCursor();
+    EXPECT_EQ(row, 2);
+    EXPECT_EQ(col, 8);
+}
+
+TEST(screenTest, wideCellTest) {
+    CellScreen screen(10, 2);
+    auto surface = screen.createSurface(0, 0, 10, 2);
+    surface->put(0, 0, "a\u4e2d\u6587b");
+    // a wide character that does not fit at the edge is left out
+    surface->put(1, 7, "xy\u4e2d");
+    surface->stage();
+    EXPECT_EQ(screen.getRow(0), "a\u4e2d\u6587b    ");
+    EXPECT_EQ(screen.getRow(1), "       xy ");
+    // overwriting half of a wide character blanks the other half
+    surface->put(0, 2, "-");
+    surface->stage();
+    EXPECT_EQ(screen.getRow(0), "a -\u6587b    ");
+}
+
+TEST(screenTest, ansiDiffTest) {
+    constexpr std::size_t width = 30, height = 8;
+    FILE* file = std::tmpfile();
+    int fd = fileno(file);
+    AnsiScreen screen(fd, width, height);
+    FakeTerminal terminal(width, height);
+    auto surface = screen.createSurface(0, 0, width, height);
+    std::mt19937 rng(3);
+    for (int frame = 0; frame < 200; frame++) {
+        for (int edit = rng() % 6; edit > 0; edit--) {
+            std::size_t row = rng() % height, col = rng() % width;
+            if (rng() % 2)
+                surface->put(row, col, std::string(rng() % 12, 'a' + rng() % 26));
+            else
+                surface->fill(row, col, ' ' + rng() % 3, rng() % width);
+        }
+        surface->setCursor(rng() % height, rng() % width);
+        surface->stage();
+        screen.update();
+        terminal.feed(readAll(fd));
+        for (std::size_t row = 0; row < height; row++)
+            ASSERT_EQ(terminal.rows[row], screen.getRow(row)) << "frame " << frame << " row " << row;
+        ASSERT_EQ(std::make_pair(terminal.row, terminal.col), screen.getCursor()) << "frame " << frame;
+    }
+    // nothing changed, nothing is sent
+    surface->stage();
+    screen.update();
+    EXPECT_EQ(screen.getLastFrameBytes(), 0);
+    // one changed cell costs a move and the cell, inside one synchronized update
+    surface->put(3, 3, "#");
+    surface->stage();
+    screen.update();
+    EXPECT_LE(screen.getLastFrameBytes(), 40);
+    std::fclose(file);
+}
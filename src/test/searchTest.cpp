@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+#include "Buffer.h"
+#include "PieceTable.h"
+#include "TextScan.h"
+#include "TextSearch.h"
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+std::vector<std::size_t> naiveFind(std::string_view text, std::string_view pattern)
+{
+    std::vector<std::size_t> found;
+    for (std::size_t pos = text.find(pattern); pos != std::string_view::npos; pos = text.find(pattern, pos + 1))
+        found.push_back(pos);
+    return found;
+}
+
+std::vector<std::size_t> indexed(const TextSearch& search)
+{
+    std::vector<std::size_t> found;
+    search.forEachIn(0, std::string::npos, [&](std::size_t offset) { found.push_back(offset); });
+    return found;
+}
+
+std::string randomText(std::mt19937& rng, std::size_t size)
+{
+    // a small alphabet makes for plenty of partial matches
+    std::string text(size, 'a');
+    for (auto& ch : text)
+        ch = "abc\n"[rng() % 4];
+    return text;
+}
+}
+
+TEST(searchTest, findAllTest) {
+    std::mt19937 rng(5);
+    for (int round = 0; round < 300; round++) {
+        std::string text = randomText(rng, rng() % 300);
+        std::string pattern = randomText(rng, 1 + rng() % (round % 3 == 0 ? 40 : 4));
+        std::vector<std::size_t> found;
+        TextScan::findAll(text, pattern, 7, found);
+        auto expected = naiveFind(text, pattern);
+        for (auto& offset : expected)
+            offset += 7;
+        ASSERT_EQ(found, expected) << "round " << round;
+    }
+}
+
+TEST(searchTest, pieceSeamTest) {
+    std::mt19937 rng(9);
+    PieceTable table;
+    std::string mirror;
+    // lots of tiny pieces, so most matches cross a seam
+    for (int i = 0; i < 2000; i++) {
+        std::string piece = randomText(rng, 1 + rng() % 3);
+        std::size_t at = rng() % (mirror.size() + 1);
+        table.insert(at, piece);
+        mirror.insert(at, piece);
+    }
+    for (std::string pattern : { "a", "ab", "abca", "cab\nab", "aaaaaa" }) {
+        EXPECT_EQ(TextSearch::findAll(table, pattern, 0, table.size()), naiveFind(mirror, pattern)) << pattern;
+        // a range only reports the matches starting in it, even if they run past its end
+        auto all = naiveFind(mirror, pattern);
+        std::vector<std::size_t> middle;
+        std::copy_if(all.begin(), all.end(), std::back_inserter(middle), [](std::size_t offset) { return offset >= 1000 && offset < 2000; });
+        EXPECT_EQ(TextSearch::findAll(table, pattern, 1000, 2000), middle) << pattern;
+    }
+}
+
+TEST(searchTest, parallelTest) {
+    // large enough to be split across the pool, both for the line index and the search
+    std::mt19937 rng(14);
+    auto original = std::make_shared<const std::string>(randomText(rng, 3 * TextScan::parallel_threshold));
+    PieceTable table(*original, original);
+    EXPECT_EQ(table.lineCount(), std::count(original->begin(), original->end(), '\n') + 1);
+    EXPECT_EQ(TextSearch::findAll(table, "ab\nc", 0, table.size()), naiveFind(*original, "ab\nc"));
+}
+
+TEST(searchTest, patchTest) {
+    std::mt19937 rng(13);
+    auto original = std::make_shared<const std::string>(randomText(rng, 20000));
+    std::string mirror = *original;
+    PieceTable table(*original, original);
+    TextSearch search;
+    search.setQuery(table, "abc");
+    ASSERT_EQ(indexed(search), naiveFind(mirror, "abc"));
+    for (int round = 0; round < 3000; round++) {
+        std::size_t at = rng() % (mirror.size() + 1);
+        if (rng() % 2 == 0) {
+            std::string piece = randomText(rng, 1 + rng() % 8);
+            table.insert(at, piece);
+            mirror.insert(at, piece);
+            search.onInsert(table, at, piece.size());
+        } else {
+            std::size_t length = std::min<std::size_t>(1 + rng() % 8, mirror.size() - at);
+            table.erase(at, length);
+            mirror.erase(at, length);
+            search.onErase(table, at, length);
+        }
+        ASSERT_EQ(search.count(), naiveFind(mirror, "abc").size()) << "round " << round;
+    }
+    EXPECT_EQ(indexed(search), naiveFind(mirror, "abc"));
+    // extending the query rechecks the matches, shortening it searches again
+    search.setQuery(table, "abca");
+    EXPECT_EQ(indexed(search), naiveFind(mirror, "abca"));
+    search.setQuery(table, "ab");
+    EXPECT_EQ(indexed(search), naiveFind(mirror, "ab"));
+}
+
+TEST(searchTest, bufferSearchTest) {
+    Buffer buffer(std::make_shared<const std::string>("one fish\ntwo fish\nred fish"));
+    EXPECT_EQ(buffer.setSearchQuery("fish"), 3);
+    EXPECT_EQ(buffer.findMatch(0, 0, true), std::make_pair(std::size_t(0), std::size_t(4)));
+    EXPECT_EQ(buffer.findMatch(1, 5, true), std::make_pair(std::size_t(2), std::size_t(4)));
+    // both directions wrap around
+    EXPECT_EQ(buffer.findMatch(2, 5, true), std::make_pair(std::size_t(0), std::size_t(4)));
+    EXPECT_EQ(buffer.findMatch(0, 4, false), std::make_pair(std::size_t(2), std::size_t(4)));
+    // typing and undoing keep the index current
+    buffer.insertAt(1, 0, std::string("fish "));
+    EXPECT_EQ(buffer.getSearch().count(), 4);
+    EXPECT_EQ(buffer.getMatchesIn(1, 0, buffer.getLineLength(1)), (std::vector<std::pair<std::size_t, std::size_t>> { { 0, 4 }, { 9, 13 } }));
+    buffer.undo();
+    EXPECT_EQ(buffer.getSearch().count(), 3);
+    EXPECT_EQ(buffer.getSearch().rank(buffer.offsetOf(2, 4)), 2);
+    buffer.eraseAt(2, 5, 1);
+    EXPECT_EQ(buffer.getSearch().count(), 2);
+    EXPECT_EQ(buffer.setSearchQuery(""), 0);
+    EXPECT_FALSE(buffer.findMatch(0, 0, true));
+}
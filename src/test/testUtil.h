@@ -0,0 +1,24 @@
+#ifndef TANOSHIIEDITOR_TESTUTIL_H
+#define TANOSHIIEDITOR_TESTUTIL_H
+
+#include "Buffer.h"
+#include <filesystem>
+#include <string>
+#include <unistd.h>
+
+namespace {
+inline std::string contentOf(const Buffer& buffer)
+{
+    return buffer.getText().substr(0, buffer.getText().size());
+}
+
+/**
+ * @brief a path in the temporary directory no other test process uses, ctest -j runs them side by side
+ */
+inline std::filesystem::path tempPath(const std::string& name)
+{
+    return std::filesystem::temp_directory_path() / ("tanoshii_" + std::to_string(getpid()) + "_" + name);
+}
+}
+
+#endif // TANOSHIIEDITOR_TESTUTIL_H
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+#include "KeyTrace.h"
+#include "RecoveryJournal.h"
+#include "Window.h"
+#include "testUtil.h"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace {
+std::uint64_t fnv(std::string_view text)
+{
+    std::uint64_t hash = 14695981039346656037ull;
+    for (char ch : text) {
+        hash ^= static_cast<unsigned char>(ch);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+KeyTrace::Event burst(std::int64_t time_us, std::vector<chtype> keys)
+{
+    return { std::chrono::microseconds(time_us), std::move(keys) };
+}
+}
+
+TEST(traceTest, recordTest) {
+    auto path = tempPath("trace_record.trace");
+    std::vector<std::vector<chtype>> bursts = { { 'a' }, { 'b', 'c', KEY_ENTER }, { KEY_PASTE_BEGIN, 0xe3, 0x81, 0x82, KEY_PASTE_END }, { KEY_DOWN } };
+    {
+        KeyTraceWriter writer(path, 120, 40);
+        for (const auto& keys : bursts) {
+            writer.record(keys);
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+    KeyTrace trace = KeyTrace::load(path);
+    EXPECT_EQ(trace.width, 120);
+    EXPECT_EQ(trace.height, 40);
+    ASSERT_EQ(trace.events.size(), bursts.size());
+    for (std::size_t i = 0; i < bursts.size(); i++) {
+        EXPECT_EQ(trace.events[i].keys, bursts[i]) << i;
+        if (i > 0) {
+            EXPECT_GE(trace.events[i].time - trace.events[i - 1].time, std::chrono::milliseconds(2)) << i;
+        }
+    }
+    // a burst torn off at the end is left out, the ones before are kept
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+    EXPECT_EQ(KeyTrace::load(path).events.size(), bursts.size() - 1);
+    std::ofstream(path) << "not a trace";
+    EXPECT_THROW(KeyTrace::load(path), std::runtime_error);
+    std::filesystem::remove(path);
+    EXPECT_THROW(KeyTrace::load(path), std::runtime_error);
+}
+
+TEST(traceTest, replayTest) {
+    auto path = tempPath("trace_replay.txt");
+    std::ofstream(path) << "base\nend";
+    KeyTrace trace;
+    trace.width = 60;
+    trace.height = 20;
+    // the keys after the split go to the new view, its cursor starts at the top
+    trace.events = { burst(1000, { 'a', 'b', 'c' }), burst(3000, { KEY_DOWN }), burst(5000, { 'd', KEY_CTRL_SPLIT }), burst(9000, { KEY_BACKSPACE, 'e' }) };
+    TraceReplay replay(trace, path.string());
+    replay.run(TraceReplay::Timing::Fast);
+    EXPECT_EQ(replay.getChecksum(), fnv("eabcbase\nendd"));
+    EXPECT_EQ(replay.getLatency().getCount(), trace.events.size());
+    EXPECT_NE(replay.toJson().find("\"keys\":8"), std::string::npos) << replay.toJson();
+    // at the original timing the last burst cannot come before it was read
+    auto start = std::chrono::steady_clock::now();
+    replay.run(TraceReplay::Timing::Original);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::microseconds(9000));
+    EXPECT_EQ(replay.getChecksum(), fnv("eabcbase\nendd"));
+    EXPECT_EQ(replay.getLatency().getCount(), trace.events.size());
+    // nothing journaled next to the file, a replay is not an editing session
+    EXPECT_FALSE(std::filesystem::exists(RecoveryJournal::pathFor(path)));
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include "TextScan.h"
+#include "Utf8.h"
+#include <random>
+#include <string>
+
+TEST(utf8Test, graphemeTest) {
+    // e + combining acute, a wide CJK character, a flag, a ZWJ family and an emoji with a skin tone
+    std::string text = "é中\U0001F1EF\U0001F1F5\U0001F468‍\U0001F469‍\U0001F467\U0001F44D\U0001F3FD!";
+    std::vector<std::size_t> widths;
+    std::vector<std::size_t> starts;
+    for (std::size_t pos = 0, width; pos < text.size();) {
+        starts.push_back(pos);
+        pos = Utf8::nextGrapheme(text, pos, width);
+        widths.push_back(width);
+    }
+    EXPECT_EQ(widths, (std::vector<std::size_t> { 1, 2, 2, 2, 2, 1 }));
+    EXPECT_EQ(Utf8::displayWidth(text), 10);
+    for (std::size_t i = 1; i < starts.size(); i++)
+        EXPECT_EQ(Utf8::prevGrapheme(text, starts[i]), starts[i - 1]);
+    EXPECT_EQ(Utf8::prevGrapheme(text, text.size()), starts.back());
+    // a wide character never gets cut in half
+    EXPECT_EQ(Utf8::fitWidth(text, 2), starts[1]);
+    EXPECT_EQ(Utf8::fitWidth(text, 3), starts[2]);
+}
+
+TEST(utf8Test, validateTest) {
+    EXPECT_TRUE(Utf8::isValid("plain ascii"));
+    EXPECT_TRUE(Utf8::isValid("é中\U0001F600"));
+    EXPECT_FALSE(Utf8::isValid("\xc0\xaf"));         // overlong
+    EXPECT_FALSE(Utf8::isValid("\xed\xa0\x80"));     // surrogate
+    EXPECT_FALSE(Utf8::isValid("ab\xe4\xb8"));       // truncated
+    EXPECT_FALSE(Utf8::isValid("\xf4\x90\x80\x80")); // past U+10FFFF
+    EXPECT_EQ(Utf8::sanitize("a\xff" "b\xe4\xb8"), "a�" "b��");
+    for (char32_t codepoint : { U'a', U'é', U'中', U'\U0001F600' }) {
+        std::string bytes = Utf8::encode(codepoint);
+        std::size_t length;
+        EXPECT_EQ(Utf8::decode(bytes, 0, length), codepoint);
+        EXPECT_EQ(length, bytes.size());
+    }
+}
+
+TEST(utf8Test, asciiPrefixTest) {
+    std::mt19937 rng(11);
+    for (int round = 0; round < 500; round++) {
+        std::string text(rng() % 200, 'x');
+        for (auto& ch : text)
+            ch = static_cast<char>(rng() % 20 == 0 ? 0x80 + rng() % 0x80 : rng() % 0x80);
+        std::size_t expected = 0;
+        while (expected < text.size() && static_cast<unsigned char>(text[expected]) < 0x80)
+            expected++;
+        ASSERT_EQ(TextScan::asciiPrefix(text), expected) << "round " << round;
+    }
+}
+
+TEST(utf8Test, columnMapTest) {
+    ColumnMap ascii("hello");
+    EXPECT_EQ(ascii.graphemeCount(), 5);
+    EXPECT_EQ(ascii.columnAtByte(3), 3);
+    EXPECT_EQ(ascii.width(), 5);
+
+    // a, 中 (3 bytes, 2 columns), e + combining acute (3 bytes, 1 column), b
+    ColumnMap mixed("a中éb");
+    EXPECT_EQ(mixed.graphemeCount(), 4);
+    EXPECT_EQ(mixed.byteOf(2), 4);
+    EXPECT_EQ(mixed.columnOf(2), 3);
+    EXPECT_EQ(mixed.columnOf(4), 5);
+    EXPECT_EQ(mixed.graphemeAt(5), 2);
+    EXPECT_EQ(mixed.columnAtByte(7), 4);
+    // the right half of the wide character belongs to it
+    EXPECT_EQ(mixed.graphemeAtColumn(2), 1);
+    EXPECT_EQ(mixed.width(), 5);
+}
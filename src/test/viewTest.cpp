@@ -0,0 +1,232 @@
+#include <gtest/gtest.h>
+#include "Buffer.h"
+#include "BufferView.h"
+#include "Window.h"
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+TEST(viewTest, widthsTest) {
+    Buffer buffer;
+    buffer.insertLine("Labore sit deserunt non nisi", 0);
+    BufferView narrow(buffer);
+    BufferView wide(buffer);
+    narrow.wrapLines(10);
+    wide.wrapLines(20);
+    EXPECT_EQ(narrow.getWrappedLineCount(), 4);
+    EXPECT_EQ(wide.getWrappedLineCount(), 3);
+    EXPECT_EQ(narrow.getWrappedRow(1), " deserunt");
+    EXPECT_EQ(wide.getWrappedRow(0), "Labore sit deserunt");
+}
+
+TEST(viewTest, sharedEditTest) {
+    Buffer buffer;
+    buffer.insertLine("one", 0);
+    buffer.insertLine("two", 1);
+    BufferView first(buffer);
+    BufferView second(buffer);
+    first.wrapLines(10);
+    second.wrapLines(5);
+    first.takeDamage();
+    second.takeDamage();
+    // an edit only damages and rewraps the touched line, in every view
+    buffer.insertAt(1, 3, std::string(" three"));
+    EXPECT_EQ(first.takeDamage(), (std::pair<std::size_t, std::size_t> { 1, 2 }));
+    EXPECT_EQ(second.takeDamage(), (std::pair<std::size_t, std::size_t> { 1, 2 }));
+    first.wrapLines(10);
+    second.wrapLines(5);
+    EXPECT_EQ(first.getWrappedLineCount(), 3);
+    EXPECT_EQ(second.getWrappedLineCount(), 5);
+    EXPECT_EQ(second.getWrappedRow(2), " thre");
+    // a view going away stops getting edits
+    {
+        BufferView gone(buffer);
+    }
+    buffer.removeLine(0);
+    first.wrapLines(10);
+    EXPECT_EQ(first.getWrappedLineCount(), 2);
+    EXPECT_EQ(first.takeDamage().second, std::string::npos);
+}
+
+TEST(viewTest, cursorTest) {
+    Buffer buffer;
+    buffer.insertAt(0, 0, std::string("alpha beta gamma"));
+    BufferView view(buffer);
+    view.setCursor(buffer.offsetOf(0, 11));
+    // edits before the cursor move it, edits after it do not
+    buffer.insertAt(0, 0, std::string("> "));
+    EXPECT_EQ(view.getCursor(), 13);
+    buffer.eraseAt(0, 15, 2);
+    EXPECT_EQ(view.getCursor(), 13);
+    // an erase covering the cursor leaves it where the erase started
+    buffer.eraseAt(0, 8, 7);
+    EXPECT_EQ(view.getCursor(), 8);
+    EXPECT_EQ(buffer[0], "> alpha a");
+    // a replacement covering the cursor leaves it at its start
+    view.setCursor(4);
+    buffer.replaceAll({ { 0, 2, "" }, { 2, 5, "ALPHA!" } }, 0, 0);
+    EXPECT_EQ(view.getCursor(), 0);
+    view.setCursor(buffer.offsetOf(0, 8));
+    buffer.undo();
+    EXPECT_EQ(buffer[0], "> alpha a");
+    EXPECT_EQ(view.getCursor(), 9);
+}
+
+TEST(viewTest, splitWindowTest) {
+    auto screen = std::make_shared<CellScreen>(41, 8);
+    TextEditWindow left(screen, DEFAULT_BORDER, "left", 20, 7, 0, 0, 41, 8);
+    TextEditWindow right(screen, DEFAULT_BORDER, "right", 20, 7, 20, 0, 41, 8, left.getBuffer());
+    auto type = [&](TextEditWindow& window, std::string keys) {
+        for (char ch : keys)
+            window.inputHandler(ch);
+        left.syncView();
+        right.syncView();
+        right.refreshWindow();
+        left.refreshWindow();
+        screen->update();
+    };
+    type(left, "shared");
+    EXPECT_EQ(screen->getRow(1), "|shared            ||shared            | ");
+    // an edit through one window moves the cursor of the other along
+    type(right, ">");
+    type(left, "!");
+    EXPECT_EQ(screen->getRow(1), "|>shared!          ||>shared!          | ");
+    EXPECT_EQ(screen->getCursor(), (std::pair<std::size_t, std::size_t> { 1, 9 }));
+    // a window without edits from elsewhere has nothing to repaint
+    left.syncView();
+    EXPECT_FALSE(left.needsRefresh());
+    right.inputHandler('x');
+    left.syncView();
+    EXPECT_TRUE(left.needsRefresh());
+}
+
+TEST(viewTest, enterTest) {
+    auto screen = std::make_shared<CellScreen>(30, 8);
+    auto buffer = std::make_shared<Buffer>();
+    buffer->insertAt(0, 0, std::string("hello\nworld"));
+    TextEditWindow window(screen, DEFAULT_BORDER, "enter", 29, 7, 0, 0, 30, 8, buffer);
+    auto type = [&](std::initializer_list<chtype> keys) {
+        for (chtype ch : keys)
+            window.inputHandler(ch);
+        // what the application does after every burst
+        window.syncView();
+    };
+    // the terminal's Enter splits the line at the cursor and the next key lands on the new line
+    type({ KEY_RIGHT, KEY_RIGHT, '\n', 'X' });
+    EXPECT_EQ(buffer->getText().substr(0, buffer->getText().size()), "he\nXllo\nworld");
+    // so do a carriage return and the keypad's Enter, at the end of the text too
+    type({ KEY_DOWN, KEY_RIGHT, KEY_RIGHT, KEY_RIGHT, KEY_RIGHT, '\r', 'Y', KEY_ENTER, 'Z' });
+    EXPECT_EQ(buffer->getText().substr(0, buffer->getText().size()), "he\nXllo\nworld\nY\nZ");
+    // a tab is text and drawn as a space, other control bytes are not text
+    type({ 0x01, '\t', 0x1c, '!' });
+    EXPECT_EQ((*buffer)[4], "Z\t!");
+    window.refreshWindow();
+    screen->update();
+    EXPECT_EQ(screen->getRow(5).substr(0, 5), "|Z ! ");
+    // one undo step per line
+    type({ KEY_CTRL_UNDO });
+    EXPECT_EQ(buffer->getText().substr(0, buffer->getText().size()), "he\nXllo\nworld\nY\n");
+}
+
+TEST(viewTest, backgroundWrapTest) {
+    // enough lines to be left to the background, every tenth one wraps
+    std::string text;
+    for (std::size_t i = 0; i < 3 * WrapCache::lazy_line_count; i++)
+        text += "line " + std::to_string(i) + (i % 10 == 0 ? " with some words wrapping at twenty\n" : "\n");
+    Buffer buffer(std::make_shared<const std::string>(text));
+    Buffer expected_buffer(std::make_shared<const std::string>(text));
+    BufferView view(buffer);
+    BufferView expected(expected_buffer);
+    view.wrapLines(40);
+    std::size_t top = view.getWrappedRowOf(20000, 0);
+    EXPECT_EQ(view.wrapAround(40, top, 10), top);
+    // a new width only wraps the lines around the top one, it stays at the top
+    top = view.wrapAround(20, top, 10);
+    expected.wrapLines(20);
+    EXPECT_GT(view.getPendingCount(), 0);
+    EXPECT_EQ(std::get<0>(view.getWrappedLineTuple(top)), 20000);
+    for (std::size_t row = 0; row < 10; row++)
+        EXPECT_EQ(view.getWrappedRow(top + row), expected.getWrappedRow(expected.getWrappedRowOf(20000, 0) + row));
+    // edits while the background runs move the lines its rows go to
+    buffer.insertAt(100, 0, std::string("new\nlines\n"));
+    expected_buffer.insertAt(100, 0, std::string("new\nlines\n"));
+    buffer.eraseAt(30000, 0, 5);
+    expected_buffer.eraseAt(30000, 0, 5);
+    top = view.wrapAround(20, top, 10);
+    expected.wrapLines(20);
+    auto scheduler = Scheduler::Instance();
+    for (int i = 0; i < 10000 && view.getPendingCount() != 0; i++) {
+        scheduler->runPending();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_EQ(view.getPendingCount(), 0);
+    // the estimates were refined into the exact rows
+    EXPECT_EQ(view.getWrappedLineCount(), expected.getWrappedLineCount());
+    EXPECT_EQ(static_cast<std::string>(view), static_cast<std::string>(expected));
+    EXPECT_EQ(view.wrapAround(20, top, 10), expected.getWrappedRowOf(20002, 0));
+}
+
+TEST(viewTest, typingWhileWrapTest) {
+    std::string text;
+    for (std::size_t i = 0; i < 2 * WrapCache::lazy_line_count; i++)
+        text += "line " + std::to_string(i) + " words wrap\n";
+    Buffer buffer(std::make_shared<const std::string>(text));
+    Buffer expected_buffer(std::make_shared<const std::string>(text));
+    BufferView view(buffer);
+    BufferView expected(expected_buffer);
+    // typed lines live in the add block, which keeps growing while the background reads them
+    auto type = [&](std::string_view typed) {
+        std::size_t last = buffer.getBufferSize() - 1;
+        buffer.insertAt(last, buffer.getLineLength(last), typed);
+        expected_buffer.insertAt(last, expected_buffer.getLineLength(last), typed);
+    };
+    for (int i = 0; i < 100; i++)
+        type("typed " + std::to_string(i) + " words wrap\n");
+    view.wrapLines(40);
+    view.wrapAround(12, 0, 10);
+    auto scheduler = Scheduler::Instance();
+    // a keystroke per frame, the frame wraps the typed line again
+    for (int i = 0; i < 10000 && view.getPendingCount() != 0; i++) {
+        type("x");
+        scheduler->runPending();
+        view.wrapAround(12, 0, 10);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_EQ(view.getPendingCount(), 0);
+    expected.wrapLines(12);
+    EXPECT_EQ(view.getWrappedLineCount(), expected.getWrappedLineCount());
+    EXPECT_EQ(static_cast<std::string>(view), static_cast<std::string>(expected));
+}
+
+TEST(viewTest, resizeTest) {
+    std::string text;
+    for (std::size_t i = 0; i < 2 * WrapCache::lazy_line_count; i++)
+        text += "row " + std::to_string(i) + " of a text long enough to wrap\n";
+    auto screen = std::make_shared<CellScreen>(60, 12);
+    TextEditWindow window(screen, DEFAULT_BORDER, "text", 59, 11, 0, 0, 60, 12, std::make_shared<Buffer>(std::make_shared<const std::string>(text)));
+    window.syncView();
+    for (int i = 0; i < 5000; i++)
+        window.inputHandler(KEY_DOWN);
+    window.refreshWindow();
+    screen->update();
+    EXPECT_EQ(screen->getRow(9).substr(0, 59), "|row 5000 of a text long enough to wrap                   |");
+    // narrower, the lines on screen are painted right away and the cursor stays inside
+    window.updateDimension(30, 11);
+    window.syncView();
+    window.refreshWindow();
+    screen->update();
+    EXPECT_EQ(screen->getRow(1).substr(0, 30), "|row 4996 of a text long     |");
+    EXPECT_EQ(screen->getRow(2).substr(0, 30), "| enough to wrap             |");
+    EXPECT_EQ(screen->getCursor(), (std::pair<std::size_t, std::size_t> { 9, 1 }));
+    // the rows wrapped in the background above it do not move the viewport
+    auto scheduler = Scheduler::Instance();
+    for (int i = 0; i < 1000 && scheduler->getJobCount() != 0; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    scheduler->runPending();
+    window.syncView();
+    window.refreshWindow();
+    screen->update();
+    EXPECT_EQ(screen->getRow(1).substr(0, 30), "|row 4996 of a text long     |");
+    EXPECT_EQ(screen->getCursor(), (std::pair<std::size_t, std::size_t> { 9, 1 }));
+}